@@ -0,0 +1,256 @@
+/*
+ * DE1 Simulator - codec benchmark
+ *
+ * Times encode and decode of every characteristic payload described by a
+ * Packet::Layout (core/packet-layout.h), plus one FleetEngine-style tick:
+ * N machines' SHOT_SAMPLEs encoded and framed into one batch, and a
+ * profile re-upload compiled afresh versus found in the ProfileCache. Run
+ * it before and after touching a layout or the wire code and compare.
+ *
+ * Run:
+ *   de1sim-bench [--iterations N] [--machines N]
+ *
+ * Every payload is also checked to decode and re-encode to the same bytes;
+ * the exit status is 1 if one doesn't, so a broken layout fails loudly.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+#include <cstring>
+
+#include "core/de1-protocol.h"
+#include "core/profile.h"
+#include "pi-daemon/de1-wire.h"
+
+// ============================================================================
+// Harness
+// ============================================================================
+
+// Keeps the compiler from dropping work whose result is never used
+static volatile uint32_t g_sink = 0;
+
+static uint32_t checksum(const uint8_t *d, int len) {
+    uint32_t sum = 0;
+    for (int i = 0; i < len; i++) sum = sum * 31 + d[i];
+    return sum;
+}
+
+struct BenchResult {
+    QString name;
+    double nsPerOp = 0.0;
+    int packetsPerOp = 1;
+};
+
+// Templated on the body so the call inlines; a std::function would cost
+// about as much as encoding a STATE_INFO
+template <typename Body>
+static BenchResult run(const QString &name, qint64 iterations, Body body) {
+    // Warm up caches and branch predictors before timing
+    for (qint64 i = 0; i < qMin<qint64>(iterations / 10, 10000); i++) body(i);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (qint64 i = 0; i < iterations; i++) body(i);
+    return {name, double(timer.nsecsElapsed()) / iterations, 1};
+}
+
+// Encodes value, decodes the bytes and encodes the result again; the two
+// encodings have to match, whatever rounding the wire types do
+template <typename Layout, typename Struct>
+static bool roundTrips(const Struct &value) {
+    uint8_t first[Layout::size], second[Layout::size];
+    Layout::encode(value, first);
+    Struct decoded{};
+    Layout::decode(first, decoded);
+    Layout::encode(decoded, second);
+    return memcmp(first, second, Layout::size) == 0;
+}
+
+// ============================================================================
+// Sample payloads - vary with i so nothing can be hoisted out of the loop
+// ============================================================================
+
+static DE1::ShotSample shotSample(qint64 i) {
+    DE1::ShotSample s;
+    s.timer = (i % 6000) / 100.0;
+    s.groupPressure = 9.0 - (i % 7) * 0.1;
+    s.groupFlow = 2.0 + (i % 5) * 0.1;
+    s.mixTemp = 92.0 + (i % 3) * 0.1;
+    s.headTemp = 93.0;
+    s.setMixTemp = 93.0;
+    s.setHeadTemp = 93.0;
+    s.setPressure = 9.0;
+    s.setFlow = 2.0;
+    s.frameNumber = static_cast<int>(i % 20);
+    s.steamTemp = 160.0;
+    return s;
+}
+
+static ProfileFrame profileFrame(qint64 i) {
+    ProfileFrame f;
+    f.frameIndex = static_cast<int>(i % 20);
+    f.flags = ProfileFlags::DoCompare | ProfileFlags::Interpolate;
+    f.setVal = 6.0 + (i % 4);
+    f.temp = 92.5;
+    f.duration = (i % 2) ? 4.5 : 30.0;
+    f.triggerVal = 4.0;
+    f.maxVol = static_cast<uint16_t>(i % 1000);
+    return f;
+}
+
+static DE1::ShotSettings shotSettings(qint64 i) {
+    DE1::ShotSettings s;
+    s.steamTemp = 160;
+    s.steamDuration = static_cast<int>(60 + i % 60);
+    s.hotWaterTemp = 85;
+    s.hotWaterVolume = 200;
+    s.hotWaterDuration = 60;
+    s.espressoVolume = 36;
+    s.groupTemp = 93.0 + (i % 4) * 0.5;
+    return s;
+}
+
+// ============================================================================
+// Benchmarks
+// ============================================================================
+
+template <typename Layout, typename Struct>
+static void benchLayout(QList<BenchResult> &results, const QString &name, qint64 iterations,
+                        Struct (*make)(qint64)) {
+    results.append(run(name + " encode", iterations, [make](qint64 i) {
+        uint8_t d[Layout::size];
+        Layout::encode(make(i), d);
+        g_sink = g_sink + checksum(d, Layout::size);
+    }));
+
+    uint8_t encoded[Layout::size];
+    Layout::encode(make(1), encoded);
+    results.append(run(name + " decode", iterations, [&encoded](qint64 i) {
+        encoded[0] = static_cast<uint8_t>(i);
+        Struct s{};
+        Layout::decode(encoded, s);
+        g_sink = g_sink + checksum(reinterpret_cast<const uint8_t*>(&s), sizeof(s));
+    }));
+}
+
+// One fleet tick: every machine's SHOT_SAMPLE encoded and framed, tagged
+// with its machine ID, into one batch
+static BenchResult benchFleetTick(qint64 iterations, int machines) {
+    const quint16 sampleId = Wire::charIdFromString(DE1::CHAR_SHOT_SAMPLE);
+    QByteArray batch;
+    batch.reserve(machines * (Wire::FRAME_HEADER_SIZE + 1 + DE1::SHOT_SAMPLE_SIZE));
+
+    BenchResult r = run(QString("SHOT_SAMPLE fleet tick x%1").arg(machines), iterations, [&](qint64 i) {
+        uint8_t payload[DE1::SHOT_SAMPLE_SIZE];
+        for (int m = 0; m < machines; m++) {
+            DE1::encodeShotSample(shotSample(i + m), payload);
+            Wire::appendFrame(batch, Wire::FrameNotify, sampleId,
+                              reinterpret_cast<const char*>(payload), sizeof(payload), m);
+        }
+        g_sink = g_sink + static_cast<uint32_t>(batch.size());
+        batch.resize(0);
+    });
+    r.packetsPerOp = machines;
+    return r;
+}
+
+// An app's profile upload before a shot: header, PROFILE_FRAMES frames and
+// the tail, then the plan compiled from scratch or taken from the cache
+static constexpr int PROFILE_FRAMES = 10;
+
+static void benchProfileUpload(QList<BenchResult> &results, qint64 iterations) {
+    ProfileHeader header{1, PROFILE_FRAMES, 2, 2.0, 6.0};
+    QList<QByteArray> writes;
+    QByteArray value(HeaderLayout::size, Qt::Uninitialized);
+    HeaderLayout::encode(header, reinterpret_cast<uint8_t*>(value.data()));
+    writes.append(value);
+    for (int f = 0; f <= PROFILE_FRAMES; f++) {
+        QByteArray frame(FrameLayout::size, Qt::Uninitialized);
+        FrameLayout::encode(profileFrame(f), reinterpret_cast<uint8_t*>(frame.data()));
+        frame[0] = static_cast<char>(f);   // f == PROFILE_FRAMES is the tail
+        writes.append(frame);
+    }
+
+    auto upload = [&writes](ProfileUpload &u) {
+        u.writeHeader(writes.first());
+        for (int w = 1; w < writes.size(); w++) u.writeFrame(writes[w]);
+    };
+
+    ProfileUpload u;
+    BenchResult compiled = run("PROFILE upload + compile", iterations, [&](qint64) {
+        upload(u);
+        g_sink = g_sink + ProfilePlan::compile(u.header(), u.frames()).steps.size();
+    });
+    compiled.packetsPerOp = writes.size();
+    results.append(compiled);
+
+    ProfileCache cache;
+    BenchResult cached = run("PROFILE upload, cached plan", iterations, [&](qint64) {
+        upload(u);
+        g_sink = g_sink + cache.add(u).plan.steps.size();
+    });
+    cached.packetsPerOp = writes.size();
+    results.append(cached);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("de1sim-bench");
+    app.setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Encode/decode cost per DE1 characteristic payload");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption iterationsOption("iterations", "Iterations per benchmark (default 1000000)",
+                                        "N", "1000000");
+    QCommandLineOption machinesOption("machines", "Machines in the fleet tick benchmark (default 256)",
+                                      "N", "256");
+    parser.addOptions({iterationsOption, machinesOption});
+    parser.process(app);
+
+    qint64 iterations = qMax<qint64>(1, parser.value(iterationsOption).toLongLong());
+    int machines = qBound(1, parser.value(machinesOption).toInt(), 256);
+
+    QTextStream out(stdout);
+
+    // Layout sanity first: a timing for a broken codec is worthless
+    bool ok = roundTrips<DE1::ShotSampleLayout>(shotSample(1234))
+           && roundTrips<DE1::StateInfoLayout>(DE1::StateInfo{DE1::State::Espresso, DE1::SubState::Pouring})
+           && roundTrips<DE1::WaterLevelsLayout>(DE1::WaterLevels{25.0})
+           && roundTrips<DE1::ShotSettingsLayout>(shotSettings(7))
+           && roundTrips<FrameLayout>(profileFrame(3))
+           && roundTrips<FrameLayout>(profileFrame(4))
+           && roundTrips<HeaderLayout>(ProfileHeader{1, 5, 2, 2.0, 6.0});
+    if (!ok) {
+        out << "Layout round trip FAILED\n";
+        return 1;
+    }
+
+    QList<BenchResult> results;
+    benchLayout<DE1::ShotSampleLayout>(results, "SHOT_SAMPLE", iterations, shotSample);
+    benchLayout<DE1::StateInfoLayout>(results, "STATE_INFO", iterations, +[](qint64 i) {
+        return DE1::StateInfo{static_cast<DE1::State>(i % 0x16), DE1::SubState::Ready};
+    });
+    benchLayout<DE1::WaterLevelsLayout>(results, "WATER_LEVELS", iterations, +[](qint64 i) {
+        return DE1::WaterLevels{(i % 400) / 10.0};
+    });
+    benchLayout<DE1::ShotSettingsLayout>(results, "SHOT_SETTINGS", iterations, shotSettings);
+    benchLayout<FrameLayout>(results, "FRAME_WRITE", iterations, profileFrame);
+    results.append(benchFleetTick(qMax<qint64>(1, iterations / machines), machines));
+    benchProfileUpload(results, qMax<qint64>(1, iterations / 100));
+
+    out << QString("%1 %2 %3\n").arg("Benchmark", -32).arg("ns/op", 10).arg("ns/packet", 10);
+    for (const BenchResult &r : std::as_const(results)) {
+        out << QString("%1 %2 %3\n")
+            .arg(r.name, -32)
+            .arg(r.nsPerOp, 10, 'f', 1)
+            .arg(r.nsPerOp / r.packetsPerOp, 10, 'f', 1);
+    }
+    out << QString("(checksum %1)\n").arg(g_sink);
+    return 0;
+}
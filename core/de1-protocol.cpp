@@ -0,0 +1,68 @@
+#include "de1-protocol.h"
+
+namespace DE1 {
+
+QString MMR::addressName(uint32_t addr) {
+    switch (addr) {
+        case CPU_BOARD_MODEL: return "CPU_BOARD_MODEL";
+        case MACHINE_MODEL: return "MACHINE_MODEL";
+        case FIRMWARE_VERSION: return "FIRMWARE_VERSION";
+        case FAN_THRESHOLD: return "FAN_THRESHOLD";
+        case GHC_INFO: return "GHC_INFO";
+        case GHC_MODE: return "GHC_MODE";
+        case STEAM_FLOW: return "STEAM_FLOW";
+        case SERIAL_NUMBER: return "SERIAL_NUMBER";
+        case HEATER_VOLTAGE: return "HEATER_VOLTAGE";
+        case USB_CHARGER: return "USB_CHARGER";
+        case REFILL_KIT: return "REFILL_KIT";
+        default: return QString("0x%1").arg(addr, 6, 16, QChar('0'));
+    }
+}
+
+QString stateName(State s) {
+    switch (s) {
+        case State::Sleep: return "Sleep";
+        case State::GoingToSleep: return "GoingToSleep";
+        case State::Idle: return "Idle";
+        case State::Busy: return "Busy";
+        case State::Espresso: return "Espresso";
+        case State::Steam: return "Steam";
+        case State::HotWater: return "HotWater";
+        case State::HotWaterRinse: return "Flush";
+        case State::Refill: return "Refill";
+        case State::Descale: return "Descale";
+        case State::FatalError: return "FatalError";
+        case State::Clean: return "Clean";
+        default: return QString("State_0x%1").arg(static_cast<int>(s), 2, 16, QChar('0'));
+    }
+}
+
+QString subStateName(SubState s) {
+    switch (s) {
+        case SubState::Ready: return "Ready";
+        case SubState::Heating: return "Heating";
+        case SubState::FinalHeating: return "FinalHeating";
+        case SubState::Stabilising: return "Stabilising";
+        case SubState::Preinfusion: return "Preinfusion";
+        case SubState::Pouring: return "Pouring";
+        case SubState::Ending: return "Ending";
+        case SubState::Steaming: return "Steaming";
+        default: return QString("SubState_%1").arg(static_cast<int>(s));
+    }
+}
+
+QString charName(const QString& shortId) {
+    if (shortId == CHAR_VERSION) return "VERSION";
+    if (shortId == CHAR_REQUESTED_STATE) return "REQUESTED_STATE";
+    if (shortId == CHAR_READ_FROM_MMR) return "READ_FROM_MMR";
+    if (shortId == CHAR_WRITE_TO_MMR) return "WRITE_TO_MMR";
+    if (shortId == CHAR_SHOT_SETTINGS) return "SHOT_SETTINGS";
+    if (shortId == CHAR_SHOT_SAMPLE) return "SHOT_SAMPLE";
+    if (shortId == CHAR_STATE_INFO) return "STATE_INFO";
+    if (shortId == CHAR_HEADER_WRITE) return "HEADER_WRITE";
+    if (shortId == CHAR_FRAME_WRITE) return "FRAME_WRITE";
+    if (shortId == CHAR_WATER_LEVELS) return "WATER_LEVELS";
+    return shortId;
+}
+
+} // namespace DE1
@@ -0,0 +1,261 @@
+/*
+ * DE1 BLE protocol - characteristic IDs, machine states, MMR addresses
+ * and the fixed-point encodings used on the wire
+ *
+ * Shared by the GUI and the headless simulator.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+
+#include <cstdint>
+
+#include "packet-layout.h"
+
+// ============================================================================
+// Constants and UUIDs
+// ============================================================================
+
+namespace DE1 {
+
+// Characteristic short IDs (4 hex digits)
+const QString CHAR_VERSION         = "A001";
+const QString CHAR_REQUESTED_STATE = "A002";
+const QString CHAR_READ_FROM_MMR   = "A005";
+const QString CHAR_WRITE_TO_MMR    = "A006";
+const QString CHAR_SHOT_SETTINGS   = "A00B";
+const QString CHAR_SHOT_SAMPLE     = "A00D";
+const QString CHAR_STATE_INFO      = "A00E";
+const QString CHAR_HEADER_WRITE    = "A00F";
+const QString CHAR_FRAME_WRITE     = "A010";
+const QString CHAR_WATER_LEVELS    = "A011";
+
+// Machine States
+enum class State : uint8_t {
+    Sleep           = 0x00,
+    GoingToSleep    = 0x01,
+    Idle            = 0x02,
+    Busy            = 0x03,
+    Espresso        = 0x04,
+    Steam           = 0x05,
+    HotWater        = 0x06,
+    ShortCal        = 0x07,
+    SelfTest        = 0x08,
+    LongCal         = 0x09,
+    Descale         = 0x0A,
+    FatalError      = 0x0B,
+    Init            = 0x0C,
+    NoRequest       = 0x0D,
+    SkipToNext      = 0x0E,
+    HotWaterRinse   = 0x0F,
+    SteamRinse      = 0x10,
+    Refill          = 0x11,
+    Clean           = 0x12,
+    InBootLoader    = 0x13,
+    AirPurge        = 0x14,
+    SchedIdle       = 0x15
+};
+
+// Machine SubStates
+enum class SubState : uint8_t {
+    Ready           = 0,
+    Heating         = 1,
+    FinalHeating    = 2,
+    Stabilising     = 3,
+    Preinfusion     = 4,
+    Pouring         = 5,
+    Ending          = 6,
+    Steaming        = 7,
+    DescaleInit     = 8,
+    DescaleFillGroup= 9,
+    DescaleReturn   = 10,
+    DescaleGroup    = 11,
+    DescaleSteam    = 12,
+    CleanInit       = 13,
+    CleanFillGroup  = 14,
+    CleanSoak       = 15,
+    CleanGroup      = 16,
+    RefillState     = 17,
+    PausedSteam     = 18,
+    UserNotPresent  = 19,
+    Puffing         = 20
+};
+
+// MMR Addresses
+namespace MMR {
+    constexpr uint32_t CPU_BOARD_MODEL  = 0x800008;
+    constexpr uint32_t MACHINE_MODEL    = 0x80000C;
+    constexpr uint32_t FIRMWARE_VERSION = 0x800010;
+    constexpr uint32_t FAN_THRESHOLD    = 0x803808;
+    constexpr uint32_t GHC_INFO         = 0x80381C;
+    constexpr uint32_t GHC_MODE         = 0x803820;
+    constexpr uint32_t STEAM_FLOW       = 0x803828;
+    constexpr uint32_t SERIAL_NUMBER    = 0x803830;
+    constexpr uint32_t HEATER_VOLTAGE   = 0x803834;
+    constexpr uint32_t USB_CHARGER      = 0x803854;
+    constexpr uint32_t REFILL_KIT       = 0x80385C;
+
+    QString addressName(uint32_t addr);
+}
+
+// State name helper
+QString stateName(State s);
+QString subStateName(SubState s);
+QString charName(const QString& shortId);
+
+} // namespace DE1
+
+// ============================================================================
+// Binary Codec - MMR addresses
+// ============================================================================
+//
+// Payload fields are encoded by the Packet::Layout wire types below
+// (core/packet-layout.h); only the big-endian MMR addresses are left here.
+
+namespace BinaryCodec {
+
+inline void encodeUint32BE(uint32_t value, uint8_t* out) {
+    out[0] = (value >> 24) & 0xFF;
+    out[1] = (value >> 16) & 0xFF;
+    out[2] = (value >> 8) & 0xFF;
+    out[3] = value & 0xFF;
+}
+
+inline uint32_t decodeAddress(const uint8_t* data) {
+    return (static_cast<uint32_t>(data[0]) << 16) |
+           (static_cast<uint32_t>(data[1]) << 8) |
+           static_cast<uint32_t>(data[2]);
+}
+
+} // namespace BinaryCodec
+
+// ============================================================================
+// Notification payloads
+// ============================================================================
+//
+// Each payload is a struct plus a Packet::Layout listing its fields in wire
+// order (core/packet-layout.h). They encode straight into a caller-provided
+// buffer, so callers that send many of them per tick don't allocate one
+// QByteArray per notification.
+
+namespace DE1 {
+
+constexpr int SHOT_SAMPLE_SIZE  = 19;
+constexpr int STATE_INFO_SIZE   = 2;
+constexpr int WATER_LEVELS_SIZE = 2;
+constexpr int SHOT_SETTINGS_SIZE = 9;
+
+struct ShotSample {
+    double timer = 0.0;         // Seconds since the operation started
+    double groupPressure = 0.0;
+    double groupFlow = 0.0;
+    double mixTemp = 0.0;
+    double headTemp = 0.0;
+    double setMixTemp = 0.0;
+    double setHeadTemp = 0.0;
+    double setPressure = 0.0;
+    double setFlow = 0.0;
+    int frameNumber = 0;
+    double steamTemp = 0.0;
+};
+
+using ShotSampleLayout = Packet::Layout<ShotSample,
+    Packet::Field<Packet::U16C,   &ShotSample::timer>,
+    Packet::Field<Packet::U16P12, &ShotSample::groupPressure>,
+    Packet::Field<Packet::U16P12, &ShotSample::groupFlow>,
+    Packet::Field<Packet::U16P8,  &ShotSample::mixTemp>,
+    Packet::Field<Packet::U24P16, &ShotSample::headTemp>,
+    Packet::Field<Packet::U16P8,  &ShotSample::setMixTemp>,
+    Packet::Field<Packet::U16P8,  &ShotSample::setHeadTemp>,
+    Packet::Field<Packet::U8P4,   &ShotSample::setPressure>,
+    Packet::Field<Packet::U8P4,   &ShotSample::setFlow>,
+    Packet::Field<Packet::U8,     &ShotSample::frameNumber>,
+    Packet::Field<Packet::U8,     &ShotSample::steamTemp>>;
+
+static_assert(ShotSampleLayout::size == SHOT_SAMPLE_SIZE, "SHOT_SAMPLE is 19 bytes");
+static_assert(ShotSampleLayout::offset<4>() == 8, "HeadTemp starts at byte 8");
+static_assert(ShotSampleLayout::offset<9>() == 17, "FrameNumber is byte 17");
+
+inline void encodeShotSample(const ShotSample &s, uint8_t *d) {
+    ShotSampleLayout::encode(s, d);
+}
+
+struct StateInfo {
+    State state = State::Sleep;
+    SubState subState = SubState::Ready;
+};
+
+using StateInfoLayout = Packet::Layout<StateInfo,
+    Packet::Field<Packet::U8, &StateInfo::state>,
+    Packet::Field<Packet::U8, &StateInfo::subState>>;
+
+static_assert(StateInfoLayout::size == STATE_INFO_SIZE, "STATE_INFO is 2 bytes");
+
+inline void encodeStateInfo(State state, SubState subState, uint8_t *d) {
+    StateInfoLayout::encode({state, subState}, d);
+}
+
+// Tank level as mm above the refill sensor
+struct WaterLevels {
+    double levelMm = 0.0;
+};
+
+using WaterLevelsLayout = Packet::Layout<WaterLevels,
+    Packet::Field<Packet::U16P8, &WaterLevels::levelMm>>;
+
+static_assert(WaterLevelsLayout::size == WATER_LEVELS_SIZE, "WATER_LEVELS is 2 bytes");
+
+// Tank level in percent, sent as mm above the refill sensor
+inline void encodeWaterLevels(double percent, uint8_t *d) {
+    WaterLevelsLayout::encode({(percent / 100.0) * 40.0 - 5.0}, d);
+}
+
+// SHOT_SETTINGS, written by the app and read back
+struct ShotSettings {
+    int steamSettings = 0;      // Flag bits
+    int steamTemp = 0;          // C
+    int steamDuration = 0;      // s
+    int hotWaterTemp = 0;       // C
+    int hotWaterVolume = 0;     // mL
+    int hotWaterDuration = 0;   // s
+    int espressoVolume = 0;     // mL
+    double groupTemp = 0.0;     // C
+};
+
+using ShotSettingsLayout = Packet::Layout<ShotSettings,
+    Packet::Field<Packet::U8,    &ShotSettings::steamSettings>,
+    Packet::Field<Packet::U8,    &ShotSettings::steamTemp>,
+    Packet::Field<Packet::U8,    &ShotSettings::steamDuration>,
+    Packet::Field<Packet::U8,    &ShotSettings::hotWaterTemp>,
+    Packet::Field<Packet::U8,    &ShotSettings::hotWaterVolume>,
+    Packet::Field<Packet::U8,    &ShotSettings::hotWaterDuration>,
+    Packet::Field<Packet::U8,    &ShotSettings::espressoVolume>,
+    Packet::Field<Packet::U16P8, &ShotSettings::groupTemp>>;
+
+static_assert(ShotSettingsLayout::size == SHOT_SETTINGS_SIZE, "SHOT_SETTINGS is 9 bytes");
+
+// VERSION as the simulator reports it: 2.1.0.0
+inline QByteArray versionValue() {
+    return QByteArray::fromHex("02010000");
+}
+
+// SHOT_SETTINGS until the app writes its own
+inline QByteArray defaultShotSettings() {
+    ShotSettings settings;
+    settings.steamTemp = 160;
+    settings.steamDuration = 120;
+    settings.hotWaterTemp = 85;
+    settings.hotWaterVolume = 200;
+    settings.hotWaterDuration = 60;
+    settings.espressoVolume = 36;
+    settings.groupTemp = 93.0;
+
+    QByteArray value(SHOT_SETTINGS_SIZE, 0);
+    ShotSettingsLayout::encode(settings, reinterpret_cast<uint8_t*>(value.data()));
+    return value;
+}
+
+} // namespace DE1
@@ -0,0 +1,811 @@
+#include "fleet-engine.h"
+
+// === Machine Table ===
+
+void MachineTable::resize(int n) {
+    int old = size();
+
+    state.resize(n);
+    subState.resize(n);
+    pressure.resize(n);
+    flow.resize(n);
+    temperature.resize(n);
+    setTemp.resize(n);
+    setPressure.resize(n);
+    setFlow.resize(n);
+    steamTemp.resize(n);
+    frame.resize(n);
+    opStart.resize(n);
+    phaseEnd.resize(n);
+    wireId.resize(n);
+    bleConnected.resize(n);
+    mmr.resize(n);
+    upload.resize(n);
+    plan.resize(n);
+    executor.resize(n);
+    physicsStart.resize(n);
+    physicsSteps.resize(n);
+
+    // Same power-on values as SimulationEngine
+    for (int i = old; i < n; i++) {
+        state[i] = DE1::State::Idle;
+        subState[i] = DE1::SubState::Ready;
+        temperature[i] = 93.0;
+        setTemp[i] = 93.0;
+        setPressure[i] = 9.0;
+        setFlow[i] = 2.0;
+        phaseEnd[i] = std::numeric_limits<double>::infinity();
+        wireId[i] = -1;
+    }
+}
+
+// === Fleet Engine ===
+
+FleetEngine::FleetEngine(QObject *parent) : QObject(parent) {
+    m_batcher = new Wire::WriteBatcher(this);
+    useTransport(Transport::create(QString(), 1, this));
+    m_latencyClock.start();
+
+    // The one scheduler timer; every machine is stepped from here
+    m_tickTimer = new QTimer(this);
+    m_tickTimer->setTimerType(Qt::PreciseTimer);
+    m_tickTimer->setInterval(1000 / m_sampleRateHz);
+    connect(m_tickTimer, &QTimer::timeout, this, &FleetEngine::onTick);
+
+    m_statsTimer = new QTimer(this);
+    m_statsTimer->setInterval(STATS_INTERVAL_MS);
+    connect(m_statsTimer, &QTimer::timeout, this, &FleetEngine::reportLoad);
+
+    // Same backoff and heartbeats as SimulationEngine (core/link-health.h)
+    m_reconnectTimer = new QTimer(this);
+    m_reconnectTimer->setSingleShot(true);
+    connect(m_reconnectTimer, &QTimer::timeout, this, [this]() {
+        if (m_transport->isIdle() && !m_host.isEmpty() && m_autoReconnect) {
+            log(QString("Auto-reconnecting to %1:%2...").arg(m_host).arg(m_port));
+            ensureTransport();
+            m_transport->open(m_host, m_port);
+        }
+    });
+
+    m_heartbeatTimer = new QTimer(this);
+    m_heartbeatTimer->setInterval(LinkHealth::PING_INTERVAL_MS);
+    connect(m_heartbeatTimer, &QTimer::timeout, this, [this]() {
+        if (m_transport->device()->bytesAvailable() > 0) onDataReceived();
+        if (m_health.timedOut()) {
+            log(QString("No pong from the Pi for %1 ms, dropping the link").arg(m_health.silentMs()), "WARN");
+            m_transport->abort();
+            return;
+        }
+        sendCommand(m_health.makePing());
+    });
+
+    // Built-in profile for machines that were never sent one
+    ProfileHeader header;
+    QVector<ProfileFrame> frames;
+    ProfileExecutor::defaultProfile(header, frames);
+    m_defaultPlan = ProfilePlan::compile(header, frames);
+
+    m_table.resize(1);
+}
+
+void FleetEngine::setGhcStatus(int status) {
+    m_ghcStatus = status;
+    for (int i = 0; i < m_table.size(); i++) pushStaticAnswers(i, false);
+    commit(0);
+}
+
+void FleetEngine::setMachineCount(int count) {
+    m_table.resize(qBound(1, count, MAX_MACHINES));
+    m_batch.reserve(m_table.size() * (Wire::FRAME_HEADER_SIZE + 1 + DE1::SHOT_SAMPLE_SIZE) * 2);
+}
+
+void FleetEngine::start() {
+    m_clock.start();
+    m_nextWater = 0.0;
+    m_tickTimer->start();
+    m_statsTimer->start();
+    m_autoReconnect = true;
+    scheduleReconnect();
+    resetStats();
+    publishSnapshot();
+}
+
+void FleetEngine::setTarget(const QString &host, int port) {
+    m_host = host;
+    m_port = port;
+}
+
+void FleetEngine::connectToPi() {
+    m_autoReconnect = true;
+    if (!m_transport->isIdle() || m_host.isEmpty()) return;
+
+    m_reconnectTimer->stop();
+
+    log(QString("Connecting to %1:%2...").arg(m_host).arg(m_port));
+    ensureTransport();
+    m_transport->open(m_host, m_port);
+}
+
+void FleetEngine::disconnectFromPi() {
+    m_autoReconnect = false;
+    m_reconnectTimer->stop();
+    m_transport->close();
+}
+
+void FleetEngine::setSimSpeed(double speed) {
+    if (qBound(SimClock::MIN_SPEED, speed, SimClock::MAX_SPEED) == m_clock.speed()) return;
+    m_clock.setSpeed(speed);
+    log(QString("Simulation speed %1x").arg(m_clock.speed()));
+}
+
+void FleetEngine::loadMmrDump(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        log(QString("Can't load MMR dump %1: %2").arg(path, file.errorString()), "ERROR");
+        return;
+    }
+    QByteArray json = file.readAll();
+    QString error;
+    for (int i = 0; i < m_table.size(); i++) {
+        if (!m_table.mmr[i].loadJson(json, &error)) {
+            log(QString("Can't load MMR dump %1: %2").arg(path, error), "ERROR");
+            return;
+        }
+    }
+    log(QString("Loaded MMR dump %1 into %2 machine(s)").arg(path).arg(m_table.size()));
+    for (int i = 0; i < m_table.size(); i++) pushStaticAnswers(i, false);
+    commit(0);
+}
+
+void FleetEngine::setSampleRate(int hz) {
+    if (hz <= 0) return;
+    m_sampleRateHz = hz;
+    m_tickTimer->setInterval(1000 / hz);
+}
+
+void FleetEngine::startOperation(DE1::State state) {
+    double now = simTime();
+    for (int i = 0; i < m_table.size(); i++) {
+        if (m_table.state[i] != state) beginOperation(i, state, now);
+    }
+    commit(0);
+}
+
+void FleetEngine::stopOperation() {
+    for (int i = 0; i < m_table.size(); i++) stopMachine(i);
+    commit(0);
+}
+
+void FleetEngine::wake() {
+    for (int i = 0; i < m_table.size(); i++) {
+        if (m_table.state[i] == DE1::State::Sleep) setState(i, DE1::State::Idle, DE1::SubState::Ready);
+    }
+    commit(0);
+}
+
+void FleetEngine::sleep() {
+    for (int i = 0; i < m_table.size(); i++) sleepMachine(i);
+    commit(0);
+}
+
+// === Fault injection ===
+
+void FleetEngine::injectFatalError() {
+    for (int i = 0; i < m_table.size(); i++) {
+        stopMachine(i);
+        setState(i, DE1::State::FatalError, DE1::SubState::Ready);
+    }
+    log(QString("Injected FatalError on %1 machine(s)").arg(m_table.size()), "WARN");
+    commit(0);
+}
+
+void FleetEngine::dropLink() {
+    if (!m_transport->isOpen()) return;
+    log("Dropping the link to the Pi", "WARN");
+    m_transport->abort();
+}
+
+// === Profiles ===
+
+void FleetEngine::useProfile(const QString &id) {
+    ProfileCache::Entry entry;
+    if (!m_profiles.find(id, entry)) {
+        log(QString("Profile %1 isn't cached").arg(id), "WARN");
+        return;
+    }
+    for (int i = 0; i < m_table.size(); i++) {
+        m_table.upload[i].restore(entry.header, entry.frames, entry.key);
+        m_table.plan[i] = entry.plan;
+    }
+    log(QString("Switched %1 machine(s) to profile %2").arg(m_table.size()).arg(entry.id));
+}
+
+void FleetEngine::log(const QString &msg, const QString &category) {
+    emit logMessage(category, msg);
+}
+
+void FleetEngine::logMachine(int i, const QString &msg, const QString &category) {
+    if (m_logMachines || category == "WARN") log(QString("[%1] %2").arg(i).arg(msg), category);
+}
+
+void FleetEngine::useTransport(Transport *transport) {
+    m_transport = transport;
+    connect(m_transport, &Transport::connected, this, &FleetEngine::onConnected);
+    connect(m_transport, &Transport::disconnected, this, &FleetEngine::onDisconnected);
+    connect(m_transport, &Transport::readyRead, this, &FleetEngine::onDataReceived);
+    connect(m_transport, &Transport::errorOccurred, this, [this]() {
+        log(QString("Socket error: %1").arg(m_transport->errorString()), "ERROR");
+        if (m_transport->isIdle()) scheduleReconnect();
+    });
+    connect(m_transport, &Transport::bytesWritten, this, &FleetEngine::onBytesWritten);
+}
+
+void FleetEngine::ensureTransport() {
+    if (m_transport->isLoopback() == Transport::isLoopbackHost(m_host)) return;
+
+    m_transport->deleteLater();
+    useTransport(Transport::create(m_host, m_table.size(), this));
+}
+
+void FleetEngine::scheduleReconnect() {
+    if (!m_autoReconnect || m_host.isEmpty() || m_reconnectTimer->isActive()) return;
+    m_reconnectTimer->start(m_health.nextReconnectDelayMs());
+}
+
+bool FleetEngine::isBusy(DE1::State state) {
+    return state == DE1::State::Espresso || state == DE1::State::Steam
+        || state == DE1::State::HotWater || state == DE1::State::HotWaterRinse;
+}
+
+// === Scheduler ===
+
+void FleetEngine::onTick() {
+    QElapsedTimer busy;
+    busy.start();
+
+    double now = simTime();
+    MachineTable &t = m_table;
+    int n = t.size();
+
+    // Step pass
+    for (int i = 0; i < n; i++) {
+        if (now >= t.phaseEnd[i]) onPhaseEnd(i, now);
+
+        switch (t.state[i]) {
+        case DE1::State::Espresso:
+            if (t.subState[i] != DE1::SubState::Heating) runPhysics(i, now);
+            break;
+        case DE1::State::Steam:
+            t.pressure[i] = 1.5;
+            t.flow[i] = 0.0;
+            t.steamTemp[i] = qMin(150.0, 100.0 + (now - t.opStart[i]) * 2.0);
+            break;
+        case DE1::State::HotWater:
+            t.pressure[i] = 0.5;
+            t.flow[i] = 6.0;
+            break;
+        case DE1::State::HotWaterRinse:
+            t.pressure[i] = 1.0;
+            t.flow[i] = 8.0;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Encode pass
+    const quint16 sampleId = Wire::charIdFromString(DE1::CHAR_SHOT_SAMPLE);
+    uint8_t payload[DE1::SHOT_SAMPLE_SIZE];
+    DE1::ShotSample sample;
+    int samples = 0;
+    for (int i = 0; i < n; i++) {
+        if (!isBusy(t.state[i])) continue;
+
+        sample.timer = now - t.opStart[i];
+        sample.groupPressure = t.pressure[i];
+        sample.groupFlow = t.flow[i];
+        sample.mixTemp = t.temperature[i];
+        sample.headTemp = t.temperature[i];
+        sample.setMixTemp = t.setTemp[i];
+        sample.setHeadTemp = t.setTemp[i];
+        sample.setPressure = t.setPressure[i];
+        sample.setFlow = t.setFlow[i];
+        sample.frameNumber = t.frame[i];
+        sample.steamTemp = t.steamTemp[i];
+        DE1::encodeShotSample(sample, payload);
+
+        if (appendNotify(i, sampleId, payload, sizeof(payload))) samples++;
+    }
+
+    if (now >= m_nextWater) {
+        const quint16 waterId = Wire::charIdFromString(DE1::CHAR_WATER_LEVELS);
+        uint8_t water[DE1::WATER_LEVELS_SIZE];
+        DE1::encodeWaterLevels(WATER_LEVEL, water);
+        for (int i = 0; i < n; i++) appendNotify(i, waterId, water, sizeof(water));
+        m_nextWater = now + WATER_INTERVAL_S;
+    }
+
+    commit(samples);
+
+    qint64 ns = busy.nsecsElapsed();
+    m_busyNs += ns;
+    m_tickMaxNs = qMax(m_tickMaxNs, ns);
+    m_ticks++;
+}
+
+void FleetEngine::runPhysics(int i, double now) {
+    MachineTable &t = m_table;
+    ProfileExecutor &ex = t.executor[i];
+
+    qint64 due = static_cast<qint64>((now - t.physicsStart[i]) / ProfileExecutor::STEP_S);
+    qint64 &steps = t.physicsSteps[i];
+    qint64 maxCatchup = static_cast<qint64>(MachineModel::MAX_CATCHUP_STEPS * qMax(1.0, m_clock.speed()));
+    if (due - steps > maxCatchup) steps = due - maxCatchup;
+    while (steps < due) {
+        ex.step();
+        steps++;
+    }
+
+    t.pressure[i] = ex.pressure();
+    t.flow[i] = ex.flow();
+    t.temperature[i] = ex.temperature();
+    t.setPressure[i] = ex.setPressure();
+    t.setFlow[i] = ex.setFlow();
+    t.setTemp[i] = ex.setTemp();
+    t.frame[i] = static_cast<uint8_t>(ex.frameIndex());
+
+    if (t.subState[i] == DE1::SubState::Ending) return;
+
+    if (!ex.isRunning()) {
+        setState(i, DE1::State::Espresso, DE1::SubState::Ending);
+        t.phaseEnd[i] = now + MachineModel::ENDING_S;
+    } else if (t.subState[i] == DE1::SubState::Preinfusion && !ex.inPreinfusion()) {
+        setState(i, DE1::State::Espresso, DE1::SubState::Pouring);
+    }
+}
+
+void FleetEngine::onPhaseEnd(int i, double now) {
+    m_table.phaseEnd[i] = std::numeric_limits<double>::infinity();
+
+    if (m_table.state[i] == DE1::State::Espresso && m_table.subState[i] == DE1::SubState::Heating) {
+        startProfile(i, now);
+    } else {
+        stopMachine(i);
+    }
+}
+
+void FleetEngine::startProfile(int i, double now) {
+    MachineTable &t = m_table;
+    ProfileExecutor &ex = t.executor[i];
+
+    ex.load(t.plan[i].isEmpty() ? m_defaultPlan : t.plan[i]);
+    ex.start(t.temperature[i]);
+    t.physicsStart[i] = now;
+    t.physicsSteps[i] = 0;
+
+    if (!ex.isRunning()) {
+        setState(i, DE1::State::Espresso, DE1::SubState::Ending);
+        t.phaseEnd[i] = now + MachineModel::ENDING_S;
+        return;
+    }
+    setState(i, DE1::State::Espresso, ex.inPreinfusion()
+        ? DE1::SubState::Preinfusion : DE1::SubState::Pouring);
+}
+
+void FleetEngine::beginOperation(int i, DE1::State state, double now) {
+    MachineTable &t = m_table;
+    if (t.state[i] != DE1::State::Idle && t.state[i] != DE1::State::Sleep) return;
+
+    MachineModel::Phase phase;
+    if (!MachineModel::firstPhase(state, phase)) return;
+
+    t.pressure[i] = 0.0;
+    t.flow[i] = 0.0;
+    t.frame[i] = 0;
+    t.opStart[i] = now;
+    t.phaseEnd[i] = now + phase.seconds;
+    setState(i, state, phase.subState);
+}
+
+void FleetEngine::stopMachine(int i) {
+    MachineTable &t = m_table;
+    t.pressure[i] = 0.0;
+    t.flow[i] = 0.0;
+    t.steamTemp[i] = 0.0;
+    t.frame[i] = 0;
+    t.phaseEnd[i] = std::numeric_limits<double>::infinity();
+    setState(i, DE1::State::Idle, DE1::SubState::Ready);
+}
+
+void FleetEngine::sleepMachine(int i) {
+    if (m_table.state[i] == DE1::State::Sleep) return;
+    stopMachine(i);
+    setState(i, DE1::State::Sleep, DE1::SubState::Ready);
+}
+
+void FleetEngine::setState(int i, DE1::State state, DE1::SubState subState) {
+    m_table.state[i] = state;
+    m_table.subState[i] = subState;
+    m_snapshotDirty = true;
+
+    uint8_t payload[DE1::STATE_INFO_SIZE];
+    DE1::encodeStateInfo(state, subState, payload);
+    appendNotify(i, Wire::charIdFromString(DE1::CHAR_STATE_INFO), payload, sizeof(payload));
+
+    if (m_logMachines) {     // Skips the string formatting for a quiet fleet
+        logMachine(i, QString("STATE_INFO: %1/%2").arg(DE1::stateName(state), DE1::subStateName(subState)), "TX");
+    }
+}
+
+// === Outgoing batch ===
+
+bool FleetEngine::appendNotify(int i, quint16 charId, const uint8_t *payload, int len) {
+    int wireId = m_table.wireId[i];
+    if (m_linked && wireId < 0) return false;
+
+    const char *data = reinterpret_cast<const char*>(payload);
+    int tag = !m_linked ? i : (m_taggedIds ? wireId : -1);
+
+    if (!m_linked || m_binaryProtocol) {
+        return Wire::appendFrame(m_batch, Wire::FrameNotify, charId, data, len, tag);
+    }
+
+    QJsonObject cmd;
+    cmd["cmd"] = "notify";
+    cmd["char"] = Wire::charIdToString(charId);
+    cmd["data"] = QString(QByteArray::fromRawData(data, len).toHex());
+    if (tag >= 0) cmd["machine"] = tag;
+    m_batch.append(QJsonDocument(cmd).toJson(QJsonDocument::Compact));
+    m_batch.append('\n');
+    return true;
+}
+
+void FleetEngine::commit(int samples) {
+    if (m_snapshotDirty) publishSnapshot();
+    if (m_batch.isEmpty()) return;
+
+    m_samplesSent += samples;
+    if (m_linked) {
+        m_batcher->enqueue(m_batch);
+        m_bytesQueued += m_batch.size();
+        if (samples > 0) m_batchEnds.enqueue({m_bytesQueued, m_latencyClock.nsecsElapsed(), samples});
+    } else {
+        m_samplesDelivered += samples;
+    }
+    m_batch.resize(0);  // Keeps the allocation for the next tick
+}
+
+void FleetEngine::pushStaticAnswers(int i, bool withChars) {
+    int wireId = m_table.wireId[i];
+    if (!m_linked || !m_daemonAnswers || wireId < 0) return;
+
+    QJsonObject cmd = MachineModel::staticAnswers(m_table.mmr[i], m_ghcStatus,
+        withChars ? DE1::defaultShotSettings() : QByteArray());
+    if (m_taggedIds) cmd["machine"] = wireId;
+    m_batch.append(QJsonDocument(cmd).toJson(QJsonDocument::Compact));
+    m_batch.append('\n');
+}
+
+void FleetEngine::sendCommand(const QJsonObject &cmd) {
+    QByteArray line = QJsonDocument(cmd).toJson(QJsonDocument::Compact) + "\n";
+    m_batcher->enqueue(line);
+    m_bytesQueued += line.size();
+}
+
+void FleetEngine::onBytesWritten(qint64 bytes) {
+    m_bytesWritten += bytes;
+    qint64 now = m_latencyClock.nsecsElapsed();
+    while (!m_batchEnds.isEmpty() && m_batchEnds.head().endOffset <= m_bytesWritten) {
+        BatchMark batch = m_batchEnds.dequeue();
+        qint64 latency = now - batch.sentNs;
+        m_samplesDelivered += batch.samples;
+        m_latencySumNs += latency * batch.samples;
+        m_latencyMaxNs = qMax(m_latencyMaxNs, latency);
+    }
+}
+
+// === Pi link ===
+
+void FleetEngine::onConnected() {
+    log(m_transport->isLoopback() ? "Connected to loopback daemon (no Pi)" : "Connected to Pi daemon");
+    m_batcher->setDevice(m_transport->device());
+    m_bytesQueued = 0;
+    m_bytesWritten = 0;
+    m_batchEnds.clear();
+    emit linkConnectedChanged(true);
+}
+
+void FleetEngine::onDisconnected() {
+    log("Disconnected from Pi");
+    m_linked = false;
+    m_binaryProtocol = false;
+    m_taggedIds = false;
+    m_daemonAnswers = false;
+    m_tcpBuffer.clear();
+    m_batcher->setDevice(nullptr);
+    m_batchEnds.clear();
+    m_indexByWireId.fill(-1);
+    for (int i = 0; i < m_table.size(); i++) {
+        m_table.wireId[i] = -1;
+        m_table.bleConnected[i] = 0;
+    }
+    m_heartbeatTimer->stop();
+    m_health.stopHeartbeat();
+    emit linkConnectedChanged(false);
+    emit bleClientChanged(QString());
+    scheduleReconnect();
+}
+
+void FleetEngine::onDataReceived() {
+    m_tcpBuffer.readFrom(m_transport->device());
+
+    Wire::Message msg;
+    while (m_tcpBuffer.next(msg)) {
+        if (msg.binary) {
+            if (msg.type == Wire::FrameWrite) {
+                int i = machineIndex(msg.machine);
+                if (i >= 0) handleWrite(i, msg.charId, msg.payload.toByteArray());
+            } else if (msg.type == Wire::FrameAnswered) {
+                int i = machineIndex(msg.machine);
+                if (i >= 0) logMachine(i, QString("%1 answered by Pi").arg(Wire::charIdToString(msg.charId)), "RX");
+            }
+            continue;
+        }
+
+        QJsonParseError err;
+        QJsonDocument doc = QJsonDocument::fromJson(
+            QByteArray::fromRawData(msg.payload.data(), msg.payload.size()), &err);
+        if (err.error != QJsonParseError::NoError) {
+            log("JSON parse error: " + err.errorString(), "ERROR");
+            continue;
+        }
+        handlePiEvent(doc.object());
+    }
+    m_tcpBuffer.compact();
+    commit(0);
+}
+
+int FleetEngine::machineIndex(int wireId) const {
+    if (wireId < 0 || !m_taggedIds) return m_linked ? 0 : -1;
+    return m_indexByWireId.value(wireId, -1);
+}
+
+void FleetEngine::handlePiEvent(const QJsonObject &event) {
+    QString type = event["event"].toString();
+
+    if (type == "ready") {
+        handleReady(event);
+        return;
+    }
+    if (type == "pong") {
+        m_health.onPong(event);
+        return;
+    }
+
+    int i = machineIndex(event.contains("machine") ? event["machine"].toInt() : -1);
+    if (i < 0) return;
+
+    if (type == "connected" || type == "disconnected") {
+        m_table.bleConnected[i] = (type == "connected");
+        logMachine(i, QString("BLE client %1 %2").arg(type, event["client"].toString()), "PI");
+        reportBleClients();
+    } else if (type == "write") {
+        handleWrite(i, Wire::charIdFromString(event["char"].toString()),
+                    QByteArray::fromHex(event["data"].toString().toLatin1()));
+    } else if (type == "connection" && event.contains("interval_ms")) {
+        logMachine(i, QString("BLE connection interval %1 ms, latency %2, MTU %3")
+            .arg(event["interval_ms"].toDouble()).arg(event["latency"].toInt()).arg(event["mtu"].toInt()), "PI");
+    } else if (type == "answered") {
+        logMachine(i, QString("%1 answered by Pi").arg(event["char"].toString()), "RX");
+    } else if (type == "error") {
+        logMachine(i, QString("Pi BLE error: %1").arg(event["code"].toInt()), "WARN");
+    }
+}
+
+void FleetEngine::handleReady(const QJsonObject &event) {
+    int protocol = event["protocol"].toInt(Wire::PROTOCOL_JSON);
+    const QJsonArray machines = event["machines"].toArray();
+    log(QString("Pi daemon ready (v%1, protocol %2)").arg(event["version"].toString()).arg(protocol), "PI");
+    m_health.resetBackoff();
+    if (event["heartbeat"].toBool()) {
+        m_health.startHeartbeat();
+        m_heartbeatTimer->start();
+    }
+
+    // Daemons that send "protocol" understand hello, and with it machine IDs
+    m_binaryProtocol = protocol >= Wire::PROTOCOL_BINARY && m_useBinary;
+    m_taggedIds = protocol >= Wire::PROTOCOL_BINARY && !machines.isEmpty();
+    if (protocol >= Wire::PROTOCOL_BINARY) {
+        QJsonObject hello;
+        hello["cmd"] = "hello";
+        hello["protocol"] = m_binaryProtocol ? Wire::PROTOCOL_BINARY : Wire::PROTOCOL_JSON;
+        if (m_taggedIds) hello["machine_ids"] = true;
+        sendCommand(hello);
+    }
+
+    // Machines bind in the daemon's order; an ID that can't be on the
+    // wire (or is listed twice) is skipped rather than trusted as an index
+    m_indexByWireId.fill(-1, MAX_MACHINES);
+    QVector<QJsonObject> caches;
+    int bound = 0;
+    if (!m_taggedIds) {
+        m_table.wireId[0] = 0;
+        m_indexByWireId[0] = 0;
+        caches.append(event["cache"].toObject());
+        bound = 1;
+    }
+    for (int k = 0; m_taggedIds && k < machines.size() && bound < m_table.size(); k++) {
+        const QJsonObject machine = machines[k].toObject();
+        int id = machine["id"].toInt(-1);
+        if (id < 0 || id >= MAX_MACHINES || m_indexByWireId[id] >= 0) {
+            log(QString("Ignoring daemon machine with ID %1").arg(machine["id"].toVariant().toString()), "WARN");
+            continue;
+        }
+        m_table.wireId[bound] = id;
+        m_indexByWireId[id] = bound;
+        caches.append(machine["cache"].toObject());
+        bound++;
+    }
+    m_linked = true;
+
+    log(QString("Driving %1 of %2 machine(s) on the link%3")
+            .arg(bound).arg(m_taggedIds ? machines.size() : 1)
+            .arg(m_binaryProtocol ? ", binary protocol" : ""), "PI");
+    if (m_table.size() > bound) {
+        log(QString("%1 machine(s) simulated without a link").arg(m_table.size() - bound));
+    }
+
+    // Daemons that take static answers reply to MMR reads themselves
+    m_daemonAnswers = event["answers"].toBool();
+
+    // Initial state, unless the daemon kept it from before; water goes
+    // out with the next tick. Characteristics it kept are not pushed
+    // again, so shot settings an app wrote survive the reconnect.
+    int kept = 0;
+    for (int i = 0; i < bound; i++) {
+        const QJsonObject &cache = caches[i];
+        pushStaticAnswers(i, !cache.contains(DE1::CHAR_SHOT_SETTINGS));
+
+        uint8_t payload[DE1::STATE_INFO_SIZE];
+        DE1::encodeStateInfo(m_table.state[i], m_table.subState[i], payload);
+        if (QByteArray::fromHex(cache[DE1::CHAR_STATE_INFO].toString().toLatin1())
+                == QByteArray(reinterpret_cast<const char*>(payload), sizeof(payload))) {
+            kept++;
+        } else {
+            setState(i, m_table.state[i], m_table.subState[i]);
+        }
+    }
+    if (kept > 0) log(QString("Pi kept the state of %1 machine(s)").arg(kept), "PI");
+    m_nextWater = 0.0;
+}
+
+void FleetEngine::reportBleClients() {
+    int connected = 0, linked = 0;
+    for (int i = 0; i < m_table.size(); i++) {
+        connected += m_table.bleConnected[i];
+        linked += m_table.wireId[i] >= 0;
+    }
+    emit bleClientChanged(connected ? QString("%1 of %2 machines").arg(connected).arg(linked) : QString());
+}
+
+void FleetEngine::handleWrite(int i, quint16 charId, const QByteArray &value) {
+    QString id = Wire::charIdToString(charId);
+    emit appWrote(id, value);
+
+    if (id == DE1::CHAR_REQUESTED_STATE && !value.isEmpty()) {
+        handleRequestedState(i, static_cast<DE1::State>(static_cast<uint8_t>(value[0])));
+    } else if (id == DE1::CHAR_READ_FROM_MMR) {
+        MmrRegisterFile &mmr = m_table.mmr[i];
+        mmr.write(DE1::MMR::GHC_INFO, static_cast<uint32_t>(m_ghcStatus.load()));
+        for (const QByteArray &response : mmr.readResponses(value)) {
+            appendNotify(i, charId, reinterpret_cast<const uint8_t*>(response.constData()), response.size());
+        }
+    } else if (id == DE1::CHAR_WRITE_TO_MMR) {
+        m_table.mmr[i].applyWrite(value);
+    } else if (id == DE1::CHAR_HEADER_WRITE) {
+        if (m_table.upload[i].writeHeader(value) == ProfileUpload::Invalid) {
+            logMachine(i, QString("HEADER_WRITE: invalid size %1").arg(value.size()), "WARN");
+        }
+    } else if (id == DE1::CHAR_FRAME_WRITE) {
+        ProfileUpload &upload = m_table.upload[i];
+        ProfileUpload::Result result = upload.writeFrame(value);
+        if (result == ProfileUpload::NoHeader) {
+            logMachine(i, "FRAME_WRITE before any HEADER_WRITE, ignored", "WARN");
+        } else if (MachineModel::uploadFinished(upload, result)) {
+            // Shared by the fleet: machines uploading the same profile compile it once
+            bool hit = false;
+            ProfileCache::Entry entry = m_profiles.add(upload, &hit);
+            m_table.plan[i] = entry.plan;
+            logMachine(i, QString(hit ? "Profile %1 from cache (%2 frames)" : "Profile %1 compiled (%2 frames)")
+                .arg(entry.id).arg(entry.plan.steps.size()), "RX");
+        }
+    }
+}
+
+void FleetEngine::handleRequestedState(int i, DE1::State requested) {
+    logMachine(i, QString("REQUESTED_STATE: %1").arg(DE1::stateName(requested)), "RX");
+
+    if (requested == DE1::State::Sleep) {
+        sleepMachine(i);
+    } else if (requested == DE1::State::Idle) {
+        if (m_table.state[i] == DE1::State::Sleep) {
+            setState(i, DE1::State::Idle, DE1::SubState::Ready);
+        } else {
+            stopMachine(i);
+        }
+    } else if (m_ghcStatus == 3) {
+        logMachine(i, QString("GHC active - BLOCKED app request: %1").arg(DE1::stateName(requested)), "WARN");
+    } else {
+        beginOperation(i, requested, simTime());
+    }
+}
+
+// === Reporting ===
+
+void FleetEngine::publishSnapshot() {
+    m_snapshotDirty = false;
+
+    EngineSnapshot snap;
+    bool allAsleep = true;
+    for (int i = 0; i < m_table.size(); i++) {
+        DE1::State s = m_table.state[i];
+        if (s != DE1::State::Sleep) allAsleep = false;
+        if (s == DE1::State::Espresso
+            || (snap.state == DE1::State::Idle && s != DE1::State::Idle && s != DE1::State::Sleep)) {
+            snap.state = s;
+            snap.subState = m_table.subState[i];
+        }
+    }
+    if (allAsleep) snap.state = DE1::State::Sleep;
+
+    if (snap.state == m_lastSnapshotState) return;
+    m_lastSnapshotState = snap.state;
+
+    snap.pressure = m_table.pressure[0];
+    snap.flow = m_table.flow[0];
+    snap.temperature = m_table.temperature[0];
+    snap.waterLevel = WATER_LEVEL;
+    snap.frameNumber = m_table.frame[0];
+    emit snapshotReady(snap);
+}
+
+void FleetEngine::resetStats() {
+    m_statsWindow.start();
+    m_busyNs = 0;
+    m_tickMaxNs = 0;
+    m_ticks = 0;
+    m_samplesSent = 0;
+    m_samplesDelivered = 0;
+    m_latencySumNs = 0;
+    m_latencyMaxNs = 0;
+}
+
+void FleetEngine::reportLoad() {
+    double secs = m_statsWindow.nsecsElapsed() / 1e9;
+    if (secs <= 0 || m_ticks == 0) return;
+
+    int busy = 0;
+    for (int i = 0; i < m_table.size(); i++) busy += isBusy(m_table.state[i]);
+
+    int queued = 0;
+    for (const BatchMark &batch : std::as_const(m_batchEnds)) queued += batch.samples;
+
+    LoadReport report;
+    report.requestedHz = busy ? m_sampleRateHz * busy : 0;
+    report.sentHz = m_samplesSent / secs;
+    report.deliveredHz = m_samplesDelivered / secs;
+    report.queued = queued;
+    if (m_samplesDelivered > 0) report.latencyAvgMs = m_latencySumNs / 1e6 / m_samplesDelivered;
+    report.latencyMaxMs = m_latencyMaxNs / 1e6;
+    if (m_health.heartbeat()) report.rttMs = m_health.lastRttMs();
+    emit loadReported(report);
+
+    if (busy) {
+        log(QString("Fleet: %1 machine(s), %2 busy, tick %3 us avg / %4 us max, %5% of one core")
+            .arg(m_table.size()).arg(busy)
+            .arg(m_busyNs / 1000.0 / m_ticks, 0, 'f', 1)
+            .arg(m_tickMaxNs / 1000.0, 0, 'f', 1)
+            .arg(m_busyNs / 1e7 / secs, 0, 'f', 2));
+    }
+    resetStats();
+}
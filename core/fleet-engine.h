@@ -0,0 +1,283 @@
+/*
+ * DE1 fleet engine - many simulated machines stepped on one scheduler tick,
+ * so one process can drive every machine on a multiplexed daemon port
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QFile>
+
+#include <atomic>
+#include <limits>
+
+#include "de1-protocol.h"
+#include "link-health.h"
+#include "machine-model.h"
+#include "mmr-registers.h"
+#include "profile.h"
+#include "sim-clock.h"
+#include "simulation-engine.h"
+#include "transport.h"
+#include "pi-daemon/de1-wire.h"
+
+// ============================================================================
+// Machine Table - per-machine state, stored struct-of-arrays
+// ============================================================================
+//
+// Each column holds one field for every machine, so the scheduler walks a
+// handful of contiguous arrays per tick instead of hopping between
+// per-machine objects with their own timers. Timers are plain deadlines in
+// sim time, checked by the tick. The cold columns (profile uploads and
+// executors) are only touched by machines that are pulling a shot or being
+// sent a profile.
+
+struct MachineTable {
+    // Hot: read or written for every machine on every tick
+    QVector<DE1::State> state;
+    QVector<DE1::SubState> subState;
+    QVector<double> pressure;
+    QVector<double> flow;
+    QVector<double> temperature;
+    QVector<double> setTemp;
+    QVector<double> setPressure;
+    QVector<double> setFlow;
+    QVector<double> steamTemp;
+    QVector<uint8_t> frame;
+    QVector<double> opStart;        // Sim time the running operation started, s
+    QVector<double> phaseEnd;       // Sim time the timed phase ends, infinity if none
+
+    // Link
+    QVector<int> wireId;            // Daemon machine ID, -1 if not on the link
+    QVector<uint8_t> bleConnected;
+
+    // Cold
+    QVector<MmrRegisterFile> mmr;
+    QVector<ProfileUpload> upload;
+    QVector<ProfilePlan> plan;      // Empty until a profile is uploaded
+    QVector<ProfileExecutor> executor;
+    QVector<double> physicsStart;   // Sim time the executor started
+    QVector<qint64> physicsSteps;   // Fixed steps run since then
+
+    int size() const { return state.size(); }
+
+    void resize(int n);
+};
+
+// ============================================================================
+// Fleet Engine - one scheduler tick for every machine
+// ============================================================================
+//
+// Each tick runs two passes over the table: a step pass (phase deadlines,
+// profile physics at the executor's fixed rate, state changes) and an
+// encode pass that writes one SHOT_SAMPLE per busy machine into a single
+// buffer. The buffer, with any STATE_INFO produced by the step pass, goes to
+// the socket as one write per tick. State changes therefore go out on tick
+// boundaries; exit conditions are still evaluated every physics step.
+//
+// On a multiplexed daemon port the first machines are bound to the
+// daemon's machines through "machine_ids" in hello and tagged frames; the
+// rest are simulated and encoded but not sent. Without a link every
+// machine runs that way, which is how to measure the scheduler cost alone.
+//
+// Runs on the thread it lives on; de1sim-headless uses the main thread.
+
+class FleetEngine : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int MAX_MACHINES = 256;            // Machine IDs are one byte on the wire
+    static constexpr double WATER_INTERVAL_S = 5.0;
+    static constexpr int STATS_INTERVAL_MS = 1000;
+
+    FleetEngine(QObject *parent = nullptr);
+    void setGhcStatus(int status);
+    void setBinaryProtocol(bool enabled) { m_useBinary = enabled; }
+    void setLogMachines(bool enabled) { m_logMachines = enabled; }
+
+    // Call before start(); machines bind to the daemon when it sends "ready"
+    void setMachineCount(int count);
+
+    int machineCount() const { return m_table.size(); }
+
+public slots:
+    void start();
+    void setTarget(const QString &host, int port);
+    void connectToPi();
+
+    // Stays disconnected until connectToPi()
+    void disconnectFromPi();
+
+    // Like SimulationEngine::setSimSpeed(); phase deadlines are sim times
+    // already, so nothing needs rescheduling
+    void setSimSpeed(double speed);
+
+    double simSpeed() const { return m_clock.speed(); }
+
+    // Merges a register dump over every machine's registers; machines added
+    // later start from the power-on values
+    void loadMmrDump(const QString &path);
+    void setSampleRate(int hz);
+
+    // Fleet-wide control, same semantics as SimulationEngine's scripted
+    // control: machines already in the requested state are left alone
+    void startOperation(DE1::State state);
+    void stopOperation();
+    void wake();
+    void sleep();
+
+    // === Fault injection ===
+
+    // The scenario faults SimulationEngine has that make sense fleet-wide;
+    // water and notification faults are single-machine only
+
+    void injectFatalError();
+    void dropLink();
+
+    // === Profiles ===
+
+    // Every machine switches to a profile uploaded earlier by any of them
+    void useProfile(const QString &id);
+
+signals:
+    void logMessage(const QString &category, const QString &msg);
+    void linkConnectedChanged(bool connected);
+    void bleClientChanged(const QString &clients);  // Empty when no machine has one
+    void snapshotReady(const EngineSnapshot &snapshot);     // Fleet-wide, see publishSnapshot()
+    void loadReported(const LoadReport &report);
+    void appWrote(const QString &charId, const QByteArray &value);  // Any machine's
+
+private:
+    void log(const QString &msg, const QString &category = "INFO");
+    void logMachine(int i, const QString &msg, const QString &category);
+    void useTransport(Transport *transport);
+
+    // The loopback daemon offers as many machines as the table holds
+    void ensureTransport();
+    void scheduleReconnect();
+
+    double simTime() const { return m_clock.now(); }
+
+    static bool isBusy(DE1::State state);
+
+    // === Scheduler ===
+
+    void onTick();
+
+    // Catch up in fixed steps to sim time, like SimulationEngine::onPhysicsTick()
+    void runPhysics(int i, double now);
+    void onPhaseEnd(int i, double now);
+    void startProfile(int i, double now);
+    void beginOperation(int i, DE1::State state, double now);
+    void stopMachine(int i);
+    void sleepMachine(int i);
+    void setState(int i, DE1::State state, DE1::SubState subState);
+
+    // === Outgoing batch ===
+
+    // Appends one notification to this tick's batch. Returns false if the
+    // machine has no place on the link. Unlinked, everything is encoded the
+    // same way (tagged with the table index) and then dropped in commit().
+    bool appendNotify(int i, quint16 charId, const uint8_t *payload, int len);
+
+    // Hands the batch to the socket in one piece
+    void commit(int samples);
+
+    // Like SimulationEngine::pushStaticAnswers(), per machine. Shot settings
+    // aren't tracked here, so characteristic values only go out on ready;
+    // after that the daemon keeps whatever the app wrote.
+    void pushStaticAnswers(int i, bool withChars);
+    void sendCommand(const QJsonObject &cmd);
+
+    // Every sample in a batch was produced in the same tick, so they share
+    // one latency
+    void onBytesWritten(qint64 bytes);
+
+    // === Pi link ===
+
+    void onConnected();
+    void onDisconnected();
+    void onDataReceived();
+
+    // Untagged messages belong to the first machine
+    int machineIndex(int wireId) const;
+    void handlePiEvent(const QJsonObject &event);
+    void handleReady(const QJsonObject &event);
+    void reportBleClients();
+    void handleWrite(int i, quint16 charId, const QByteArray &value);
+
+    // Unlike the GUI engine an operation requested by the app actually runs,
+    // so a fleet can be driven by the apps alone once GHC is off
+    void handleRequestedState(int i, DE1::State requested);
+
+    // === Reporting ===
+
+    // One snapshot for the whole fleet: the busiest state any machine is
+    // in (Espresso first), Sleep only when all machines sleep, else Idle.
+    // Values are machine 0's.
+    void publishSnapshot();
+    void resetStats();
+    void reportLoad();
+
+private:
+    static constexpr double WATER_LEVEL = 75.0;     // Percent, same for every machine
+
+    MachineTable m_table;
+    ProfilePlan m_defaultPlan;
+    ProfileCache m_profiles;        // Uploads of every machine
+    SimClock m_clock;               // Sim time for every machine
+    double m_nextWater = 0.0;
+    int m_sampleRateHz = 5;
+
+    // Pi link
+    QString m_host;
+    int m_port = 12345;
+    Transport *m_transport = nullptr;
+    Wire::StreamBuffer m_tcpBuffer;
+    Wire::WriteBatcher *m_batcher = nullptr;
+    QByteArray m_batch;             // Everything encoded since the last commit()
+    bool m_linked = false;          // Daemon sent "ready" and machines are bound
+    bool m_binaryProtocol = false;
+    bool m_taggedIds = false;       // Frames carry machine IDs
+    bool m_daemonAnswers = false;   // Daemon answers MMR reads from pushStaticAnswers()
+    bool m_autoReconnect = false;   // Off after disconnectFromPi()
+    LinkHealth m_health;
+    QVector<int> m_indexByWireId;   // Daemon machine ID -> table index
+
+    std::atomic<int> m_ghcStatus{3};
+    std::atomic<bool> m_useBinary{true};
+    bool m_logMachines = false;
+
+    // Timers
+    QTimer *m_tickTimer = nullptr;
+    QTimer *m_statsTimer = nullptr;
+    QTimer *m_reconnectTimer = nullptr;
+    QTimer *m_heartbeatTimer = nullptr;
+
+    // Snapshot / load reporting
+    bool m_snapshotDirty = false;
+    DE1::State m_lastSnapshotState = DE1::State::Init;   // Forces the first snapshot
+    QElapsedTimer m_statsWindow;
+    qint64 m_busyNs = 0;            // Time spent in onTick() this window
+    qint64 m_tickMaxNs = 0;
+    int m_ticks = 0;
+    int m_samplesSent = 0;
+    int m_samplesDelivered = 0;
+    qint64 m_bytesQueued = 0;
+    qint64 m_bytesWritten = 0;
+    struct BatchMark {
+        qint64 endOffset;           // Where the batch ends in the outgoing stream
+        qint64 sentNs;              // m_latencyClock when the tick committed it
+        int samples;
+    };
+    QQueue<BatchMark> m_batchEnds;
+    QElapsedTimer m_latencyClock;
+    qint64 m_latencySumNs = 0;
+    qint64 m_latencyMaxNs = 0;
+};
@@ -0,0 +1,105 @@
+#include "latency-stats.h"
+#include "pi-daemon/de1-wire.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include <algorithm>
+
+QString LatencyStats::stageName(LatencyStage stage) {
+    switch (stage) {
+        case LatencyStage::Gui:     return "Simulator";
+        case LatencyStage::Network: return "Network (one way)";
+        case LatencyStage::Parse:   return "Daemon parse";
+        case LatencyStage::Ble:     return "Daemon BLE write";
+        case LatencyStage::Total:   return "End to end";
+        default:                    return "Unknown";
+    }
+}
+
+void LatencyStats::add(const LatencySample &sample) {
+    for (int i = 0; i < int(LatencyStage::Count); i++) {
+        if (sample.stageUs[i] >= 0) m_window[i].append(sample.stageUs[i]);
+    }
+    if (!sample.written) m_coalesced++;
+
+    if (m_rows.size() < MAX_ROWS) {
+        m_rows.append(sample);
+    } else {
+        m_rowsDropped++;
+    }
+}
+
+// Nearest-rank percentile; nth_element reorders the window, which is
+// discarded afterwards anyway
+static double percentileMs(QVector<qint64> &values, double p) {
+    if (values.isEmpty()) return 0.0;
+    qsizetype rank = qBound<qsizetype>(0, qsizetype(p * values.size() + 0.5) - 1, values.size() - 1);
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank] / 1000.0;
+}
+
+LatencyReport LatencyStats::takeReport() {
+    LatencyReport report;
+    for (int i = 0; i < int(LatencyStage::Count); i++) {
+        QVector<qint64> &values = m_window[i];
+
+        LatencyStageReport stage;
+        stage.name = stageName(LatencyStage(i));
+        stage.count = values.size();
+        if (!values.isEmpty()) {
+            stage.maxMs = *std::max_element(values.cbegin(), values.cend()) / 1000.0;
+            stage.p99Ms = percentileMs(values, 0.99);
+            stage.p50Ms = percentileMs(values, 0.50);
+        }
+        report.stages.append(stage);
+
+        if (LatencyStage(i) == LatencyStage::Ble) report.acked = values.size();
+        values.resize(0);   // Keeps the allocation for the next window
+    }
+    report.coalesced = m_coalesced;
+    report.unacked = m_unacked;
+    m_coalesced = 0;
+    m_unacked = 0;
+    return report;
+}
+
+bool LatencyStats::writeCsv(const QString &path, QString *error) const {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+
+    // Unknown stages (notification never written) are left empty
+    auto field = [](qint64 us) { return us >= 0 ? QString::number(us) : QString(); };
+
+    QTextStream out(&file);
+    out << "seq,char,produced_us,written,simulator_us,network_us,parse_us,ble_us,total_us\n";
+    for (const LatencySample &s : m_rows) {
+        out << s.seq << ',' << Wire::charIdToString(s.charId) << ',' << s.producedUs << ','
+            << (s.written ? 1 : 0);
+        for (int i = 0; i < int(LatencyStage::Count); i++) {
+            out << ',' << field(s.stageUs[i]);
+        }
+        out << '\n';
+    }
+    if (m_rowsDropped > 0) {
+        out << "# " << m_rowsDropped << " later sample(s) not kept (limit " << MAX_ROWS << ")\n";
+    }
+
+    out.flush();
+    if (file.error() != QFileDevice::NoError) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void LatencyStats::clear() {
+    for (QVector<qint64> &values : m_window) values.clear();
+    m_coalesced = 0;
+    m_unacked = 0;
+    m_rows.clear();
+    m_rowsDropped = 0;
+}
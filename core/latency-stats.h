@@ -0,0 +1,90 @@
+/*
+ * Notification latency - per-stage timing of timed notifications, from the
+ * simulator producing them to the Pi daemon handing them to BlueZ
+ */
+
+#pragma once
+
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+
+#include <cstdint>
+
+// ============================================================================
+// Latency Samples
+// ============================================================================
+//
+// One sample per notification the daemon acked (see the "timing" event in
+// pi-daemon/de1-wire.h). The engine and the daemon have separate clocks, so
+// the network leg is derived from the round trip: the time between writing a
+// notification and reading its ack, minus everything the daemon says it
+// spent on it, split evenly in both directions.
+
+enum class LatencyStage {
+    Gui,        // Produced until the transport took the bytes
+    Network,    // One way, half the round trip left after the daemon's share
+    Parse,      // Daemon: TCP data read until the notification was queued
+    Ble,        // Daemon: queued until writeCharacteristic() returned
+    Total,      // Sum of the above: produced until handed to BlueZ
+    Count
+};
+
+struct LatencySample {
+    quint16 seq = 0;
+    quint16 charId = 0;
+    qint64 producedUs = 0;      // Engine clock
+    bool written = false;       // False if the daemon coalesced or dropped it
+    qint64 stageUs[int(LatencyStage::Count)] = {};  // -1 where unknown (not written)
+};
+
+struct LatencyStageReport {
+    QString name;
+    double p50Ms = 0.0;
+    double p99Ms = 0.0;
+    double maxMs = 0.0;
+    int count = 0;
+};
+
+// Percentiles over the last report interval
+struct LatencyReport {
+    QVector<LatencyStageReport> stages;     // In LatencyStage order
+    int acked = 0;              // Written by the daemon
+    int coalesced = 0;          // Replaced by a newer value (or dropped) before BLE got it
+    int unacked = 0;            // Timed out waiting for an ack
+};
+
+Q_DECLARE_METATYPE(LatencyReport)
+
+// ============================================================================
+// Latency Stats - report window plus the rows kept for CSV export
+// ============================================================================
+
+class LatencyStats {
+public:
+    static constexpr int MAX_ROWS = 500000;  // About 5.5 hours of SHOT_SAMPLE at 25 Hz
+
+    static QString stageName(LatencyStage stage);
+
+    // Samples that weren't written only count towards the Gui and Parse stages
+    void add(const LatencySample &sample);
+    void addUnacked(int count) { m_unacked += count; }
+
+    // Percentiles since the last call; the export rows are kept
+    LatencyReport takeReport();
+
+    // One row per sample, in microseconds. Returns false with *error set
+    // if the file can't be written.
+    bool writeCsv(const QString &path, QString *error = nullptr) const;
+
+    int rowCount() const { return m_rows.size(); }
+    void clear();
+
+private:
+    QVector<qint64> m_window[int(LatencyStage::Count)];
+    int m_coalesced = 0;
+    int m_unacked = 0;
+
+    QVector<LatencySample> m_rows;
+    qint64 m_rowsDropped = 0;   // Beyond MAX_ROWS
+};
@@ -0,0 +1,88 @@
+/*
+ * Link health - reconnect backoff and ping/pong heartbeats for the daemon
+ * link, shared by both engines
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QtGlobal>
+
+// ============================================================================
+// Link Health
+// ============================================================================
+//
+// Reconnects start RECONNECT_MIN_MS after the link drops and double up to
+// RECONNECT_MAX_MS while attempts keep failing; a completed handshake
+// ("ready") resets the delay. So a Wi-Fi blip costs a fraction of a second,
+// and a Pi that is off is retried as often as before.
+//
+// Daemons that advertise "heartbeat" in ready get a ping every
+// PING_INTERVAL_MS:
+//
+//   {"cmd": "ping", "seq": 12, "t": <our clock, us>}
+//   {"event": "pong", "seq": 12, "t": <echoed>}
+//
+// The RTT is measured against our own clock, so no clock sync is needed.
+// No pong for PONG_TIMEOUT_MS means the link is half-open (or the daemon is
+// stuck) and the engine aborts it instead of waiting for the OS to notice.
+
+class LinkHealth {
+public:
+    static constexpr int RECONNECT_MIN_MS = 100;
+    static constexpr int RECONNECT_MAX_MS = 5000;
+    static constexpr int PING_INTERVAL_MS = 250;
+    static constexpr int PONG_TIMEOUT_MS = 1000;
+
+    LinkHealth() { m_clock.start(); }
+
+    // Delay before the next attempt; each call doubles the one after
+    int nextReconnectDelayMs() {
+        int delay = m_reconnectDelayMs;
+        m_reconnectDelayMs = qMin(m_reconnectDelayMs * 2, RECONNECT_MAX_MS);
+        return delay;
+    }
+
+    void resetBackoff() { m_reconnectDelayMs = RECONNECT_MIN_MS; }
+
+    // Heartbeats from now on; a fresh link counts as just heard from
+    void startHeartbeat() {
+        m_heartbeat = true;
+        m_lastPongNs = m_clock.nsecsElapsed();
+        m_lastRttMs = -1.0;
+    }
+
+    void stopHeartbeat() { m_heartbeat = false; }
+    bool heartbeat() const { return m_heartbeat; }
+
+    QJsonObject makePing() {
+        return QJsonObject{{"cmd", "ping"}, {"seq", qint64(m_nextSeq++)},
+                           {"t", m_clock.nsecsElapsed() / 1000}};
+    }
+
+    // RTT of the ping this pong answers, in ms
+    double onPong(const QJsonObject &pong) {
+        qint64 nowNs = m_clock.nsecsElapsed();
+        m_lastPongNs = nowNs;
+        m_lastRttMs = qMax<qint64>(0, nowNs / 1000 - pong["t"].toInteger()) / 1000.0;
+        return m_lastRttMs;
+    }
+
+    // Milliseconds since the last pong, 0 without heartbeats
+    qint64 silentMs() const {
+        return m_heartbeat ? (m_clock.nsecsElapsed() - m_lastPongNs) / 1000000 : 0;
+    }
+
+    bool timedOut() const { return silentMs() > PONG_TIMEOUT_MS; }
+
+    double lastRttMs() const { return m_lastRttMs; }     // -1 until the first pong
+
+private:
+    QElapsedTimer m_clock;
+    int m_reconnectDelayMs = RECONNECT_MIN_MS;
+    bool m_heartbeat = false;
+    quint32 m_nextSeq = 0;
+    qint64 m_lastPongNs = 0;
+    double m_lastRttMs = -1.0;
+};
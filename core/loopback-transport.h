@@ -0,0 +1,298 @@
+/*
+ * Loopback transport - an in-process stand-in for the Pi daemon, so the
+ * simulator can be measured without Wi-Fi, BlueZ or a Pi
+ */
+
+#pragma once
+
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QVector>
+
+#include "transport.h"
+#include "pi-daemon/de1-wire.h"
+
+// ============================================================================
+// Loopback Device - the engine's end of an in-memory byte stream
+// ============================================================================
+//
+// Writes land in a buffer the loopback daemon drains on its next
+// event-loop pass (like a socket, the engine never sees its own write being
+// processed synchronously); the daemon's replies are read back from a
+// second buffer.
+
+class LoopbackDevice : public QIODevice {
+    Q_OBJECT
+
+public:
+    explicit LoopbackDevice(QObject *parent = nullptr) : QIODevice(parent) {}
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override { return m_toEngine.size() + QIODevice::bytesAvailable(); }
+
+    // Daemon side
+    QByteArray takeWritten() {
+        QByteArray bytes;
+        bytes.swap(m_toDaemon);
+        return bytes;
+    }
+
+    void deliver(const QByteArray &bytes) {
+        m_toEngine.append(bytes);
+        emit readyRead();
+    }
+
+signals:
+    void written();     // Bytes are waiting in takeWritten()
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override {
+        qint64 n = qMin<qint64>(maxSize, m_toEngine.size());
+        memcpy(data, m_toEngine.constData(), n);
+        m_toEngine.remove(0, n);
+        return n;
+    }
+
+    qint64 writeData(const char *data, qint64 size) override {
+        bool wasEmpty = m_toDaemon.isEmpty();
+        m_toDaemon.append(data, size);
+        if (wasEmpty) emit written();
+        return size;
+    }
+
+private:
+    QByteArray m_toDaemon;
+    QByteArray m_toEngine;
+};
+
+// ============================================================================
+// Loopback Transport - the fake daemon
+// ============================================================================
+//
+// Speaks the daemon side of the TCP protocol: "ready" (with a "machines"
+// list when it offers more than one), hello with protocol 2 and machine IDs,
+// notify/update as JSON or binary frames, and a "stats" event per machine
+// once a second. A BLE client "connects" to every machine as soon as the
+// engine has said hello (or after HELLO_WAIT_MS for engines that never do),
+// so wait-ble scenarios run unchanged.
+//
+// Notifications are counted as sent by BLE the moment they are parsed;
+// there is no radio, no coalescing and no queue. bytesWritten() fires once
+// the daemon has parsed the bytes, which is the "delivered" point engines
+// measure latency to. Timed notifications are acked after every batch, with
+// the BLE stage reduced to the time spent parsing the rest of the batch.
+
+class LoopbackTransport : public Transport {
+    Q_OBJECT
+
+public:
+    static constexpr int HELLO_WAIT_MS = 500;
+    static constexpr int STATS_INTERVAL_MS = 1000;
+
+    explicit LoopbackTransport(int machines, QObject *parent = nullptr)
+        : Transport(parent), m_machines(qBound(1, machines, 256)) {
+        m_device = new LoopbackDevice(this);
+        connect(m_device, &QIODevice::readyRead, this, &Transport::readyRead);
+        connect(m_device, &LoopbackDevice::written, this, [this]() {
+            // Queued, so parsing happens on a later pass, as with a real peer
+            QMetaObject::invokeMethod(this, &LoopbackTransport::processWritten, Qt::QueuedConnection);
+        });
+
+        m_helloTimer = new QTimer(this);
+        m_helloTimer->setSingleShot(true);
+        m_helloTimer->setInterval(HELLO_WAIT_MS);
+        connect(m_helloTimer, &QTimer::timeout, this, &LoopbackTransport::connectClients);
+
+        m_statsTimer = new QTimer(this);
+        m_statsTimer->setInterval(STATS_INTERVAL_MS);
+        connect(m_statsTimer, &QTimer::timeout, this, &LoopbackTransport::sendStats);
+
+        m_clock.start();
+    }
+
+    bool isLoopback() const override { return true; }
+    bool isOpen() const override { return m_open; }
+    bool isIdle() const override { return !m_open && !m_opening; }
+    QIODevice *device() override { return m_device; }
+    QString errorString() const override { return QString(); }
+
+    void open(const QString &host, int port) override {
+        Q_UNUSED(host);
+        Q_UNUSED(port);
+        if (!isIdle()) return;
+
+        m_opening = true;
+        QTimer::singleShot(0, this, [this]() {
+            if (!m_opening) return;
+            m_opening = false;
+            m_open = true;
+            m_device->open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+            m_buffer.clear();
+            m_machineIds = false;
+            m_timing = false;
+            m_clientsConnected = false;
+            m_stats.clear();
+            m_acks.clear();
+            emit connected();
+            sendReady();
+        });
+    }
+
+    void close() override {
+        m_opening = false;
+        if (!m_open) return;
+
+        m_open = false;
+        m_helloTimer->stop();
+        m_statsTimer->stop();
+        m_device->takeWritten();
+        m_device->close();
+        emit disconnected();
+    }
+
+private:
+    struct NotifyCount { qint64 sent = 0; };
+
+    void sendReady() {
+        QJsonObject ready{{"event", "ready"}, {"version", "loopback"}, {"protocol", Wire::PROTOCOL_BINARY},
+                          {"timing", true}, {"heartbeat", true}};
+        if (m_machines > 1) {
+            QJsonArray machines;
+            for (int id = 0; id < m_machines; id++) {
+                machines.append(QJsonObject{{"id", id}, {"name", QString("DE1-SIM%1").arg(id)}});
+            }
+            ready["machines"] = machines;
+        }
+        sendEvent(ready, -1);
+        m_helloTimer->start();
+        m_statsTimer->start();
+    }
+
+    // Untagged events belong to the first machine, as with the real daemon
+    void sendEvent(QJsonObject event, int machine) {
+        if (m_machineIds && machine >= 0) event["machine"] = machine;
+        m_device->deliver(QJsonDocument(event).toJson(QJsonDocument::Compact) + "\n");
+    }
+
+    void connectClients() {
+        m_helloTimer->stop();
+        if (m_clientsConnected) return;
+        m_clientsConnected = true;
+
+        int clients = m_machineIds ? m_machines : 1;
+        for (int id = 0; id < clients; id++) {
+            sendEvent(QJsonObject{{"event", "connected"}, {"client", "loopback"}}, id);
+        }
+    }
+
+    void processWritten() {
+        if (!m_open) return;
+
+        QByteArray bytes = m_device->takeWritten();
+        if (bytes.isEmpty()) return;
+        m_buffer.append(bytes);
+        qint64 receivedUs = m_clock.nsecsElapsed() / 1000;
+
+        Wire::Message msg;
+        while (m_buffer.next(msg)) {
+            if (msg.binary) {
+                if (msg.type == Wire::FrameNotify) {
+                    countNotify(msg.machine, msg.charId);
+                    if (msg.timed) queueAck(msg.machine, msg.timing.seq, msg.timing.sentUs, receivedUs);
+                }
+                continue;
+            }
+
+            QJsonObject cmd = QJsonDocument::fromJson(
+                QByteArray::fromRawData(msg.payload.data(), msg.payload.size())).object();
+            QString action = cmd["cmd"].toString();
+            if (action == "hello") {
+                m_machineIds = m_machines > 1 && cmd["machine_ids"].toBool();
+                m_timing = cmd["timing"].toBool();
+                connectClients();
+            } else if (action == "ping") {
+                sendEvent(QJsonObject{{"event", "pong"}, {"seq", cmd["seq"]}, {"t", cmd["t"]}}, -1);
+            } else if (action == "notify") {
+                int machine = cmd.contains("machine") ? cmd["machine"].toInt() : -1;
+                countNotify(machine, Wire::charIdFromString(cmd["char"].toString()));
+                if (cmd.contains("seq")) {
+                    queueAck(machine, static_cast<quint16>(cmd["seq"].toInt()),
+                             static_cast<quint32>(cmd["t"].toInteger()), receivedUs);
+                }
+            }
+        }
+        m_buffer.compact();
+
+        emit bytesWritten(bytes.size());
+        sendAcks();
+    }
+
+    // Same element layout as the daemon's "timing" event
+    void queueAck(int machine, quint16 seq, quint32 sentUs, qint64 receivedUs) {
+        if (!m_timing) return;
+        qint64 parsedUs = m_clock.nsecsElapsed() / 1000;
+        // ble_us holds the parse time until sendAcks()
+        m_acks[(machine < 0 || !m_machineIds) ? 0 : machine].append(
+            QJsonArray{seq, qint64(sentUs), parsedUs - receivedUs, parsedUs, 0});
+    }
+
+    void sendAcks() {
+        if (m_acks.isEmpty()) return;
+
+        // Everything in the batch is "written" once the whole batch is parsed
+        qint64 writtenUs = m_clock.nsecsElapsed() / 1000;
+        for (auto it = m_acks.constBegin(); it != m_acks.constEnd(); ++it) {
+            QJsonArray acks;
+            for (QJsonArray ack : *it) {
+                ack[3] = writtenUs - ack[3].toInteger();
+                acks.append(ack);
+            }
+            sendEvent(QJsonObject{{"event", "timing"}, {"acks", acks}}, it.key());
+        }
+        m_acks.clear();
+    }
+
+    void countNotify(int machine, quint16 charId) {
+        int id = (machine < 0 || !m_machineIds) ? 0 : machine;
+        m_stats[id][charId].sent++;
+        m_statsDirty = true;
+    }
+
+    // Same shape as the daemon's "stats" event
+    void sendStats() {
+        if (!m_statsDirty) return;
+        m_statsDirty = false;
+
+        for (auto it = m_stats.constBegin(); it != m_stats.constEnd(); ++it) {
+            QJsonObject perChar;
+            for (auto c = it->constBegin(); c != it->constEnd(); ++c) {
+                perChar[Wire::charIdToString(c.key())] = QJsonObject{
+                    {"sent", c->sent}, {"coalesced", 0}, {"dropped", 0}};
+            }
+            sendEvent(QJsonObject{{"event", "stats"}, {"interval_ms", STATS_INTERVAL_MS},
+                                  {"queued", 0}, {"loop_lag_ms", 0}, {"notify", perChar}}, it.key());
+        }
+    }
+
+    int m_machines = 1;
+    LoopbackDevice *m_device = nullptr;
+    Wire::StreamBuffer m_buffer;
+    bool m_opening = false;
+    bool m_open = false;
+    bool m_machineIds = false;
+    bool m_timing = false;
+    bool m_clientsConnected = false;
+
+    QTimer *m_helloTimer = nullptr;
+    QTimer *m_statsTimer = nullptr;
+    QHash<int, QHash<quint16, NotifyCount>> m_stats;    // Machine -> characteristic -> counters
+    bool m_statsDirty = false;
+
+    QElapsedTimer m_clock;
+    QMap<int, QVector<QJsonArray>> m_acks;  // Machine -> acks for this batch
+};
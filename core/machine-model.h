@@ -0,0 +1,78 @@
+/*
+ * Machine model - operation phases, the daemon's static answers and profile
+ * uploads, shared by SimulationEngine and FleetEngine so a fleet machine
+ * behaves like the GUI's one
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QJsonObject>
+
+#include "de1-protocol.h"
+#include "mmr-registers.h"
+#include "profile.h"
+
+namespace MachineModel {
+
+// ============================================================================
+// Operation Phases
+// ============================================================================
+//
+// Every operation starts with one timed phase. Espresso heats for a moment
+// and then runs the profile; the others pour for a fixed time and end Idle.
+// After the profile, espresso spends ENDING_S in Ending.
+
+constexpr double ENDING_S = 2.0;
+constexpr int MAX_CATCHUP_STEPS = 100;      // Physics steps replayed after a stall
+
+struct Phase {
+    DE1::SubState subState = DE1::SubState::Pouring;
+    double seconds = 0.0;                   // Sim time
+};
+
+// False if state isn't an operation the app or a scenario can start
+inline bool firstPhase(DE1::State state, Phase &phase) {
+    switch (state) {
+    case DE1::State::Espresso:      phase = {DE1::SubState::Heating, 2.0}; return true;
+    case DE1::State::Steam:         phase = {DE1::SubState::Steaming, 45.0}; return true;
+    case DE1::State::HotWater:      phase = {DE1::SubState::Pouring, 30.0}; return true;
+    case DE1::State::HotWaterRinse: phase = {DE1::SubState::Pouring, 10.0}; return true;
+    default:                        return false;
+    }
+}
+
+// ============================================================================
+// Static Answers
+// ============================================================================
+//
+// Everything a daemon can answer without the engine: the MMR registers
+// (GHC_INFO following the GHC status) and, unless shotSettings is empty,
+// VERSION and SHOT_SETTINGS. The caller adds "machine" on tagged links.
+
+inline QJsonObject staticAnswers(MmrRegisterFile &mmr, int ghcStatus, const QByteArray &shotSettings) {
+    mmr.write(DE1::MMR::GHC_INFO, static_cast<uint32_t>(ghcStatus));
+
+    QJsonObject cmd;
+    cmd["cmd"] = "answers";
+    cmd["mmr"] = mmr.toJson()["registers"];
+    if (!shotSettings.isEmpty()) {
+        cmd["chars"] = QJsonObject{
+            {DE1::CHAR_VERSION, QString(DE1::versionValue().toHex())},
+            {DE1::CHAR_SHOT_SETTINGS, QString(shotSettings.toHex())}};
+    }
+    return cmd;
+}
+
+// ============================================================================
+// Profile Uploads
+// ============================================================================
+
+// True when this FRAME_WRITE finished the upload, so its plan is due: the
+// tail, or an extension written after it
+inline bool uploadFinished(const ProfileUpload &upload, ProfileUpload::Result result) {
+    return result == ProfileUpload::Tail
+        || (result == ProfileUpload::Extension && !upload.inProgress());
+}
+
+} // namespace MachineModel
@@ -0,0 +1,112 @@
+#include "mmr-registers.h"
+#include "de1-protocol.h"
+
+#include <QJsonDocument>
+
+#include <algorithm>
+
+void MmrRegisterFile::reset() {
+    m_words.clear();
+    write(DE1::MMR::MACHINE_MODEL, 2);      // DE1Plus
+    write(DE1::MMR::FIRMWARE_VERSION, 1);
+    write(DE1::MMR::GHC_INFO, 3);           // Overridden by the engine's GHC status
+    write(DE1::MMR::USB_CHARGER, 1);        // On
+}
+
+QVector<QByteArray> MmrRegisterFile::readResponses(const QByteArray &request) const {
+    QVector<QByteArray> responses;
+    if (request.size() < 4) return responses;
+
+    const uint8_t *d = reinterpret_cast<const uint8_t*>(request.constData());
+    int words = d[0] + 1;
+    uint32_t address = BinaryCodec::decodeAddress(d + 1) & ~3u;
+
+    for (int done = 0; done < words; done += WORDS_PER_NOTIFICATION) {
+        int n = std::min(WORDS_PER_NOTIFICATION, words - done);
+        uint32_t chunkAddress = address + done * 4;
+
+        QByteArray response(4 + n * 4, 0);
+        uint8_t *out = reinterpret_cast<uint8_t*>(response.data());
+        BinaryCodec::encodeUint32BE(chunkAddress, out);
+        out[0] = static_cast<uint8_t>(n - 1);
+        for (int w = 0; w < n; w++) {
+            uint32_t value = read(chunkAddress + w * 4);
+            for (int b = 0; b < 4; b++) out[4 + w * 4 + b] = (value >> (8 * b)) & 0xFF;
+        }
+        responses.append(response);
+    }
+    return responses;
+}
+
+int MmrRegisterFile::applyWrite(const QByteArray &request, uint32_t *address) {
+    if (request.size() < 8) return 0;
+
+    const uint8_t *d = reinterpret_cast<const uint8_t*>(request.constData());
+    int words = std::min<int>(d[0] + 1, (request.size() - 4) / 4);
+    uint32_t start = BinaryCodec::decodeAddress(d + 1) & ~3u;
+
+    for (int w = 0; w < words; w++) {
+        const uint8_t *v = d + 4 + w * 4;
+        write(start + w * 4, uint32_t(v[0]) | (uint32_t(v[1]) << 8) | (uint32_t(v[2]) << 16) | (uint32_t(v[3]) << 24));
+    }
+    if (address) *address = start;
+    return words;
+}
+
+static bool parseNumber(const QJsonValue &value, uint32_t *out) {
+    if (value.isDouble()) {
+        double d = value.toDouble();
+        if (d < 0 || d > 0xFFFFFFFFu) return false;
+        *out = static_cast<uint32_t>(d);
+        return true;
+    }
+    if (value.isString()) {
+        QString s = value.toString().trimmed();
+        bool ok = false;
+        *out = s.startsWith("0x", Qt::CaseInsensitive) ? s.mid(2).toUInt(&ok, 16) : s.toUInt(&ok, 10);
+        return ok;
+    }
+    return false;
+}
+
+bool MmrRegisterFile::loadJson(const QByteArray &json, QString *error) {
+    QJsonParseError err;
+    QJsonDocument doc = QJsonDocument::fromJson(json, &err);
+    if (!doc.isObject()) {
+        if (error) *error = err.error != QJsonParseError::NoError ? err.errorString() : "Not a JSON object";
+        return false;
+    }
+
+    QJsonObject registers = doc.object();
+    if (registers.contains("registers")) registers = registers["registers"].toObject();
+
+    QHash<uint32_t, uint32_t> parsed;
+    for (auto it = registers.begin(); it != registers.end(); ++it) {
+        QString key = it.key().trimmed();
+        if (key.startsWith("0x", Qt::CaseInsensitive)) key = key.mid(2);
+
+        bool ok = false;
+        uint32_t address = key.toUInt(&ok, 16);
+        uint32_t value = 0;
+        if (!ok || address > 0xFFFFFF || !parseNumber(it.value(), &value)) {
+            if (error) *error = QString("Bad register entry \"%1\"").arg(it.key());
+            return false;
+        }
+        parsed.insert(address & ~3u, value);
+    }
+
+    for (auto it = parsed.constBegin(); it != parsed.constEnd(); ++it) m_words.insert(it.key(), it.value());
+    return true;
+}
+
+QJsonObject MmrRegisterFile::toJson() const {
+    QList<uint32_t> addresses = m_words.keys();
+    std::sort(addresses.begin(), addresses.end());
+
+    QJsonObject registers;
+    for (uint32_t address : addresses) {
+        QString key = "0x" + QString("%1").arg(address, 6, 16, QChar('0')).toUpper();
+        registers[key] = "0x" + QString("%1").arg(m_words.value(address), 8, 16, QChar('0')).toUpper();
+    }
+    return QJsonObject{{"registers", registers}};
+}
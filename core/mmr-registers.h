@@ -0,0 +1,63 @@
+/*
+ * DE1 MMR register file - the memory-mapped registers apps read and write
+ * through READ_FROM_MMR / WRITE_TO_MMR
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+#include <cstdint>
+
+// ============================================================================
+// MMR Register File
+// ============================================================================
+//
+// Sparse map of 32-bit words keyed by their 24-bit byte address; anything
+// never written reads as 0, like unused registers on the machine. Requests
+// and responses use the firmware layout:
+//
+//   [len u8][address u24 BE][data: len + 1 words, little-endian]
+//
+// A read of more words than fit in one 20-byte notification is answered
+// with several, each for the next 4 words.
+//
+// JSON dumps map addresses (hex strings, "0x" optional) to values (numbers
+// or hex strings), optionally inside a "registers" object:
+//
+//   {"registers": {"0x80000C": 2, "0x800010": "0x00010000"}}
+
+class MmrRegisterFile {
+public:
+    static constexpr int WORDS_PER_NOTIFICATION = 4;
+
+    MmrRegisterFile() { reset(); }
+
+    // Back to the power-on values the simulator reports
+    void reset();
+
+    uint32_t read(uint32_t address) const { return m_words.value(address & ~3u, 0); }
+    void write(uint32_t address, uint32_t value) { m_words.insert(address & ~3u, value); }
+
+    // Notification payloads answering a READ_FROM_MMR write; empty if the
+    // request is malformed
+    QVector<QByteArray> readResponses(const QByteArray &request) const;
+
+    // Stores a WRITE_TO_MMR payload. Returns the number of words written
+    // (0 if malformed); *address gets the first one.
+    int applyWrite(const QByteArray &request, uint32_t *address = nullptr);
+
+    // Merges a dump over the current values. Returns false with *error set
+    // if it isn't a register dump; nothing is changed then.
+    bool loadJson(const QByteArray &json, QString *error = nullptr);
+    QJsonObject toJson() const;
+
+    int size() const { return m_words.size(); }
+
+private:
+    QHash<uint32_t, uint32_t> m_words;
+};
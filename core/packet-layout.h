@@ -0,0 +1,158 @@
+/*
+ * Packet layouts - characteristic payloads described once as a list of
+ * fields, with the encoder and decoder generated from that list
+ */
+
+#pragma once
+
+#include <QtGlobal>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// ============================================================================
+// Wire Types
+// ============================================================================
+//
+// Each wire type knows its size in bytes and how to turn a struct member
+// into bytes and back. Multi-byte values are big-endian, like everything
+// the DE1 sends outside the MMR registers.
+
+namespace Packet {
+
+// Unsigned fixed point: stored = value * Scale, truncated and saturated to
+// the field width. Integer and enum members are stored as they are.
+template <int Bytes, uint32_t Scale>
+struct UScaled {
+    static_assert(Bytes >= 1 && Bytes <= 3, "UScaled fields are 1-3 bytes");
+
+    static constexpr int size = Bytes;
+    static constexpr uint32_t maxRaw = (1u << (8 * Bytes)) - 1;
+
+    template <typename T>
+    static void encode(T value, uint8_t *d) {
+        uint32_t raw;
+        if constexpr (std::is_floating_point_v<T>) {
+            raw = static_cast<uint32_t>(qBound(0.0, double(value) * Scale, double(maxRaw)));
+        } else {
+            raw = static_cast<uint32_t>(value) & maxRaw;
+        }
+        for (int i = 0; i < Bytes; i++) d[i] = static_cast<uint8_t>(raw >> (8 * (Bytes - 1 - i)));
+    }
+
+    template <typename T>
+    static T decode(const uint8_t *d) {
+        uint32_t raw = 0;
+        for (int i = 0; i < Bytes; i++) raw = (raw << 8) | d[i];
+        if constexpr (std::is_floating_point_v<T>) {
+            return static_cast<T>(double(raw) / Scale);
+        } else {
+            return static_cast<T>(raw);
+        }
+    }
+};
+
+using U8     = UScaled<1, 1>;
+using U16    = UScaled<2, 1>;
+using U8P1   = UScaled<1, 2>;
+using U8P4   = UScaled<1, 16>;
+using U16P8  = UScaled<2, 256>;
+using U16P12 = UScaled<2, 4096>;
+using U24P16 = UScaled<3, 65536>;
+using U16C   = UScaled<2, 100>;         // Hundredths (SHOT_SAMPLE timer)
+
+// Low 10 bits of a 16-bit word; the upper bits are flags nobody sets
+struct U10P0 {
+    static constexpr int size = 2;
+
+    template <typename T>
+    static void encode(T value, uint8_t *d) { U16::encode(static_cast<uint32_t>(value) & 0x3FF, d); }
+
+    template <typename T>
+    static T decode(const uint8_t *d) { return static_cast<T>(U16::decode<uint32_t>(d) & 0x3FF); }
+};
+
+// Durations: tenths of a second below 12.8 s, whole seconds (bit 7 set) above
+struct F8_1_7 {
+    static constexpr int size = 1;
+
+    template <typename T>
+    static void encode(T value, uint8_t *d) {
+        double v = qMax(0.0, double(value));
+        d[0] = v < 12.75 ? static_cast<uint8_t>(std::lround(v * 10.0))
+                         : static_cast<uint8_t>(0x80 | qMin(127L, std::lround(v)));
+    }
+
+    template <typename T>
+    static T decode(const uint8_t *d) {
+        return static_cast<T>((d[0] & 0x80) ? (d[0] & 0x7F) : d[0] / 10.0);
+    }
+};
+
+// ============================================================================
+// Fields and Layouts
+// ============================================================================
+
+// One struct member at the next offset, in wire type Wire
+template <typename Wire, auto Member>
+struct Field {
+    static constexpr int size = Wire::size;
+
+    template <typename S>
+    static void encode(const S &s, uint8_t *d) { Wire::encode(s.*Member, d); }
+
+    template <typename S>
+    static void decode(const uint8_t *d, S &s) {
+        using T = std::remove_cv_t<std::remove_reference_t<decltype(s.*Member)>>;
+        s.*Member = Wire::template decode<T>(d);
+    }
+};
+
+// Bytes nobody reads; encoded as zeros
+template <int Bytes>
+struct Pad {
+    static constexpr int size = Bytes;
+
+    template <typename S>
+    static void encode(const S &, uint8_t *d) { memset(d, 0, Bytes); }
+
+    template <typename S>
+    static void decode(const uint8_t *, S &) {}
+};
+
+// Fields back to back from offset 0. Offsets are compile-time constants,
+// so encode()/decode() inline to the same stores as hand-written code.
+template <typename Struct, typename... Fields>
+struct Layout {
+    static constexpr int size = (Fields::size + ...);
+
+    template <int I>
+    static constexpr int offset() {
+        static_assert(I >= 0 && I < int(sizeof...(Fields)), "No such field");
+        constexpr int sizes[] = {Fields::size...};
+        int o = 0;
+        for (int i = 0; i < I; i++) o += sizes[i];
+        return o;
+    }
+
+    static void encode(const Struct &s, uint8_t *d) {
+        int o = 0;
+        ((Fields::encode(s, d + o), o += Fields::size), ...);
+    }
+
+    static void decode(const uint8_t *d, Struct &s) {
+        int o = 0;
+        ((Fields::decode(d + o, s), o += Fields::size), ...);
+    }
+
+    // False (and s untouched) if fewer than size bytes arrived
+    static bool decode(const uint8_t *d, int len, Struct &s) {
+        if (len < size) return false;
+        decode(d, s);
+        return true;
+    }
+};
+
+} // namespace Packet
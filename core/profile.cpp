@@ -0,0 +1,191 @@
+#include "profile.h"
+#include "de1-protocol.h"
+
+#include <QCryptographicHash>
+
+#include <cstring>
+#include <limits>
+
+// Frames the app never wrote stay zeroed: duration 0, so they exit on
+// their first step, like on the machine
+ProfilePlan ProfilePlan::compile(const ProfileHeader &header, const QVector<ProfileFrame> &frames) {
+    constexpr float unlimited = std::numeric_limits<float>::infinity();
+
+    ProfilePlan plan;
+    plan.preinfuseSteps = header.numPreinfuseFrames;
+    plan.steps.reserve(frames.size());
+
+    for (int i = 0; i < frames.size(); i++) {
+        const ProfileFrame &f = frames[i];
+        PlanStep s;
+
+        bool flowMode = f.flags & ProfileFlags::CtrlFlow;
+        bool useLimits = !(f.flags & ProfileFlags::IgnoreLimit);
+
+        s.pump = flowMode ? PlanStep::PumpFlow : PlanStep::PumpPressure;
+        s.target = f.setVal;
+        s.duration = f.duration;
+        s.temp = f.temp;
+        s.maxVolume = f.maxVol > 0 ? static_cast<float>(f.maxVol) : unlimited;
+
+        if (f.flags & ProfileFlags::DoCompare) {
+            bool gt = f.flags & ProfileFlags::CompareGT;
+            if (f.flags & ProfileFlags::CompareFlow) {
+                s.exit = gt ? PlanStep::ExitFlowAbove : PlanStep::ExitFlowBelow;
+            } else {
+                s.exit = gt ? PlanStep::ExitPressureAbove : PlanStep::ExitPressureBelow;
+            }
+            s.trigger = f.triggerVal;
+        }
+
+        // A zero range is a hard limit; a tiny range gives the same result
+        // without a special case in softLimit()
+        if (f.hasExtension && f.limiterValue > 0) {
+            s.limitRange = qMax(f.limiterRange, 0.001);
+            s.limitKnee = f.limiterValue - s.limitRange;
+        } else {
+            s.limitKnee = unlimited;
+            s.limitRange = 1.0f;
+        }
+
+        if (flowMode) {
+            s.headerLimit = useLimits ? header.minPressure : 0.0;
+        } else {
+            s.headerLimit = (useLimits && header.maxFlow > 0) ? header.maxFlow : ProfileExecutor::PUMP_MAX_FLOW;
+        }
+
+        if ((f.flags & ProfileFlags::Interpolate) && f.duration > 0) {
+            if (i > 0 && plan.steps[i - 1].pump == s.pump) {
+                s.ramp = PlanStep::RampFromPrevious;
+                s.rampFrom = plan.steps[i - 1].target;
+                s.rampSlope = (s.target - s.rampFrom) / s.duration;
+            } else {
+                s.ramp = PlanStep::RampFromMeasured;
+            }
+        }
+
+        plan.steps.append(s);
+    }
+    return plan;
+}
+
+ProfileUpload::Result ProfileUpload::writeHeader(const QByteArray &value) {
+    if (!HeaderLayout::decode(reinterpret_cast<const uint8_t*>(value.constData()), value.size(), m_header)) {
+        return Invalid;
+    }
+
+    m_key = value.left(HeaderLayout::size);
+    m_key.append(m_header.numFrames * KEY_FRAME_BYTES + FrameLayout::size, '\0');
+    m_frames.clear();
+    m_framesDecoded = false;
+    m_inProgress = true;
+    return Header;
+}
+
+// Index 32 and up is the extension frame (limiter) for frame index - 32;
+// index numFrames is the tail that ends the upload. Only the key is
+// written here, see frames().
+ProfileUpload::Result ProfileUpload::writeFrame(const QByteArray &value, int *index) {
+    if (value.size() < FrameLayout::size) return Invalid;
+
+    const uint8_t* d = reinterpret_cast<const uint8_t*>(value.constData());
+    int frameIdx = d[0];
+    bool extension = frameIdx >= 32;
+    if (extension) frameIdx -= 32;
+    if (index) *index = frameIdx;
+    if (m_key.isEmpty()) return NoHeader;
+
+    if (!extension && frameIdx == m_header.numFrames) {
+        memcpy(m_key.data() + m_key.size() - FrameLayout::size, d, FrameLayout::size);
+        m_inProgress = false;
+        return Tail;
+    }
+    if (frameIdx >= m_header.numFrames) return OutOfRange;
+
+    int offset = HeaderLayout::size + frameIdx * KEY_FRAME_BYTES + (extension ? FrameLayout::size : 0);
+    memcpy(m_key.data() + offset, d, FrameLayout::size);
+    m_framesDecoded = false;
+    return extension ? Extension : Frame;
+}
+
+// A frame never written is all zeros, and so is its extension slot until
+// one is written (whose first byte is then 32 + index)
+ProfileFrame ProfileUpload::frame(int index) const {
+    ProfileFrame frame;
+    if (index < 0 || index >= m_header.numFrames || m_key.isEmpty()) return frame;
+
+    const uint8_t* d = reinterpret_cast<const uint8_t*>(m_key.constData())
+                     + HeaderLayout::size + index * KEY_FRAME_BYTES;
+    FrameLayout::decode(d, frame);
+    if (d[FrameLayout::size] != 0) {
+        frame.hasExtension = true;
+        ExtensionFrameLayout::decode(d + FrameLayout::size, frame);
+    }
+    return frame;
+}
+
+const QVector<ProfileFrame> &ProfileUpload::frames() const {
+    if (!m_framesDecoded) {
+        int count = m_key.isEmpty() ? 0 : m_header.numFrames;
+        m_frames.resize(count);
+        for (int i = 0; i < count; i++) m_frames[i] = frame(i);
+        m_framesDecoded = true;
+    }
+    return m_frames;
+}
+
+void ProfileUpload::restore(const ProfileHeader &header, const QVector<ProfileFrame> &frames,
+                            const QByteArray &key) {
+    m_header = header;
+    m_frames = frames;
+    m_framesDecoded = true;
+    m_key = key;
+    m_inProgress = false;
+}
+
+// === Cache ===
+
+QString ProfileCache::idForKey(const QByteArray &key) {
+    return QString::fromLatin1(QCryptographicHash::hash(key, QCryptographicHash::Sha1).left(4).toHex());
+}
+
+void ProfileCache::use(int index) {
+    if (index > 0) m_entries.move(index, 0);
+}
+
+// Only a miss decodes the upload's frames
+ProfileCache::Entry ProfileCache::add(const ProfileUpload &upload, bool *hit) {
+    const QByteArray &key = upload.key();
+    for (int i = 0; i < m_entries.size(); i++) {
+        if (m_entries[i].key == key) {
+            m_hits++;
+            if (hit) *hit = true;
+            use(i);
+            return m_entries.first();
+        }
+    }
+
+    m_misses++;
+    if (hit) *hit = false;
+    Entry entry;
+    entry.id = idForKey(key);
+    entry.key = key;
+    entry.header = upload.header();
+    entry.frames = upload.frames();
+    entry.plan = ProfilePlan::compile(upload.header(), upload.frames());
+
+    m_entries.prepend(entry);
+    if (m_entries.size() > CAPACITY) m_entries.removeLast();
+    return entry;
+}
+
+bool ProfileCache::find(const QString &id, Entry &entry) {
+    for (int i = 0; i < m_entries.size(); i++) {
+        if (m_entries[i].id.compare(id, Qt::CaseInsensitive) == 0) {
+            use(i);
+            entry = m_entries.first();
+            return true;
+        }
+    }
+    return false;
+}
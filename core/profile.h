@@ -0,0 +1,440 @@
+/*
+ * DE1 profiles - uploaded header/frame structures, the compiled execution
+ * plan and the executor that runs it against a simple puck model
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include <cmath>
+#include <cstdint>
+
+#include "packet-layout.h"
+
+// ============================================================================
+// Profile Frame Structure
+// ============================================================================
+
+// Frame flag bits, as defined by the DE1 firmware
+namespace ProfileFlags {
+constexpr uint8_t CtrlFlow    = 0x01;   // Flow pump mode (else pressure)
+constexpr uint8_t DoCompare   = 0x02;   // Frame has an exit condition
+constexpr uint8_t CompareGT   = 0x04;   // Exit when value > trigger (else <)
+constexpr uint8_t CompareFlow = 0x08;   // Compare flow (else pressure)
+constexpr uint8_t MixTemp     = 0x10;   // Temperature is water, not coffee
+constexpr uint8_t Interpolate = 0x20;   // Smooth transition (else fast)
+constexpr uint8_t IgnoreLimit = 0x40;   // Ignore header minPressure/maxFlow
+}
+
+struct ProfileFrame {
+    int frameIndex = 0;
+    uint8_t flags = 0;
+    double setVal = 0;
+    double temp = 0;
+    double duration = 0;
+    double triggerVal = 0;
+    uint16_t maxVol = 0;
+    bool hasExtension = false;
+    double limiterValue = 0;
+    double limiterRange = 0;
+
+    QString pumpMode() const { return (flags & ProfileFlags::CtrlFlow) ? "Flow" : "Pressure"; }
+    QString sensor() const { return (flags & ProfileFlags::MixTemp) ? "Water" : "Coffee"; }
+    QString transition() const { return (flags & ProfileFlags::Interpolate) ? "Smooth" : "Fast"; }
+    bool hasExitCondition() const { return flags & ProfileFlags::DoCompare; }
+    QString exitType() const {
+        if (!(flags & ProfileFlags::DoCompare)) return "None";
+        QString compareWhat = (flags & ProfileFlags::CompareFlow) ? "Flow" : "Pressure";
+        QString compareHow = (flags & ProfileFlags::CompareGT) ? ">" : "<";
+        return QString("%1 %2 %3").arg(compareWhat).arg(compareHow).arg(triggerVal, 0, 'f', 1);
+    }
+
+    QString toString() const {
+        QString s = QString("Frame %1: %2 %3, %4C, %5s")
+            .arg(frameIndex)
+            .arg(pumpMode())
+            .arg(setVal, 0, 'f', 1)
+            .arg(temp, 0, 'f', 1)
+            .arg(duration, 0, 'f', 1);
+        if (maxVol > 0) s += QString(", max %1mL").arg(maxVol);
+        if (hasExitCondition()) s += QString(", exit: %1").arg(exitType());
+        if (hasExtension) s += QString(" [Limiter: %1/%2]").arg(limiterValue, 0, 'f', 1).arg(limiterRange, 0, 'f', 1);
+        return s;
+    }
+};
+
+// FRAME_WRITE, one of three kinds told apart by byte 0: a frame, an
+// extension frame (32 + frame index; the caller owns byte 0) or the tail
+using FrameLayout = Packet::Layout<ProfileFrame,
+    Packet::Field<Packet::U8,     &ProfileFrame::frameIndex>,
+    Packet::Field<Packet::U8,     &ProfileFrame::flags>,
+    Packet::Field<Packet::U8P4,   &ProfileFrame::setVal>,
+    Packet::Field<Packet::U8P1,   &ProfileFrame::temp>,
+    Packet::Field<Packet::F8_1_7, &ProfileFrame::duration>,
+    Packet::Field<Packet::U8P4,   &ProfileFrame::triggerVal>,
+    Packet::Field<Packet::U10P0,  &ProfileFrame::maxVol>>;
+
+using ExtensionFrameLayout = Packet::Layout<ProfileFrame,
+    Packet::Pad<1>,
+    Packet::Field<Packet::U8P4, &ProfileFrame::limiterValue>,
+    Packet::Field<Packet::U8P4, &ProfileFrame::limiterRange>,
+    Packet::Pad<5>>;
+
+static_assert(FrameLayout::size == 8 && ExtensionFrameLayout::size == 8, "FRAME_WRITE is 8 bytes");
+
+struct ProfileHeader {
+    uint8_t headerV = 0;
+    uint8_t numFrames = 0;
+    uint8_t numPreinfuseFrames = 0;
+    double minPressure = 0;
+    double maxFlow = 0;
+
+    QString toString() const {
+        return QString("Header: v%1, %2 frames (%3 preinfuse), minP=%4 bar, maxF=%5 mL/s")
+            .arg(headerV).arg(numFrames).arg(numPreinfuseFrames)
+            .arg(minPressure, 0, 'f', 1).arg(maxFlow, 0, 'f', 1);
+    }
+};
+
+using HeaderLayout = Packet::Layout<ProfileHeader,
+    Packet::Field<Packet::U8,   &ProfileHeader::headerV>,
+    Packet::Field<Packet::U8,   &ProfileHeader::numFrames>,
+    Packet::Field<Packet::U8,   &ProfileHeader::numPreinfuseFrames>,
+    Packet::Field<Packet::U8P4, &ProfileHeader::minPressure>,
+    Packet::Field<Packet::U8P4, &ProfileHeader::maxFlow>>;
+
+// Header and frame writes from the app. Frames are only stored as the bytes
+// written; they are decoded into ProfileFrame when first asked for, so an
+// upload that the ProfileCache already knows never gets decoded at all. The
+// caller compiles a plan when the tail frame arrives, or when an extension
+// frame amends an upload that is already complete. Frame writes before the
+// first header are ignored (NoHeader).
+class ProfileUpload {
+public:
+    enum Result { Invalid, Header, Frame, Extension, Tail, OutOfRange, NoHeader };
+
+    Result writeHeader(const QByteArray &value);
+    Result writeFrame(const QByteArray &value, int *index = nullptr);
+
+    const ProfileHeader &header() const { return m_header; }
+    const QVector<ProfileFrame> &frames() const;         // Decodes all of them once
+    ProfileFrame frame(int index) const;                 // Decodes just that one
+    bool inProgress() const { return m_inProgress; }     // Header seen, no tail yet
+
+    // The bytes written, as header, then frame and extension per frame,
+    // then the tail; anything not written is zero. Uploads with the same
+    // key compile to the same plan.
+    const QByteArray &key() const { return m_key; }
+
+    // A finished upload as if the app had just written it again
+    void restore(const ProfileHeader &header, const QVector<ProfileFrame> &frames, const QByteArray &key);
+
+private:
+    static constexpr int KEY_FRAME_BYTES = 2 * FrameLayout::size;
+
+    ProfileHeader m_header;
+    QByteArray m_key;                       // Empty until the first header
+    bool m_inProgress = false;
+    mutable QVector<ProfileFrame> m_frames; // Decoded from m_key by frames()
+    mutable bool m_framesDecoded = false;
+};
+
+// ============================================================================
+// Profile Executor - runs uploaded frames against a simple puck model
+// ============================================================================
+//
+// An uploaded profile is compiled once (on the tail frame) into a
+// ProfilePlan: flags are resolved into table indexes, limits are folded into
+// plain numbers and ramp slopes are precomputed, so a physics step is plain
+// arithmetic with no per-tick branching on frame flags.
+//
+// The executor is stepped at a fixed internal rate (STEP_S), independent of
+// how often SHOT_SAMPLE goes out, so frame timing and exit conditions behave
+// the same at 5 Hz and 50 Hz.
+
+struct PlanStep {
+    enum Pump : uint8_t { PumpPressure, PumpFlow, PumpCount };
+    enum Exit : uint8_t { ExitNone, ExitPressureAbove, ExitPressureBelow,
+                          ExitFlowAbove, ExitFlowBelow, ExitCount };
+    enum Ramp : uint8_t { RampFast, RampFromPrevious, RampFromMeasured };
+
+    // 32-bit floats keep a step in one cache line; the wire format only
+    // carries 1/16 resolution anyway
+    float target = 0;       // Pressure (bar) or flow (mL/s), depending on pump
+    float rampFrom = 0;     // RampFromPrevious: previous frame's target
+    float rampSlope = 0;    // RampFromPrevious: per second
+    float duration = 0;
+    float maxVolume = 0;    // Infinity when unlimited
+    float trigger = 0;
+    float limitKnee = 0;    // Limiter: soft limit starts here (infinity if none)
+    float limitRange = 0;
+    float headerLimit = 0;  // Pressure pump: max flow; flow pump: min pressure
+    float temp = 0;
+    uint8_t pump = PumpPressure;
+    uint8_t exit = ExitNone;
+    uint8_t ramp = RampFast;
+};
+
+struct ProfilePlan {
+    QVector<PlanStep> steps;
+    int preinfuseSteps = 0;
+
+    bool isEmpty() const { return steps.isEmpty(); }
+
+    static ProfilePlan compile(const ProfileHeader &header, const QVector<ProfileFrame> &frames);
+};
+
+class ProfileExecutor {
+public:
+    static constexpr double STEP_S = 0.01;          // 100 Hz physics step
+
+    // Puck model: pressure = resistance * flow. A dry puck has almost no
+    // resistance until the headspace is filled and the coffee is wetted,
+    // then it slowly erodes as the shot runs.
+    static constexpr double PUCK_RESISTANCE = 4.0;      // bar per mL/s when saturated
+    static constexpr double PUCK_DRY_FACTOR = 0.05;     // Fraction of it before any water
+    static constexpr double PUCK_WETTING_ML = 35.0;     // Headspace + absorption
+    static constexpr double PUCK_EROSION_PER_S = 0.008; // Resistance lost per second
+    static constexpr double PUCK_MIN_FACTOR = 0.4;
+
+    static constexpr double PUMP_TAU_S = 0.4;       // Pump response time constant
+    static constexpr double HEATER_TAU_S = 3.0;
+    static constexpr double ENDING_TAU_S = 0.3;     // Pressure release after the last frame
+    static constexpr double PUMP_MAX_PRESSURE = 12.0;
+    static constexpr double PUMP_MAX_FLOW = 8.0;
+
+    // Used when no profile has been uploaded: flow preinfusion until the
+    // puck builds pressure, then a 9 bar pour declining to 6 bar
+    static void defaultProfile(ProfileHeader &header, QVector<ProfileFrame> &frames) {
+        header = ProfileHeader();
+        header.headerV = 1;
+        header.numFrames = 3;
+        header.numPreinfuseFrames = 1;
+        header.maxFlow = 6.0;
+
+        frames.resize(3);
+        frames[0] = ProfileFrame();
+        frames[0].flags = ProfileFlags::CtrlFlow | ProfileFlags::DoCompare | ProfileFlags::CompareGT;
+        frames[0].setVal = 4.0;
+        frames[0].temp = 92.0;
+        frames[0].duration = 20.0;
+        frames[0].triggerVal = 4.0;
+
+        frames[1] = ProfileFrame();
+        frames[1].frameIndex = 1;
+        frames[1].setVal = 9.0;
+        frames[1].temp = 92.0;
+        frames[1].duration = 4.0;
+
+        frames[2] = ProfileFrame();
+        frames[2].frameIndex = 2;
+        frames[2].flags = ProfileFlags::Interpolate;
+        frames[2].setVal = 6.0;
+        frames[2].temp = 92.0;
+        frames[2].duration = 26.0;
+    }
+
+    void load(const ProfilePlan &plan) {
+        m_plan = plan;
+        m_running = false;
+    }
+
+    void start(double groupTemp) {
+        m_time = 0.0;
+        m_volume = 0.0;
+        m_pressure = 0.0;
+        m_flow = 0.0;
+        m_temperature = groupTemp;
+        m_running = true;
+        enterStep(0);
+    }
+
+    // Advances by one STEP_S. Returns false once the last frame has exited;
+    // after that it keeps releasing pressure with the pump off.
+    bool step() {
+        m_time += STEP_S;
+
+        if (!m_running) {
+            m_pressure -= m_pressure * STEP_S / ENDING_TAU_S;
+            m_flow -= m_flow * STEP_S / ENDING_TAU_S;
+            return false;
+        }
+
+        const PlanStep &s = m_plan.steps[m_frame];
+        m_frameTime += STEP_S;
+
+        double target = m_rampStart + m_rampSlope * qMin(m_frameTime, static_cast<double>(s.duration));
+        (this->*PUMPS[s.pump])(s, target, puckResistance());
+
+        m_volume += m_flow * STEP_S;
+        m_frameVolume += m_flow * STEP_S;
+
+        m_setTemp = s.temp;
+        m_temperature += (s.temp - m_temperature) * STEP_S / HEATER_TAU_S;
+
+        // maxVol counts water pumped during this frame
+        if (m_frameTime >= s.duration || m_frameVolume >= s.maxVolume
+            || EXITS[s.exit](m_pressure, m_flow, s.trigger)) {
+            enterStep(m_frame + 1);
+        }
+        return m_running;
+    }
+
+    bool isRunning() const { return m_running; }
+    int frameIndex() const { return m_frame; }
+    bool inPreinfusion() const { return m_running && m_frame < m_plan.preinfuseSteps; }
+    int frameCount() const { return m_plan.steps.size(); }
+
+    double time() const { return m_time; }
+    double pressure() const { return m_pressure; }
+    double flow() const { return m_flow; }
+    double volume() const { return m_volume; }
+    double temperature() const { return m_temperature; }
+    double setPressure() const { return m_setPressure; }
+    double setFlow() const { return m_setFlow; }
+    double setTemp() const { return m_setTemp; }
+
+    // Limiter extension: passes values through below the knee, then bends
+    // them smoothly towards knee + range
+    static double softLimit(double value, double knee, double range) {
+        if (value <= knee) return value;
+        return knee + range * std::tanh((value - knee) / range);
+    }
+
+private:
+    using PumpFn = void (ProfileExecutor::*)(const PlanStep &s, double target, double resistance);
+    using ExitFn = bool (*)(double pressure, double flow, double trigger);
+
+    void pumpPressure(const PlanStep &s, double target, double resistance) {
+        m_setPressure = target;
+        m_setFlow = 0.0;
+        m_pressure += (target - m_pressure) * (STEP_S / PUMP_TAU_S);
+
+        double flow = softLimit(m_pressure / resistance, s.limitKnee, s.limitRange);
+        m_flow = qMin(flow, static_cast<double>(s.headerLimit));
+        m_pressure = m_flow * resistance;
+    }
+
+    void pumpFlow(const PlanStep &s, double target, double resistance) {
+        m_setFlow = target;
+        m_setPressure = 0.0;
+        m_flow += (target - m_flow) * (STEP_S / PUMP_TAU_S);
+
+        double pressure = softLimit(resistance * m_flow, s.limitKnee, s.limitRange);
+        m_pressure = qMin(qMax(pressure, static_cast<double>(s.headerLimit)), PUMP_MAX_PRESSURE);
+        m_flow = m_pressure / resistance;
+    }
+
+    static constexpr PumpFn PUMPS[PlanStep::PumpCount] = {
+        &ProfileExecutor::pumpPressure,
+        &ProfileExecutor::pumpFlow,
+    };
+
+    static constexpr ExitFn EXITS[PlanStep::ExitCount] = {
+        [](double, double, double) { return false; },
+        [](double p, double, double t) { return p > t; },
+        [](double p, double, double t) { return p < t; },
+        [](double, double f, double t) { return f > t; },
+        [](double, double f, double t) { return f < t; },
+    };
+
+    // Ramps are resolved once per frame, not per step
+    void enterStep(int index) {
+        if (index >= m_plan.steps.size()) {
+            m_running = false;
+            return;
+        }
+
+        const PlanStep &s = m_plan.steps[index];
+        m_frame = index;
+        m_frameTime = 0.0;
+        m_frameVolume = 0.0;
+
+        if (s.ramp == PlanStep::RampFast) {
+            m_rampStart = s.target;
+            m_rampSlope = 0.0;
+        } else if (s.ramp == PlanStep::RampFromPrevious) {
+            m_rampStart = s.rampFrom;
+            m_rampSlope = s.rampSlope;
+        } else {
+            // The previous frame controlled the other quantity (or there is
+            // none), so ramp from what the machine is doing right now
+            m_rampStart = (s.pump == PlanStep::PumpFlow) ? m_flow : m_pressure;
+            m_rampSlope = (s.target - m_rampStart) / s.duration;
+        }
+    }
+
+    double puckResistance() const {
+        double wetted = qMin(1.0, m_volume / PUCK_WETTING_ML);
+        wetted = wetted * wetted * (3.0 - 2.0 * wetted);   // Smoothstep
+        double factor = PUCK_DRY_FACTOR + (1.0 - PUCK_DRY_FACTOR) * wetted;
+        factor *= qMax(PUCK_MIN_FACTOR, 1.0 - PUCK_EROSION_PER_S * m_time);
+        return PUCK_RESISTANCE * factor;
+    }
+
+    ProfilePlan m_plan;
+
+    bool m_running = false;
+    int m_frame = 0;
+    double m_time = 0.0;
+    double m_frameTime = 0.0;
+    double m_frameVolume = 0.0;
+    double m_rampStart = 0.0;
+    double m_rampSlope = 0.0;
+
+    double m_pressure = 0.0;
+    double m_flow = 0.0;
+    double m_volume = 0.0;
+    double m_temperature = 0.0;
+    double m_setPressure = 0.0;
+    double m_setFlow = 0.0;
+    double m_setTemp = 0.0;
+};
+
+// ============================================================================
+// Profile Cache - recent uploads by content, with their compiled plans
+// ============================================================================
+//
+// Apps upload the whole profile again before every shot. The engines look
+// each finished upload up by its key: a known one reuses the plan that was
+// compiled for it, and one that matches the loaded profile changes nothing
+// at all. The last CAPACITY profiles are kept, the least recently used
+// going first, so a scenario can also switch between profiles the app
+// uploaded earlier ("profile <id>") without a new upload.
+
+class ProfileCache {
+public:
+    static constexpr int CAPACITY = 8;
+
+    struct Entry {
+        QString id;                 // First 8 hex digits of the key's SHA-1
+        QByteArray key;
+        ProfileHeader header;
+        QVector<ProfileFrame> frames;
+        ProfilePlan plan;
+    };
+
+    // The entry for a finished upload, compiled first if it isn't cached;
+    // it is the most recently used from now on
+    Entry add(const ProfileUpload &upload, bool *hit = nullptr);
+
+    // False if no cached profile has that id (case-insensitive)
+    bool find(const QString &id, Entry &entry);
+
+    const QList<Entry> &entries() const { return m_entries; }    // Most recently used first
+    qint64 hits() const { return m_hits; }
+    qint64 misses() const { return m_misses; }
+
+    static QString idForKey(const QByteArray &key);
+
+private:
+    void use(int index);
+
+    QList<Entry> m_entries;
+    qint64 m_hits = 0;
+    qint64 m_misses = 0;
+};
@@ -0,0 +1,306 @@
+#include "scenario.h"
+
+#include <QFile>
+#include <QHash>
+#include <QStringList>
+
+// === Parsing ===
+
+// Characteristic by the name the log uses, case-insensitive
+static QString charIdFromName(const QString &name) {
+    static const QString ids[] = {
+        DE1::CHAR_VERSION, DE1::CHAR_REQUESTED_STATE, DE1::CHAR_READ_FROM_MMR,
+        DE1::CHAR_WRITE_TO_MMR, DE1::CHAR_SHOT_SETTINGS, DE1::CHAR_SHOT_SAMPLE,
+        DE1::CHAR_STATE_INFO, DE1::CHAR_HEADER_WRITE, DE1::CHAR_FRAME_WRITE,
+        DE1::CHAR_WATER_LEVELS,
+    };
+    for (const QString &id : ids) {
+        if (DE1::charName(id).compare(name, Qt::CaseInsensitive) == 0) return id;
+    }
+    return QString();
+}
+
+static bool stateFromName(const QString &name, DE1::State &state) {
+    for (int s = 0; s <= static_cast<int>(DE1::State::SchedIdle); s++) {
+        if (DE1::stateName(static_cast<DE1::State>(s)).compare(name, Qt::CaseInsensitive) == 0) {
+            state = static_cast<DE1::State>(s);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Optional trailing [timeout], the last word; false if it's there but not a
+// positive number, or followed by anything
+static bool parseTimeout(const QStringList &words, int index, double &timeout, double byDefault) {
+    timeout = byDefault;
+    if (words.size() <= index) return true;
+    bool ok = false;
+    timeout = words[index].toDouble(&ok);
+    return ok && timeout > 0 && words.size() == index + 1;
+}
+
+bool Scenario::parse(const QString &path, QList<ScenarioStep> &steps, QString &error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        error = QString("%1: %2").arg(path, file.errorString());
+        return false;
+    }
+
+    static const QHash<QString, DE1::State> operations = {
+        {"espresso", DE1::State::Espresso},
+        {"steam",    DE1::State::Steam},
+        {"hotwater", DE1::State::HotWater},
+        {"flush",    DE1::State::HotWaterRinse},
+    };
+
+    int lineNo = 0;
+    while (!file.atEnd()) {
+        lineNo++;
+        QString line = QString::fromUtf8(file.readLine());
+        line = line.left(line.indexOf('#')).trimmed();
+        if (line.isEmpty()) continue;
+
+        QStringList words = line.split(' ', Qt::SkipEmptyParts);
+        QString cmd = words.first().toLower();
+        bool ok = true;
+        double arg = words.size() < 2 ? 0.0 : words[1].toDouble(&ok);
+        bool isInt = false;
+        int intArg = words.size() < 2 ? 0 : words[1].toInt(&isInt);
+        bool bare = words.size() == 1;          // Commands without arguments
+
+        ScenarioStep step;
+        step.line = lineNo;
+        step.value = arg;
+        step.text = line;
+
+        // drop and delay: a number, then an optional characteristic
+        auto faultChar = [&]() {
+            if (words.size() > 3) return false;
+            if (words.size() == 3) step.charId = charIdFromName(words[2]);
+            return words.size() < 3 || !step.charId.isEmpty();
+        };
+
+        if (cmd == "wait-ble") {
+            step.command = ScenarioStep::WaitBle;
+            ok = parseTimeout(words, 1, step.value, Scenario::WAIT_TIMEOUT_S);
+        } else if (cmd == "wait-idle") {
+            step.command = ScenarioStep::WaitIdle;
+            ok = parseTimeout(words, 1, step.value, Scenario::WAIT_TIMEOUT_S);
+        } else if (cmd == "wait" && words.size() == 2 && arg > 0) {
+            step.command = ScenarioStep::Wait;
+        } else if (operations.contains(cmd) && bare) {
+            step.command = ScenarioStep::Operation;
+            step.state = operations.value(cmd);
+        } else if (cmd == "stop" && bare) {
+            step.command = ScenarioStep::Stop;
+        } else if (cmd == "sleep" && bare) {
+            step.command = ScenarioStep::Sleep;
+        } else if (cmd == "wake" && bare) {
+            step.command = ScenarioStep::Wake;
+        } else if (cmd == "ghc" && words.size() == 2 && isInt && intArg >= 0 && intArg <= 4) {
+            step.command = ScenarioStep::Ghc;
+        } else if (cmd == "rate" && words.size() == 2 && isInt && intArg > 0) {
+            step.command = ScenarioStep::Rate;
+        } else if (cmd == "profile" && words.size() == 2) {
+            step.command = ScenarioStep::Profile;
+            step.profileId = words[1];
+            ok = true;
+        } else if (cmd == "water" && words.size() == 2 && arg >= 0 && arg <= 100) {
+            step.command = ScenarioStep::Water;
+        } else if (cmd == "drop" && words.size() > 1 && arg >= 0 && arg <= 100) {
+            step.command = ScenarioStep::Drop;
+            ok = ok && faultChar();
+        } else if (cmd == "delay" && words.size() > 1 && arg >= 0) {
+            step.command = ScenarioStep::Delay;
+            ok = ok && faultChar();
+        } else if (cmd == "clear-faults" && bare) {
+            step.command = ScenarioStep::ClearFaults;
+        } else if (cmd == "disconnect" && bare) {
+            step.command = ScenarioStep::Disconnect;
+        } else if (cmd == "fatal" && bare) {
+            step.command = ScenarioStep::Fatal;
+        } else if (cmd == "expect-write" && words.size() > 1) {
+            step.command = ScenarioStep::ExpectWrite;
+            QString name = words[1].section('=', 0, 0);
+            QString hex = words[1].section('=', 1);
+            step.charId = charIdFromName(name);
+            step.prefix = QByteArray::fromHex(hex.toLatin1());
+            ok = !step.charId.isEmpty() && step.prefix.size() * 2 == hex.size()
+              && parseTimeout(words, 2, step.value, Scenario::EXPECT_TIMEOUT_S);
+        } else if (cmd == "expect-state" && words.size() > 1) {
+            step.command = ScenarioStep::ExpectState;
+            ok = stateFromName(words[1], step.state)
+              && parseTimeout(words, 2, step.value, Scenario::EXPECT_TIMEOUT_S);
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            error = QString("%1:%2: can't parse \"%3\"").arg(path).arg(lineNo).arg(line);
+            return false;
+        }
+        steps.append(step);
+    }
+    return true;
+}
+
+// === Running ===
+
+QString ScenarioRunner::unsupported() const {
+    for (const ScenarioStep &step : m_steps) {
+        bool missing = (step.command == ScenarioStep::Water && !m_control.setWaterLevel)
+                    || ((step.command == ScenarioStep::Drop || step.command == ScenarioStep::Delay
+                         || step.command == ScenarioStep::ClearFaults) && !m_control.setNotificationFaults);
+        if (missing) {
+            return QString("line %1: \"%2\" needs a single machine, not a fleet").arg(step.line).arg(step.text);
+        }
+    }
+    return QString();
+}
+
+void ScenarioRunner::runNext() {
+    while (m_waiting < 0 && !m_done) {
+        if (m_pc >= m_steps.size()) {
+            m_iteration++;
+            if (m_steps.isEmpty() || (m_repeat > 0 && m_iteration >= m_repeat)) {
+                if (!m_steps.isEmpty()) finish(0);
+                return;
+            }
+            m_pc = 0;
+            log(QString("Scenario iteration %1").arg(m_iteration + 1)
+                + (m_failures > 0 ? QString(", %1 expectation(s) failed so far").arg(m_failures) : QString()));
+        }
+
+        const ScenarioStep &step = m_steps[m_pc];
+        switch (step.command) {
+        case ScenarioStep::WaitBle:
+        case ScenarioStep::WaitIdle:
+        case ScenarioStep::ExpectState:
+            m_waiting = step.command;
+            m_waitTimer->start(wallMs(step.value));
+            checkWait();
+            return;
+        case ScenarioStep::Wait:
+        case ScenarioStep::ExpectWrite:
+            m_waiting = step.command;
+            m_waitTimer->start(wallMs(step.value));
+            return;
+        case ScenarioStep::Operation:
+            m_control.startOperation(step.state);
+            break;
+        case ScenarioStep::Stop:
+            m_control.stopOperation();
+            break;
+        case ScenarioStep::Sleep:
+            m_control.sleep();
+            break;
+        case ScenarioStep::Wake:
+            m_control.wake();
+            break;
+        case ScenarioStep::Ghc:
+            m_control.setGhcStatus(static_cast<int>(step.value));
+            emit ghcStatusChanged(static_cast<int>(step.value));
+            break;
+        case ScenarioStep::Rate:
+            m_control.setSampleRate(static_cast<int>(step.value));
+            break;
+        case ScenarioStep::Profile:
+            m_control.useProfile(step.profileId);
+            break;
+        case ScenarioStep::Water:
+            m_control.setWaterLevel(step.value);
+            break;
+        case ScenarioStep::Drop:
+            m_dropPercent = static_cast<int>(step.value);
+            m_faultChar = step.charId;
+            applyFaults();
+            break;
+        case ScenarioStep::Delay:
+            m_delayMs = static_cast<int>(step.value);
+            m_faultChar = step.charId;
+            applyFaults();
+            break;
+        case ScenarioStep::ClearFaults:
+            m_dropPercent = 0;
+            m_delayMs = 0;
+            m_faultChar.clear();
+            applyFaults();
+            break;
+        case ScenarioStep::Disconnect:
+            m_control.dropLink();
+            break;
+        case ScenarioStep::Fatal:
+            m_control.injectFatalError();
+            break;
+        }
+        m_pc++;
+    }
+}
+
+void ScenarioRunner::applyFaults() {
+    m_control.setNotificationFaults(m_dropPercent, m_faultChar, m_delayMs);
+}
+
+void ScenarioRunner::checkWait() {
+    if (m_waiting < 0 || m_done) return;
+
+    bool done = (m_waiting == ScenarioStep::WaitBle && m_bleConnected)
+             || (m_waiting == ScenarioStep::WaitIdle && m_state == DE1::State::Idle)
+             || (m_waiting == ScenarioStep::ExpectState && m_state == m_steps[m_pc].state);
+    if (done) finishWait();
+}
+
+void ScenarioRunner::finishWait() {
+    m_waitTimer->stop();
+    m_waiting = -1;
+    m_pc++;
+    runNext();
+}
+
+void ScenarioRunner::onWaitTimeout() {
+    const ScenarioStep &step = m_steps[m_pc];
+    switch (m_waiting) {
+    case ScenarioStep::Wait:
+        finishWait();
+        break;
+    case ScenarioStep::ExpectWrite:
+    case ScenarioStep::ExpectState:
+        m_failures++;
+        log(QString("Expectation failed at scenario line %1: \"%2\" not met within %3 s")
+            .arg(step.line).arg(step.text).arg(step.value), "ERROR");
+        finishWait();
+        break;
+    default:
+        log(QString("Timed out at scenario line %1").arg(step.line), "ERROR");
+        finish(1);
+        break;
+    }
+}
+
+void ScenarioRunner::onAppWrote(const QString &charId, const QByteArray &value) {
+    if (m_waiting != ScenarioStep::ExpectWrite || m_done) return;
+
+    const ScenarioStep &step = m_steps[m_pc];
+    if (charId == step.charId && value.startsWith(step.prefix)) finishWait();
+}
+
+void ScenarioRunner::finish(int status) {
+    if (m_done) return;
+    m_done = true;
+    m_waitTimer->stop();
+    m_waiting = -1;
+
+    // Faults end with the run, so an app left connected recovers
+    if (m_control.setNotificationFaults && (m_dropPercent > 0 || m_delayMs > 0)) {
+        m_dropPercent = 0;
+        m_delayMs = 0;
+        applyFaults();
+    }
+
+    if (status == 0 && m_failures > 0) status = 1;
+    log(QString("Done: %1 iteration(s), %2 shot(s), %3 expectation(s) failed in %4 s")
+            .arg(m_iteration).arg(m_shots).arg(m_failures).arg(m_clock.elapsed() / 1000.0, 0, 'f', 1),
+        status == 0 ? "INFO" : "ERROR");
+    emit finished(status);
+}
@@ -0,0 +1,230 @@
+/*
+ * Scenarios - scripted operations, faults and expectations on the
+ * simulation clock, run by de1sim-headless and the GUI's Tools menu
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+#include <cmath>
+#include <functional>
+#include <type_traits>
+
+#include "de1-protocol.h"
+#include "simulation-engine.h"
+
+// ============================================================================
+// Scenario Files
+// ============================================================================
+//
+// One command per line, '#' starts a comment. Waits and timeouts are in sim
+// seconds, so --sim-speed shortens them too; a timeout has to be positive.
+// A line with words a command doesn't take is an error.
+//
+//   wait-ble [timeout]     Wait until an app connects over BLE
+//   wait-idle [timeout]    Wait until the machine is back to Idle
+//                          (both: default timeout WAIT_TIMEOUT_S)
+//   wait <seconds>         Let the simulation run
+//   espresso | steam | hotwater | flush
+//   stop | sleep | wake
+//   ghc <0-4>              GHC status reported to the app
+//   rate <hz>              SHOT_SAMPLE rate, whole Hz
+//   profile <id>           Switch to a profile the app uploaded earlier, by
+//                          the id logged with it (see ProfileCache)
+//
+// Faults:
+//
+//   water <percent>        Tank level jumps to percent
+//   drop <percent> [char]  Drop that share of notifications (to char only)
+//   delay <ms> [char]      Hold notifications back ms of sim time
+//   clear-faults           Notifications go out normally again
+//   disconnect             Drop the daemon link; the engine reconnects
+//   fatal                  Machine reports FatalError until stop
+//
+// drop and delay share one characteristic filter; the last one given wins.
+// Characteristics are named as in the log (REQUESTED_STATE, SHOT_SAMPLE...).
+//
+// Expectations, on what the app does in response:
+//
+//   expect-write <char>[=hex] [timeout]    The app writes char, starting
+//                                          with those bytes if given
+//   expect-state <state> [timeout]         Machine reaches state (Idle,
+//                                          Espresso, Sleep, FatalError...)
+//
+// Only writes made after the expectation starts count. One not met within
+// its timeout (default EXPECT_TIMEOUT_S) is logged as an ERROR and the
+// scenario carries on; the run then ends with status 1. A wait-ble or
+// wait-idle timeout ends the run right away.
+
+struct ScenarioStep {
+    enum Command {
+        WaitBle, WaitIdle, Wait, Operation, Stop, Sleep, Wake, Ghc, Rate,
+        Profile, Water, Drop, Delay, ClearFaults, Disconnect, Fatal,
+        ExpectWrite, ExpectState
+    };
+
+    Command command = Wait;
+    DE1::State state = DE1::State::Idle;   // Operation, ExpectState
+    double value = 0.0;                    // Seconds, GHC status, Hz, percent or ms
+    QString charId;                        // Drop, Delay, ExpectWrite; empty = any
+    QByteArray prefix;                     // ExpectWrite
+    QString profileId;                     // Profile
+    int line = 0;
+    QString text;                          // As written, for messages
+};
+
+namespace Scenario {
+
+constexpr double EXPECT_TIMEOUT_S = 10.0;
+constexpr double WAIT_TIMEOUT_S = 300.0;   // wait-ble, wait-idle
+
+// False with error set ("file:line: ...") on the first line that doesn't parse
+bool parse(const QString &path, QList<ScenarioStep> &steps, QString &error);
+
+} // namespace Scenario
+
+// ============================================================================
+// Scenario Runner
+// ============================================================================
+//
+// Works with SimulationEngine and FleetEngine, which share the signals and
+// control slots used here; water and notification faults are
+// SimulationEngine only (see unsupported()). The runner calls the engine
+// directly, so it has to live on the engine's thread.
+
+class ScenarioRunner : public QObject {
+    Q_OBJECT
+
+public:
+    template <class Engine>
+    ScenarioRunner(Engine *engine, const QList<ScenarioStep> &steps, int repeat, QObject *parent = nullptr)
+        : QObject(parent), m_steps(steps), m_repeat(repeat) {
+        m_control.startOperation = [engine](DE1::State state) { engine->startOperation(state); };
+        m_control.stopOperation = [engine]() { engine->stopOperation(); };
+        m_control.sleep = [engine]() { engine->sleep(); };
+        m_control.wake = [engine]() { engine->wake(); };
+        m_control.setGhcStatus = [engine](int status) { engine->setGhcStatus(status); };
+        m_control.setSampleRate = [engine](int hz) { engine->setSampleRate(hz); };
+        m_control.simSpeed = [engine]() { return engine->simSpeed(); };
+        m_control.dropLink = [engine]() { engine->dropLink(); };
+        m_control.injectFatalError = [engine]() { engine->injectFatalError(); };
+        m_control.useProfile = [engine](const QString &id) { engine->useProfile(id); };
+        if constexpr (std::is_same_v<Engine, SimulationEngine>) {
+            m_control.setWaterLevel = [engine](double percent) { engine->setWaterLevel(percent); };
+            m_control.setNotificationFaults = [engine](int dropPercent, const QString &charId, int delayMs) {
+                engine->setNotificationFaults(dropPercent, charId, delayMs);
+            };
+        }
+
+        connect(engine, &Engine::linkConnectedChanged, this, [this](bool connected) {
+            if (connected && m_waitForLink && !m_started) begin();
+        });
+        connect(engine, &Engine::bleClientChanged, this, [this](const QString &client) {
+            m_bleConnected = !client.isEmpty();
+            checkWait();
+        });
+        connect(engine, &Engine::snapshotReady, this, [this](const EngineSnapshot &snap) {
+            if (m_state == DE1::State::Espresso && snap.state != DE1::State::Espresso) m_shots++;
+            m_state = snap.state;
+            checkWait();
+        });
+        connect(engine, &Engine::appWrote, this, &ScenarioRunner::onAppWrote);
+
+        m_waitTimer = new QTimer(this);
+        m_waitTimer->setSingleShot(true);
+        connect(m_waitTimer, &QTimer::timeout, this, &ScenarioRunner::onWaitTimeout);
+    }
+
+    // Empty if the engine can run every step, else why not
+    QString unsupported() const;
+
+    int failures() const { return m_failures; }
+
+public slots:
+    // With waitForLink the first step runs once the daemon link is up,
+    // otherwise right away. bleConnected and state are where the engine is
+    // now, for a runner started on one that's been running a while.
+    void start(bool waitForLink, bool bleConnected = false, DE1::State state = DE1::State::Idle) {
+        m_waitForLink = waitForLink;
+        m_bleConnected = bleConnected;
+        m_state = state;
+        if (!waitForLink) begin();
+    }
+
+    // Ends the run where it is, as failed
+    void stop() {
+        if (m_done) return;
+        if (m_started && m_pc < m_steps.size()) {
+            log(QString("Scenario stopped at line %1").arg(m_steps[m_pc].line), "WARN");
+        }
+        finish(1);
+    }
+
+signals:
+    void logMessage(const QString &category, const QString &msg);
+    void ghcStatusChanged(int status);      // A ghc step ran
+    void finished(int status);              // 0 = completed and every expectation met
+
+private:
+    void log(const QString &msg, const QString &category = "INFO") {
+        emit logMessage(category, msg);
+    }
+
+    void begin() {
+        m_started = true;
+        m_clock.start();
+        runNext();
+    }
+
+    void runNext();
+    void checkWait();
+    void finishWait();
+    void onWaitTimeout();
+    void onAppWrote(const QString &charId, const QByteArray &value);
+    void finish(int status);
+
+    // Hands m_dropPercent/m_delayMs/m_faultChar to the engine
+    void applyFaults();
+
+    int wallMs(double simSeconds) const {
+        return static_cast<int>(std::ceil(simSeconds * 1000.0 / m_control.simSpeed()));
+    }
+
+    struct Control {
+        std::function<void()> stopOperation, sleep, wake, dropLink, injectFatalError;
+        std::function<void(DE1::State)> startOperation;
+        std::function<void(int)> setGhcStatus, setSampleRate;
+        std::function<double()> simSpeed;
+        std::function<void(const QString &)> useProfile;
+        std::function<void(double)> setWaterLevel;                          // SimulationEngine only
+        std::function<void(int, const QString &, int)> setNotificationFaults;  // SimulationEngine only
+    } m_control;
+
+    QList<ScenarioStep> m_steps;
+    int m_repeat = 1;           // 0 = forever
+
+    int m_pc = 0;               // Next scenario step
+    int m_waiting = -1;         // ScenarioStep::Command being waited on, or -1
+    int m_iteration = 0;
+    int m_shots = 0;
+    int m_failures = 0;         // Expectations not met
+    bool m_waitForLink = false;
+    bool m_started = false;
+    bool m_done = false;
+    QTimer *m_waitTimer = nullptr;
+    QElapsedTimer m_clock;
+
+    // Notification faults as last set by drop/delay
+    int m_dropPercent = 0;
+    int m_delayMs = 0;
+    QString m_faultChar;
+
+    bool m_bleConnected = false;
+    DE1::State m_state = DE1::State::Idle;
+};
@@ -0,0 +1,182 @@
+#include "shot-timeline.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <QTextStream>
+
+#include <cstring>
+
+const char *ShotTimeline::channelName(int channel) {
+    switch (channel) {
+        case Time:           return "time_s";
+        case Pressure:       return "pressure_bar";
+        case Flow:           return "flow_mls";
+        case Temperature:    return "temp_c";
+        case SetPressure:    return "set_pressure_bar";
+        case SetFlow:        return "set_flow_mls";
+        case SetTemperature: return "set_temp_c";
+        case Frame:          return "frame";
+        default:             return "unknown";
+    }
+}
+
+void ShotTimeline::reserve(int samples) {
+    for (QVector<float> &column : m_columns) column.reserve(samples);
+}
+
+void ShotTimeline::clear(const QDateTime &started) {
+    for (QVector<float> &column : m_columns) column.resize(0);  // Keeps the allocation
+    m_started = started;
+    m_truncated = 0;
+}
+
+ShotTimeline ShotTimeline::detached() const {
+    ShotTimeline copy;
+    for (int c = 0; c < ChannelCount; c++) {
+        copy.m_columns[c] = QVector<float>(m_columns[c].cbegin(), m_columns[c].cend());
+    }
+    copy.m_started = m_started;
+    copy.m_truncated = m_truncated;
+    return copy;
+}
+
+// === CSV ===
+
+bool ShotTimeline::writeCsv(const QList<ShotTimeline> &shots, const QString &path, QString *error) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "shot";
+    for (int c = 0; c < ChannelCount; c++) out << ',' << channelName(c);
+    out << '\n';
+
+    for (int s = 0; s < shots.size(); s++) {
+        const ShotTimeline &shot = shots[s];
+        for (int i = 0; i < shot.size(); i++) {
+            out << s + 1;
+            for (int c = 0; c < Frame; c++) out << ',' << QString::number(shot.m_columns[c][i], 'f', 3);
+            out << ',' << static_cast<int>(shot.m_columns[Frame][i]) << '\n';
+        }
+        if (shot.m_truncated > 0) {
+            out << "# shot " << s + 1 << ": " << shot.m_truncated << " later sample(s) not kept\n";
+        }
+    }
+
+    out.flush();
+    if (file.error() != QFileDevice::NoError) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+// === Columnar ===
+
+bool ShotTimeline::writeColumnar(const QList<ShotTimeline> &shots, const QString &path, QString *error) {
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    out.writeRawData(ShotFile::MAGIC, sizeof(ShotFile::MAGIC));
+    out << ShotFile::VERSION << quint16(ChannelCount) << quint32(shots.size());
+    for (int c = 0; c < ChannelCount; c++) {
+        QByteArray name(channelName(c));
+        out << quint8(name.size());
+        out.writeRawData(name.constData(), name.size());
+    }
+
+    for (const ShotTimeline &shot : shots) {
+        out << quint32(shot.size()) << quint32(shot.m_truncated)
+            << qint64(shot.m_started.isValid() ? shot.m_started.toMSecsSinceEpoch() : 0);
+        for (const QVector<float> &column : shot.m_columns) {
+            for (float v : column) out << v;
+        }
+    }
+
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool ShotTimeline::readColumnar(const QString &path, QList<ShotTimeline> *shots, QString *error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setByteOrder(QDataStream::LittleEndian);
+    in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    char magic[sizeof(ShotFile::MAGIC)] = {};
+    quint16 version = 0, channels = 0;
+    quint32 count = 0;
+    in.readRawData(magic, sizeof(magic));
+    in >> version >> channels >> count;
+    if (in.status() != QDataStream::Ok || memcmp(magic, ShotFile::MAGIC, sizeof(magic)) != 0) {
+        if (error) *error = "Not a DE1 shot file";
+        return false;
+    }
+    if (version != ShotFile::VERSION) {
+        if (error) *error = QString("Unsupported shot file version %1").arg(version);
+        return false;
+    }
+
+    // Where each stored channel goes, -1 for ones we don't know
+    QVector<int> mapping(channels, -1);
+    for (int i = 0; i < channels; i++) {
+        quint8 len = 0;
+        in >> len;
+        QByteArray name(len, Qt::Uninitialized);
+        in.readRawData(name.data(), len);
+        for (int c = 0; c < ChannelCount; c++) {
+            if (name == channelName(c)) mapping[i] = c;
+        }
+    }
+
+    QList<ShotTimeline> loaded;
+    for (quint32 s = 0; s < count; s++) {
+        quint32 samples = 0, truncated = 0;
+        qint64 startedMs = 0;
+        in >> samples >> truncated >> startedMs;
+
+        // A corrupt count would otherwise allocate gigabytes below
+        if (in.status() != QDataStream::Ok || qint64(samples) * channels * 4 > file.bytesAvailable()) {
+            if (error) *error = QString("Shot %1 is cut short").arg(s + 1);
+            return false;
+        }
+
+        ShotTimeline shot;
+        shot.m_started = startedMs ? QDateTime::fromMSecsSinceEpoch(startedMs) : QDateTime();
+        shot.m_truncated = static_cast<int>(truncated);
+        for (int i = 0; i < channels; i++) {
+            QVector<float> column(samples);
+            for (float &v : column) in >> v;
+            if (mapping[i] >= 0) shot.m_columns[mapping[i]] = column;
+        }
+        // Channels the file lacks read as 0
+        for (QVector<float> &column : shot.m_columns) column.resize(samples);
+        loaded.append(shot);
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        if (error) *error = "Shot file is cut short";
+        return false;
+    }
+    *shots = loaded;
+    return true;
+}
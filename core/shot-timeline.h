@@ -0,0 +1,106 @@
+/*
+ * Shot timelines - every SHOT_SAMPLE of a shot kept as columns, for
+ * overlaying shots and exporting them
+ */
+
+#pragma once
+
+#include <QDateTime>
+#include <QList>
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+
+#include <array>
+#include <cstdint>
+
+// ============================================================================
+// Shot Timeline - one contiguous float column per channel
+// ============================================================================
+//
+// Columns are reserved for a whole shot before it starts, and append()
+// never grows them: a shot that outruns the reservation is truncated (and
+// says so) rather than reallocating on the sample path. clear() keeps the
+// allocation for the next shot.
+//
+// A timeline handed to another thread should be a detached() copy; sharing
+// the engine's columns would make its next append() copy them.
+
+class ShotTimeline {
+public:
+    enum Channel {
+        Time,               // Shot timer, sim seconds
+        Pressure,           // bar
+        Flow,               // mL/s
+        Temperature,        // C
+        SetPressure,
+        SetFlow,
+        SetTemperature,
+        Frame,
+        ChannelCount
+    };
+
+    using Sample = std::array<float, ChannelCount>;
+
+    static const char *channelName(int channel);
+
+    void reserve(int samples);
+    int capacity() const { return m_columns[0].capacity(); }
+
+    // New shot, keeping the reservation
+    void clear(const QDateTime &started = QDateTime());
+
+    // False (and counted in truncated()) once the reservation is full
+    bool append(const Sample &sample) {
+        if (m_columns[0].size() >= m_columns[0].capacity()) {
+            m_truncated++;
+            return false;
+        }
+        for (int c = 0; c < ChannelCount; c++) m_columns[c].append(sample[c]);
+        return true;
+    }
+
+    int size() const { return m_columns[0].size(); }
+    bool isEmpty() const { return size() == 0; }
+    const QVector<float> &column(int channel) const { return m_columns[channel]; }
+    float duration() const { return isEmpty() ? 0.0f : m_columns[Time].last(); }
+    QDateTime started() const { return m_started; }
+    int truncated() const { return m_truncated; }
+
+    // Deep copy sized to the samples, sharing nothing with this one
+    ShotTimeline detached() const;
+
+    // One row per sample, any number of shots (numbered from 1 in the
+    // "shot" column). Return false with *error set if the file can't be
+    // written; readColumnar() also if it isn't a shot file.
+    static bool writeCsv(const QList<ShotTimeline> &shots, const QString &path, QString *error = nullptr);
+    static bool writeColumnar(const QList<ShotTimeline> &shots, const QString &path, QString *error = nullptr);
+    static bool readColumnar(const QString &path, QList<ShotTimeline> *shots, QString *error = nullptr);
+
+private:
+    QVector<float> m_columns[ChannelCount];
+    QDateTime m_started;
+    int m_truncated = 0;
+};
+
+Q_DECLARE_METATYPE(ShotTimeline)
+
+// ============================================================================
+// Columnar Shot Format (.de1shot)
+// ============================================================================
+//
+//   Header:  "DE1SHOTS" [version u16][channels u16][shots u32]
+//            channels x [name length u8][name, ASCII]
+//   Shot:    [samples u32][truncated u32][started, ms since epoch i64]
+//            channels x samples x float32, one column after the other
+//
+// Everything is little-endian, so a reader can map each column straight
+// into a float32 array (numpy.frombuffer(..., "<f4")). Readers match
+// channels by name and ignore ones they don't know.
+
+namespace ShotFile {
+
+constexpr char MAGIC[8] = {'D', 'E', '1', 'S', 'H', 'O', 'T', 'S'};
+constexpr quint16 VERSION = 1;
+
+} // namespace ShotFile
@@ -0,0 +1,60 @@
+/*
+ * Simulation clock - monotonic sim time that can run faster (or slower)
+ * than the wall clock, for soak tests
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QtGlobal>
+
+#include <cmath>
+
+// ============================================================================
+// Sim Clock
+// ============================================================================
+//
+// Sim seconds advance at speed x wall seconds. Changing the speed rebases
+// the clock, so sim time never jumps. Phase lengths, the shot timer in
+// SHOT_SAMPLE and the water drain all read from it; timers that wait for a
+// sim deadline convert it back with wallMs().
+
+class SimClock {
+public:
+    static constexpr double MIN_SPEED = 0.1;
+    static constexpr double MAX_SPEED = 100.0;
+
+    SimClock() { m_wall.start(); }
+
+    // Back to sim time 0, keeping the speed
+    void start() {
+        m_wall.start();
+        m_baseS = 0.0;
+        m_baseWallNs = 0;
+    }
+
+    double now() const {
+        return m_baseS + (m_wall.nsecsElapsed() - m_baseWallNs) / 1e9 * m_speed;
+    }
+
+    double speed() const { return m_speed; }
+
+    void setSpeed(double speed) {
+        m_baseS = now();
+        m_baseWallNs = m_wall.nsecsElapsed();
+        m_speed = qBound(MIN_SPEED, speed, MAX_SPEED);
+    }
+
+    // Wall-clock milliseconds until simSeconds from now have passed, rounded
+    // up so a timer never fires before the sim deadline
+    int wallMs(double simSeconds) const {
+        if (simSeconds <= 0) return 0;
+        return static_cast<int>(std::ceil(simSeconds * 1000.0 / m_speed));
+    }
+
+private:
+    QElapsedTimer m_wall;
+    double m_baseS = 0.0;           // Sim time at the last rebase
+    qint64 m_baseWallNs = 0;        // Wall time at the last rebase
+    double m_speed = 1.0;
+};
@@ -0,0 +1,1358 @@
+#include "simulation-engine.h"
+
+SimulationEngine::SimulationEngine(QObject *parent) : QObject(parent) {
+    // Everything is parented to the engine so moveToThread() takes it along
+
+    // Daemon link; TCP until the target is "loopback"
+    m_batcher = new Wire::WriteBatcher(this);
+    useTransport(Transport::create(QString(), 1, this));
+    m_latencyClock.start();
+
+    // Simulation timer (rate selectable, default 5Hz = 200ms). PreciseTimer
+    // matters at 25/50 Hz, where coarse timers drift by several ms per tick.
+    m_shotTimer = new QTimer(this);
+    m_shotTimer->setTimerType(Qt::PreciseTimer);
+    m_shotTimer->setInterval(1000 / m_sampleRateHz);
+    connect(m_shotTimer, &QTimer::timeout, this, &SimulationEngine::onShotTimerTick);
+    m_shot.reserve(SHOT_CAPACITY_S * m_sampleRateHz);
+
+    // Sample rate load report (once per second)
+    m_rateTimer = new QTimer(this);
+    m_rateTimer->setInterval(1000);
+    connect(m_rateTimer, &QTimer::timeout, this, &SimulationEngine::reportLoad);
+
+    // Profile physics, fixed step independent of the sample rate
+    m_physicsTimer = new QTimer(this);
+    m_physicsTimer->setTimerType(Qt::PreciseTimer);
+    m_physicsTimer->setInterval(10);
+    connect(m_physicsTimer, &QTimer::timeout, this, &SimulationEngine::onPhysicsTick);
+
+    // Phase progression timer
+    m_phaseTimer = new QTimer(this);
+    m_phaseTimer->setSingleShot(true);
+    connect(m_phaseTimer, &QTimer::timeout, this, &SimulationEngine::onPhaseTimeout);
+
+    // Water level update timer (every 5 sim seconds)
+    m_waterTimer = new QTimer(this);
+    m_waterTimer->setInterval(m_simClock.wallMs(WATER_INTERVAL_S));
+    connect(m_waterTimer, &QTimer::timeout, this, &SimulationEngine::sendWaterLevel);
+
+    // Auto-reconnect, rescheduled with backoff after each failed attempt
+    m_reconnectTimer = new QTimer(this);
+    m_reconnectTimer->setSingleShot(true);
+    connect(m_reconnectTimer, &QTimer::timeout, this, &SimulationEngine::tryAutoReconnect);
+
+    // Heartbeats, while the daemon answers pings
+    m_heartbeatTimer = new QTimer(this);
+    m_heartbeatTimer->setInterval(LinkHealth::PING_INTERVAL_MS);
+    connect(m_heartbeatTimer, &QTimer::timeout, this, &SimulationEngine::onHeartbeat);
+
+    // Trace replay, rescheduled for each record that isn't due yet
+    m_replayTimer = new QTimer(this);
+    m_replayTimer->setSingleShot(true);
+    m_replayTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_replayTimer, &QTimer::timeout, this, &SimulationEngine::pumpReplay);
+
+    // Throttled snapshots for the window
+    m_snapshotTimer = new QTimer(this);
+    m_snapshotTimer->setInterval(SNAPSHOT_INTERVAL_MS);
+    connect(m_snapshotTimer, &QTimer::timeout, this, [this]() {
+        if (m_snapshotDirty) publishSnapshot();
+        if (!m_liveSamples.isEmpty()) {
+            emit liveSamplesReady(m_liveSamples);
+            m_liveSamples.clear();      // Shared with the signal, so this starts a new buffer
+        }
+    });
+    m_liveSamples.reserve(LIVE_SAMPLES_RESERVE);
+}
+
+void SimulationEngine::setGhcStatus(int status) {
+    m_ghcStatus = status;
+    // A daemon answering MMR reads needs the new GHC_INFO
+    QMetaObject::invokeMethod(this, &SimulationEngine::pushStaticAnswers, Qt::QueuedConnection);
+}
+
+void SimulationEngine::start() {
+    m_autoReconnect = true;
+    scheduleReconnect();
+    m_snapshotTimer->start();
+    publishSnapshot();
+    updateProfileDisplay();
+}
+
+void SimulationEngine::setTarget(const QString &host, int port) {
+    m_host = host;
+    m_port = port;
+}
+
+void SimulationEngine::connectToPi() {
+    m_autoReconnect = true;
+    if (!m_transport->isIdle()) return;
+
+    m_reconnectTimer->stop();
+    ensureTransport();
+    log(QString("Connecting to %1:%2...").arg(m_host).arg(m_port));
+    emit linkStatusChanged(LinkStatus::Busy, "Connecting...");
+    m_transport->open(m_host, m_port);
+}
+
+void SimulationEngine::disconnectFromPi() {
+    m_autoReconnect = false;
+    m_reconnectTimer->stop();
+    m_transport->close();
+}
+
+void SimulationEngine::exportLatencyCsv(const QString &path) {
+    QString error;
+    if (m_latency.writeCsv(path, &error)) {
+        log(QString("Exported %1 latency sample(s) to %2").arg(m_latency.rowCount()).arg(path));
+    } else {
+        log(QString("Latency export to %1 failed: %2").arg(path, error), "ERROR");
+    }
+}
+
+// === MMR registers ===
+
+void SimulationEngine::loadMmrDump(const QString &path) {
+    QFile file(path);
+    QString error;
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+    } else if (m_mmr.loadJson(file.readAll(), &error)) {
+        log(QString("Loaded MMR dump %1 (%2 registers set)").arg(path).arg(m_mmr.size()));
+        pushStaticAnswers();
+        return;
+    }
+    log(QString("Can't load MMR dump %1: %2").arg(path, error), "ERROR");
+}
+
+void SimulationEngine::exportMmrDump(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || file.write(QJsonDocument(m_mmr.toJson()).toJson()) < 0) {
+        log(QString("Can't write MMR dump %1: %2").arg(path, file.errorString()), "ERROR");
+        return;
+    }
+    log(QString("Exported %1 MMR register(s) to %2").arg(m_mmr.size()).arg(path));
+}
+
+// === Traces ===
+
+void SimulationEngine::startRecording(const QString &path) {
+    QString error;
+    if (!m_traceWriter.open(path, &error)) {
+        log(QString("Can't record trace to %1: %2").arg(path, error), "ERROR");
+        return;
+    }
+    m_traceClock.start();
+    log("Recording trace to " + path);
+    emit traceStateChanged(true, m_traceReader.isOpen());
+}
+
+void SimulationEngine::stopRecording() {
+    if (!m_traceWriter.isOpen()) return;
+    m_traceWriter.close();
+    log(QString("Trace recorded: %1 record(s) in %2")
+        .arg(m_traceWriter.records()).arg(m_traceWriter.fileName()));
+    emit traceStateChanged(false, m_traceReader.isOpen());
+}
+
+void SimulationEngine::startReplay(const QString &path, double speed) {
+    stopReplay();
+
+    QString error;
+    if (!m_traceReader.open(path, &error)) {
+        log(QString("Can't replay %1: %2").arg(path, error), "ERROR");
+        emit replayFinished(0, false);
+        return;
+    }
+
+    stopOperation();
+    m_waterTimer->stop();
+
+    m_replaySpeed = qMax(0.0, speed);
+    m_replayed = 0;
+    m_replayBlocked = false;
+    m_replayHasNext = m_traceReader.next(m_replayNext);
+    m_replayClock.start();
+    log(QString("Replaying %1 at %2").arg(path,
+        m_replaySpeed > 0 ? QString("%1x").arg(m_replaySpeed) : QString("full speed")));
+    emit traceStateChanged(m_traceWriter.isOpen(), true);
+    pumpReplay();
+}
+
+void SimulationEngine::stopReplay() {
+    if (!m_traceReader.isOpen()) return;
+    finishReplay(false);
+}
+
+void SimulationEngine::setSimSpeed(double speed) {
+    if (qBound(SimClock::MIN_SPEED, speed, SimClock::MAX_SPEED) == m_simClock.speed()) return;
+
+    double remaining = m_phaseTimer->isActive() ? m_phaseEnd - m_simClock.now() : -1.0;
+    m_simClock.setSpeed(speed);
+
+    if (remaining >= 0) m_phaseTimer->start(m_simClock.wallMs(remaining));
+    m_waterTimer->setInterval(m_simClock.wallMs(WATER_INTERVAL_S));
+    log(QString("Simulation speed %1x").arg(m_simClock.speed()));
+}
+
+void SimulationEngine::setSampleRate(int hz) {
+    if (hz <= 0) return;
+    m_sampleRateHz = hz;
+    m_shotTimer->setInterval(1000 / hz);
+    m_shot.reserve(SHOT_CAPACITY_S * hz);   // Before the shot, not on its sample path
+}
+
+void SimulationEngine::toggleOperation(DE1::State state) {
+    if (m_traceReader.isOpen()) return;
+    if (m_currentState == state) {
+        stopOperation();
+    } else {
+        beginOperation(state);
+    }
+}
+
+void SimulationEngine::startOperation(DE1::State state) {
+    if (m_currentState == state) return;
+    beginOperation(state);
+}
+
+void SimulationEngine::wake() {
+    if (m_currentState == DE1::State::Sleep) {
+        transitionToState(DE1::State::Idle, DE1::SubState::Ready);
+    }
+}
+
+void SimulationEngine::sleep() {
+    if (m_currentState == DE1::State::Sleep) return;
+    stopOperation();
+    transitionToState(DE1::State::Sleep, DE1::SubState::Ready);
+}
+
+void SimulationEngine::togglePower() {
+    if (m_currentState == DE1::State::Sleep) {
+        transitionToState(DE1::State::Idle, DE1::SubState::Ready);
+    } else {
+        stopOperation();
+        transitionToState(DE1::State::Sleep, DE1::SubState::Ready);
+    }
+}
+
+void SimulationEngine::stopOperation() {
+    m_shotTimer->stop();
+    m_phaseTimer->stop();
+    m_physicsTimer->stop();
+
+    m_pressure = 0.0;
+    m_flow = 0.0;
+    m_steamTemp = 0.0;
+    m_frameNumber = 0;
+
+    transitionToState(DE1::State::Idle, DE1::SubState::Ready);
+}
+
+// === Fault injection ===
+
+void SimulationEngine::setWaterLevel(double percent) {
+    m_waterLevel = qBound(0.0, percent, 100.0);
+    log(QString("Water level set to %1%").arg(m_waterLevel, 0, 'f', 1), "WARN");
+    sendWaterLevel();
+}
+
+void SimulationEngine::injectFatalError() {
+    m_shotTimer->stop();
+    m_phaseTimer->stop();
+    m_physicsTimer->stop();
+
+    m_pressure = 0.0;
+    m_flow = 0.0;
+    m_steamTemp = 0.0;
+    m_frameNumber = 0;
+
+    log("Injected FatalError", "WARN");
+    transitionToState(DE1::State::FatalError, DE1::SubState::Ready);
+}
+
+void SimulationEngine::dropLink() {
+    if (!m_transport->isOpen()) return;
+    log("Dropping the link to the Pi", "WARN");
+    m_transport->abort();
+}
+
+// === Profiles ===
+
+void SimulationEngine::useProfile(const QString &id) {
+    ProfileCache::Entry entry;
+    if (!m_profiles.find(id, entry)) {
+        log(QString("Profile %1 isn't cached").arg(id), "WARN");
+        return;
+    }
+    loadProfile(entry);
+    log(QString("Switched to profile %1 (%2 frames)").arg(m_profileId).arg(m_plan.steps.size()));
+}
+
+void SimulationEngine::setNotificationFaults(int dropPercent, const QString &charId, int delayMs) {
+    if (m_faultDropPercent > 0 || m_faultDelayMs > 0) {
+        log(QString("Notification faults until now: %1 dropped, %2 delayed")
+            .arg(m_faultsDropped).arg(m_faultsDelayed));
+    }
+    m_faultDropPercent = qBound(0, dropPercent, 100);
+    m_faultChar = charId.isEmpty() ? 0 : Wire::charIdFromString(charId);
+    m_faultDelayMs = qMax(0, delayMs);
+    m_faultRandom.seed(FAULT_SEED);
+    m_faultsDropped = 0;
+    m_faultsDelayed = 0;
+
+    if (m_faultDropPercent > 0 || m_faultDelayMs > 0) {
+        log(QString("Notification faults on %1: %2% dropped, %3 ms delay")
+            .arg(charId.isEmpty() ? QString("all characteristics") : DE1::charName(charId))
+            .arg(m_faultDropPercent).arg(m_faultDelayMs), "WARN");
+    }
+}
+
+void SimulationEngine::log(const QString& msg, const QString& category) {
+    emit logMessage(category, msg);
+}
+
+void SimulationEngine::useTransport(Transport *transport) {
+    m_transport = transport;
+    connect(m_transport, &Transport::connected, this, &SimulationEngine::onConnected);
+    connect(m_transport, &Transport::disconnected, this, &SimulationEngine::onDisconnected);
+    connect(m_transport, &Transport::readyRead, this, &SimulationEngine::onDataReceived);
+    connect(m_transport, &Transport::errorOccurred, this, &SimulationEngine::onSocketError);
+    connect(m_transport, &Transport::bytesWritten, this, &SimulationEngine::onBytesWritten);
+    m_batcher->setDevice(m_transport->device());
+}
+
+void SimulationEngine::ensureTransport() {
+    if (m_transport->isLoopback() == Transport::isLoopbackHost(m_host)) return;
+
+    m_transport->deleteLater();
+    useTransport(Transport::create(m_host, 1, this));
+}
+
+void SimulationEngine::scheduleReconnect() {
+    if (!m_autoReconnect || m_host.isEmpty() || m_reconnectTimer->isActive()) return;
+    m_reconnectTimer->start(m_health.nextReconnectDelayMs());
+}
+
+void SimulationEngine::onConnected() {
+    log(m_transport->isLoopback() ? "Connected to loopback daemon (no Pi)" : "Connected to Pi daemon");
+    m_batcher->setDevice(m_transport->device());    // Drop anything left from a previous connection
+
+    emit linkStatusChanged(LinkStatus::Ok, "Connected to Pi - Waiting for BLE...");
+    emit linkConnectedChanged(true);
+    emit statusMessage("Connected to Raspberry Pi");
+
+    // Start water level timer
+    m_waterTimer->start();
+
+    resetRateCounters();
+    m_rateTimer->start();
+}
+
+void SimulationEngine::onDisconnected() {
+    log("Disconnected from Pi");
+    emit linkStatusChanged(LinkStatus::Neutral, "Disconnected from Pi");
+    emit linkConnectedChanged(false);
+    emit bleClientChanged(QString());
+    emit statusMessage("Disconnected");
+
+    m_tcpBuffer.clear();
+    m_binaryProtocol = false;
+    m_daemonAnswers = false;
+    resetTiming();
+    stopReplay();
+
+    // Stop timers
+    m_shotTimer->stop();
+    m_phaseTimer->stop();
+    m_physicsTimer->stop();
+    m_waterTimer->stop();
+    m_rateTimer->stop();
+    m_heartbeatTimer->stop();
+    m_health.stopHeartbeat();
+
+    scheduleReconnect();
+}
+
+void SimulationEngine::onSocketError() {
+    log(QString("Socket error: %1").arg(m_transport->errorString()), "ERROR");
+    emit linkStatusChanged(LinkStatus::Error, "Connection failed: " + m_transport->errorString());
+    emit linkConnectedChanged(m_transport->isOpen());
+
+    // A refused or timed-out attempt never gets to disconnected()
+    if (m_transport->isIdle()) scheduleReconnect();
+}
+
+void SimulationEngine::tryAutoReconnect() {
+    // Only try if not already connected or connecting
+    if (m_transport->isIdle() && !m_host.isEmpty() && m_autoReconnect) {
+        ensureTransport();
+        log(QString("Auto-reconnecting to %1:%2...").arg(m_host).arg(m_port));
+        emit linkStatusChanged(LinkStatus::Busy, "Auto-reconnecting...");
+        m_transport->open(m_host, m_port);
+    }
+}
+
+void SimulationEngine::onHeartbeat() {
+    // Pongs that arrived while this thread was busy count as on time
+    if (m_transport->device()->bytesAvailable() > 0) onDataReceived();
+
+    if (m_health.timedOut()) {
+        log(QString("No pong from the Pi for %1 ms, dropping the link").arg(m_health.silentMs()), "WARN");
+        m_transport->abort();
+        return;
+    }
+    sendCommand(m_health.makePing());
+}
+
+void SimulationEngine::onDataReceived() {
+    m_tcpBuffer.readFrom(m_transport->device());
+
+    // Process complete messages (binary frames or newline-delimited JSON)
+    Wire::Message msg;
+    while (m_tcpBuffer.next(msg)) {
+        if (msg.binary) {
+            handlePiFrame(msg);
+            continue;
+        }
+
+        QJsonParseError err;
+        QJsonDocument doc = QJsonDocument::fromJson(
+            QByteArray::fromRawData(msg.payload.data(), msg.payload.size()), &err);
+        if (err.error != QJsonParseError::NoError) {
+            log("JSON parse error: " + err.errorString(), "ERROR");
+            continue;
+        }
+
+        handlePiEvent(doc.object());
+    }
+    m_tcpBuffer.compact();
+}
+
+void SimulationEngine::handlePiFrame(const Wire::Message &msg) {
+    QString charId = Wire::charIdToString(msg.charId);
+
+    if (msg.type == Wire::FrameWrite) {
+        handleCharacteristicWrite(charId, msg.payload.toByteArray());
+    } else if (msg.type == Wire::FrameRead) {
+        logRx(QString("CHAR_READ: %1").arg(DE1::charName(charId)));
+    } else if (msg.type == Wire::FrameAnswered) {
+        handleAnsweredWrite(charId, msg.payload.toByteArray());
+    } else {
+        log(QString("Unknown frame type 0x%1").arg(static_cast<int>(msg.type), 2, 16, QChar('0')), "ERROR");
+    }
+}
+
+void SimulationEngine::handlePiEvent(const QJsonObject &event) {
+    QString type = event["event"].toString();
+
+    if (type == "ready") {
+        QString version = event["version"].toString();
+        int protocol = event["protocol"].toInt(Wire::PROTOCOL_JSON);
+        logPi(QString("Pi daemon ready (v%1, protocol %2)").arg(version).arg(protocol));
+        m_health.resetBackoff();
+
+        // Multiplexed port: without "machine_ids" in hello we drive the first machine
+        const QJsonArray machines = event["machines"].toArray();
+        if (machines.size() > 1) {
+            logPi(QString("Port shared by %1 machines, driving %2")
+                .arg(machines.size()).arg(machines.first().toObject()["name"].toString()));
+        }
+
+        // Older daemons don't send "protocol" and only speak JSON, nor
+        // "timing" and never ack
+        bool binary = protocol >= Wire::PROTOCOL_BINARY && m_useBinary;
+        bool timing = event["timing"].toBool() && m_useTiming;
+        if (binary || timing) {
+            QJsonObject hello;
+            hello["cmd"] = "hello";
+            hello["protocol"] = binary ? Wire::PROTOCOL_BINARY : Wire::PROTOCOL_JSON;
+            if (timing) hello["timing"] = true;
+            sendCommand(hello);
+            m_binaryProtocol = binary;
+            m_timing = timing;
+            if (binary) logPi("Using binary protocol");
+            if (timing) logPi("Timing notifications for latency stats");
+        }
+        emit linkStatusChanged(LinkStatus::Ok, "Connected to Pi - Advertising as DE1-SIM");
+
+        // Older daemons don't answer pings; the OS has to notice a dead link then
+        if (event["heartbeat"].toBool()) {
+            m_health.startHeartbeat();
+            m_heartbeatTimer->start();
+            logPi(QString("Heartbeat every %1 ms").arg(LinkHealth::PING_INTERVAL_MS));
+        }
+
+        // Values the daemon kept from before (this or an earlier GUI
+        // session, or its state file). Shot settings an app wrote then
+        // are still the machine's.
+        const QJsonObject cache = event["cache"].toObject();
+        QByteArray cachedSettings = QByteArray::fromHex(cache[DE1::CHAR_SHOT_SETTINGS].toString().toLatin1());
+        if (cachedSettings.size() == DE1::SHOT_SETTINGS_SIZE) m_shotSettings = cachedSettings;
+
+        // Daemons that take our static answers reply to MMR reads themselves
+        m_daemonAnswers = event["answers"].toBool();
+        if (m_daemonAnswers) {
+            logPi("Pi answers MMR reads locally");
+            pushStaticAnswers();
+        }
+
+        // Send initial state, unless the daemon already holds it
+        if (cachedValue(cache, DE1::CHAR_STATE_INFO) == stateInfoValue()
+            && cachedValue(cache, DE1::CHAR_WATER_LEVELS) == waterLevelValue()) {
+            logPi(QString("Pi kept %1 characteristic value(s), state unchanged").arg(cache.size()));
+        } else {
+            sendStateNotification();
+            sendWaterLevel();
+        }
+    }
+    else if (type == "advertising") {
+        logPi("BLE advertising started");
+    }
+    else if (type == "connected") {
+        QString client = event["client"].toString();
+        logPi(QString("BLE client connected: %1").arg(client));
+        const QJsonObject requested = event["requested"].toObject();
+        if (!requested.isEmpty()) {
+            logPi(QString("Requested connection interval %1-%2 ms, latency %3, supervision timeout %4 ms")
+                .arg(requested["interval_min_ms"].toDouble())
+                .arg(requested["interval_max_ms"].toDouble())
+                .arg(requested["latency"].toInt())
+                .arg(requested["supervision_timeout_ms"].toInt()));
+        }
+        m_bleIntervalMs = 0.0;
+        emit bleClientChanged(client);
+        emit statusMessage("BLE client connected: " + client);
+    }
+    else if (type == "pong") {
+        emit rttMeasured(m_health.onPong(event));
+    }
+    else if (type == "connection") {
+        // Negotiated parameters; MTU changes come on their own
+        if (event.contains("interval_ms")) {
+            m_bleIntervalMs = event["interval_ms"].toDouble();
+            logPi(QString("BLE connection: interval %1 ms, latency %2, supervision timeout %3 ms, MTU %4")
+                .arg(m_bleIntervalMs)
+                .arg(event["latency"].toInt())
+                .arg(event["supervision_timeout_ms"].toInt())
+                .arg(event["mtu"].toInt()));
+        } else {
+            logPi(QString("BLE MTU %1").arg(event["mtu"].toInt()));
+        }
+    }
+    else if (type == "disconnected") {
+        logPi("BLE client disconnected");
+        m_bleIntervalMs = 0.0;
+        emit bleClientChanged(QString());
+        emit statusMessage("BLE client disconnected");
+    }
+    else if (type == "write") {
+        QString charId = event["char"].toString();
+        QByteArray data = QByteArray::fromHex(event["data"].toString().toLatin1());
+        handleCharacteristicWrite(charId, data);
+    }
+    else if (type == "read") {
+        QString charId = event["char"].toString();
+        logRx(QString("CHAR_READ: %1").arg(DE1::charName(charId)));
+    }
+    else if (type == "answered") {
+        handleAnsweredWrite(event["char"].toString(),
+                            QByteArray::fromHex(event["data"].toString().toLatin1()));
+    }
+    else if (type == "error") {
+        int code = event["code"].toInt();
+        log(QString("Pi BLE error: %1").arg(code), "ERROR");
+    }
+    else if (type == "stats") {
+        handleDaemonStats(event);
+    }
+    else if (type == "timing") {
+        handleTimingAcks(event["acks"].toArray());
+    }
+}
+
+void SimulationEngine::handleTimingAcks(const QJsonArray &acks) {
+    qint64 nowNs = m_latencyClock.nsecsElapsed();
+
+    for (const QJsonValue &value : acks) {
+        const QJsonArray ack = value.toArray();
+        if (ack.size() < 5) continue;
+
+        quint16 seq = static_cast<quint16>(ack[0].toInt());
+        TimedNotify &t = m_timedRing[seq % TIMED_RING_SIZE];
+        if (!t.pending || t.seq != seq || quint32(t.producedNs / 1000) != quint32(ack[1].toInteger())) {
+            continue;   // Timed out already, or from before a reconnect
+        }
+        t.pending = false;
+
+        qint64 parseUs = ack[2].toInteger();
+        qint64 bleUs = ack[3].toInteger();
+        qint64 holdUs = ack[4].toInteger();
+        qint64 writtenNs = t.writtenNs >= 0 ? t.writtenNs : nowNs;
+
+        LatencySample sample;
+        sample.seq = seq;
+        sample.charId = t.charId;
+        sample.producedUs = t.producedNs / 1000;
+        sample.written = bleUs >= 0;
+
+        qint64 *stage = sample.stageUs;
+        stage[int(LatencyStage::Gui)] = (writtenNs - t.producedNs) / 1000;
+        stage[int(LatencyStage::Parse)] = parseUs;
+        if (sample.written) {
+            qint64 roundTripUs = (nowNs - writtenNs) / 1000 - parseUs - bleUs - holdUs;
+            stage[int(LatencyStage::Network)] = qMax<qint64>(0, roundTripUs / 2);
+            stage[int(LatencyStage::Ble)] = bleUs;
+            stage[int(LatencyStage::Total)] = stage[int(LatencyStage::Gui)]
+                + stage[int(LatencyStage::Network)] + parseUs + bleUs;
+        } else {
+            stage[int(LatencyStage::Network)] = -1;
+            stage[int(LatencyStage::Ble)] = -1;
+            stage[int(LatencyStage::Total)] = -1;
+        }
+        m_latency.add(sample);
+    }
+}
+
+void SimulationEngine::handleDaemonStats(const QJsonObject &event) {
+    QJsonObject sample = event["notify"].toObject()[DE1::CHAR_SHOT_SAMPLE].toObject();
+    qint64 sent = sample["sent"].toInteger();
+    qint64 coalesced = sample["coalesced"].toInteger();
+    qint64 dropped = 0;
+
+    const QJsonObject perChar = event["notify"].toObject();
+    for (auto it = perChar.begin(); it != perChar.end(); ++it) {
+        dropped += it.value().toObject()["dropped"].toInteger();
+    }
+
+    double secs = m_bleStatsWindow.isValid() ? m_bleStatsWindow.nsecsElapsed() / 1e9 : 0.0;
+    if (secs > 0) {
+        m_bleSampleRate = (sent - m_bleSamplesSent) / secs;
+        m_bleCoalescedRate = (coalesced - m_bleSamplesCoalesced) / secs;
+    }
+    if (dropped > m_bleDropped) {
+        log(QString("Pi dropped %1 notification(s)").arg(dropped - m_bleDropped), "WARN");
+    }
+
+    m_bleSamplesSent = sent;
+    m_bleSamplesCoalesced = coalesced;
+    m_bleDropped = dropped;
+    m_bleStatsWindow.start();
+}
+
+void SimulationEngine::handleCharacteristicWrite(const QString &charId, const QByteArray &value) {
+    QString charName = DE1::charName(charId);
+    if (m_traceWriter.isOpen()) {
+        m_traceWriter.record(Trace::KindWrite, Wire::charIdFromString(charId), value, m_traceClock.nsecsElapsed() / 1000);
+    }
+    emit appWrote(charId, value);
+
+    if (charId == DE1::CHAR_REQUESTED_STATE) {
+        if (value.size() >= 1) {
+            auto requestedState = static_cast<DE1::State>(static_cast<uint8_t>(value[0]));
+            logRx(QString("REQUESTED_STATE: %1 (0x%2)")
+                .arg(DE1::stateName(requestedState))
+                .arg(static_cast<int>(requestedState), 2, 16, QChar('0')));
+            handleRequestedState(requestedState);
+        }
+    } else if (charId == DE1::CHAR_READ_FROM_MMR) {
+        handleMMRReadRequest(value);
+    } else if (charId == DE1::CHAR_WRITE_TO_MMR) {
+        handleMMRWrite(value);
+    } else if (charId == DE1::CHAR_HEADER_WRITE) {
+        handleHeaderWrite(value);
+    } else if (charId == DE1::CHAR_FRAME_WRITE) {
+        handleFrameWrite(value);
+    } else if (charId == DE1::CHAR_SHOT_SETTINGS) {
+        handleShotSettings(value);
+    } else {
+        logRx(QString("%1: %2").arg(charName, value.toHex(' ')));
+    }
+}
+
+void SimulationEngine::handleAnsweredWrite(const QString &charId, const QByteArray &value) {
+    if (m_traceWriter.isOpen()) {
+        m_traceWriter.record(Trace::KindWrite, Wire::charIdFromString(charId), value, m_traceClock.nsecsElapsed() / 1000);
+    }
+    emit appWrote(charId, value);
+
+    if (charId != DE1::CHAR_READ_FROM_MMR || value.size() < 4) {
+        logRx(QString("%1: %2 (answered by Pi)").arg(DE1::charName(charId), value.toHex(' ')));
+        return;
+    }
+
+    uint32_t address = BinaryCodec::decodeAddress(reinterpret_cast<const uint8_t*>(value.constData() + 1));
+    uint32_t val = m_mmr.read(address);
+    logRx(QString("MMR_READ: %1 = %2 (0x%3), answered by Pi")
+        .arg(DE1::MMR::addressName(address))
+        .arg(val)
+        .arg(val, 8, 16, QChar('0')));
+}
+
+void SimulationEngine::handleRequestedState(DE1::State requested) {
+    int ghcStatus = m_ghcStatus;
+    if (ghcStatus == 3) {
+        if (requested != DE1::State::Sleep && requested != DE1::State::Idle) {
+            log(QString("GHC active - BLOCKED app request: %1").arg(DE1::stateName(requested)), "WARN");
+            return;
+        }
+    }
+
+    transitionToState(requested, DE1::SubState::Ready);
+}
+
+void SimulationEngine::handleMMRReadRequest(const QByteArray &value) {
+    if (value.size() < 4) return;
+
+    uint32_t address = BinaryCodec::decodeAddress(reinterpret_cast<const uint8_t*>(value.constData() + 1));
+    int words = static_cast<uint8_t>(value[0]) + 1;
+    QString addrName = DE1::MMR::addressName(address);
+
+    logRx(words > 1 ? QString("MMR_READ: %1 (%2 words)").arg(addrName).arg(words)
+                    : QString("MMR_READ: %1").arg(addrName));
+
+    // GHC_INFO follows the GHC status picked in the window
+    m_mmr.write(DE1::MMR::GHC_INFO, static_cast<uint32_t>(m_ghcStatus.load()));
+
+    const QVector<QByteArray> responses = m_mmr.readResponses(value);
+    for (const QByteArray &response : responses) {
+        sendNotification(DE1::CHAR_READ_FROM_MMR, response);
+    }
+
+    uint32_t val = m_mmr.read(address);
+    logTx(QString("MMR_RESPONSE: %1 = %2 (0x%3)%4")
+        .arg(addrName)
+        .arg(val)
+        .arg(val, 8, 16, QChar('0'))
+        .arg(responses.size() > 1 ? QString(" in %1 notifications").arg(responses.size()) : QString()));
+}
+
+void SimulationEngine::handleMMRWrite(const QByteArray &value) {
+    uint32_t address = 0;
+    int words = m_mmr.applyWrite(value, &address);
+    if (words == 0) {
+        logRx(QString("MMR_WRITE: invalid size %1").arg(value.size()));
+        return;
+    }
+
+    uint32_t val = m_mmr.read(address);
+    QString addrName = DE1::MMR::addressName(address);
+    logRx(QString("MMR_WRITE: %1 = %2 (0x%3)%4")
+        .arg(addrName)
+        .arg(val)
+        .arg(val, 8, 16, QChar('0'))
+        .arg(words > 1 ? QString(" + %1 more word(s)").arg(words - 1) : QString()));
+}
+
+void SimulationEngine::handleHeaderWrite(const QByteArray &value) {
+    if (m_upload.writeHeader(value) == ProfileUpload::Invalid) {
+        logRx(QString("HEADER_WRITE: invalid size %1").arg(value.size()));
+        return;
+    }
+
+    // The plan and the profile view are rebuilt when the tail frame arrives
+    logRx(QString("HEADER_WRITE: %1").arg(m_upload.header().toString()));
+}
+
+void SimulationEngine::handleFrameWrite(const QByteArray &value) {
+    int index = 0;
+    ProfileUpload::Result result = m_upload.writeFrame(value, &index);
+    switch (result) {
+    case ProfileUpload::Invalid:
+        logRx(QString("FRAME_WRITE: invalid size %1").arg(value.size()));
+        break;
+    case ProfileUpload::Extension: {
+        const ProfileFrame frame = m_upload.frame(index);
+        logRx(QString("FRAME_EXT[%1]: limiter=%2, range=%3")
+            .arg(index)
+            .arg(frame.limiterValue, 0, 'f', 1)
+            .arg(frame.limiterRange, 0, 'f', 1));
+        break;
+    }
+    case ProfileUpload::Tail:
+        logRx(QString("FRAME_WRITE: Tail frame received (profile complete)"));
+        break;
+    case ProfileUpload::Frame:
+        logRx(QString("FRAME_WRITE[%1]: %2").arg(index).arg(m_upload.frame(index).toString()));
+        break;
+    case ProfileUpload::NoHeader:
+        logRx(QString("FRAME_WRITE[%1]: no HEADER_WRITE yet, ignored").arg(index));
+        break;
+    default:
+        logRx(QString("FRAME_WRITE: index %1 out of range").arg(index));
+        break;
+    }
+
+    // Extensions written after the tail amend the finished upload
+    if (MachineModel::uploadFinished(m_upload, result)) compileProfile();
+}
+
+void SimulationEngine::compileProfile() {
+    if (!m_plan.isEmpty() && m_upload.key() == m_profileKey) {
+        logRx(QString("Profile %1 unchanged, keeping its plan").arg(m_profileId));
+        return;
+    }
+
+    bool hit = false;
+    loadProfile(m_profiles.add(m_upload, &hit));
+    logRx(QString(hit ? "Profile %1 from cache (%2 frames)" : "Profile %1 compiled (%2 frames)")
+        .arg(m_profileId).arg(m_plan.steps.size()));
+}
+
+void SimulationEngine::loadProfile(const ProfileCache::Entry &entry) {
+    m_upload.restore(entry.header, entry.frames, entry.key);
+    m_plan = entry.plan;
+    m_profileKey = entry.key;
+    m_profileId = entry.id;
+    updateProfileDisplay();
+}
+
+void SimulationEngine::handleShotSettings(const QByteArray &value) {
+    DE1::ShotSettings s;
+    if (!DE1::ShotSettingsLayout::decode(reinterpret_cast<const uint8_t*>(value.constData()), value.size(), s)) {
+        logRx(QString("SHOT_SETTINGS: invalid size %1").arg(value.size()));
+        return;
+    }
+
+    // The daemon's SHOT_SETTINGS now holds this too; we keep it for the
+    // next static answers
+    m_shotSettings = value.left(DE1::SHOT_SETTINGS_SIZE);
+
+    logRx(QString("SHOT_SETTINGS: steam=%1C/%2s, hotWater=%3C/%4mL, espresso=%5mL, groupTemp=%6C")
+        .arg(s.steamTemp).arg(s.steamDuration)
+        .arg(s.hotWaterTemp).arg(s.hotWaterVolume)
+        .arg(s.espressoVolume)
+        .arg(s.groupTemp, 0, 'f', 1));
+}
+
+// === Send to Pi ===
+
+void SimulationEngine::sendRaw(const QByteArray &bytes) {
+    if (!m_transport->isOpen()) return;
+
+    m_batcher->enqueue(bytes);
+    m_bytesQueued += bytes.size();
+}
+
+void SimulationEngine::sendCommand(const QJsonObject &cmd) {
+    sendRaw(QJsonDocument(cmd).toJson(QJsonDocument::Compact) + "\n");
+}
+
+void SimulationEngine::pushStaticAnswers() {
+    if (!m_daemonAnswers || !m_transport->isOpen()) return;
+    sendCommand(MachineModel::staticAnswers(m_mmr, m_ghcStatus, m_shotSettings));
+}
+
+void SimulationEngine::sendNotification(const QString &charId, const QByteArray &data) {
+    sendNotification(Wire::charIdFromString(charId), data);
+}
+
+void SimulationEngine::sendNotification(quint16 id, const QByteArray &data) {
+    if ((m_faultDropPercent > 0 || m_faultDelayMs > 0) && (m_faultChar == 0 || m_faultChar == id)) {
+        if (int(m_faultRandom.bounded(100)) < m_faultDropPercent) {
+            m_faultsDropped++;
+            return;
+        }
+        if (m_faultDelayMs > 0) {
+            m_faultsDelayed++;
+            QTimer::singleShot(m_simClock.wallMs(m_faultDelayMs / 1000.0), this, [this, id, data]() {
+                transmitNotification(id, data);
+            });
+            return;
+        }
+    }
+    transmitNotification(id, data);
+}
+
+void SimulationEngine::transmitNotification(quint16 id, const QByteArray &data) {
+    static const quint16 shotSampleId = Wire::charIdFromString(DE1::CHAR_SHOT_SAMPLE);
+
+    if (m_traceWriter.isOpen()) {
+        m_traceWriter.record(Trace::KindNotify, id, data, m_traceClock.nsecsElapsed() / 1000);
+    }
+    if (!m_transport->isOpen()) return;
+
+    Wire::FrameTiming timing;
+    if (m_timing) timing = stampNotification(id);
+
+    QByteArray frame;
+    if (m_binaryProtocol) {
+        frame = Wire::encodeFrame(Wire::FrameNotify, id, data, -1, m_timing ? &timing : nullptr);
+    }
+    if (!frame.isEmpty()) {
+        sendRaw(frame);
+    } else {
+        QJsonObject cmd;
+        cmd["cmd"] = "notify";
+        cmd["char"] = Wire::charIdToString(id);
+        cmd["data"] = QString(data.toHex());
+        if (m_timing) {
+            cmd["seq"] = timing.seq;
+            cmd["t"] = qint64(timing.sentUs);
+        }
+        sendCommand(cmd);
+    }
+    if (m_timing) m_timedUnwritten.enqueue({m_bytesQueued, timing.seq});
+
+    // Remember where a sample ends in the outgoing stream so
+    // onBytesWritten() can count it as delivered. Only here, once the
+    // bytes are really queued: not for dropped ones, and a delayed one
+    // when it finally goes out.
+    if (id == shotSampleId) {
+        m_samplesSent++;
+        m_sampleMarks.enqueue({m_bytesQueued, m_latencyClock.nsecsElapsed()});
+    }
+}
+
+Wire::FrameTiming SimulationEngine::stampNotification(quint16 charId) {
+    Wire::FrameTiming timing;
+    timing.seq = m_nextSeq++;
+
+    TimedNotify &t = m_timedRing[timing.seq % TIMED_RING_SIZE];
+    if (t.pending) m_latency.addUnacked(1);
+    t.pending = true;
+    t.seq = timing.seq;
+    t.charId = charId;
+    t.producedNs = m_latencyClock.nsecsElapsed();
+    t.writtenNs = -1;
+
+    timing.sentUs = quint32(t.producedNs / 1000);
+    return timing;
+}
+
+QByteArray SimulationEngine::cachedValue(const QJsonObject &cache, const char *charId) {
+    return QByteArray::fromHex(cache[charId].toString().toLatin1());
+}
+
+QByteArray SimulationEngine::stateInfoValue() const {
+    QByteArray data(DE1::STATE_INFO_SIZE, 0);
+    DE1::encodeStateInfo(m_currentState, m_currentSubState, reinterpret_cast<uint8_t*>(data.data()));
+    return data;
+}
+
+QByteArray SimulationEngine::waterLevelValue() const {
+    QByteArray data(DE1::WATER_LEVELS_SIZE, 0);
+    DE1::encodeWaterLevels(m_waterLevel, reinterpret_cast<uint8_t*>(data.data()));
+    return data;
+}
+
+void SimulationEngine::sendStateNotification() {
+    sendNotification(DE1::CHAR_STATE_INFO, stateInfoValue());
+    logTx(QString("STATE_INFO: %1/%2")
+        .arg(DE1::stateName(m_currentState))
+        .arg(DE1::subStateName(m_currentSubState)));
+}
+
+void SimulationEngine::sendWaterLevel() {
+    if (!m_transport->isOpen()) return;
+    sendNotification(DE1::CHAR_WATER_LEVELS, waterLevelValue());
+}
+
+void SimulationEngine::sendShotSample() {
+    if (m_recordingShot) {
+        m_shot.append({float(m_shotTimer_s), float(m_pressure), float(m_flow), float(m_temperature),
+                       float(m_setPressure), float(m_setFlow), float(m_setTemp), float(m_frameNumber)});
+    }
+    if (m_liveSamplesWanted) {
+        m_liveSamples.append({m_latencyClock.nsecsElapsed() / 1e9, float(m_pressure), float(m_flow),
+                              float(m_temperature), float(m_setPressure), float(m_setFlow), float(m_setTemp)});
+    }
+    if (!m_transport->isOpen()) return;
+
+    DE1::ShotSample sample;
+    sample.timer = m_shotTimer_s;
+    sample.groupPressure = m_pressure;
+    sample.groupFlow = m_flow;
+    sample.mixTemp = m_temperature;
+    sample.headTemp = m_temperature;
+    sample.setMixTemp = m_setTemp;
+    sample.setHeadTemp = m_setTemp;
+    sample.setPressure = m_setPressure;
+    sample.setFlow = m_setFlow;
+    sample.frameNumber = m_frameNumber;
+    sample.steamTemp = m_steamTemp;
+
+    QByteArray data(DE1::SHOT_SAMPLE_SIZE, 0);
+    DE1::encodeShotSample(sample, reinterpret_cast<uint8_t*>(data.data()));
+
+    sendNotification(DE1::CHAR_SHOT_SAMPLE, data);
+    if (m_logSamples) {
+        logTx(QString("SHOT_SAMPLE: t=%1s P=%2 F=%3 T=%4 frame=%5")
+            .arg(m_shotTimer_s, 0, 'f', 2)
+            .arg(m_pressure, 0, 'f', 2)
+            .arg(m_flow, 0, 'f', 2)
+            .arg(m_temperature, 0, 'f', 1)
+            .arg(m_frameNumber));
+    }
+}
+
+void SimulationEngine::onBytesWritten(qint64 bytes) {
+    m_bytesWritten += bytes;
+    qint64 now = m_latencyClock.nsecsElapsed();
+    while (!m_sampleMarks.isEmpty() && m_sampleMarks.head().endOffset <= m_bytesWritten) {
+        qint64 latency = now - m_sampleMarks.dequeue().sentNs;
+        m_latencySumNs += latency;
+        m_latencyMaxNs = qMax(m_latencyMaxNs, latency);
+        m_samplesDelivered++;
+    }
+    while (!m_timedUnwritten.isEmpty() && m_timedUnwritten.head().endOffset <= m_bytesWritten) {
+        TimedNotify &t = m_timedRing[m_timedUnwritten.dequeue().seq % TIMED_RING_SIZE];
+        if (t.pending && t.writtenNs < 0) t.writtenNs = now;
+    }
+
+    if (m_replayBlocked && m_bytesQueued - m_bytesWritten <= REPLAY_MAX_IN_FLIGHT / 2) {
+        m_replayBlocked = false;
+        pumpReplay();
+    }
+}
+
+// === Trace replay ===
+
+void SimulationEngine::pumpReplay() {
+    if (!m_traceReader.isOpen()) return;
+
+    QElapsedTimer slice;
+    slice.start();
+    while (m_replayHasNext) {
+        if (!m_transport->isOpen()) {
+            finishReplay(false);
+            return;
+        }
+
+        if (m_replaySpeed > 0) {
+            qint64 dueNs = qint64(m_replayNext.timeUs * 1000 / m_replaySpeed);
+            qint64 waitNs = dueNs - m_replayClock.nsecsElapsed();
+            if (waitNs > 0) {
+                m_replayTimer->start(static_cast<int>((waitNs + 999999) / 1000000));
+                return;
+            }
+        } else if (m_bytesQueued - m_bytesWritten > REPLAY_MAX_IN_FLIGHT) {
+            m_replayBlocked = true;
+            return;
+        }
+
+        if (m_replayNext.kind == Trace::KindNotify) {
+            transmitNotification(m_replayNext.charId, m_replayNext.payload.toByteArray());
+            m_replayed++;
+        }
+        m_replayHasNext = m_traceReader.next(m_replayNext);
+
+        if (slice.nsecsElapsed() > REPLAY_SLICE_NS) {
+            m_replayTimer->start(0);
+            return;
+        }
+    }
+    finishReplay(true);
+}
+
+void SimulationEngine::finishReplay(bool completed) {
+    m_replayTimer->stop();
+    m_replayBlocked = false;
+    m_traceReader.close();
+
+    log(QString("Replay %1: %2 notification(s) in %3 s")
+        .arg(completed ? "finished" : "stopped").arg(m_replayed)
+        .arg(m_replayClock.nsecsElapsed() / 1e9, 0, 'f', 2));
+    if (m_transport->isOpen()) m_waterTimer->start();
+    emit traceStateChanged(m_traceWriter.isOpen(), false);
+    emit replayFinished(m_replayed, completed);
+}
+
+void SimulationEngine::expireTimedNotifications() {
+    qint64 cutoff = m_latencyClock.nsecsElapsed() - qint64(ACK_TIMEOUT_MS) * 1000000;
+    int expired = 0;
+    for (TimedNotify &t : m_timedRing) {
+        if (t.pending && t.producedNs < cutoff) {
+            t.pending = false;
+            expired++;
+        }
+    }
+    if (expired > 0) m_latency.addUnacked(expired);
+}
+
+void SimulationEngine::resetTiming() {
+    m_timing = false;
+    m_timedUnwritten.clear();
+    for (TimedNotify &t : m_timedRing) t.pending = false;
+}
+
+void SimulationEngine::resetRateCounters() {
+    m_bytesQueued = 0;
+    m_bytesWritten = 0;
+    m_sampleMarks.clear();
+    m_samplesSent = 0;
+    m_samplesDelivered = 0;
+    m_latencySumNs = 0;
+    m_latencyMaxNs = 0;
+    m_rateWindow.start();
+    m_latency.clear();
+
+    m_bleStatsWindow.invalidate();
+    m_bleSamplesSent = 0;
+    m_bleSamplesCoalesced = 0;
+    m_bleDropped = 0;
+    m_bleSampleRate = 0.0;
+    m_bleCoalescedRate = 0.0;
+}
+
+void SimulationEngine::reportLoad() {
+    double secs = m_rateWindow.nsecsElapsed() / 1e9;
+    if (secs <= 0) return;
+
+    // The daemon only reports while its counters change
+    if (m_bleStatsWindow.isValid() && m_bleStatsWindow.elapsed() > 2500) {
+        m_bleSampleRate = 0.0;
+        m_bleCoalescedRate = 0.0;
+    }
+
+    LoadReport report;
+    report.requestedHz = m_shotTimer->isActive() ? m_sampleRateHz : 0;
+    report.sentHz = m_samplesSent / secs;
+    report.deliveredHz = m_samplesDelivered / secs;
+    report.queued = m_sampleMarks.size();
+    report.bleHz = m_bleSampleRate;
+    report.bleCoalescedHz = m_bleCoalescedRate;
+    if (m_samplesDelivered > 0) report.latencyAvgMs = m_latencySumNs / 1e6 / m_samplesDelivered;
+    report.latencyMaxMs = m_latencyMaxNs / 1e6;
+    report.bleIntervalMs = m_bleIntervalMs;
+    if (m_health.heartbeat()) report.rttMs = m_health.lastRttMs();
+    emit loadReported(report);
+
+    if (m_timing) {
+        expireTimedNotifications();
+        emit latencyReported(m_latency.takeReport());
+    }
+
+    // Start a new window, keeping undelivered samples queued
+    m_samplesSent = 0;
+    m_samplesDelivered = 0;
+    m_latencySumNs = 0;
+    m_latencyMaxNs = 0;
+    m_rateWindow.start();
+}
+
+// === Simulation ===
+
+void SimulationEngine::onShotTimerTick() {
+    // Derive the shot time from the sim clock rather than counting
+    // ticks, so timer jitter or missed ticks don't skew the timeline
+    double elapsed = m_simClock.now() - m_operationStart;
+    double dt = qMax(0.0, elapsed - m_shotTimer_s);
+    m_shotTimer_s = elapsed;
+    updateSimulationValues();
+    drainWater(m_flow * dt);
+    sendShotSample();
+    m_snapshotDirty = true;
+}
+
+void SimulationEngine::drainWater(double ml) {
+    if (ml <= 0) return;
+    m_waterLevel = qMax(0.0, m_waterLevel - ml / TANK_ML * 100.0);
+    if (m_waterLevel < REFILL_BELOW) {
+        m_waterLevel = START_WATER_LEVEL;
+        log(QString("Water tank refilled to %1 %").arg(START_WATER_LEVEL));
+        sendWaterLevel();
+    }
+}
+
+void SimulationEngine::startPhase(double simSeconds) {
+    m_phaseEnd = m_simClock.now() + simSeconds;
+    m_phaseTimer->start(m_simClock.wallMs(simSeconds));
+}
+
+void SimulationEngine::updateSimulationValues() {
+    if (m_currentState == DE1::State::Steam) {
+        m_pressure = 1.5;
+        m_flow = 0.0;
+        m_steamTemp = qMin(150.0, 100.0 + m_shotTimer_s * 2.0);
+    } else if (m_currentState == DE1::State::HotWater) {
+        m_pressure = 0.5;
+        m_flow = 6.0;
+    } else if (m_currentState == DE1::State::HotWaterRinse) {
+        m_pressure = 1.0;
+        m_flow = 8.0;
+    }
+}
+
+void SimulationEngine::onPhaseTimeout() {
+    if (m_currentState == DE1::State::Espresso) {
+        // Preinfusion/Pouring are driven by the profile, see onPhysicsTick()
+        if (m_currentSubState == DE1::SubState::Heating) {
+            startProfile();
+        } else if (m_currentSubState == DE1::SubState::Ending) {
+            stopOperation();
+        }
+    } else if (m_currentState == DE1::State::Steam) {
+        stopOperation();
+    } else if (m_currentState == DE1::State::HotWater) {
+        stopOperation();
+    } else if (m_currentState == DE1::State::HotWaterRinse) {
+        stopOperation();
+    }
+}
+
+void SimulationEngine::startProfile() {
+    if (m_upload.inProgress()) {
+        log("Profile upload not finished (no tail frame yet)", "WARN");
+    }
+
+    if (!m_plan.isEmpty()) {
+        m_executor.load(m_plan);
+        log(QString("Running uploaded profile (%1 frames)").arg(m_plan.steps.size()));
+    } else {
+        ProfileHeader header;
+        QVector<ProfileFrame> frames;
+        ProfileExecutor::defaultProfile(header, frames);
+        m_executor.load(ProfilePlan::compile(header, frames));
+        log("No profile uploaded - running built-in default");
+    }
+
+    m_executor.start(m_temperature);
+    m_physicsStart = m_simClock.now();
+    m_physicsSteps = 0;
+    m_physicsTimer->start();
+
+    if (!m_executor.isRunning()) {
+        log("Profile has no frames to run", "WARN");
+        transitionToState(DE1::State::Espresso, DE1::SubState::Ending);
+        startPhase(MachineModel::ENDING_S);
+        return;
+    }
+
+    transitionToState(DE1::State::Espresso, m_executor.inPreinfusion()
+        ? DE1::SubState::Preinfusion : DE1::SubState::Pouring);
+}
+
+void SimulationEngine::onPhysicsTick() {
+    // Catch up in fixed steps to sim time. A stall longer than
+    // MAX_CATCHUP_STEPS (per unit of sim speed) is skipped rather than
+    // replayed in one burst.
+    qint64 maxCatchup = static_cast<qint64>(MachineModel::MAX_CATCHUP_STEPS * qMax(1.0, m_simClock.speed()));
+    qint64 due = static_cast<qint64>((m_simClock.now() - m_physicsStart) / ProfileExecutor::STEP_S);
+    if (due - m_physicsSteps > maxCatchup) m_physicsSteps = due - maxCatchup;
+
+    int lastFrame = m_executor.frameIndex();
+    while (m_physicsSteps < due) {
+        m_executor.step();
+        m_physicsSteps++;
+    }
+
+    m_pressure = m_executor.pressure();
+    m_flow = m_executor.flow();
+    m_temperature = m_executor.temperature();
+    m_setPressure = m_executor.setPressure();
+    m_setFlow = m_executor.setFlow();
+    m_setTemp = m_executor.setTemp();
+    m_frameNumber = m_executor.frameIndex();
+
+    if (m_frameNumber != lastFrame) {
+        log(QString("Profile frame %1 at %2s").arg(m_frameNumber).arg(m_executor.time(), 0, 'f', 2));
+    }
+
+    if (m_currentSubState == DE1::SubState::Ending) return;
+
+    if (!m_executor.isRunning()) {
+        log(QString("Profile complete: %1 mL in %2s")
+            .arg(m_executor.volume(), 0, 'f', 1)
+            .arg(m_executor.time(), 0, 'f', 1));
+        transitionToState(DE1::State::Espresso, DE1::SubState::Ending);
+        startPhase(MachineModel::ENDING_S);
+    } else if (m_currentSubState == DE1::SubState::Preinfusion && !m_executor.inPreinfusion()) {
+        transitionToState(DE1::State::Espresso, DE1::SubState::Pouring);
+    }
+}
+
+void SimulationEngine::transitionToState(DE1::State state, DE1::SubState subState) {
+    if (state == DE1::State::Espresso && m_currentState != DE1::State::Espresso) {
+        m_shot.clear(QDateTime::currentDateTime());
+        m_recordingShot = true;
+    } else if (state != DE1::State::Espresso && m_recordingShot) {
+        finishShot();
+    }
+    m_currentState = state;
+    m_currentSubState = subState;
+    sendStateNotification();
+
+    // State changes go to the window right away, not at the next snapshot tick
+    publishSnapshot();
+}
+
+void SimulationEngine::finishShot() {
+    m_recordingShot = false;
+    if (m_shot.isEmpty()) return;
+
+    log(QString("Shot recorded: %1 samples over %2 s%3")
+        .arg(m_shot.size())
+        .arg(m_shot.duration(), 0, 'f', 1)
+        .arg(m_shot.truncated() > 0 ? QString(", %1 past the %2 s reservation dropped")
+                                          .arg(m_shot.truncated()).arg(SHOT_CAPACITY_S)
+                                    : QString()));
+    emit shotRecorded(m_shot.detached());
+}
+
+void SimulationEngine::publishSnapshot() {
+    EngineSnapshot snap;
+    snap.state = m_currentState;
+    snap.subState = m_currentSubState;
+    snap.pressure = m_pressure;
+    snap.flow = m_flow;
+    snap.temperature = m_temperature;
+    snap.shotTime = m_shotTimer_s;
+    snap.waterLevel = m_waterLevel;
+    snap.frameNumber = m_frameNumber;
+    m_snapshotDirty = false;
+    emit snapshotReady(snap);
+}
+
+void SimulationEngine::updateProfileDisplay() {
+    QString text;
+    text += m_profileId.isEmpty() ? QString("=== CURRENT PROFILE ===\n\n")
+                                  : QString("=== CURRENT PROFILE %1 ===\n\n").arg(m_profileId);
+
+    const ProfileHeader &header = m_upload.header();
+    if (header.numFrames == 0) {
+        text += "(No profile uploaded yet)\n";
+    } else {
+        text += header.toString() + "\n\n";
+
+        const QVector<ProfileFrame> &frames = m_upload.frames();
+        for (int i = 0; i < frames.size(); i++) {
+            if (i < header.numPreinfuseFrames) {
+                text += "[Preinfuse] ";
+            } else {
+                text += "[Pour]      ";
+            }
+            text += frames[i].toString() + "\n";
+        }
+    }
+
+    emit profileChanged(text);
+}
+
+void SimulationEngine::beginOperation(DE1::State state) {
+    if (m_currentState != DE1::State::Idle && m_currentState != DE1::State::Sleep) {
+        return;
+    }
+    if (m_traceReader.isOpen()) {
+        log(QString("Replaying a trace - ignoring %1").arg(DE1::stateName(state)), "WARN");
+        return;
+    }
+
+    MachineModel::Phase phase;
+    if (!MachineModel::firstPhase(state, phase)) return;
+
+    m_shotTimer_s = 0.0;
+    m_pressure = 0.0;
+    m_flow = 0.0;
+    m_frameNumber = 0;
+
+    transitionToState(state, phase.subState);
+    startPhase(phase.seconds);
+
+    m_operationStart = m_simClock.now();
+    m_shotTimer->start();
+    m_snapshotDirty = true;
+}
@@ -0,0 +1,478 @@
+/*
+ * DE1 simulation engine - state machine, profile execution and the TCP
+ * link to the Pi daemon, shared by the GUI and de1sim-headless
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QMetaType>
+#include <QFile>
+#include <QRandomGenerator>
+
+#include <atomic>
+
+#include "de1-protocol.h"
+#include "latency-stats.h"
+#include "link-health.h"
+#include "machine-model.h"
+#include "mmr-registers.h"
+#include "profile.h"
+#include "shot-timeline.h"
+#include "sim-clock.h"
+#include "trace.h"
+#include "transport.h"
+#include "pi-daemon/de1-wire.h"
+
+// ============================================================================
+// Simulation Engine - state machine, profile storage and Pi link
+// ============================================================================
+//
+// Needs only QtCore and QtNetwork. The GUI runs it on its own thread so
+// widget layout, log rendering or a window resize can't delay STATE_INFO or
+// SHOT_SAMPLE; the window only gets throttled snapshots and drives the
+// engine through queued calls. de1sim-headless runs it on the main thread.
+
+struct EngineSnapshot {
+    DE1::State state = DE1::State::Idle;
+    DE1::SubState subState = DE1::SubState::Ready;
+    double pressure = 0.0;
+    double flow = 0.0;
+    double temperature = 0.0;
+    double shotTime = 0.0;
+    double waterLevel = 0.0;
+    int frameNumber = 0;
+};
+
+// Every SHOT_SAMPLE's values, for the live plot; they go to the window in
+// batches with the snapshots, so none are lost at 25-50 Hz
+struct LiveSample {
+    double timeS = 0.0;         // Engine wall clock when the sample was produced
+    float pressure = 0.0f;
+    float flow = 0.0f;
+    float temperature = 0.0f;
+    float setPressure = 0.0f;
+    float setFlow = 0.0f;
+    float setTemperature = 0.0f;
+};
+
+using LiveSamples = QVector<LiveSample>;
+
+// SHOT_SAMPLE load over the last report interval
+struct LoadReport {
+    int requestedHz = 0;
+    double sentHz = 0.0;        // Produced by the simulator
+    double deliveredHz = 0.0;   // Written by the TCP socket
+    int queued = 0;             // Samples not yet written
+    double bleHz = 0.0;         // Notified by the Pi
+    double bleCoalescedHz = 0.0;
+    double latencyAvgMs = 0.0;  // SHOT_SAMPLE produced until the transport delivered it
+    double latencyMaxMs = 0.0;
+    double bleIntervalMs = 0.0; // Negotiated BLE connection interval, 0 = not reported
+    double rttMs = -1.0;        // Last heartbeat round trip, -1 = no heartbeats
+};
+
+Q_DECLARE_METATYPE(EngineSnapshot)
+Q_DECLARE_METATYPE(LiveSamples)
+Q_DECLARE_METATYPE(LoadReport)
+
+class SimulationEngine : public QObject {
+    Q_OBJECT
+
+public:
+    enum class LinkStatus { Neutral, Busy, Ok, Error };
+    Q_ENUM(LinkStatus)
+
+    static constexpr int SNAPSHOT_INTERVAL_MS = 50;   // Window updates at most 20 Hz
+    static constexpr int SHOT_CAPACITY_S = 180;       // Wall seconds of samples reserved per shot
+    static constexpr int LIVE_SAMPLES_RESERVE = 16;   // Per snapshot interval; 50 Hz needs 3
+
+    static constexpr double WATER_INTERVAL_S = 5.0;     // Sim seconds between WATER_LEVELS
+    static constexpr double TANK_ML = 2000.0;           // 100 % on the water level
+    static constexpr double REFILL_BELOW = 10.0;        // Simulated refill to the start level, %
+    static constexpr double START_WATER_LEVEL = 75.0;
+
+    // Replay speed that sends the trace as fast as the link takes it
+    static constexpr double REPLAY_AS_FAST_AS_POSSIBLE = 0.0;
+
+    SimulationEngine(QObject *parent = nullptr);
+
+    // These are plain flags, safe to set from the window thread
+    void setGhcStatus(int status);
+    void setLogSamples(bool enabled) { m_logSamples = enabled; }
+    void setLiveSamples(bool enabled) { m_liveSamplesWanted = enabled; }
+    void setBinaryProtocol(bool enabled) { m_useBinary = enabled; }
+    void setLatencyTiming(bool enabled) { m_useTiming = enabled; }     // From the next connection
+
+public slots:
+    // Call once the engine lives on its thread
+    void start();
+    void setTarget(const QString &host, int port);
+    void connectToPi();
+
+    // Stays disconnected until connectToPi()
+    void disconnectFromPi();
+
+    // Timed notifications acked since the link connected
+    void exportLatencyCsv(const QString &path);
+
+    // === MMR registers ===
+
+    // Merges a register dump (see MmrRegisterFile) over the current values
+    void loadMmrDump(const QString &path);
+    void exportMmrDump(const QString &path);
+
+    // === Traces ===
+
+    // Records every notification sent and every write the app makes
+    void startRecording(const QString &path);
+    void stopRecording();
+
+    // Sends the trace's notifications byte for byte, with their recorded
+    // spacing divided by speed (REPLAY_AS_FAST_AS_POSSIBLE: no spacing).
+    // Injected faults don't apply: the trace already holds what was sent.
+    // The simulator's own operations are stopped while it plays; app
+    // writes are still answered, the recorded ones are skipped.
+    void startReplay(const QString &path, double speed);
+    void stopReplay();
+
+    // Sim seconds per wall second. Phases, the shot timer in SHOT_SAMPLE,
+    // profile physics and the water drain all follow it; the SHOT_SAMPLE
+    // rate stays in wall time, so samples just land further apart in sim time.
+    void setSimSpeed(double speed);
+
+    double simSpeed() const { return m_simClock.speed(); }
+
+    void setSampleRate(int hz);
+
+    // GHC buttons: start the operation, or stop it if it's already running
+    void toggleOperation(DE1::State state);
+
+    // Scripted control: unlike the toggles these are no-ops when the
+    // machine is already in the requested state
+    void startOperation(DE1::State state);
+    void wake();
+    void sleep();
+    void togglePower();
+    void stopOperation();
+
+    // === Fault injection ===
+
+    // Scenario faults (core/scenario.h): the app sees these as it would a
+    // misbehaving machine or link
+
+    // The tank jumps to percent and the app hears about it right away; the
+    // drain carries on from there
+    void setWaterLevel(double percent);
+
+    // What the firmware reports when it gives up. It stays there until
+    // stopOperation() or an app's REQUESTED_STATE.
+    void injectFatalError();
+
+    // Drops the daemon link without a goodbye, like a Wi-Fi outage; the
+    // backoff reconnects as usual
+    void dropLink();
+
+    // === Profiles ===
+
+    // A profile the app uploaded earlier (id as logged on upload), as if it
+    // had been uploaded again; takes effect from the next shot
+    void useProfile(const QString &id);
+
+    // Drops dropPercent of the notifications to charId (empty: all of them)
+    // and holds back the rest for delayMs of sim time. The drops follow a
+    // fixed seed, so a scenario loses the same notifications on every run.
+    void setNotificationFaults(int dropPercent, const QString &charId, int delayMs);
+
+signals:
+    void logMessage(const QString &category, const QString &msg);
+    void linkStatusChanged(SimulationEngine::LinkStatus status, const QString &text);
+    void linkConnectedChanged(bool connected);
+    void bleClientChanged(const QString &client);   // Empty when none
+    void statusMessage(const QString &msg);
+    void snapshotReady(const EngineSnapshot &snapshot);
+    void loadReported(const LoadReport &report);
+    void latencyReported(const LatencyReport &report);  // Only while timing is negotiated
+    void traceStateChanged(bool recording, bool replaying);
+    void replayFinished(qint64 notifications, bool completed);
+    void profileChanged(const QString &text);
+    void rttMeasured(double ms);                    // Every pong
+    void shotRecorded(const ShotTimeline &shot);    // Each espresso shot, once it ends
+    void liveSamplesReady(const LiveSamples &samples);  // With setLiveSamples(true)
+    void appWrote(const QString &charId, const QByteArray &value);  // Every app write, answered by the Pi or not
+
+private:
+    void log(const QString& msg, const QString& category = "INFO");
+
+    void logRx(const QString& msg) { log(msg, "RX"); }
+    void logTx(const QString& msg) { log(msg, "TX"); }
+    void logPi(const QString& msg) { log(msg, "PI"); }
+
+    void useTransport(Transport *transport);
+
+    // Swaps TCP for loopback (or back) when the target changed kind; only
+    // called while the transport is idle
+    void ensureTransport();
+
+    // Next attempt after the backoff delay; a no-op while one is pending
+    void scheduleReconnect();
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onSocketError();
+    void tryAutoReconnect();
+
+    // A pong overdue means the link is half-open: abort it and let the
+    // backoff reconnect instead of waiting for TCP to time out
+    void onHeartbeat();
+
+private:
+    void onDataReceived();
+    void handlePiFrame(const Wire::Message &msg);
+    void handlePiEvent(const QJsonObject &event);
+
+    // Each ack is [seq, sent_us, parse_us, ble_us, hold_us], with ble_us and
+    // hold_us -1 if the daemon never wrote the notification. The daemon's
+    // clock is unrelated to ours, so only its durations are used.
+    void handleTimingAcks(const QJsonArray &acks);
+
+    // Daemon queue counters are cumulative since we connected; we turn the
+    // SHOT_SAMPLE ones into per-second rates for the load readout
+    void handleDaemonStats(const QJsonObject &event);
+    void handleCharacteristicWrite(const QString &charId, const QByteArray &value);
+
+    // A write the daemon already answered from our static answers; it
+    // replied with the registers we pushed, so ours show what the app got
+    void handleAnsweredWrite(const QString &charId, const QByteArray &value);
+    void handleRequestedState(DE1::State requested);
+    void handleMMRReadRequest(const QByteArray &value);
+    void handleMMRWrite(const QByteArray &value);
+    void handleHeaderWrite(const QByteArray &value);
+    void handleFrameWrite(const QByteArray &value);
+
+    // A re-upload of the loaded profile keeps its plan and the profile
+    // view as they are; one uploaded earlier comes from m_profiles
+    void compileProfile();
+
+    // The upload takes the entry's decoded frames, so a cache hit is shown
+    // without decoding the frames again
+    void loadProfile(const ProfileCache::Entry &entry);
+    void handleShotSettings(const QByteArray &value);
+
+    // === Send to Pi ===
+
+    // Everything sent during one event-loop pass goes out in one write
+    void sendRaw(const QByteArray &bytes);
+    void sendCommand(const QJsonObject &cmd);
+
+    // Everything the daemon can answer without us: the MMR registers
+    // (GHC_INFO following the GHC status), VERSION and SHOT_SETTINGS. Pushed
+    // on ready and again whenever a register changes on our side; app writes
+    // to WRITE_TO_MMR the daemon tracks itself.
+    void pushStaticAnswers();
+    void sendNotification(const QString &charId, const QByteArray &data);
+
+    // Injected faults apply here, before the trace: a trace holds what the
+    // app was actually sent, and when. A dropped notification is never
+    // queued, so it isn't counted as a sent sample either.
+    void sendNotification(quint16 id, const QByteArray &data);
+    void transmitNotification(quint16 id, const QByteArray &data);
+
+    // Claims the next sequence number. A slot still waiting for its ack
+    // when the ring wraps around is counted as unacked.
+    Wire::FrameTiming stampNotification(quint16 charId);
+    static QByteArray cachedValue(const QJsonObject &cache, const char *charId);
+    QByteArray stateInfoValue() const;
+    QByteArray waterLevelValue() const;
+    void sendStateNotification();
+    void sendWaterLevel();
+    void sendShotSample();
+    void onBytesWritten(qint64 bytes);
+
+    // === Trace replay ===
+
+    // Sends every record that is due, for at most REPLAY_SLICE_NS per pass
+    // so the link's own events still get through. At full speed it stops
+    // while more than REPLAY_MAX_IN_FLIGHT bytes wait for the transport and
+    // onBytesWritten() picks it up again.
+    void pumpReplay();
+    void finishReplay(bool completed);
+
+    // Acks that never came (daemon restarted, BLE client went away with the
+    // notification queued, ...) leave the ring after ACK_TIMEOUT_MS
+    void expireTimedNotifications();
+    void resetTiming();
+    void resetRateCounters();
+    void reportLoad();
+
+    // === Simulation ===
+
+    void onShotTimerTick();
+
+    // Everything the group head pours comes out of the tank. Soak tests
+    // would otherwise run it dry, so an empty-ish tank is refilled.
+    void drainWater(double ml);
+
+    // Runs a timed phase for simSeconds of sim time
+    void startPhase(double simSeconds);
+
+    // Espresso values come from the profile executor (onPhysicsTick)
+    void updateSimulationValues();
+    void onPhaseTimeout();
+    void startProfile();
+    void onPhysicsTick();
+    void transitionToState(DE1::State state, DE1::SubState subState);
+
+    // The window gets its own copy; ours keeps its reservation for the next shot
+    void finishShot();
+    void publishSnapshot();
+    void updateProfileDisplay();
+    void beginOperation(DE1::State state);
+
+private:
+    // Pi link
+    QString m_host;
+    int m_port = 12345;
+    Transport *m_transport = nullptr;
+    Wire::StreamBuffer m_tcpBuffer;
+    Wire::WriteBatcher *m_batcher = nullptr;
+    bool m_binaryProtocol = false;  // Negotiated with the daemon after "ready"
+    bool m_timing = false;          // Likewise, timed notifications and acks
+    bool m_daemonAnswers = false;   // Daemon answers MMR reads from pushStaticAnswers()
+    bool m_autoReconnect = false;   // Off after disconnectFromPi()
+    LinkHealth m_health;
+    double m_bleIntervalMs = 0.0;   // From the daemon's "connection" event
+
+    // Set from the window thread
+    std::atomic<int> m_ghcStatus{3};
+    std::atomic<bool> m_logSamples{false};
+    std::atomic<bool> m_useBinary{true};
+    std::atomic<bool> m_useTiming{false};
+
+    // State
+    DE1::State m_currentState = DE1::State::Idle;
+    DE1::SubState m_currentSubState = DE1::SubState::Ready;
+
+    // MMR registers, including everything the app wrote
+    MmrRegisterFile m_mmr;
+    QByteArray m_shotSettings = DE1::defaultShotSettings();
+
+    // Profile data
+    ProfileUpload m_upload;
+    ProfilePlan m_plan;             // Compiled on the tail frame, run by m_executor
+    ProfileCache m_profiles;
+    QByteArray m_profileKey;        // m_plan's upload, see ProfileUpload::key()
+    QString m_profileId;
+
+    // Simulated values
+    double m_pressure = 0.0;
+    double m_flow = 0.0;
+    double m_temperature = 93.0;
+    double m_setTemp = 93.0;
+    double m_setPressure = 9.0;
+    double m_setFlow = 2.0;
+    double m_shotTimer_s = 0.0;
+
+    // Shot timeline, reserved up front so recording never allocates
+    ShotTimeline m_shot;
+    bool m_recordingShot = false;
+
+    // Live plot batch, flushed with the snapshots
+    std::atomic<bool> m_liveSamplesWanted{false};
+    LiveSamples m_liveSamples;
+    SimClock m_simClock;
+    double m_operationStart = 0.0;  // Sim time the running operation started
+    double m_phaseEnd = 0.0;        // Sim time m_phaseTimer is waiting for
+    double m_waterLevel = START_WATER_LEVEL;
+    double m_steamTemp = 0.0;
+    int m_frameNumber = 0;
+    int m_sampleRateHz = 5;
+
+    // Profile execution
+    ProfileExecutor m_executor;
+    double m_physicsStart = 0.0;    // Sim time the profile started
+    qint64 m_physicsSteps = 0;      // Fixed steps run since the profile started
+
+    // Timers
+    QTimer *m_shotTimer = nullptr;
+    QTimer *m_physicsTimer = nullptr;
+    QTimer *m_phaseTimer = nullptr;
+    QTimer *m_waterTimer = nullptr;
+    QTimer *m_reconnectTimer = nullptr;
+    QTimer *m_heartbeatTimer = nullptr;
+    QTimer *m_rateTimer = nullptr;
+    QTimer *m_snapshotTimer = nullptr;
+    bool m_snapshotDirty = false;
+
+    // Sample rate load reporting
+    struct SampleMark {
+        qint64 endOffset;               // Where the sample ends in the outgoing stream
+        qint64 sentNs;                  // m_latencyClock when sendShotSample() ran
+    };
+    qint64 m_bytesQueued = 0;           // Total bytes handed to the transport
+    qint64 m_bytesWritten = 0;          // Total bytes the transport has delivered
+    QQueue<SampleMark> m_sampleMarks;   // Samples not yet delivered
+    int m_samplesSent = 0;
+    int m_samplesDelivered = 0;
+    QElapsedTimer m_rateWindow;
+    QElapsedTimer m_latencyClock;
+    qint64 m_latencySumNs = 0;
+    qint64 m_latencyMaxNs = 0;
+
+    // Timed notifications waiting for the daemon's ack, by seq
+    static constexpr int TIMED_RING_SIZE = 4096;    // Divides 65536, so seq wraps cleanly
+    static constexpr int ACK_TIMEOUT_MS = 5000;
+    struct TimedNotify {
+        bool pending = false;
+        quint16 seq = 0;
+        quint16 charId = 0;
+        qint64 producedNs = 0;          // m_latencyClock
+        qint64 writtenNs = -1;          // Transport took the bytes
+    };
+    struct TimedMark {
+        qint64 endOffset;
+        quint16 seq;
+    };
+    QVector<TimedNotify> m_timedRing = QVector<TimedNotify>(TIMED_RING_SIZE);
+    QQueue<TimedMark> m_timedUnwritten;
+    quint16 m_nextSeq = 0;
+    LatencyStats m_latency;
+
+    // Traces
+    static constexpr qint64 REPLAY_SLICE_NS = 5000000;
+    static constexpr qint64 REPLAY_MAX_IN_FLIGHT = 256 * 1024;
+    TraceWriter m_traceWriter;
+    QElapsedTimer m_traceClock;
+    TraceReader m_traceReader;          // Open while replaying
+    Trace::Record m_replayNext;         // Valid while m_replayHasNext
+    bool m_replayHasNext = false;
+    bool m_replayBlocked = false;       // Waiting for the transport to drain
+    double m_replaySpeed = 1.0;
+    QElapsedTimer m_replayClock;
+    qint64 m_replayed = 0;
+    QTimer *m_replayTimer = nullptr;
+
+    // Daemon "stats" event (cumulative counters, rates derived per report)
+    QElapsedTimer m_bleStatsWindow;
+    qint64 m_bleSamplesSent = 0;
+    qint64 m_bleSamplesCoalesced = 0;
+    qint64 m_bleDropped = 0;
+    double m_bleSampleRate = 0.0;
+    double m_bleCoalescedRate = 0.0;
+
+    // Injected notification faults, see setNotificationFaults()
+    static constexpr quint32 FAULT_SEED = 0xDE1;
+    int m_faultDropPercent = 0;
+    int m_faultDelayMs = 0;             // Sim ms
+    quint16 m_faultChar = 0;            // 0 = every characteristic
+    QRandomGenerator m_faultRandom{FAULT_SEED};
+    qint64 m_faultsDropped = 0;
+    qint64 m_faultsDelayed = 0;
+};
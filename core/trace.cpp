@@ -0,0 +1,136 @@
+#include "trace.h"
+
+#include <cstring>
+#include <limits>
+
+// === Writer ===
+
+bool TraceWriter::open(const QString &path, QString *error) {
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (error) *error = m_file.errorString();
+        return false;
+    }
+
+    char header[Trace::HEADER_SIZE] = {};
+    memcpy(header, Trace::MAGIC, sizeof(Trace::MAGIC));
+    header[8] = static_cast<char>(Trace::VERSION >> 8);
+    header[9] = static_cast<char>(Trace::VERSION & 0xFF);
+    m_buffer.reserve(FLUSH_BYTES + Trace::RECORD_HEADER_SIZE + 255);
+    m_buffer.append(header, sizeof(header));
+    m_lastUs = -1;
+    m_records = 0;
+    return true;
+}
+
+void TraceWriter::close() {
+    if (!m_file.isOpen()) return;
+    flush();
+    m_file.close();
+}
+
+void TraceWriter::record(Trace::Kind kind, quint16 charId, QByteArrayView payload, qint64 timeUs) {
+    if (!m_file.isOpen()) return;
+
+    // Longer payloads can't occur on BLE; don't write a record we can't read back
+    qsizetype len = qMin<qsizetype>(payload.size(), 255);
+
+    qint64 delta = m_lastUs < 0 ? 0 : qBound<qint64>(0, timeUs - m_lastUs, std::numeric_limits<quint32>::max());
+    m_lastUs = timeUs;
+
+    char h[Trace::RECORD_HEADER_SIZE];
+    h[0] = static_cast<char>(kind);
+    h[1] = static_cast<char>(charId >> 8);
+    h[2] = static_cast<char>(charId & 0xFF);
+    h[3] = static_cast<char>(len);
+    for (int i = 0; i < 4; i++) {
+        h[4 + i] = static_cast<char>((quint32(delta) >> (24 - 8 * i)) & 0xFF);
+    }
+    m_buffer.append(h, sizeof(h));
+    m_buffer.append(payload.data(), len);
+    m_records++;
+
+    if (m_buffer.size() >= FLUSH_BYTES) flush();
+}
+
+void TraceWriter::flush() {
+    if (!m_file.isOpen() || m_buffer.isEmpty()) return;
+    m_file.write(m_buffer);
+    m_file.flush();
+    m_buffer.resize(0);     // Keeps the allocation for the next batch
+}
+
+// === Reader ===
+
+bool TraceReader::open(const QString &path, QString *error) {
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        if (error) *error = m_file.errorString();
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size < Trace::HEADER_SIZE) {
+        if (error) *error = "Not a DE1 trace (too short)";
+        m_file.close();
+        return false;
+    }
+
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        if (error) *error = "Can't map file: " + m_file.errorString();
+        m_file.close();
+        return false;
+    }
+
+    if (memcmp(m_data, Trace::MAGIC, sizeof(Trace::MAGIC)) != 0) {
+        if (error) *error = "Not a DE1 trace";
+        close();
+        return false;
+    }
+
+    quint16 version = static_cast<quint16>((m_data[8] << 8) | m_data[9]);
+    if (version != Trace::VERSION) {
+        if (error) *error = QString("Unsupported trace version %1").arg(version);
+        close();
+        return false;
+    }
+
+    rewind();
+    return true;
+}
+
+void TraceReader::close() {
+    if (m_data) m_file.unmap(const_cast<uchar*>(m_data));
+    m_data = nullptr;
+    m_size = 0;
+    m_pos = 0;
+    m_file.close();
+}
+
+bool TraceReader::next(Trace::Record &record) {
+    if (!m_data || m_size - m_pos < Trace::RECORD_HEADER_SIZE) return false;
+
+    const uchar *h = m_data + m_pos;
+    int len = h[3];
+    if (m_size - m_pos < Trace::RECORD_HEADER_SIZE + len) return false;
+
+    quint32 delta = (quint32(h[4]) << 24) | (quint32(h[5]) << 16) | (quint32(h[6]) << 8) | quint32(h[7]);
+    m_timeUs += delta;
+
+    record.kind = static_cast<Trace::Kind>(h[0]);
+    record.charId = static_cast<quint16>((h[1] << 8) | h[2]);
+    record.timeUs = m_timeUs;
+    record.payload = QByteArrayView(reinterpret_cast<const char*>(h + Trace::RECORD_HEADER_SIZE), len);
+    m_pos += Trace::RECORD_HEADER_SIZE + len;
+    return true;
+}
+
+void TraceReader::rewind() {
+    m_pos = Trace::HEADER_SIZE;
+    m_timeUs = 0;
+}
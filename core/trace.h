@@ -0,0 +1,104 @@
+/*
+ * Shot traces - compact binary recordings of the notifications the
+ * simulator sent and the writes the app made, for deterministic replay
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QFile>
+#include <QString>
+
+#include <cstdint>
+
+// ============================================================================
+// Trace Format
+// ============================================================================
+//
+//   Header:  "DE1TRACE" [version u16 BE][reserved u16][reserved u32]
+//   Record:  [kind u8][charId u16 BE][len u8][delta_us u32 BE][payload...]
+//
+// delta_us is the time since the previous record (since recording started
+// for the first one), saturating at ~71 minutes. Payloads are the exact
+// characteristic bytes, so a replay sends what was recorded byte for byte.
+// A record cut short by a crash ends the trace; everything before it plays.
+
+namespace Trace {
+
+constexpr char MAGIC[8] = {'D', 'E', '1', 'T', 'R', 'A', 'C', 'E'};
+constexpr quint16 VERSION = 1;
+constexpr int HEADER_SIZE = 16;
+constexpr int RECORD_HEADER_SIZE = 8;
+
+enum Kind : quint8 {
+    KindNotify = 1,     // Simulator -> app notification
+    KindWrite  = 2      // App -> simulator characteristic write
+};
+
+struct Record {
+    Kind kind = KindNotify;
+    quint16 charId = 0;
+    qint64 timeUs = 0;          // Since the trace started
+    QByteArrayView payload;     // Points into the mapped file
+};
+
+} // namespace Trace
+
+// ============================================================================
+// Trace Writer - buffered, one write() per FLUSH_BYTES
+// ============================================================================
+
+class TraceWriter {
+public:
+    static constexpr int FLUSH_BYTES = 64 * 1024;
+
+    ~TraceWriter() { close(); }
+
+    // Returns false with *error set if the file can't be created
+    bool open(const QString &path, QString *error = nullptr);
+    void close();
+    bool isOpen() const { return m_file.isOpen(); }
+
+    // timeUs on any monotonic clock; only differences are stored
+    void record(Trace::Kind kind, quint16 charId, QByteArrayView payload, qint64 timeUs);
+    void flush();
+
+    qint64 records() const { return m_records; }
+    QString fileName() const { return m_file.fileName(); }
+
+private:
+    QFile m_file;
+    QByteArray m_buffer;
+    qint64 m_lastUs = -1;
+    qint64 m_records = 0;
+};
+
+// ============================================================================
+// Trace Reader - memory-mapped, records are parsed in place
+// ============================================================================
+
+class TraceReader {
+public:
+    ~TraceReader() { close(); }
+
+    // Returns false with *error set if the file is missing or not a trace
+    bool open(const QString &path, QString *error = nullptr);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+
+    // Next record, or false at the end of the trace
+    bool next(Trace::Record &record);
+    void rewind();
+
+    qint64 position() const { return m_pos; }
+    qint64 size() const { return m_size; }
+    QString fileName() const { return m_file.fileName(); }
+
+private:
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    qint64 m_pos = 0;
+    qint64 m_timeUs = 0;
+};
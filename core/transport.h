@@ -0,0 +1,91 @@
+/*
+ * Daemon link transports - the byte stream between an engine and the Pi
+ * daemon, over TCP or to an in-process stand-in for it
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QIODevice>
+#include <QString>
+#include <QTcpSocket>
+
+// ============================================================================
+// Transport - one daemon connection
+// ============================================================================
+//
+// Engines only see a QIODevice to read from and hand to Wire::WriteBatcher,
+// plus connection signals, so the same engine code runs over TCP and over
+// the loopback daemon (core/loopback-transport.h).
+//
+// bytesWritten() means "delivered": for TCP it's the kernel taking the
+// bytes, for loopback it's the stand-in daemon having parsed them. Engines
+// measure SHOT_SAMPLE latency up to that point.
+
+class Transport : public QObject {
+    Q_OBJECT
+
+public:
+    // Host name that selects the in-process loopback daemon
+    static inline const QString LOOPBACK_HOST = QStringLiteral("loopback");
+
+    // TCP for any other host. machines is how many machines the loopback
+    // daemon offers on its (multiplexed) port.
+    static Transport *create(const QString &host, int machines, QObject *parent);
+
+    static bool isLoopbackHost(const QString &host) {
+        return host.trimmed().compare(LOOPBACK_HOST, Qt::CaseInsensitive) == 0;
+    }
+
+    explicit Transport(QObject *parent = nullptr) : QObject(parent) {}
+
+    virtual bool isLoopback() const = 0;
+    virtual void open(const QString &host, int port) = 0;
+    virtual void close() = 0;
+    virtual void abort() { close(); }       // Drop without flushing, for a dead link
+    virtual bool isOpen() const = 0;        // Connected
+    virtual bool isIdle() const = 0;        // Neither connected nor connecting
+    virtual QIODevice *device() = 0;
+    virtual QString errorString() const = 0;
+
+signals:
+    void connected();
+    void disconnected();
+    void readyRead();
+    void errorOccurred();
+    void bytesWritten(qint64 bytes);
+};
+
+// ============================================================================
+// TCP Transport - the Pi daemon (or a daemon on this machine) over TCP
+// ============================================================================
+
+class TcpTransport : public Transport {
+    Q_OBJECT
+
+public:
+    explicit TcpTransport(QObject *parent = nullptr) : Transport(parent) {
+        m_socket = new QTcpSocket(this);
+        connect(m_socket, &QTcpSocket::connected, this, [this]() {
+            // Writes are batched per event-loop pass, so Nagle only adds delay
+            m_socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+            emit connected();
+        });
+        connect(m_socket, &QTcpSocket::disconnected, this, &Transport::disconnected);
+        connect(m_socket, &QTcpSocket::readyRead, this, &Transport::readyRead);
+        connect(m_socket, &QTcpSocket::errorOccurred, this, &Transport::errorOccurred);
+        connect(m_socket, &QTcpSocket::bytesWritten, this, &Transport::bytesWritten);
+    }
+
+    bool isLoopback() const override { return false; }
+    void open(const QString &host, int port) override { m_socket->connectToHost(host, port); }
+    void close() override { m_socket->disconnectFromHost(); }
+    void abort() override { m_socket->abort(); }
+    bool isOpen() const override { return m_socket->state() == QAbstractSocket::ConnectedState; }
+    bool isIdle() const override { return m_socket->state() == QAbstractSocket::UnconnectedState; }
+    QIODevice *device() override { return m_socket; }
+    QString errorString() const override { return m_socket->errorString(); }
+
+private:
+    QTcpSocket *m_socket = nullptr;
+};
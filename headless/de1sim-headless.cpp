@@ -0,0 +1,332 @@
+/*
+ * DE1 Simulator - headless runner
+ *
+ * Runs the simulation engine against the Pi daemon with no widgets, for
+ * soak tests on CI runners or in a rack. Without a scenario it just acts
+ * as the machine and answers whatever the app asks for.
+ *
+ * Run:
+ *   de1sim-headless --host <pi> [--port 12345] [--scenario file] [--repeat N]
+ *
+ * With --machines N it runs a fleet of N machines on one scheduler tick
+ * instead (core/fleet-engine.h); scenario commands then apply to every
+ * machine and wait-idle waits for all of them. --offline skips the daemon
+ * and starts the scenario right away, to measure the simulator on its own.
+ *
+ * --host loopback runs against an in-process stand-in for the daemon
+ * (core/loopback-transport.h) instead: the whole protocol, but no network
+ * or BLE, so the latency in the load line is the simulator's own. For a
+ * daemon on this machine use --host localhost.
+ *
+ * --record file captures every notification and app write to a trace
+ * (core/trace.h). --replay file sends a trace's notifications byte for byte
+ * once an app connects, with its recorded spacing divided by --replay-speed
+ * (0 = as fast as the link takes them), and exits when it's done.
+ *
+ * Scenario files (core/scenario.h) script operations, GHC and sample rate
+ * changes, faults (water level, dropped or delayed notifications, daemon
+ * disconnects, FatalError) and expectations on the app's writes:
+ *
+ *   wait-ble 60
+ *   espresso
+ *   drop 20 SHOT_SAMPLE
+ *   expect-write REQUESTED_STATE=02 40     # App stops the shot itself
+ *   clear-faults
+ *
+ * --shots file writes every espresso shot's samples on exit
+ * (core/shot-timeline.h): CSV, or the columnar format if the name ends
+ * in .de1shot.
+ *
+ * --mmr-dump file answers MMR reads from a JSON register dump of a real
+ * machine (core/mmr-registers.h) instead of the built-in values.
+ *
+ * With --sim-speed N the simulation runs N times faster than real time
+ * (phases, shot timer, water drain); scenario waits and timeouts are in
+ * sim seconds too.
+ *
+ * SIGINT and SIGTERM end the run like a scenario's end does, so the files
+ * above are still written on Ctrl-C or systemctl stop.
+ *
+ * Exit status: 0 when the scenario completed with every expectation met,
+ * 1 on a timeout or a failed expectation, 2 on a bad command line or
+ * scenario file.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QFile>
+#include <QSocketNotifier>
+#include <QTextStream>
+
+#ifdef Q_OS_UNIX
+#include <csignal>
+#include <unistd.h>
+#endif
+
+#include "core/simulation-engine.h"
+#include "core/fleet-engine.h"
+#include "core/scenario.h"
+
+// ============================================================================
+// Output
+// ============================================================================
+
+static bool g_quiet = false;
+
+static void print(const QString &category, const QString &msg) {
+    if (g_quiet && category != "WARN" && category != "ERROR") return;
+
+    static QTextStream out(stdout);
+    out << "[" << QDateTime::currentDateTime().toString("hh:mm:ss.zzz") << "] ["
+        << category << "] " << msg << Qt::endl;
+}
+
+// Engine log, load line and the scenario's exit status; the same for both
+// engines, which share these signals
+template <class Engine>
+static void attach(Engine *engine, ScenarioRunner *runner) {
+    QObject::connect(engine, &Engine::logMessage, engine, &print);
+    QObject::connect(runner, &ScenarioRunner::logMessage, runner, &print);
+    QObject::connect(runner, &ScenarioRunner::finished, runner, [](int status) {
+        QCoreApplication::exit(status);
+    });
+    QObject::connect(engine, &Engine::loadReported, engine, [](const LoadReport &r) {
+        if (g_quiet || r.requestedHz == 0) return;
+        print("INFO", QString("Load: %1 Hz requested / %2 sent / %3 delivered (%4 queued) / %5 BLE, "
+                              "latency %6 ms avg / %7 ms max")
+            .arg(r.requestedHz)
+            .arg(r.sentHz, 0, 'f', 1)
+            .arg(r.deliveredHz, 0, 'f', 1)
+            .arg(r.queued)
+            .arg(r.bleHz, 0, 'f', 1)
+            .arg(r.latencyAvgMs, 0, 'f', 2)
+            .arg(r.latencyMaxMs, 0, 'f', 2)
+            + (r.bleIntervalMs > 0 ? QString(", BLE interval %1 ms").arg(r.bleIntervalMs) : QString())
+            + (r.rttMs >= 0 ? QString(", RTT %1 ms").arg(r.rttMs, 0, 'f', 1) : QString()));
+    });
+}
+
+// ============================================================================
+// Signals
+// ============================================================================
+//
+// The handler only writes a byte to a pipe; the event loop reads it and
+// quits the normal way, so the aboutToQuit handlers still write --shots,
+// --latency-csv and the end of a --record trace. A second signal kills the
+// process as usual, in case quitting hangs.
+
+#ifdef Q_OS_UNIX
+static int g_signalPipe[2] = {-1, -1};
+
+static void onSignal(int) {
+    char c = 1;
+    if (::write(g_signalPipe[1], &c, 1) < 0) return;
+}
+#endif
+
+// A scenario stops where it is (logged, exit status 1); without one the
+// run just ends, with status 0
+static void quitOnSignals(ScenarioRunner *runner, bool scripted) {
+#ifdef Q_OS_UNIX
+    if (::pipe(g_signalPipe) != 0) return;
+
+    auto *notifier = new QSocketNotifier(g_signalPipe[0], QSocketNotifier::Read, runner);
+    QObject::connect(notifier, &QSocketNotifier::activated, runner, [notifier, runner, scripted]() {
+        char c;
+        if (::read(g_signalPipe[0], &c, 1) < 0) return;
+        notifier->setEnabled(false);
+        print("WARN", "Interrupted, writing output files");
+        if (scripted) runner->stop();
+        else QCoreApplication::quit();
+    });
+
+    struct sigaction action = {};
+    action.sa_handler = onSignal;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+#else
+    Q_UNUSED(runner);
+    Q_UNUSED(scripted);
+#endif
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("de1sim-headless");
+    app.setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless DE1 simulator, driven by scenario scripts");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption hostOption("host", "Pi daemon host, or \"loopback\" for the in-process "
+                                  "stand-in (default DE1-Simulator.local)", "host",
+                                  "DE1-Simulator.local");
+    QCommandLineOption portOption("port", "Pi daemon TCP port (default 12345)", "port", "12345");
+    QCommandLineOption scenarioOption("scenario", "Scenario file to run; without one the simulator "
+                                      "runs until killed", "file");
+    QCommandLineOption repeatOption("repeat", "Run the scenario N times, 0 = forever (default 1)", "N", "1");
+    QCommandLineOption rateOption("sample-rate", "SHOT_SAMPLE rate in Hz (default 5)", "hz", "5");
+    QCommandLineOption ghcOption("ghc", "GHC status 0-4 (default 3 = app cannot start operations)",
+                                 "status", "3");
+    QCommandLineOption jsonOption("json-protocol", "Don't negotiate binary frames with the daemon");
+    QCommandLineOption samplesOption("log-samples", "Log every SHOT_SAMPLE");
+    QCommandLineOption quietOption("quiet", "Only print warnings and errors");
+    QCommandLineOption machinesOption("machines", "Simulate a fleet of N machines (1-256) on one "
+                                      "scheduler tick, driving a multiplexed daemon port", "N");
+    QCommandLineOption logMachinesOption("log-machines", "With --machines, log every machine's "
+                                         "state changes and app requests");
+    QCommandLineOption offlineOption("offline", "Don't connect to a daemon; run the scenario "
+                                     "against the simulator alone");
+    QCommandLineOption simSpeedOption("sim-speed", "Run the simulation N times faster than real "
+                                      "time, 0.1-100 (default 1)", "N", "1");
+    QCommandLineOption recordOption("record", "Record notifications and app writes to a trace file", "file");
+    QCommandLineOption replayOption("replay", "Replay a trace once an app connects, then exit", "file");
+    QCommandLineOption replaySpeedOption("replay-speed", "Replay speed factor, 0 = as fast as possible "
+                                         "(default 1)", "factor", "1");
+    QCommandLineOption latencyCsvOption("latency-csv", "Time every notification with daemon acks "
+                                        "and write the per-stage latencies to file on exit", "file");
+    QCommandLineOption mmrDumpOption("mmr-dump", "Answer MMR reads from a JSON register dump", "file");
+    QCommandLineOption shotsOption("shots", "Write every shot's samples to file on exit (CSV, or "
+                                   "columnar if it ends in .de1shot)", "file");
+    parser.addOptions({hostOption, portOption, scenarioOption, repeatOption, rateOption,
+                       ghcOption, jsonOption, samplesOption, quietOption, machinesOption,
+                       logMachinesOption, offlineOption, latencyCsvOption, recordOption,
+                       replayOption, replaySpeedOption, simSpeedOption, mmrDumpOption, shotsOption});
+    parser.process(app);
+
+    QList<ScenarioStep> steps;
+    if (parser.isSet(scenarioOption)) {
+        QString error;
+        if (!Scenario::parse(parser.value(scenarioOption), steps, error)) {
+            qCritical().noquote() << error;
+            return 2;
+        }
+    }
+
+    // Checked up front so a bad dump is a command line error, not a log line
+    QString mmrDump = parser.value(mmrDumpOption);
+    if (!mmrDump.isEmpty()) {
+        QFile file(mmrDump);
+        QString error;
+        MmrRegisterFile check;
+        if (!file.open(QIODevice::ReadOnly)) error = file.errorString();
+        else check.loadJson(file.readAll(), &error);
+        if (!error.isEmpty()) {
+            qCritical().noquote() << "Can't load MMR dump" << mmrDump + ":" << error;
+            return 2;
+        }
+    }
+
+    bool offline = parser.isSet(offlineOption);
+    QString host = offline ? QString() : parser.value(hostOption);
+    int repeat = parser.value(repeatOption).toInt();
+    g_quiet = parser.isSet(quietOption);
+
+    auto configure = [&](auto *engine) {
+        engine->setTarget(host, parser.value(portOption).toInt());
+        engine->setSampleRate(parser.value(rateOption).toInt());
+        engine->setGhcStatus(qBound(0, parser.value(ghcOption).toInt(), 4));
+        engine->setBinaryProtocol(!parser.isSet(jsonOption));
+    };
+
+    // Offline, the scenario starts right away (wait-ble then only ends on
+    // its timeout)
+    auto launch = [&](auto *engine) {
+        auto *runner = new ScenarioRunner(engine, steps, repeat, engine);
+        QString unsupported = runner->unsupported();
+        if (!unsupported.isEmpty()) {
+            qCritical().noquote() << parser.value(scenarioOption) + ":" << unsupported;
+            return false;
+        }
+        attach(engine, runner);
+        quitOnSignals(runner, !steps.isEmpty());
+
+        double speed = parser.value(simSpeedOption).toDouble();
+        if (speed != 1.0) engine->setSimSpeed(speed);
+        engine->start();
+        if (!offline) engine->connectToPi();
+        runner->start(!offline);
+        return true;
+    };
+
+    if (parser.isSet(machinesOption)) {
+        int machines = parser.value(machinesOption).toInt();
+        if (machines < 1 || machines > FleetEngine::MAX_MACHINES) {
+            qCritical().noquote() << "--machines must be between 1 and" << FleetEngine::MAX_MACHINES;
+            return 2;
+        }
+        for (const QCommandLineOption &option : {latencyCsvOption, recordOption, replayOption, shotsOption}) {
+            if (parser.isSet(option)) {
+                qCritical().noquote() << "--" + option.names().first() << "is not supported with --machines";
+                return 2;
+            }
+        }
+
+        auto *fleet = new FleetEngine(&app);
+        configure(fleet);
+        fleet->setMachineCount(machines);
+        fleet->setLogMachines(parser.isSet(logMachinesOption));
+        if (!mmrDump.isEmpty()) fleet->loadMmrDump(mmrDump);
+        if (!launch(fleet)) return 2;
+    } else {
+        auto *engine = new SimulationEngine(&app);
+        configure(engine);
+        engine->setLogSamples(parser.isSet(samplesOption));
+        if (parser.isSet(latencyCsvOption)) {
+            QString path = parser.value(latencyCsvOption);
+            engine->setLatencyTiming(true);
+            QObject::connect(&app, &QCoreApplication::aboutToQuit, engine, [engine, path]() {
+                engine->exportLatencyCsv(path);
+            });
+        }
+        if (parser.isSet(shotsOption)) {
+            QString path = parser.value(shotsOption);
+            auto *shots = new QList<ShotTimeline>();
+            QObject::connect(engine, &SimulationEngine::shotRecorded, engine, [shots](const ShotTimeline &shot) {
+                shots->append(shot);
+            });
+            QObject::connect(&app, &QCoreApplication::aboutToQuit, engine, [shots, path]() {
+                QString error;
+                bool ok = path.endsWith(".de1shot", Qt::CaseInsensitive)
+                              ? ShotTimeline::writeColumnar(*shots, path, &error)
+                              : ShotTimeline::writeCsv(*shots, path, &error);
+                if (!ok) qCritical().noquote() << "Can't write shots to" << path + ":" << error;
+                delete shots;
+            });
+        }
+        if (parser.isSet(recordOption)) {
+            engine->startRecording(parser.value(recordOption));
+            QObject::connect(&app, &QCoreApplication::aboutToQuit, engine, &SimulationEngine::stopRecording);
+        }
+        if (parser.isSet(replayOption)) {
+            if (!steps.isEmpty() || offline) {
+                qCritical().noquote() << "--replay can't be combined with --scenario or --offline";
+                return 2;
+            }
+            QString path = parser.value(replayOption);
+            double speed = parser.value(replaySpeedOption).toDouble();
+            QObject::connect(engine, &SimulationEngine::bleClientChanged, engine,
+                             [engine, path, speed, started = false](const QString &client) mutable {
+                if (client.isEmpty() || started) return;
+                started = true;
+                engine->startReplay(path, speed);
+            });
+            QObject::connect(engine, &SimulationEngine::replayFinished, &app, [](qint64, bool completed) {
+                QCoreApplication::exit(completed ? 0 : 1);
+            });
+        }
+        if (!mmrDump.isEmpty()) engine->loadMmrDump(mmrDump);
+        if (!launch(engine)) return 2;
+    }
+
+    return app.exec();
+}
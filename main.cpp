@@ -20,6 +20,7 @@
 #include <QPlainTextEdit>
 #include <QLineEdit>
 #include <QSpinBox>
+#include <QCheckBox>
 #include <QDialog>
 #include <QDialogButtonBox>
 #include <QFormLayout>
@@ -27,6 +28,7 @@
 #include <QProgressDialog>
 #include <QDateTime>
 #include <QScrollBar>
+#include <QContiguousCache>
 #include <QTcpSocket>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -35,540 +37,35 @@
 #include <QProcess>
 #include <QFile>
 #include <QDir>
+#include <QFileInfo>
 #include <QDebug>
 #include <QMenuBar>
 #include <QMenu>
 #include <QAction>
+#include <QActionGroup>
 #include <QStatusBar>
 #include <QMainWindow>
+#include <QThread>
+#include <QTableWidget>
+#include <QListWidget>
+#include <QHeaderView>
+#include <QFileDialog>
+#include <QPainter>
+#include <QPainterPath>
 
-// ============================================================================
-// Constants and UUIDs
-// ============================================================================
-
-namespace DE1 {
-
-// Characteristic short IDs (4 hex digits)
-const QString CHAR_VERSION         = "A001";
-const QString CHAR_REQUESTED_STATE = "A002";
-const QString CHAR_READ_FROM_MMR   = "A005";
-const QString CHAR_WRITE_TO_MMR    = "A006";
-const QString CHAR_SHOT_SETTINGS   = "A00B";
-const QString CHAR_SHOT_SAMPLE     = "A00D";
-const QString CHAR_STATE_INFO      = "A00E";
-const QString CHAR_HEADER_WRITE    = "A00F";
-const QString CHAR_FRAME_WRITE     = "A010";
-const QString CHAR_WATER_LEVELS    = "A011";
-
-// Machine States
-enum class State : uint8_t {
-    Sleep           = 0x00,
-    GoingToSleep    = 0x01,
-    Idle            = 0x02,
-    Busy            = 0x03,
-    Espresso        = 0x04,
-    Steam           = 0x05,
-    HotWater        = 0x06,
-    ShortCal        = 0x07,
-    SelfTest        = 0x08,
-    LongCal         = 0x09,
-    Descale         = 0x0A,
-    FatalError      = 0x0B,
-    Init            = 0x0C,
-    NoRequest       = 0x0D,
-    SkipToNext      = 0x0E,
-    HotWaterRinse   = 0x0F,
-    SteamRinse      = 0x10,
-    Refill          = 0x11,
-    Clean           = 0x12,
-    InBootLoader    = 0x13,
-    AirPurge        = 0x14,
-    SchedIdle       = 0x15
-};
-
-// Machine SubStates
-enum class SubState : uint8_t {
-    Ready           = 0,
-    Heating         = 1,
-    FinalHeating    = 2,
-    Stabilising     = 3,
-    Preinfusion     = 4,
-    Pouring         = 5,
-    Ending          = 6,
-    Steaming        = 7,
-    DescaleInit     = 8,
-    DescaleFillGroup= 9,
-    DescaleReturn   = 10,
-    DescaleGroup    = 11,
-    DescaleSteam    = 12,
-    CleanInit       = 13,
-    CleanFillGroup  = 14,
-    CleanSoak       = 15,
-    CleanGroup      = 16,
-    RefillState     = 17,
-    PausedSteam     = 18,
-    UserNotPresent  = 19,
-    Puffing         = 20
-};
-
-// MMR Addresses
-namespace MMR {
-    constexpr uint32_t CPU_BOARD_MODEL  = 0x800008;
-    constexpr uint32_t MACHINE_MODEL    = 0x80000C;
-    constexpr uint32_t FIRMWARE_VERSION = 0x800010;
-    constexpr uint32_t FAN_THRESHOLD    = 0x803808;
-    constexpr uint32_t GHC_INFO         = 0x80381C;
-    constexpr uint32_t GHC_MODE         = 0x803820;
-    constexpr uint32_t STEAM_FLOW       = 0x803828;
-    constexpr uint32_t SERIAL_NUMBER    = 0x803830;
-    constexpr uint32_t HEATER_VOLTAGE   = 0x803834;
-    constexpr uint32_t USB_CHARGER      = 0x803854;
-    constexpr uint32_t REFILL_KIT       = 0x80385C;
-
-    QString addressName(uint32_t addr) {
-        switch (addr) {
-            case CPU_BOARD_MODEL: return "CPU_BOARD_MODEL";
-            case MACHINE_MODEL: return "MACHINE_MODEL";
-            case FIRMWARE_VERSION: return "FIRMWARE_VERSION";
-            case FAN_THRESHOLD: return "FAN_THRESHOLD";
-            case GHC_INFO: return "GHC_INFO";
-            case GHC_MODE: return "GHC_MODE";
-            case STEAM_FLOW: return "STEAM_FLOW";
-            case SERIAL_NUMBER: return "SERIAL_NUMBER";
-            case HEATER_VOLTAGE: return "HEATER_VOLTAGE";
-            case USB_CHARGER: return "USB_CHARGER";
-            case REFILL_KIT: return "REFILL_KIT";
-            default: return QString("0x%1").arg(addr, 6, 16, QChar('0'));
-        }
-    }
-}
-
-// State name helper
-QString stateName(State s) {
-    switch (s) {
-        case State::Sleep: return "Sleep";
-        case State::GoingToSleep: return "GoingToSleep";
-        case State::Idle: return "Idle";
-        case State::Busy: return "Busy";
-        case State::Espresso: return "Espresso";
-        case State::Steam: return "Steam";
-        case State::HotWater: return "HotWater";
-        case State::HotWaterRinse: return "Flush";
-        case State::Refill: return "Refill";
-        case State::Descale: return "Descale";
-        case State::Clean: return "Clean";
-        default: return QString("State_0x%1").arg(static_cast<int>(s), 2, 16, QChar('0'));
-    }
-}
-
-QString subStateName(SubState s) {
-    switch (s) {
-        case SubState::Ready: return "Ready";
-        case SubState::Heating: return "Heating";
-        case SubState::FinalHeating: return "FinalHeating";
-        case SubState::Stabilising: return "Stabilising";
-        case SubState::Preinfusion: return "Preinfusion";
-        case SubState::Pouring: return "Pouring";
-        case SubState::Ending: return "Ending";
-        case SubState::Steaming: return "Steaming";
-        default: return QString("SubState_%1").arg(static_cast<int>(s));
-    }
-}
-
-QString charName(const QString& shortId) {
-    if (shortId == CHAR_VERSION) return "VERSION";
-    if (shortId == CHAR_REQUESTED_STATE) return "REQUESTED_STATE";
-    if (shortId == CHAR_READ_FROM_MMR) return "READ_FROM_MMR";
-    if (shortId == CHAR_WRITE_TO_MMR) return "WRITE_TO_MMR";
-    if (shortId == CHAR_SHOT_SETTINGS) return "SHOT_SETTINGS";
-    if (shortId == CHAR_SHOT_SAMPLE) return "SHOT_SAMPLE";
-    if (shortId == CHAR_STATE_INFO) return "STATE_INFO";
-    if (shortId == CHAR_HEADER_WRITE) return "HEADER_WRITE";
-    if (shortId == CHAR_FRAME_WRITE) return "FRAME_WRITE";
-    if (shortId == CHAR_WATER_LEVELS) return "WATER_LEVELS";
-    return shortId;
-}
-
-} // namespace DE1
-
-// ============================================================================
-// Binary Codec - Encoding/Decoding helpers
-// ============================================================================
-
-namespace BinaryCodec {
-
-inline uint8_t encodeU8P4(double value) {
-    return static_cast<uint8_t>(qBound(0.0, value * 16.0, 255.0));
-}
-
-inline double decodeU8P4(uint8_t value) {
-    return value / 16.0;
-}
-
-inline uint16_t encodeU16P12(double value) {
-    return static_cast<uint16_t>(qBound(0.0, value * 4096.0, 65535.0));
-}
-
-inline uint16_t encodeU16P8(double value) {
-    return static_cast<uint16_t>(qBound(0.0, value * 256.0, 65535.0));
-}
-
-inline double decodeU16P8(uint16_t value) {
-    return value / 256.0;
-}
-
-inline double decodeU8P1(uint8_t value) {
-    return value / 2.0;
-}
-
-inline void encodeU24P16(double value, uint8_t* out) {
-    uint32_t encoded = static_cast<uint32_t>(qBound(0.0, value * 65536.0, 16777215.0));
-    out[0] = (encoded >> 16) & 0xFF;
-    out[1] = (encoded >> 8) & 0xFF;
-    out[2] = encoded & 0xFF;
-}
-
-inline void encodeShortBE(uint16_t value, uint8_t* out) {
-    out[0] = (value >> 8) & 0xFF;
-    out[1] = value & 0xFF;
-}
-
-inline uint16_t decodeShortBE(const uint8_t* data) {
-    return (static_cast<uint16_t>(data[0]) << 8) | data[1];
-}
-
-inline void encodeUint32BE(uint32_t value, uint8_t* out) {
-    out[0] = (value >> 24) & 0xFF;
-    out[1] = (value >> 16) & 0xFF;
-    out[2] = (value >> 8) & 0xFF;
-    out[3] = value & 0xFF;
-}
-
-inline uint32_t decodeAddress(const uint8_t* data) {
-    return (static_cast<uint32_t>(data[0]) << 16) |
-           (static_cast<uint32_t>(data[1]) << 8) |
-           static_cast<uint32_t>(data[2]);
-}
-
-inline double decodeF8_1_7(uint8_t value) {
-    if (value & 0x80) {
-        return value & 0x7F;
-    } else {
-        return value / 10.0;
-    }
-}
-
-inline uint16_t decodeU10P0(const uint8_t* data) {
-    return decodeShortBE(data) & 0x3FF;
-}
-
-} // namespace BinaryCodec
-
-// ============================================================================
-// Profile Frame Structure
-// ============================================================================
-
-struct ProfileFrame {
-    int frameIndex = 0;
-    uint8_t flags = 0;
-    double setVal = 0;
-    double temp = 0;
-    double duration = 0;
-    double triggerVal = 0;
-    uint16_t maxVol = 0;
-    bool hasExtension = false;
-    double limiterValue = 0;
-    double limiterRange = 0;
-
-    QString pumpMode() const { return (flags & 0x01) ? "Flow" : "Pressure"; }
-    QString sensor() const { return (flags & 0x10) ? "Water" : "Coffee"; }
-    QString transition() const { return (flags & 0x20) ? "Smooth" : "Fast"; }
-    bool hasExitCondition() const { return flags & 0x02; }
-    QString exitType() const {
-        if (!(flags & 0x02)) return "None";
-        QString compareWhat = (flags & 0x08) ? "Flow" : "Pressure";
-        QString compareHow = (flags & 0x04) ? ">" : "<";
-        return QString("%1 %2 %3").arg(compareWhat).arg(compareHow).arg(triggerVal, 0, 'f', 1);
-    }
-
-    QString toString() const {
-        QString s = QString("Frame %1: %2 %3, %4C, %5s")
-            .arg(frameIndex)
-            .arg(pumpMode())
-            .arg(setVal, 0, 'f', 1)
-            .arg(temp, 0, 'f', 1)
-            .arg(duration, 0, 'f', 1);
-        if (maxVol > 0) s += QString(", max %1mL").arg(maxVol);
-        if (hasExitCondition()) s += QString(", exit: %1").arg(exitType());
-        if (hasExtension) s += QString(" [Limiter: %1/%2]").arg(limiterValue, 0, 'f', 1).arg(limiterRange, 0, 'f', 1);
-        return s;
-    }
-};
-
-struct ProfileHeader {
-    uint8_t headerV = 0;
-    uint8_t numFrames = 0;
-    uint8_t numPreinfuseFrames = 0;
-    double minPressure = 0;
-    double maxFlow = 0;
-
-    QString toString() const {
-        return QString("Header: v%1, %2 frames (%3 preinfuse), minP=%4 bar, maxF=%5 mL/s")
-            .arg(headerV).arg(numFrames).arg(numPreinfuseFrames)
-            .arg(minPressure, 0, 'f', 1).arg(maxFlow, 0, 'f', 1);
-    }
-};
+#include "core/simulation-engine.h"
+#include "core/scenario.h"
 
 // ============================================================================
 // Pi Setup Dialog
 // ============================================================================
 
-// Embedded daemon source files
-static const char* DAEMON_CPP = R"DAEMON(
-#include <QCoreApplication>
-#include <QBluetoothUuid>
-#include <QLowEnergyController>
-#include <QLowEnergyService>
-#include <QLowEnergyServiceData>
-#include <QLowEnergyCharacteristicData>
-#include <QLowEnergyDescriptorData>
-#include <QLowEnergyAdvertisingData>
-#include <QLowEnergyAdvertisingParameters>
-#include <QTcpServer>
-#include <QTcpSocket>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QDebug>
-
-static const QString SERVICE_UUID = "0000A000-0000-1000-8000-00805F9B34FB";
-static const QString CCCD_UUID = "00002902-0000-1000-8000-00805f9b34fb";
-
-static const QMap<QString, QString> CHAR_UUIDS = {
-    {"VERSION",         "0000A001-0000-1000-8000-00805F9B34FB"},
-    {"REQUESTED_STATE", "0000A002-0000-1000-8000-00805F9B34FB"},
-    {"READ_FROM_MMR",   "0000A005-0000-1000-8000-00805F9B34FB"},
-    {"WRITE_TO_MMR",    "0000A006-0000-1000-8000-00805F9B34FB"},
-    {"SHOT_SETTINGS",   "0000A00B-0000-1000-8000-00805F9B34FB"},
-    {"SHOT_SAMPLE",     "0000A00D-0000-1000-8000-00805F9B34FB"},
-    {"STATE_INFO",      "0000A00E-0000-1000-8000-00805F9B34FB"},
-    {"HEADER_WRITE",    "0000A00F-0000-1000-8000-00805F9B34FB"},
-    {"FRAME_WRITE",     "0000A010-0000-1000-8000-00805F9B34FB"},
-    {"WATER_LEVELS",    "0000A011-0000-1000-8000-00805F9B34FB"}
-};
-
-class DE1BleDaemon : public QObject {
-    Q_OBJECT
-public:
-    explicit DE1BleDaemon(quint16 port, QObject *parent = nullptr) : QObject(parent), m_port(port) {
-        m_tcpServer = new QTcpServer(this);
-        connect(m_tcpServer, &QTcpServer::newConnection, this, &DE1BleDaemon::onTcpConnection);
-        m_bleController = QLowEnergyController::createPeripheral(this);
-        connect(m_bleController, &QLowEnergyController::connected, this, [this]() {
-            qInfo() << "BLE client connected";
-            sendToWindows("connected", {{"client", m_bleController->remoteAddress().toString()}});
-        });
-        connect(m_bleController, &QLowEnergyController::disconnected, this, [this]() {
-            qInfo() << "BLE client disconnected";
-            sendToWindows("disconnected", {});
-            startAdvertising();
-        });
-        createDE1Service();
-    }
-
-    bool start() {
-        if (!m_tcpServer->listen(QHostAddress::Any, m_port)) {
-            qCritical() << "Failed to start TCP server on port" << m_port;
-            return false;
-        }
-        qInfo() << "TCP server listening on port" << m_port;
-        return true;
-    }
-
-private:
-    void createDE1Service() {
-        QLowEnergyServiceData serviceData;
-        serviceData.setType(QLowEnergyServiceData::ServiceTypePrimary);
-        serviceData.setUuid(QBluetoothUuid(SERVICE_UUID));
-        QLowEnergyDescriptorData cccd(QBluetoothUuid(CCCD_UUID), QByteArray(2, 0));
-
-        auto addChar = [&](const QString& name, QLowEnergyCharacteristic::PropertyTypes props, const QByteArray& val, bool notify = false) {
-            QLowEnergyCharacteristicData c;
-            c.setUuid(QBluetoothUuid(CHAR_UUIDS[name]));
-            c.setProperties(props);
-            c.setValue(val);
-            if (notify) c.addDescriptor(cccd);
-            serviceData.addCharacteristic(c);
-        };
-
-        addChar("VERSION", QLowEnergyCharacteristic::Read, QByteArray::fromHex("02010000"));
-        addChar("REQUESTED_STATE", QLowEnergyCharacteristic::Write, QByteArray(1, 0));
-        addChar("READ_FROM_MMR", QLowEnergyCharacteristic::Read | QLowEnergyCharacteristic::Notify | QLowEnergyCharacteristic::Write, QByteArray(20, 0), true);
-        addChar("WRITE_TO_MMR", QLowEnergyCharacteristic::Write, QByteArray(20, 0));
-        addChar("SHOT_SETTINGS", QLowEnergyCharacteristic::Read | QLowEnergyCharacteristic::Write, QByteArray(9, 0));
-        addChar("SHOT_SAMPLE", QLowEnergyCharacteristic::Notify, QByteArray(19, 0), true);
-        addChar("STATE_INFO", QLowEnergyCharacteristic::Read | QLowEnergyCharacteristic::Notify, QByteArray::fromHex("0200"), true);
-        addChar("HEADER_WRITE", QLowEnergyCharacteristic::Write, QByteArray(5, 0));
-        addChar("FRAME_WRITE", QLowEnergyCharacteristic::Write, QByteArray(8, 0));
-        addChar("WATER_LEVELS", QLowEnergyCharacteristic::Read | QLowEnergyCharacteristic::Notify, QByteArray::fromHex("4B00"), true);
-
-        m_de1Service = m_bleController->addService(serviceData);
-        if (m_de1Service) {
-            connect(m_de1Service, &QLowEnergyService::characteristicChanged, this, &DE1BleDaemon::onCharChanged);
-        }
-    }
-
-    void startAdvertising() {
-        QLowEnergyAdvertisingData ad;
-        ad.setDiscoverability(QLowEnergyAdvertisingData::DiscoverabilityGeneral);
-        ad.setLocalName("DE1-SIM");
-        ad.setServices({QBluetoothUuid(SERVICE_UUID)});
-        m_bleController->startAdvertising(QLowEnergyAdvertisingParameters(), ad, ad);
-        qInfo() << "Advertising as DE1-SIM";
-        sendToWindows("advertising", {});
-    }
-
-private slots:
-    void onTcpConnection() {
-        QTcpSocket *s = m_tcpServer->nextPendingConnection();
-        if (m_tcpClient) { s->close(); s->deleteLater(); return; }
-        m_tcpClient = s;
-        qInfo() << "Windows GUI connected";
-        connect(s, &QTcpSocket::readyRead, this, &DE1BleDaemon::onTcpData);
-        connect(s, &QTcpSocket::disconnected, this, [this]() { m_tcpClient = nullptr; m_bleController->stopAdvertising(); });
-        sendToWindows("ready", {{"version", "1.0.0"}});
-        startAdvertising();
-    }
-
-    void onTcpData() {
-        m_buf += m_tcpClient->readAll();
-        while (true) {
-            int i = m_buf.indexOf('\n');
-            if (i < 0) break;
-            QByteArray line = m_buf.left(i);
-            m_buf = m_buf.mid(i + 1);
-            if (line.isEmpty()) continue;
-            QJsonObject cmd = QJsonDocument::fromJson(line).object();
-            QString action = cmd["cmd"].toString();
-            if (action == "notify" || action == "update") {
-                QString charId = cmd["char"].toString();
-                QByteArray data = QByteArray::fromHex(cmd["data"].toString().toLatin1());
-                QString fullUuid = QString("0000%1-0000-1000-8000-00805F9B34FB").arg(charId);
-                auto c = m_de1Service->characteristic(QBluetoothUuid(fullUuid));
-                if (c.isValid()) m_de1Service->writeCharacteristic(c, data);
-            }
-        }
-    }
-
-    void onCharChanged(const QLowEnergyCharacteristic &c, const QByteArray &v) {
-        QString shortUuid = c.uuid().toString().mid(5, 4).toUpper();
-        sendToWindows("write", {{"char", shortUuid}, {"data", QString(v.toHex())}});
-    }
-
-    void sendToWindows(const QString &event, const QVariantMap &data) {
-        if (!m_tcpClient) return;
-        QJsonObject obj;
-        obj["event"] = event;
-        for (auto it = data.begin(); it != data.end(); ++it) obj[it.key()] = QJsonValue::fromVariant(it.value());
-        m_tcpClient->write(QJsonDocument(obj).toJson(QJsonDocument::Compact) + "\n");
-    }
-
-private:
-    quint16 m_port;
-    QTcpServer *m_tcpServer = nullptr;
-    QTcpSocket *m_tcpClient = nullptr;
-    QByteArray m_buf;
-    QLowEnergyController *m_bleController = nullptr;
-    QLowEnergyService *m_de1Service = nullptr;
+// The wizard deploys pi-daemon/ as it is in this tree; CMake bundles the
+// files as resources under :/pi-daemon
+static const char *DAEMON_FILES[] = {
+    "de1-ble-daemon.cpp", "de1-wire.h", "de1-ble-daemon.pro", "de1-ble-daemon.service", "setup-pi.sh",
 };
 
-int main(int argc, char *argv[]) {
-    QCoreApplication app(argc, argv);
-    DE1BleDaemon daemon(12345);
-    if (!daemon.start()) return 1;
-    return app.exec();
-}
-
-#include "DAEMON_MOC_PLACEHOLDER"
-)DAEMON";
-
-static const char* DAEMON_PRO = R"PRO(
-QT = core bluetooth network
-CONFIG += console c++17
-CONFIG -= app_bundle
-TARGET = de1-ble-daemon
-SOURCES += de1-ble-daemon.cpp
-)PRO";
-
-static const char* SETUP_SCRIPT = R"SCRIPT(#!/bin/bash
-set -e
-echo "=== DE1 BLE Daemon Setup ==="
-
-echo "[1/5] Installing dependencies..."
-apt update && apt install -y qt6-base-dev qt6-connectivity-dev bluez
-
-echo "[2/5] Configuring Bluetooth for BLE peripheral mode..."
-# Find the bluetooth service file
-BLUETOOTH_SERVICE=""
-for f in /lib/systemd/system/bluetooth.service /usr/lib/systemd/system/bluetooth.service; do
-    [ -f "$f" ] && BLUETOOTH_SERVICE="$f" && break
-done
-if [ -n "$BLUETOOTH_SERVICE" ]; then
-    if ! grep -q -- "--experimental" "$BLUETOOTH_SERVICE"; then
-        echo "Enabling BlueZ experimental mode..."
-        sed -i '/^ExecStart=.*bluetoothd/ s/$/ --experimental/' "$BLUETOOTH_SERVICE"
-    else
-        echo "BlueZ experimental mode already enabled"
-    fi
-else
-    echo "WARNING: Bluetooth service file not found"
-fi
-systemctl daemon-reload
-systemctl enable bluetooth
-systemctl restart bluetooth
-sleep 3
-echo "Configuring Bluetooth adapter..."
-rfkill unblock bluetooth 2>/dev/null || true
-timeout 5 btmgmt power on || echo "Warning: btmgmt power on timed out"
-timeout 5 btmgmt le on || echo "Warning: btmgmt le on timed out"
-timeout 5 btmgmt advertising on || echo "Warning: btmgmt advertising on timed out"
-timeout 3 btmgmt name 'DE1-SIM' || echo "Warning: btmgmt name timed out"
-hciconfig hci0 up 2>/dev/null || true
-hciconfig hci0 piscan 2>/dev/null || true
-sleep 1
-
-echo "[3/5] Stopping existing daemon (if running)..."
-systemctl stop de1-ble-daemon 2>/dev/null || true
-sleep 1
-
-echo "[4/5] Building daemon..."
-cd /tmp/de1-daemon
-qmake6 && make -j$(nproc)
-cp de1-ble-daemon /usr/local/bin/
-
-echo "[5/5] Configuring systemd service..."
-cat > /etc/systemd/system/de1-ble-daemon.service << 'EOF'
-[Unit]
-Description=DE1 BLE Simulator Daemon
-After=bluetooth.target network-online.target
-Wants=bluetooth.target
-[Service]
-Type=simple
-TimeoutStartSec=30
-ExecStartPre=/bin/sleep 2
-ExecStartPre=/bin/bash -c "timeout 5 btmgmt power on || true; timeout 5 btmgmt le on || true; timeout 5 btmgmt advertising on || true; timeout 3 btmgmt name DE1-SIM || true; hciconfig hci0 piscan || true"
-ExecStart=/usr/local/bin/de1-ble-daemon
-Restart=on-failure
-RestartSec=5
-[Install]
-WantedBy=multi-user.target
-EOF
-systemctl daemon-reload && systemctl enable de1-ble-daemon && systemctl start de1-ble-daemon
-echo "=== Setup complete! ==="
-echo ""
-echo "If BLE stops working, check: dmesg | grep -i 'bluetooth.*fail'"
-echo "If you see 'Frame reassembly failed', reboot the Pi: sudo reboot"
-)SCRIPT";
-
 class PiSetupDialog : public QDialog {
     Q_OBJECT
 
@@ -639,24 +136,16 @@ private:
         m_tempDir = QDir::tempPath() + "/de1-daemon";
         QDir().mkpath(m_tempDir);
 
-        QString daemonCode = QString(DAEMON_CPP).replace("DAEMON_MOC_PLACEHOLDER", "de1-ble-daemon.moc");
-
-        QFile cppFile(m_tempDir + "/de1-ble-daemon.cpp");
-        if (cppFile.open(QIODevice::WriteOnly)) {
-            cppFile.write(daemonCode.toUtf8());
-            cppFile.close();
-        }
-
-        QFile proFile(m_tempDir + "/de1-ble-daemon.pro");
-        if (proFile.open(QIODevice::WriteOnly)) {
-            proFile.write(DAEMON_PRO);
-            proFile.close();
-        }
-
-        QFile shFile(m_tempDir + "/setup.sh");
-        if (shFile.open(QIODevice::WriteOnly)) {
-            shFile.write(SETUP_SCRIPT);
-            shFile.close();
+        // Copied byte for byte: the Pi wants LF line endings, not Windows ones
+        for (const char *name : DAEMON_FILES) {
+            QString target = m_tempDir + "/" + name;
+            QFile::remove(target);
+            if (!QFile::copy(QString(":/pi-daemon/") + name, target)) {
+                log(QString("Could not prepare %1").arg(name));
+                continue;
+            }
+            QFile::setPermissions(target, QFileDevice::ReadOwner | QFileDevice::WriteOwner
+                                          | QFileDevice::ReadGroup | QFileDevice::ReadOther);
         }
 
         log("Files prepared in: " + m_tempDir);
@@ -699,14 +188,15 @@ private slots:
                 "echo.\n"
                 "echo [Step 2/3] Copying files to Pi...\n"
                 "echo.\n"
-                "scp -o StrictHostKeyChecking=accept-new \"%2\\de1-ble-daemon.cpp\" \"%2\\de1-ble-daemon.pro\" \"%2\\setup.sh\" %1:/tmp/de1-daemon/\n"
+                "scp -o StrictHostKeyChecking=accept-new \"%2\\de1-ble-daemon.cpp\" \"%2\\de1-wire.h\" "
+                "\"%2\\de1-ble-daemon.pro\" \"%2\\de1-ble-daemon.service\" \"%2\\setup-pi.sh\" %1:/tmp/de1-daemon/\n"
                 "if errorlevel 1 goto :error\n"
                 "echo Files copied.\n"
                 "echo.\n"
                 "echo [Step 3/3] Running installation script...\n"
                 "echo (This takes 3-5 minutes)\n"
                 "echo.\n"
-                "ssh -tt -o StrictHostKeyChecking=accept-new %1 \"cd /tmp/de1-daemon && sudo bash setup.sh\"\n"
+                "ssh -tt -o StrictHostKeyChecking=accept-new %1 \"cd /tmp/de1-daemon && sudo bash setup-pi.sh\"\n"
                 "echo.\n"
                 "if errorlevel 1 (\n"
                 "    color 0C\n"
@@ -760,42 +250,729 @@ private slots:
         QString host = m_hostEdit->text().trimmed();
         if (host.isEmpty()) host = "DE1-Simulator.local";
 
-        // Clear SSH known_hosts entry for this Pi
-        QString knownHostsPath = QDir::homePath() + "/.ssh/known_hosts";
-        QString msg;
+        // Clear SSH known_hosts entry for this Pi
+        QString knownHostsPath = QDir::homePath() + "/.ssh/known_hosts";
+        QString msg;
+
+        // Try to remove the host from known_hosts using ssh-keygen
+        QProcess sshKeygen;
+        sshKeygen.start("ssh-keygen", {"-R", host});
+        if (sshKeygen.waitForFinished(5000) && sshKeygen.exitCode() == 0) {
+            msg = QString("Cleared SSH known_hosts entry for '%1'.\n\n"
+                         "The next SSH connection will ask you to verify\n"
+                         "the Pi's fingerprint again.").arg(host);
+            log(QString("Cleared SSH known_hosts entry for %1").arg(host));
+        } else {
+            msg = QString("Could not clear SSH known_hosts for '%1'.\n\n"
+                         "You may need to manually edit:\n%2").arg(host, knownHostsPath);
+            log(QString("Failed to clear known_hosts: %1").arg(QString(sshKeygen.readAllStandardError())));
+        }
+
+        // Also reset saved settings to defaults
+        QSettings settings("Decenza", "DE1Simulator");
+        settings.remove("pi_host");
+        settings.remove("pi_port");
+        m_hostEdit->setText("DE1-Simulator.local");
+        m_userEdit->setText("pi");
+
+        QMessageBox::information(this, "Password Cleared", msg);
+    }
+
+private:
+    QLineEdit *m_hostEdit;
+    QLineEdit *m_userEdit;
+    QPlainTextEdit *m_outputLog;
+    QPushButton *m_installBtn;
+    QPushButton *m_clearSettingsBtn;
+    QPushButton *m_closeBtn;
+    QString m_tempDir;
+};
+
+// ============================================================================
+// Log View - ring-buffered BLE log, flushed to the widget a few times a second
+// ============================================================================
+
+class LogView : public QWidget {
+    Q_OBJECT
+
+public:
+    enum Category : quint8 { Info, Rx, Tx, Pi, Warn, Error, CategoryCount };
+
+    static constexpr int MAX_LINES = 5000;
+    static constexpr int FLUSH_INTERVAL_MS = 100;
+
+    LogView(QWidget *parent = nullptr) : QWidget(parent), m_lines(MAX_LINES) {
+        auto *layout = new QVBoxLayout(this);
+        layout->setContentsMargins(0, 0, 0, 0);
+
+        m_view = new QPlainTextEdit();
+        m_view->setReadOnly(true);
+        m_view->setFont(QFont("Consolas", 9));
+        m_view->setStyleSheet("QPlainTextEdit { background-color: #1e1e1e; color: #d4d4d4; }");
+        m_view->setMaximumBlockCount(MAX_LINES);
+        m_view->setUndoRedoEnabled(false);
+        layout->addWidget(m_view);
+
+        auto *btnLayout = new QHBoxLayout();
+        btnLayout->addWidget(new QLabel("Show:"));
+        for (int c = 0; c < CategoryCount; c++) {
+            m_filterChecks[c] = new QCheckBox(categoryName(static_cast<Category>(c)));
+            m_filterChecks[c]->setChecked(true);
+            connect(m_filterChecks[c], &QCheckBox::toggled, this, &LogView::rebuild);
+            btnLayout->addWidget(m_filterChecks[c]);
+        }
+        btnLayout->addSpacing(20);
+        m_samplesCheck = new QCheckBox("TX samples");
+        m_samplesCheck->setToolTip("Log every SHOT_SAMPLE notification (expensive at high sample rates)");
+        connect(m_samplesCheck, &QCheckBox::toggled, this, &LogView::logSamplesChanged);
+        btnLayout->addWidget(m_samplesCheck);
+        btnLayout->addStretch();
+
+        auto *clearBtn = new QPushButton("Clear Log");
+        connect(clearBtn, &QPushButton::clicked, this, &LogView::clear);
+        btnLayout->addWidget(clearBtn);
+        layout->addLayout(btnLayout);
+
+        m_flushTimer = new QTimer(this);
+        m_flushTimer->setInterval(FLUSH_INTERVAL_MS);
+        connect(m_flushTimer, &QTimer::timeout, this, &LogView::flush);
+        m_flushTimer->start();
+    }
+
+    static QString categoryName(Category c) {
+        switch (c) {
+            case Info: return "INFO";
+            case Rx: return "RX";
+            case Tx: return "TX";
+            case Pi: return "PI";
+            case Warn: return "WARN";
+            case Error: return "ERROR";
+            default: return "?";
+        }
+    }
+
+    static Category categoryFromName(const QString &name) {
+        for (int c = 0; c < CategoryCount; c++) {
+            if (name == categoryName(static_cast<Category>(c))) return static_cast<Category>(c);
+        }
+        return Info;
+    }
+
+    // Cheap enough to call from anywhere: the widget is only touched in flush()
+    void append(const QString &category, const QString &msg) {
+        Category c = categoryFromName(category);
+        QString timestamp = QDateTime::currentDateTime().toString("hh:mm:ss.zzz");
+        Entry entry{c, QString("[%1] [%2] %3").arg(timestamp, category, msg)};
+
+        if (m_filterChecks[c]->isChecked()) {
+            m_pending.append(entry.text);
+        }
+        m_lines.append(entry);
+        if (!m_lines.areIndexesValid()) m_lines.normalizeIndexes();
+    }
+
+    bool logSamples() const { return m_samplesCheck->isChecked(); }
+
+    void loadSettings(QSettings &settings) {
+        for (int c = 0; c < CategoryCount; c++) {
+            QString key = "log_show_" + categoryName(static_cast<Category>(c)).toLower();
+            m_filterChecks[c]->setChecked(settings.value(key, true).toBool());
+        }
+        m_samplesCheck->setChecked(settings.value("log_tx_samples", false).toBool());
+    }
+
+    void saveSettings(QSettings &settings) const {
+        for (int c = 0; c < CategoryCount; c++) {
+            QString key = "log_show_" + categoryName(static_cast<Category>(c)).toLower();
+            settings.setValue(key, m_filterChecks[c]->isChecked());
+        }
+        settings.setValue("log_tx_samples", m_samplesCheck->isChecked());
+    }
+
+signals:
+    void logSamplesChanged(bool enabled);
+
+public slots:
+    void clear() {
+        m_lines.clear();
+        m_pending.clear();
+        m_view->clear();
+    }
+
+private slots:
+    void flush() {
+        if (m_pending.isEmpty()) return;
+
+        // Only follow the tail if the user hasn't scrolled up to read something
+        QScrollBar *sb = m_view->verticalScrollBar();
+        bool atBottom = sb->value() == sb->maximum();
+
+        // Lines beyond MAX_LINES would be trimmed by the view right away
+        if (m_pending.size() > MAX_LINES) {
+            m_pending.erase(m_pending.begin(), m_pending.end() - MAX_LINES);
+        }
+        m_view->appendPlainText(m_pending.join('\n'));
+        m_pending.clear();
+
+        if (atBottom) sb->setValue(sb->maximum());
+    }
+
+    // Filter changed: re-render what's still in the ring buffer
+    void rebuild() {
+        m_pending.clear();
+        QStringList visible;
+        for (qsizetype i = m_lines.firstIndex(); i <= m_lines.lastIndex(); i++) {
+            const Entry &e = m_lines.at(i);
+            if (m_filterChecks[e.category]->isChecked()) visible.append(e.text);
+        }
+        m_view->setPlainText(visible.join('\n'));
+        QScrollBar *sb = m_view->verticalScrollBar();
+        sb->setValue(sb->maximum());
+    }
+
+private:
+    struct Entry {
+        Category category = Info;
+        QString text;
+    };
+
+    QPlainTextEdit *m_view = nullptr;
+    QCheckBox *m_filterChecks[CategoryCount] = {};
+    QCheckBox *m_samplesCheck = nullptr;
+    QTimer *m_flushTimer = nullptr;
+
+    QContiguousCache<Entry> m_lines;    // Last MAX_LINES entries, all categories
+    QStringList m_pending;              // Visible lines not yet in the widget
+};
+
+// ============================================================================
+// RTT Graph - heartbeat round trips over the last minute
+// ============================================================================
+
+class RttGraph : public QWidget {
+    Q_OBJECT
+
+public:
+    static constexpr int HISTORY = 60000 / LinkHealth::PING_INTERVAL_MS;
+
+    RttGraph(QWidget *parent = nullptr) : QWidget(parent), m_samples(HISTORY) {
+        setMinimumHeight(80);
+        setToolTip("Heartbeat round trip to the Pi daemon, last 60 s (needs daemon 1.7.0 or later)");
+    }
+
+public slots:
+    void addSample(double ms) {
+        m_samples.append(ms);
+        update();
+    }
+
+    // A gap in the line marks the reconnect
+    void addGap() {
+        if (!m_samples.isEmpty() && m_samples.last() >= 0) addSample(-1.0);
+    }
+
+protected:
+    void paintEvent(QPaintEvent *) override {
+        QPainter p(this);
+        p.fillRect(rect(), QColor("#1e1e1e"));
+
+        double maxMs = 10.0;    // Grows with the data, never below 10 ms
+        double last = -1.0;
+        for (int i = m_samples.firstIndex(); i <= m_samples.lastIndex(); i++) {
+            maxMs = qMax(maxMs, m_samples.at(i));
+            if (m_samples.at(i) >= 0) last = m_samples.at(i);
+        }
+
+        QRectF plot = QRectF(rect()).adjusted(4, 16, -4, -4);
+        double dx = plot.width() / (HISTORY - 1);
+        double x0 = plot.right() - (m_samples.count() - 1) * dx;
+
+        QPainterPath path;
+        bool drawing = false;
+        for (int i = 0; i < m_samples.count(); i++) {
+            double ms = m_samples.at(m_samples.firstIndex() + i);
+            if (ms < 0) {
+                drawing = false;
+                continue;
+            }
+            QPointF pt(x0 + i * dx, plot.bottom() - ms / maxMs * plot.height());
+            if (drawing) path.lineTo(pt); else path.moveTo(pt);
+            drawing = true;
+        }
+        p.setRenderHint(QPainter::Antialiasing);
+        p.setPen(QPen(QColor("#4CAF50"), 1.5));
+        p.drawPath(path);
+
+        p.setPen(QColor("#d4d4d4"));
+        p.drawText(QRectF(rect()).adjusted(4, 0, -4, 0), Qt::AlignTop | Qt::AlignLeft,
+                   last >= 0 ? QString("RTT %1 ms").arg(last, 0, 'f', 1) : QString("RTT -"));
+        p.drawText(QRectF(rect()).adjusted(4, 0, -4, 0), Qt::AlignTop | Qt::AlignRight,
+                   QString("%1 ms").arg(maxMs, 0, 'f', 0));
+    }
+
+private:
+    QContiguousCache<double> m_samples;     // -1 = gap
+};
+
+// ============================================================================
+// Latency View - per-stage percentiles of timed notifications
+// ============================================================================
+
+class LatencyView : public QWidget {
+    Q_OBJECT
+
+public:
+    LatencyView(QWidget *parent = nullptr) : QWidget(parent) {
+        auto *layout = new QVBoxLayout(this);
+        layout->setContentsMargins(0, 0, 0, 0);
+
+        int stages = static_cast<int>(LatencyStage::Count);
+        m_table = new QTableWidget(stages, 4);
+        m_table->setHorizontalHeaderLabels({"p50 (ms)", "p99 (ms)", "Max (ms)", "Samples"});
+        for (int i = 0; i < stages; i++) {
+            m_table->setVerticalHeaderItem(i, new QTableWidgetItem(LatencyStats::stageName(LatencyStage(i))));
+            for (int col = 0; col < 4; col++) {
+                auto *item = new QTableWidgetItem("-");
+                item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+                m_table->setItem(i, col, item);
+            }
+        }
+        m_table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        m_table->setSelectionMode(QAbstractItemView::NoSelection);
+        m_table->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+        layout->addWidget(m_table);
+
+        m_summaryLabel = new QLabel("Timing off");
+        layout->addWidget(m_summaryLabel);
+
+        m_rttGraph = new RttGraph();
+        layout->addWidget(m_rttGraph);
+
+        auto *btnLayout = new QHBoxLayout();
+        m_timingCheck = new QCheckBox("Timed notifications");
+        m_timingCheck->setToolTip("Number and timestamp every notification and have the Pi daemon "
+                                  "ack them with its own timing points (takes effect on the next "
+                                  "connection, needs daemon 1.3.0 or later)");
+        connect(m_timingCheck, &QCheckBox::toggled, this, &LatencyView::timingChanged);
+        btnLayout->addWidget(m_timingCheck);
+        btnLayout->addStretch();
+
+        auto *exportBtn = new QPushButton("Export CSV...");
+        exportBtn->setToolTip("Every acked notification since the link connected, in microseconds");
+        connect(exportBtn, &QPushButton::clicked, this, [this]() {
+            QString path = QFileDialog::getSaveFileName(this, "Export Latency Samples",
+                                                        "de1sim-latency.csv", "CSV files (*.csv)");
+            if (!path.isEmpty()) emit exportRequested(path);
+        });
+        btnLayout->addWidget(exportBtn);
+        layout->addLayout(btnLayout);
+    }
+
+    bool timing() const { return m_timingCheck->isChecked(); }
+    RttGraph *rttGraph() const { return m_rttGraph; }
+
+    void loadSettings(QSettings &settings) {
+        m_timingCheck->setChecked(settings.value("latency_timing", false).toBool());
+    }
+
+    void saveSettings(QSettings &settings) const {
+        settings.setValue("latency_timing", m_timingCheck->isChecked());
+    }
+
+signals:
+    void timingChanged(bool enabled);
+    void exportRequested(const QString &path);
+
+public slots:
+    void showReport(const LatencyReport &report) {
+        for (int i = 0; i < report.stages.size() && i < m_table->rowCount(); i++) {
+            const LatencyStageReport &stage = report.stages[i];
+            bool any = stage.count > 0;
+            m_table->item(i, 0)->setText(any ? QString::number(stage.p50Ms, 'f', 2) : "-");
+            m_table->item(i, 1)->setText(any ? QString::number(stage.p99Ms, 'f', 2) : "-");
+            m_table->item(i, 2)->setText(any ? QString::number(stage.maxMs, 'f', 2) : "-");
+            m_table->item(i, 3)->setText(QString::number(stage.count));
+        }
+        m_summaryLabel->setText(QString("Last second: %1 acked, %2 coalesced by the Pi, %3 never acked")
+            .arg(report.acked).arg(report.coalesced).arg(report.unacked));
+    }
+
+    void reset() {
+        for (int i = 0; i < m_table->rowCount(); i++) {
+            for (int col = 0; col < 4; col++) m_table->item(i, col)->setText("-");
+        }
+        m_summaryLabel->setText(m_timingCheck->isChecked() ? "Waiting for acks" : "Timing off");
+        m_rttGraph->addGap();
+    }
+
+private:
+    QTableWidget *m_table = nullptr;
+    QLabel *m_summaryLabel = nullptr;
+    QCheckBox *m_timingCheck = nullptr;
+    RttGraph *m_rttGraph = nullptr;
+};
+
+// ============================================================================
+// Live Plot - strip chart of every SHOT_SAMPLE, drawn incrementally
+// ============================================================================
+//
+// The curves live in a cached pixmap. New samples only add their segments:
+// when the newest one runs off the right edge the pixmap is scrolled left in
+// place and just the exposed strip gets its background and grid. A paint is
+// one blit plus the axis labels, so 50 Hz costs the same as 5 Hz. Only a
+// resize redraws the whole window from the kept history.
+
+class LivePlot : public QWidget {
+    Q_OBJECT
+
+public:
+    static constexpr double WINDOW_S = 30.0;
+    static constexpr double GAP_S = 1.0;            // Longer silences aren't joined
+    static constexpr double MAX_VALUE = 12.0;       // bar and mL/s share the left axis
+    static constexpr double TEMP_MIN = 80.0;        // C, right axis
+    static constexpr double TEMP_MAX = 100.0;
+    static constexpr int MARGIN_LEFT = 28;
+    static constexpr int MARGIN_RIGHT = 32;
+    static constexpr int HISTORY = 4096;            // Covers WINDOW_S at 100 Hz
+
+    LivePlot(QWidget *parent = nullptr) : QWidget(parent), m_history(HISTORY) {
+        setMinimumHeight(140);
+        setAttribute(Qt::WA_OpaquePaintEvent);
+    }
+
+public slots:
+    void addSamples(const LiveSamples &samples) {
+        if (samples.isEmpty()) return;
+        if (m_cache.isNull()) rebuild();
+
+        scrollTo(samples.last().timeS);
+
+        QPainter p(&m_cache);
+        p.setRenderHint(QPainter::Antialiasing);
+        p.setClipRect(plotArea());
+        const LiveSample *prev = m_history.isEmpty() ? nullptr : &m_history.last();
+        for (const LiveSample &s : samples) {
+            if (prev) drawSegment(p, *prev, s);
+            m_history.append(s);
+            prev = &m_history.last();
+        }
+        p.end();
+        update();
+    }
+
+protected:
+    void resizeEvent(QResizeEvent *) override { rebuild(); }
+
+    void paintEvent(QPaintEvent *) override {
+        QPainter p(this);
+        if (m_cache.isNull()) rebuild();
+        p.drawPixmap(0, 0, m_cache);
+
+        // Labels stay put while the curves scroll, so they aren't cached
+        p.setPen(QColor("#888"));
+        for (int v = 0; v <= MAX_VALUE; v += 4) {
+            p.drawText(QRectF(0, yValue(v) - 8, MARGIN_LEFT - 4, 16), Qt::AlignRight | Qt::AlignVCenter,
+                       QString::number(v));
+        }
+        for (double t = TEMP_MIN; t <= TEMP_MAX; t += 10) {
+            p.drawText(QRectF(width() - MARGIN_RIGHT + 4, yTemp(t) - 8, MARGIN_RIGHT - 4, 16),
+                       Qt::AlignLeft | Qt::AlignVCenter, QString::number(t, 'f', 0));
+        }
+        int x = MARGIN_LEFT + 6;
+        for (int c = 0; c < 3; c++) {
+            static const char *names[] = {"Pressure", "Flow", "Temp"};
+            p.setPen(color(c));
+            p.drawText(x, 14, names[c]);
+            x += p.fontMetrics().horizontalAdvance(names[c]) + 12;
+        }
+        p.setPen(QColor("#888"));
+        p.drawText(x, 14, "(dashed: set point)");
+    }
+
+private:
+    static QColor color(int channel) {
+        static const char *colors[] = {"#4CAF50", "#2196F3", "#FF9800"};
+        return QColor(colors[channel]);
+    }
+
+    double plotRight() const { return width() - MARGIN_RIGHT; }
+    QRectF plotArea() const { return QRectF(MARGIN_LEFT, 0, plotRight() - MARGIN_LEFT, height()); }
+    double pxPerSecond() const { return (plotRight() - MARGIN_LEFT) / WINDOW_S; }
+    double xFor(double timeS) const { return MARGIN_LEFT + (timeS - m_originS) * pxPerSecond(); }
+    double yValue(double v) const { return 20 + (1.0 - qBound(0.0, v / MAX_VALUE, 1.0)) * (height() - 28); }
+    double yTemp(double t) const {
+        return 20 + (1.0 - qBound(0.0, (t - TEMP_MIN) / (TEMP_MAX - TEMP_MIN), 1.0)) * (height() - 28);
+    }
+
+    // Background for x in [from, to), in widget pixels, with the grid
+    // where that overlaps the plot area
+    void drawBackground(QPainter &p, double from, double to) {
+        p.fillRect(QRectF(from, 0, to - from, height()), QColor("#1e1e1e"));
+        from = qMax<double>(from, MARGIN_LEFT);
+        to = qMin(to, plotRight());
+        if (from >= to) return;
+
+        p.setPen(QColor("#333"));
+        for (int v = 0; v <= MAX_VALUE; v += 2) {
+            p.drawLine(QPointF(from, yValue(v)), QPointF(to, yValue(v)));
+        }
+        // Every 5 s of wall time, moving with the curves
+        for (double t = std::ceil((m_originS + (from - MARGIN_LEFT) / pxPerSecond()) / 5.0) * 5.0;
+             xFor(t) < to; t += 5.0) {
+            p.drawLine(QPointF(xFor(t), 20), QPointF(xFor(t), height() - 8));
+        }
+    }
+
+    void drawSegment(QPainter &p, const LiveSample &a, const LiveSample &b) {
+        if (b.timeS - a.timeS > GAP_S || b.timeS < a.timeS) return;
+        double x0 = xFor(a.timeS), x1 = xFor(b.timeS);
+        if (x1 < MARGIN_LEFT) return;
+
+        auto line = [&](int channel, Qt::PenStyle style, double y0, double y1) {
+            p.setPen(QPen(color(channel), style == Qt::SolidLine ? 1.5 : 1.0, style));
+            p.drawLine(QPointF(x0, y0), QPointF(x1, y1));
+        };
+        line(0, Qt::DashLine, yValue(a.setPressure), yValue(b.setPressure));
+        line(1, Qt::DashLine, yValue(a.setFlow), yValue(b.setFlow));
+        line(2, Qt::DashLine, yTemp(a.setTemperature), yTemp(b.setTemperature));
+        line(0, Qt::SolidLine, yValue(a.pressure), yValue(b.pressure));
+        line(1, Qt::SolidLine, yValue(a.flow), yValue(b.flow));
+        line(2, Qt::SolidLine, yTemp(a.temperature), yTemp(b.temperature));
+    }
+
+    // Makes room for timeS at the right edge by scrolling the cache; a jump
+    // past the whole window starts it over
+    void scrollTo(double timeS) {
+        double overflow = xFor(timeS) - plotRight();
+        if (overflow <= 0) return;
+
+        qreal dpr = m_cache.devicePixelRatio();
+        int devicePx = static_cast<int>(std::ceil(overflow * dpr));
+        double shift = devicePx / dpr;
+        if (shift >= plotRight() - MARGIN_LEFT) {
+            m_originS = timeS - WINDOW_S;
+            QPainter p(&m_cache);
+            drawBackground(p, 0, width());
+            return;
+        }
+
+        m_cache.scroll(-devicePx, 0, m_cache.rect());
+        m_originS += shift / pxPerSecond();
+        QPainter p(&m_cache);
+        drawBackground(p, width() - shift - MARGIN_RIGHT, width());
+        drawBackground(p, 0, MARGIN_LEFT);     // Curves scrolled into the axis
+    }
+
+    // Whole window from the history, newest sample at the right edge
+    void rebuild() {
+        qreal dpr = devicePixelRatioF();
+        m_cache = QPixmap(size() * dpr);
+        m_cache.setDevicePixelRatio(dpr);
+        if (!m_history.isEmpty()) m_originS = qMax(m_originS, m_history.last().timeS - WINDOW_S);
+
+        QPainter p(&m_cache);
+        drawBackground(p, 0, width());
+        p.setRenderHint(QPainter::Antialiasing);
+        p.setClipRect(plotArea());
+        for (int i = m_history.firstIndex() + 1; i <= m_history.lastIndex(); i++) {
+            drawSegment(p, m_history.at(i - 1), m_history.at(i));
+        }
+    }
+
+    QPixmap m_cache;
+    QContiguousCache<LiveSample> m_history;
+    double m_originS = 0.0;         // Wall time at the left edge of the plot
+};
+
+// ============================================================================
+// Shot Overlay - pressure (solid) and flow (dashed) of several shots
+// ============================================================================
+
+class ShotOverlay : public QWidget {
+    Q_OBJECT
+
+public:
+    ShotOverlay(QWidget *parent = nullptr) : QWidget(parent) {
+        setMinimumHeight(160);
+    }
+
+    // Shots with their colors; repaints
+    void setShots(const QList<QPair<ShotTimeline, QColor>> &shots) {
+        m_shots = shots;
+        update();
+    }
+
+protected:
+    void paintEvent(QPaintEvent *) override {
+        QPainter p(this);
+        p.fillRect(rect(), QColor("#1e1e1e"));
+
+        double maxT = 10.0, maxY = 12.0;
+        for (const auto &shot : std::as_const(m_shots)) {
+            maxT = qMax(maxT, double(shot.first.duration()));
+            for (int c : {ShotTimeline::Pressure, ShotTimeline::Flow}) {
+                for (float v : shot.first.column(c)) maxY = qMax(maxY, double(v));
+            }
+        }
+
+        QRectF plot = QRectF(rect()).adjusted(30, 8, -8, -20);
+        p.setPen(QColor("#444"));
+        for (int y = 0; y <= maxY; y += 2) {
+            double py = plot.bottom() - y / maxY * plot.height();
+            p.drawLine(QPointF(plot.left(), py), QPointF(plot.right(), py));
+            p.drawText(QRectF(0, py - 8, plot.left() - 4, 16), Qt::AlignRight | Qt::AlignVCenter, QString::number(y));
+        }
+        p.drawText(QRectF(plot.left(), plot.bottom() + 2, plot.width(), 16), Qt::AlignRight,
+                   QString("%1 s").arg(maxT, 0, 'f', 0));
+
+        p.setRenderHint(QPainter::Antialiasing);
+        for (const auto &shot : std::as_const(m_shots)) {
+            const QVector<float> &time = shot.first.column(ShotTimeline::Time);
+            for (int c : {ShotTimeline::Pressure, ShotTimeline::Flow}) {
+                const QVector<float> &values = shot.first.column(c);
+                QPainterPath path;
+                for (int i = 0; i < values.size(); i++) {
+                    QPointF pt(plot.left() + time[i] / maxT * plot.width(),
+                               plot.bottom() - values[i] / maxY * plot.height());
+                    if (i == 0) path.moveTo(pt); else path.lineTo(pt);
+                }
+                p.setPen(QPen(shot.second, 1.5, c == ShotTimeline::Pressure ? Qt::SolidLine : Qt::DashLine));
+                p.drawPath(path);
+            }
+        }
+    }
+
+private:
+    QList<QPair<ShotTimeline, QColor>> m_shots;
+};
+
+// ============================================================================
+// Shots View - recorded shots, overlaid and exported
+// ============================================================================
+
+class ShotsView : public QWidget {
+    Q_OBJECT
+
+public:
+    static constexpr int MAX_SHOTS = 20;    // Oldest dropped first
+
+    ShotsView(QWidget *parent = nullptr) : QWidget(parent) {
+        auto *layout = new QHBoxLayout(this);
+        layout->setContentsMargins(0, 0, 0, 0);
+
+        auto *side = new QVBoxLayout();
+        m_list = new QListWidget();
+        m_list->setToolTip("Checked shots are overlaid and exported");
+        connect(m_list, &QListWidget::itemChanged, this, &ShotsView::updateOverlay);
+        side->addWidget(m_list, 1);
+
+        auto *loadBtn = new QPushButton("Load...");
+        connect(loadBtn, &QPushButton::clicked, this, &ShotsView::load);
+        auto *csvBtn = new QPushButton("Export CSV...");
+        connect(csvBtn, &QPushButton::clicked, this, [this]() { exportShots(false); });
+        auto *binaryBtn = new QPushButton("Export Columnar...");
+        binaryBtn->setToolTip("One float32 array per channel (.de1shot, see core/shot-timeline.h)");
+        connect(binaryBtn, &QPushButton::clicked, this, [this]() { exportShots(true); });
+        auto *clearBtn = new QPushButton("Clear");
+        connect(clearBtn, &QPushButton::clicked, this, [this]() {
+            m_list->clear();
+            m_shots.clear();
+            updateOverlay();
+        });
+        auto *btnGrid = new QGridLayout();
+        btnGrid->addWidget(loadBtn, 0, 0);
+        btnGrid->addWidget(clearBtn, 0, 1);
+        btnGrid->addWidget(csvBtn, 1, 0);
+        btnGrid->addWidget(binaryBtn, 1, 1);
+        side->addLayout(btnGrid);
+        layout->addLayout(side);
+
+        m_overlay = new ShotOverlay();
+        layout->addWidget(m_overlay, 1);
+    }
+
+public slots:
+    // A new shot is checked on its own, so the overlay follows the last
+    // shot until others are picked
+    void addShot(const ShotTimeline &shot) { appendShot(shot, true); }
+
+private:
+    void appendShot(const ShotTimeline &shot, bool only) {
+        if (m_shots.size() >= MAX_SHOTS) {
+            m_shots.removeFirst();
+            delete m_list->takeItem(0);
+        }
+        m_shots.append(shot);
+
+        QSignalBlocker block(m_list);
+        if (only) {
+            for (int i = 0; i < m_list->count(); i++) m_list->item(i)->setCheckState(Qt::Unchecked);
+        }
+        auto *item = new QListWidgetItem(QString("%1 - %2 s, %3 samples")
+            .arg(shot.started().isValid() ? shot.started().toString("HH:mm:ss") : QString("loaded"))
+            .arg(shot.duration(), 0, 'f', 1)
+            .arg(shot.size()));
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState(Qt::Checked);
+        m_list->addItem(item);
+        updateOverlay();
+    }
+
+    QList<ShotTimeline> checkedShots() const {
+        QList<ShotTimeline> shots;
+        for (int i = 0; i < m_list->count(); i++) {
+            if (m_list->item(i)->checkState() == Qt::Checked) shots.append(m_shots[i]);
+        }
+        return shots;
+    }
+
+    void updateOverlay() {
+        static const char *colors[] = {"#4CAF50", "#2196F3", "#FF9800", "#E91E63", "#9C27B0", "#00BCD4"};
+        QList<QPair<ShotTimeline, QColor>> shown;
+        QSignalBlocker block(m_list);     // setForeground() is an itemChanged() too
+        for (int i = 0; i < m_list->count(); i++) {
+            QListWidgetItem *item = m_list->item(i);
+            QColor color(colors[i % 6]);
+            item->setForeground(color);
+            if (item->checkState() == Qt::Checked) shown.append({m_shots[i], color});
+        }
+        m_overlay->setShots(shown);
+    }
 
-        // Try to remove the host from known_hosts using ssh-keygen
-        QProcess sshKeygen;
-        sshKeygen.start("ssh-keygen", {"-R", host});
-        if (sshKeygen.waitForFinished(5000) && sshKeygen.exitCode() == 0) {
-            msg = QString("Cleared SSH known_hosts entry for '%1'.\n\n"
-                         "The next SSH connection will ask you to verify\n"
-                         "the Pi's fingerprint again.").arg(host);
-            log(QString("Cleared SSH known_hosts entry for %1").arg(host));
-        } else {
-            msg = QString("Could not clear SSH known_hosts for '%1'.\n\n"
-                         "You may need to manually edit:\n%2").arg(host, knownHostsPath);
-            log(QString("Failed to clear known_hosts: %1").arg(QString(sshKeygen.readAllStandardError())));
+    void exportShots(bool columnar) {
+        QList<ShotTimeline> shots = checkedShots();
+        if (shots.isEmpty()) {
+            QMessageBox::warning(this, "Export Shots", "Check the shots to export first.");
+            return;
         }
+        QString path = columnar
+            ? QFileDialog::getSaveFileName(this, "Export Shots", "shots.de1shot", "DE1 shots (*.de1shot)")
+            : QFileDialog::getSaveFileName(this, "Export Shots", "shots.csv", "CSV files (*.csv)");
+        if (path.isEmpty()) return;
+
+        QString error;
+        bool ok = columnar ? ShotTimeline::writeColumnar(shots, path, &error)
+                           : ShotTimeline::writeCsv(shots, path, &error);
+        if (!ok) QMessageBox::warning(this, "Export Shots", QString("Can't write %1: %2").arg(path, error));
+    }
 
-        // Also reset saved settings to defaults
-        QSettings settings("Decenza", "DE1Simulator");
-        settings.remove("pi_host");
-        settings.remove("pi_port");
-        m_hostEdit->setText("DE1-Simulator.local");
-        m_userEdit->setText("pi");
+    void load() {
+        QString path = QFileDialog::getOpenFileName(this, "Load Shots", QString(),
+                                                    "DE1 shots (*.de1shot);;All files (*)");
+        if (path.isEmpty()) return;
 
-        QMessageBox::information(this, "Password Cleared", msg);
+        QList<ShotTimeline> shots;
+        QString error;
+        if (!ShotTimeline::readColumnar(path, &shots, &error)) {
+            QMessageBox::warning(this, "Load Shots", QString("Can't load %1: %2").arg(path, error));
+            return;
+        }
+        for (const ShotTimeline &shot : std::as_const(shots)) appendShot(shot, false);
     }
 
-private:
-    QLineEdit *m_hostEdit;
-    QLineEdit *m_userEdit;
-    QPlainTextEdit *m_outputLog;
-    QPushButton *m_installBtn;
-    QPushButton *m_clearSettingsBtn;
-    QPushButton *m_closeBtn;
-    QString m_tempDir;
+    QListWidget *m_list = nullptr;
+    ShotOverlay *m_overlay = nullptr;
+    QList<ShotTimeline> m_shots;        // Same order as m_list
 };
 
 // ============================================================================
@@ -807,44 +984,79 @@ class DE1Simulator : public QMainWindow {
 
 public:
     DE1Simulator(QWidget *parent = nullptr) : QMainWindow(parent) {
+        // Created first so UI and settings can configure it; moved to its
+        // thread once everything is wired up
+        m_engine = new SimulationEngine();
+
         setupUI();
         setupMenuBar();
         loadSettings();
 
-        // TCP socket
-        m_socket = new QTcpSocket(this);
-        connect(m_socket, &QTcpSocket::connected, this, &DE1Simulator::onConnected);
-        connect(m_socket, &QTcpSocket::disconnected, this, &DE1Simulator::onDisconnected);
-        connect(m_socket, &QTcpSocket::readyRead, this, &DE1Simulator::onDataReceived);
-        connect(m_socket, &QTcpSocket::errorOccurred, this, &DE1Simulator::onSocketError);
-
-        // Simulation timer (5Hz = 200ms)
-        m_shotTimer = new QTimer(this);
-        m_shotTimer->setInterval(200);
-        connect(m_shotTimer, &QTimer::timeout, this, &DE1Simulator::onShotTimerTick);
-
-        // Phase progression timer
-        m_phaseTimer = new QTimer(this);
-        m_phaseTimer->setSingleShot(true);
-        connect(m_phaseTimer, &QTimer::timeout, this, &DE1Simulator::onPhaseTimeout);
-
-        // Water level update timer (every 5 seconds)
-        m_waterTimer = new QTimer(this);
-        m_waterTimer->setInterval(5000);
-        connect(m_waterTimer, &QTimer::timeout, this, &DE1Simulator::sendWaterLevel);
-
-        // Auto-reconnect timer (every 5 seconds if disconnected)
-        m_reconnectTimer = new QTimer(this);
-        m_reconnectTimer->setInterval(5000);
-        connect(m_reconnectTimer, &QTimer::timeout, this, &DE1Simulator::tryAutoReconnect);
-        m_reconnectTimer->start(); // Always running, checks if reconnect needed
-
-        // Check Pi connection on startup (after window shows)
+        connect(m_engine, &SimulationEngine::logMessage, m_logView, &LogView::append);
+        connect(m_engine, &SimulationEngine::linkStatusChanged, this, &DE1Simulator::onLinkStatusChanged);
+        connect(m_engine, &SimulationEngine::linkConnectedChanged, this, &DE1Simulator::onLinkConnectedChanged);
+        connect(m_engine, &SimulationEngine::bleClientChanged, this, &DE1Simulator::onBleClientChanged);
+        connect(m_engine, &SimulationEngine::statusMessage, m_statusBar, [this](const QString &msg) {
+            m_statusBar->showMessage(msg);
+        });
+        connect(m_engine, &SimulationEngine::snapshotReady, this, &DE1Simulator::onSnapshot);
+        connect(m_engine, &SimulationEngine::loadReported, this, &DE1Simulator::onLoadReported);
+        connect(m_engine, &SimulationEngine::profileChanged, m_profileView, &QPlainTextEdit::setPlainText);
+        connect(m_engine, &SimulationEngine::latencyReported, m_latencyView, &LatencyView::showReport);
+        connect(m_engine, &SimulationEngine::rttMeasured, m_latencyView->rttGraph(), &RttGraph::addSample);
+        connect(m_engine, &SimulationEngine::shotRecorded, m_shotsView, &ShotsView::addShot);
+        connect(m_engine, &SimulationEngine::liveSamplesReady, m_livePlot, &LivePlot::addSamples);
+        connect(m_engine, &SimulationEngine::traceStateChanged, this, [this](bool recording, bool replaying) {
+            m_recordAction->setChecked(recording);
+            m_replaying = replaying;
+            m_replayAction->setText(replaying ? "Stop &Replay" : "Re&play Trace...");
+        });
+
+        m_engine->setGhcStatus(m_ghcCombo->currentData().toInt());
+        m_engine->setLogSamples(m_logView->logSamples());
+        m_engine->setLiveSamples(true);
+        m_engine->setBinaryProtocol(m_binaryCheck->isChecked());
+        m_engine->setLatencyTiming(m_latencyView->timing());
+        m_engine->setSampleRate(m_sampleRateCombo->currentData().toInt());
+        m_engine->setSimSpeed(m_simSpeedCombo->currentData().toDouble());
+        m_engine->setTarget(m_hostEdit->text(), m_portSpin->value());
+
+        connect(m_logView, &LogView::logSamplesChanged, this, [this](bool enabled) {
+            m_engine->setLogSamples(enabled);
+        });
+        connect(m_binaryCheck, &QCheckBox::toggled, this, [this](bool enabled) {
+            m_engine->setBinaryProtocol(enabled);
+        });
+        connect(m_latencyView, &LatencyView::timingChanged, this, [this](bool enabled) {
+            m_engine->setLatencyTiming(enabled);
+        });
+        connect(m_latencyView, &LatencyView::exportRequested, this, [this](const QString &path) {
+            QMetaObject::invokeMethod(m_engine, [engine = m_engine, path]() { engine->exportLatencyCsv(path); });
+        });
+        connect(m_hostEdit, &QLineEdit::textChanged, this, &DE1Simulator::pushTarget);
+        connect(m_portSpin, &QSpinBox::valueChanged, this, &DE1Simulator::pushTarget);
+
+        // Sample timing matters more than repaint latency, so the engine
+        // thread runs above the GUI thread
+        m_engineThread = new QThread(this);
+        m_engineThread->setObjectName("SimulationEngine");
+        m_engine->moveToThread(m_engineThread);
+        connect(m_engineThread, &QThread::finished, m_engine, &QObject::deleteLater);
+        m_engineThread->start(QThread::HighPriority);
+
+        // The engine connects on its own once started; the first attempt
+        // doubles as the check whether the Pi is set up
+        QString host = m_hostEdit->text();
+        m_awaitingFirstLink = !host.isEmpty() && !Transport::isLoopbackHost(host);
+        QMetaObject::invokeMethod(m_engine, &SimulationEngine::start);
         QTimer::singleShot(500, this, &DE1Simulator::checkPiOnStartup);
     }
 
     ~DE1Simulator() {
         saveSettings();
+        if (m_scenario) m_scenario->deleteLater();     // Goes with the engine thread's deferred deletes
+        m_engineThread->quit();
+        m_engineThread->wait();
     }
 
 private slots:
@@ -855,47 +1067,71 @@ private slots:
             return;
         }
 
-        log("Checking if Pi daemon is running...");
-        m_statusLabel->setText("Checking Pi connection...");
-
-        // Try a quick connection
-        m_checkSocket = new QTcpSocket(this);
-        connect(m_checkSocket, &QTcpSocket::connected, this, [this]() {
-            log("Pi daemon is running! Ready to connect.");
-            m_statusLabel->setText("Pi daemon found - Click Connect");
-            m_statusLabel->setStyleSheet("font-weight: bold; font-size: 14px; color: #4CAF50;");
-            m_checkSocket->disconnectFromHost();
-            m_checkSocket->deleteLater();
-            m_checkSocket = nullptr;
+        if (Transport::isLoopbackHost(host)) {
+            log("Loopback mode - the in-process daemon stands in for the Pi");
+        }
+    }
+
+    // The first attempt failed: offer the setup wizard once, while the
+    // engine keeps retrying in the background
+    void offerSetup() {
+        log("Pi daemon not responding - showing setup wizard");
+
+        auto result = QMessageBox::question(this, "Setup Required",
+            "Could not connect to the Pi daemon.\n\n"
+            "Would you like to set up the Raspberry Pi now?",
+            QMessageBox::Yes | QMessageBox::No);
+
+        if (result == QMessageBox::Yes) {
+            showSetupDialog();
+        }
+    }
+
+    // Runs a scenario once against the engine as it is; the log shows its
+    // steps, faults and failed expectations like everything else
+    void toggleScenario() {
+        if (m_scenario) {
+            QMetaObject::invokeMethod(m_scenario, &ScenarioRunner::stop);
+            return;
+        }
+
+        QString path = QFileDialog::getOpenFileName(this, "Run Scenario", QString(),
+                                                    "Scenarios (*.scenario *.txt);;All files (*)");
+        if (path.isEmpty()) return;
+
+        QList<ScenarioStep> steps;
+        QString error;
+        if (!Scenario::parse(path, steps, error)) {
+            QMessageBox::warning(this, "Run Scenario", error);
+            return;
+        }
+
+        m_scenario = new ScenarioRunner(m_engine, steps, 1);
+        connect(m_scenario, &ScenarioRunner::logMessage, m_logView, &LogView::append);
+        connect(m_scenario, &ScenarioRunner::ghcStatusChanged, this, [this](int status) {
+            QSignalBlocker block(m_ghcCombo);   // The engine has it already
+            m_ghcCombo->setCurrentIndex(m_ghcCombo->findData(status));
         });
-        connect(m_checkSocket, &QTcpSocket::errorOccurred, this, [this](QAbstractSocket::SocketError) {
-            log("Pi daemon not responding - showing setup wizard");
-            m_statusLabel->setText("Pi not configured");
-            m_statusLabel->setStyleSheet("font-weight: bold; font-size: 14px; color: #FF9800;");
-            m_checkSocket->deleteLater();
-            m_checkSocket = nullptr;
-
-            // Ask user if they want to set up
-            auto result = QMessageBox::question(this, "Setup Required",
-                "Could not connect to the Pi daemon.\n\n"
-                "Would you like to set up the Raspberry Pi now?",
-                QMessageBox::Yes | QMessageBox::No);
-
-            if (result == QMessageBox::Yes) {
-                showSetupDialog();
-            }
+        connect(m_scenario, &ScenarioRunner::finished, this, [this, path](int status) {
+            m_scenario->deleteLater();
+            m_scenario = nullptr;
+            m_scenarioAction->setText("Run S&cenario...");
+            m_statusBar->showMessage(QString("Scenario %1 %2").arg(QFileInfo(path).fileName())
+                                         .arg(status == 0 ? "passed" : "failed"));
         });
 
-        m_checkSocket->connectToHost(host, m_portSpin->value());
+        // It calls the engine directly, so it runs on the engine's thread
+        m_scenario->moveToThread(m_engineThread);
+        QMetaObject::invokeMethod(m_scenario, [runner = m_scenario, ble = m_bleConnected, state = m_snapshot.state]() {
+            runner->start(false, ble, state);
+        });
+        m_scenarioAction->setText("Stop S&cenario");
+        log("Running scenario " + path);
     }
 
 private:
     void log(const QString& msg, const QString& category = "INFO") {
-        QString timestamp = QDateTime::currentDateTime().toString("hh:mm:ss.zzz");
-        QString formatted = QString("[%1] [%2] %3").arg(timestamp, category, msg);
-        m_logView->appendPlainText(formatted);
-        QScrollBar* sb = m_logView->verticalScrollBar();
-        sb->setValue(sb->maximum());
+        m_logView->append(category, msg);
     }
 
     void logRx(const QString& msg) { log(msg, "RX"); }
@@ -912,6 +1148,78 @@ private:
         auto *setupAction = new QAction("Setup &Raspberry Pi...", this);
         connect(setupAction, &QAction::triggered, this, &DE1Simulator::showSetupDialog);
         toolsMenu->addAction(setupAction);
+        toolsMenu->addSeparator();
+
+        // Traces: record a run, play it back byte for byte
+        m_recordAction = new QAction("&Record Trace...", this);
+        m_recordAction->setCheckable(true);
+        connect(m_recordAction, &QAction::triggered, this, [this](bool checked) {
+            if (!checked) {
+                QMetaObject::invokeMethod(m_engine, &SimulationEngine::stopRecording);
+                return;
+            }
+            m_recordAction->setChecked(false);      // Until the engine confirms
+            QString path = QFileDialog::getSaveFileName(this, "Record Trace", "shot.de1trace",
+                                                        "DE1 traces (*.de1trace)");
+            if (path.isEmpty()) return;
+            QMetaObject::invokeMethod(m_engine, [engine = m_engine, path]() { engine->startRecording(path); });
+        });
+        toolsMenu->addAction(m_recordAction);
+
+        m_replayAction = new QAction("Re&play Trace...", this);
+        connect(m_replayAction, &QAction::triggered, this, [this]() {
+            if (m_replaying) {
+                QMetaObject::invokeMethod(m_engine, &SimulationEngine::stopReplay);
+                return;
+            }
+            QString path = QFileDialog::getOpenFileName(this, "Replay Trace", QString(),
+                                                        "DE1 traces (*.de1trace);;All files (*)");
+            if (path.isEmpty()) return;
+            double speed = m_replaySpeedGroup->checkedAction()->data().toDouble();
+            QMetaObject::invokeMethod(m_engine, [engine = m_engine, path, speed]() {
+                engine->startReplay(path, speed);
+            });
+        });
+        toolsMenu->addAction(m_replayAction);
+
+        auto *speedMenu = toolsMenu->addMenu("Replay &Speed");
+        m_replaySpeedGroup = new QActionGroup(this);
+        const QList<QPair<QString, double>> speeds{
+            {"1x (as recorded)", 1.0}, {"10x", 10.0},
+            {"As fast as possible", SimulationEngine::REPLAY_AS_FAST_AS_POSSIBLE}};
+        for (const auto &speed : speeds) {
+            auto *action = speedMenu->addAction(speed.first);
+            action->setCheckable(true);
+            action->setData(speed.second);
+            m_replaySpeedGroup->addAction(action);
+        }
+        m_replaySpeedGroup->actions().first()->setChecked(true);
+        toolsMenu->addSeparator();
+
+        // Scenarios: scripted operations, faults and expectations (core/scenario.h)
+        m_scenarioAction = new QAction("Run S&cenario...", this);
+        connect(m_scenarioAction, &QAction::triggered, this, &DE1Simulator::toggleScenario);
+        toolsMenu->addAction(m_scenarioAction);
+        toolsMenu->addSeparator();
+
+        // MMR registers: answer with a real machine's values
+        auto *loadMmrAction = new QAction("Load &MMR Dump...", this);
+        connect(loadMmrAction, &QAction::triggered, this, [this]() {
+            QString path = QFileDialog::getOpenFileName(this, "Load MMR Dump", QString(),
+                                                        "MMR dumps (*.json);;All files (*)");
+            if (path.isEmpty()) return;
+            QMetaObject::invokeMethod(m_engine, [engine = m_engine, path]() { engine->loadMmrDump(path); });
+        });
+        toolsMenu->addAction(loadMmrAction);
+
+        auto *exportMmrAction = new QAction("&Export MMR Dump...", this);
+        connect(exportMmrAction, &QAction::triggered, this, [this]() {
+            QString path = QFileDialog::getSaveFileName(this, "Export MMR Dump", "mmr.json",
+                                                        "MMR dumps (*.json)");
+            if (path.isEmpty()) return;
+            QMetaObject::invokeMethod(m_engine, [engine = m_engine, path]() { engine->exportMmrDump(path); });
+        });
+        toolsMenu->addAction(exportMmrAction);
 
         // Help menu
         auto *helpMenu = menuBar->addMenu("&Help");
@@ -941,7 +1249,7 @@ private:
 
         connLayout->addWidget(new QLabel("Pi Address:"));
         m_hostEdit = new QLineEdit();
-        m_hostEdit->setPlaceholderText("DE1-Simulator.local or IP address");
+        m_hostEdit->setPlaceholderText("DE1-Simulator.local, IP address or loopback");
         m_hostEdit->setMinimumWidth(200);
         connLayout->addWidget(m_hostEdit);
 
@@ -956,6 +1264,12 @@ private:
         connect(m_connectBtn, &QPushButton::clicked, this, &DE1Simulator::onConnectClicked);
         connLayout->addWidget(m_connectBtn);
 
+        m_binaryCheck = new QCheckBox("Binary protocol");
+        m_binaryCheck->setToolTip("Use binary frames for characteristic traffic if the daemon supports it.\n"
+                                  "Uncheck to keep everything as JSON for debugging (applies on next connect).");
+        m_binaryCheck->setChecked(true);
+        connLayout->addWidget(m_binaryCheck);
+
         connLayout->addStretch();
 
         mainLayout->addWidget(connGroup);
@@ -1013,6 +1327,11 @@ private:
         connect(m_hotWaterBtn, &QPushButton::clicked, this, &DE1Simulator::onHotWaterClicked);
         connect(m_flushBtn, &QPushButton::clicked, this, &DE1Simulator::onFlushClicked);
 
+        // The buttons' checked state follows the engine's state, not clicks
+        for (auto *btn : {m_powerBtn, m_espressoBtn, m_steamBtn, m_hotWaterBtn, m_flushBtn}) {
+            connect(btn, &QPushButton::clicked, this, [this]() { updateStateDisplay(); });
+        }
+
         ghcLayout->addLayout(buttonLayout);
 
         // GHC Status dropdown + Stop button
@@ -1025,6 +1344,9 @@ private:
         m_ghcCombo->addItem("3 - Present and active (app CANNOT start)", 3);
         m_ghcCombo->addItem("4 - Debug mode (app CAN start)", 4);
         m_ghcCombo->setCurrentIndex(3);
+        connect(m_ghcCombo, &QComboBox::currentIndexChanged, this, [this]() {
+            m_engine->setGhcStatus(m_ghcCombo->currentData().toInt());
+        });
         ghcStatusLayout->addWidget(m_ghcCombo);
         ghcStatusLayout->addStretch();
 
@@ -1077,33 +1399,51 @@ private:
         m_frameLabel->setStyleSheet("font-weight: bold;");
         valuesLayout->addWidget(m_frameLabel, 1, 5);
 
+        valuesLayout->addWidget(new QLabel("Sample Rate:"), 2, 0);
+        m_sampleRateCombo = new QComboBox();
+        for (int hz : {5, 10, 25, 50}) {
+            m_sampleRateCombo->addItem(QString("%1 Hz").arg(hz), hz);
+        }
+        connect(m_sampleRateCombo, &QComboBox::currentIndexChanged, this, [this]() {
+            int hz = m_sampleRateCombo->currentData().toInt();
+            QMetaObject::invokeMethod(m_engine, [engine = m_engine, hz]() { engine->setSampleRate(hz); });
+        });
+        valuesLayout->addWidget(m_sampleRateCombo, 2, 1);
+
+        valuesLayout->addWidget(new QLabel("Load:"), 2, 2);
+        m_rateLabel = new QLabel("-");
+        m_rateLabel->setToolTip("SHOT_SAMPLE rate: requested / sent by the simulator / "
+                                "delivered to the network (written by the TCP socket) / "
+                                "notified over BLE by the Pi, and samples the Pi collapsed "
+                                "because a newer one arrived before the old one went out");
+        valuesLayout->addWidget(m_rateLabel, 2, 3, 1, 3);
+
+        valuesLayout->addWidget(new QLabel("Sim Speed:"), 3, 0);
+        m_simSpeedCombo = new QComboBox();
+        for (int speed : {1, 2, 5, 10, 50, 100}) {
+            m_simSpeedCombo->addItem(QString("%1x").arg(speed), speed);
+        }
+        m_simSpeedCombo->setToolTip("Phases, the shot timer and the water drain run this much faster "
+                                    "than real time; the sample rate stays in real time");
+        connect(m_simSpeedCombo, &QComboBox::currentIndexChanged, this, [this]() {
+            double speed = m_simSpeedCombo->currentData().toDouble();
+            QMetaObject::invokeMethod(m_engine, [engine = m_engine, speed]() { engine->setSimSpeed(speed); });
+        });
+        valuesLayout->addWidget(m_simSpeedCombo, 3, 1);
+
         mainLayout->addWidget(valuesGroup);
 
         // === Tabs for Log and Profile ===
         m_tabWidget = new QTabWidget();
 
-        // BLE Log tab with clear button
-        auto *logTab = new QWidget();
-        auto *logTabLayout = new QVBoxLayout(logTab);
-        logTabLayout->setContentsMargins(0, 0, 0, 0);
-
-        m_logView = new QPlainTextEdit();
-        m_logView->setReadOnly(true);
-        m_logView->setFont(QFont("Consolas", 9));
-        m_logView->setStyleSheet("QPlainTextEdit { background-color: #1e1e1e; color: #d4d4d4; }");
-        m_logView->setMaximumBlockCount(1000);
-        logTabLayout->addWidget(m_logView);
-
-        auto *logBtnLayout = new QHBoxLayout();
-        logBtnLayout->addStretch();
-        m_clearLogBtn = new QPushButton("Clear Log");
-        connect(m_clearLogBtn, &QPushButton::clicked, this, [this]() {
-            m_logView->clear();
-        });
-        logBtnLayout->addWidget(m_clearLogBtn);
-        logTabLayout->addLayout(logBtnLayout);
+        // BLE Log tab (filters, sample logging toggle and clear button built in)
+        m_logView = new LogView();
+        m_tabWidget->addTab(m_logView, "BLE Log");
 
-        m_tabWidget->addTab(logTab, "BLE Log");
+        m_livePlot = new LivePlot();
+        m_livePlot->setToolTip("Every SHOT_SAMPLE over the last 30 s of wall time; "
+                               "uneven spacing is sample jitter");
+        m_tabWidget->addTab(m_livePlot, "Live Plot");
 
         m_profileView = new QPlainTextEdit();
         m_profileView->setReadOnly(true);
@@ -1111,6 +1451,12 @@ private:
         m_profileView->setStyleSheet("QPlainTextEdit { background-color: #1e1e1e; color: #d4d4d4; }");
         m_tabWidget->addTab(m_profileView, "Profile");
 
+        m_latencyView = new LatencyView();
+        m_tabWidget->addTab(m_latencyView, "Latency");
+
+        m_shotsView = new ShotsView();
+        m_tabWidget->addTab(m_shotsView, "Shots");
+
         mainLayout->addWidget(m_tabWidget, 1);
 
         // Status bar
@@ -1119,19 +1465,35 @@ private:
         m_statusBar->showMessage("Ready - Connect to Raspberry Pi to start");
 
         updateStateDisplay();
-        updateProfileDisplay();
     }
 
     void loadSettings() {
         QSettings settings("Decenza", "DE1Simulator");
         m_hostEdit->setText(settings.value("pi_host", "DE1-Simulator.local").toString());
         m_portSpin->setValue(settings.value("pi_port", 12345).toInt());
+        m_binaryCheck->setChecked(settings.value("binary_protocol", true).toBool());
+        int rateIdx = m_sampleRateCombo->findData(settings.value("sample_rate_hz", 5).toInt());
+        if (rateIdx >= 0) m_sampleRateCombo->setCurrentIndex(rateIdx);
+        int speedIdx = m_simSpeedCombo->findData(settings.value("sim_speed", 1).toInt());
+        if (speedIdx >= 0) m_simSpeedCombo->setCurrentIndex(speedIdx);
+        m_logView->loadSettings(settings);
+        m_latencyView->loadSettings(settings);
+        double replaySpeed = settings.value("replay_speed", 1.0).toDouble();
+        for (QAction *action : m_replaySpeedGroup->actions()) {
+            if (action->data().toDouble() == replaySpeed) action->setChecked(true);
+        }
     }
 
     void saveSettings() {
         QSettings settings("Decenza", "DE1Simulator");
         settings.setValue("pi_host", m_hostEdit->text());
         settings.setValue("pi_port", m_portSpin->value());
+        settings.setValue("binary_protocol", m_binaryCheck->isChecked());
+        settings.setValue("sample_rate_hz", m_sampleRateCombo->currentData().toInt());
+        settings.setValue("sim_speed", m_simSpeedCombo->currentData().toInt());
+        m_logView->saveSettings(settings);
+        m_latencyView->saveSettings(settings);
+        settings.setValue("replay_speed", m_replaySpeedGroup->checkedAction()->data().toDouble());
     }
 
 private slots:
@@ -1141,629 +1503,162 @@ private slots:
     }
 
     void onConnectClicked() {
-        if (m_socket->state() == QAbstractSocket::ConnectedState) {
-            m_socket->disconnectFromHost();
-        } else {
-            QString host = m_hostEdit->text();
-            int port = m_portSpin->value();
-
-            if (host.isEmpty()) {
-                QMessageBox::warning(this, "Error", "Please enter the Pi hostname or IP address.");
-                return;
-            }
-
-            log(QString("Connecting to %1:%2...").arg(host).arg(port));
-            m_statusLabel->setText("Connecting...");
-            m_statusLabel->setStyleSheet("font-weight: bold; font-size: 14px; color: #FF9800;");
-            m_connectBtn->setEnabled(false);
-
-            m_socket->connectToHost(host, port);
-        }
-    }
-
-    void onConnected() {
-        log("Connected to Pi daemon");
-        m_statusLabel->setText("Connected to Pi - Waiting for BLE...");
-        m_statusLabel->setStyleSheet("font-weight: bold; font-size: 14px; color: #4CAF50;");
-        m_connectBtn->setText("Disconnect");
-        m_connectBtn->setEnabled(true);
-        m_statusBar->showMessage("Connected to Raspberry Pi");
-
-        // Enable controls
-        for (auto *btn : {m_powerBtn, m_espressoBtn, m_steamBtn, m_hotWaterBtn, m_flushBtn, m_stopBtn}) {
-            btn->setEnabled(true);
-        }
-
-        // Start water level timer
-        m_waterTimer->start();
-    }
-
-    void onDisconnected() {
-        log("Disconnected from Pi");
-        m_statusLabel->setText("Disconnected from Pi");
-        m_statusLabel->setStyleSheet("font-weight: bold; font-size: 14px; color: #666;");
-        m_connectBtn->setText("Connect");
-        m_connectBtn->setEnabled(true);
-        m_bleClientLabel->setText("None");
-        m_statusBar->showMessage("Disconnected");
-
-        // Disable controls
-        for (auto *btn : {m_powerBtn, m_espressoBtn, m_steamBtn, m_hotWaterBtn, m_flushBtn, m_stopBtn}) {
-            btn->setEnabled(false);
+        if (m_linkConnected) {
+            QMetaObject::invokeMethod(m_engine, &SimulationEngine::disconnectFromPi);
+            return;
         }
 
-        // Stop timers
-        m_shotTimer->stop();
-        m_phaseTimer->stop();
-        m_waterTimer->stop();
-    }
-
-    void onSocketError(QAbstractSocket::SocketError error) {
-        Q_UNUSED(error);
-        log(QString("Socket error: %1").arg(m_socket->errorString()), "ERROR");
-        m_statusLabel->setText("Connection failed: " + m_socket->errorString());
-        m_statusLabel->setStyleSheet("font-weight: bold; font-size: 14px; color: #f44336;");
-        m_connectBtn->setText("Connect");
-        m_connectBtn->setEnabled(true);
-    }
-
-    void tryAutoReconnect() {
-        // Only try if not already connected or connecting
-        if (m_socket->state() == QAbstractSocket::UnconnectedState) {
-            QString host = m_hostEdit->text();
-            int port = m_portSpin->value();
-            if (!host.isEmpty()) {
-                log(QString("Auto-reconnecting to %1:%2...").arg(host).arg(port));
-                m_statusLabel->setText("Auto-reconnecting...");
-                m_statusLabel->setStyleSheet("font-weight: bold; font-size: 14px; color: #FF9800;");
-                m_socket->connectToHost(host, port);
-            }
+        if (m_hostEdit->text().isEmpty()) {
+            QMessageBox::warning(this, "Error", "Please enter the Pi hostname or IP address.");
+            return;
         }
-    }
-
-    void onDataReceived() {
-        m_tcpBuffer += m_socket->readAll();
-
-        // Process complete JSON messages (newline-delimited)
-        while (true) {
-            int idx = m_tcpBuffer.indexOf('\n');
-            if (idx < 0) break;
 
-            QByteArray line = m_tcpBuffer.left(idx);
-            m_tcpBuffer = m_tcpBuffer.mid(idx + 1);
-
-            if (line.isEmpty()) continue;
-
-            QJsonParseError err;
-            QJsonDocument doc = QJsonDocument::fromJson(line, &err);
-            if (err.error != QJsonParseError::NoError) {
-                log("JSON parse error: " + err.errorString(), "ERROR");
-                continue;
-            }
-
-            handlePiEvent(doc.object());
-        }
+        m_connectBtn->setEnabled(false);
+        pushTarget();
+        QMetaObject::invokeMethod(m_engine, &SimulationEngine::connectToPi);
     }
 
-    void handlePiEvent(const QJsonObject &event) {
-        QString type = event["event"].toString();
-
-        if (type == "ready") {
-            QString version = event["version"].toString();
-            logPi(QString("Pi daemon ready (v%1)").arg(version));
-            m_statusLabel->setText("Connected to Pi - Advertising as DE1-SIM");
-            m_statusLabel->setStyleSheet("font-weight: bold; font-size: 14px; color: #4CAF50;");
-
-            // Send initial state
-            sendStateNotification();
-            sendWaterLevel();
-        }
-        else if (type == "advertising") {
-            logPi("BLE advertising started");
-        }
-        else if (type == "connected") {
-            QString client = event["client"].toString();
-            logPi(QString("BLE client connected: %1").arg(client));
-            m_bleClientLabel->setText(client);
-            m_bleClientLabel->setStyleSheet("font-weight: bold; color: #4CAF50;");
-            m_statusBar->showMessage("BLE client connected: " + client);
-        }
-        else if (type == "disconnected") {
-            logPi("BLE client disconnected");
-            m_bleClientLabel->setText("None");
-            m_bleClientLabel->setStyleSheet("font-weight: bold; color: #666;");
-            m_statusBar->showMessage("BLE client disconnected");
-        }
-        else if (type == "write") {
-            QString charId = event["char"].toString();
-            QByteArray data = QByteArray::fromHex(event["data"].toString().toLatin1());
-            handleCharacteristicWrite(charId, data);
-        }
-        else if (type == "read") {
-            QString charId = event["char"].toString();
-            logRx(QString("CHAR_READ: %1").arg(DE1::charName(charId)));
-        }
-        else if (type == "error") {
-            int code = event["code"].toInt();
-            log(QString("Pi BLE error: %1").arg(code), "ERROR");
-        }
+    void pushTarget() {
+        QString host = m_hostEdit->text();
+        int port = m_portSpin->value();
+        QMetaObject::invokeMethod(m_engine, [engine = m_engine, host, port]() {
+            engine->setTarget(host, port);
+        });
     }
 
-    void handleCharacteristicWrite(const QString &charId, const QByteArray &value) {
-        QString charName = DE1::charName(charId);
+    // === Engine updates ===
 
-        if (charId == DE1::CHAR_REQUESTED_STATE) {
-            if (value.size() >= 1) {
-                auto requestedState = static_cast<DE1::State>(static_cast<uint8_t>(value[0]));
-                logRx(QString("REQUESTED_STATE: %1 (0x%2)")
-                    .arg(DE1::stateName(requestedState))
-                    .arg(static_cast<int>(requestedState), 2, 16, QChar('0')));
-                handleRequestedState(requestedState);
-            }
-        } else if (charId == DE1::CHAR_READ_FROM_MMR) {
-            handleMMRReadRequest(value);
-        } else if (charId == DE1::CHAR_WRITE_TO_MMR) {
-            handleMMRWrite(value);
-        } else if (charId == DE1::CHAR_HEADER_WRITE) {
-            handleHeaderWrite(value);
-        } else if (charId == DE1::CHAR_FRAME_WRITE) {
-            handleFrameWrite(value);
-        } else if (charId == DE1::CHAR_SHOT_SETTINGS) {
-            handleShotSettings(value);
-        } else {
-            logRx(QString("%1: %2").arg(charName, value.toHex(' ')));
-        }
-    }
+    void onLinkStatusChanged(SimulationEngine::LinkStatus status, const QString &text) {
+        static const char *colors[] = {"#666", "#FF9800", "#4CAF50", "#f44336"};
+        m_statusLabel->setText(text);
+        m_statusLabel->setStyleSheet(QString("font-weight: bold; font-size: 14px; color: %1;")
+            .arg(colors[static_cast<int>(status)]));
 
-    void handleRequestedState(DE1::State requested) {
-        int ghcStatus = m_ghcCombo->currentData().toInt();
-        if (ghcStatus == 3) {
-            if (requested != DE1::State::Sleep && requested != DE1::State::Idle) {
-                log(QString("GHC active - BLOCKED app request: %1").arg(DE1::stateName(requested)), "WARN");
-                return;
+        // A failed attempt re-enables Connect
+        if (status == SimulationEngine::LinkStatus::Error) {
+            m_connectBtn->setEnabled(true);
+            if (m_awaitingFirstLink) {
+                m_awaitingFirstLink = false;
+                QTimer::singleShot(0, this, &DE1Simulator::offerSetup);
             }
         }
-
-        transitionToState(requested, DE1::SubState::Ready);
-    }
-
-    void handleMMRReadRequest(const QByteArray &value) {
-        if (value.size() < 4) return;
-
-        uint32_t address = BinaryCodec::decodeAddress(reinterpret_cast<const uint8_t*>(value.constData() + 1));
-        QString addrName = DE1::MMR::addressName(address);
-
-        logRx(QString("MMR_READ: %1").arg(addrName));
-
-        QByteArray response(8, 0);
-        BinaryCodec::encodeUint32BE(address, reinterpret_cast<uint8_t*>(response.data()));
-
-        QString responseVal;
-        if (address == DE1::MMR::GHC_INFO) {
-            int ghc = m_ghcCombo->currentData().toInt();
-            response[4] = static_cast<char>(ghc);
-            responseVal = QString::number(ghc);
-        } else if (address == DE1::MMR::USB_CHARGER) {
-            response[4] = 1;
-            responseVal = "1 (on)";
-        } else if (address == DE1::MMR::MACHINE_MODEL) {
-            response[4] = 2;
-            responseVal = "2 (DE1Plus)";
-        } else if (address == DE1::MMR::FIRMWARE_VERSION) {
-            response[4] = 1; response[5] = 0; response[6] = 0; response[7] = 0;
-            responseVal = "1.0.0.0";
-        } else {
-            responseVal = "0 (unknown addr)";
-        }
-
-        sendNotification(DE1::CHAR_READ_FROM_MMR, response);
-        logTx(QString("MMR_RESPONSE: %1 = %2").arg(addrName, responseVal));
     }
 
-    void handleMMRWrite(const QByteArray &value) {
-        if (value.size() < 8) return;
-
-        uint32_t address = BinaryCodec::decodeAddress(reinterpret_cast<const uint8_t*>(value.constData() + 1));
-        uint32_t val = static_cast<uint8_t>(value[4]) |
-                       (static_cast<uint8_t>(value[5]) << 8) |
-                       (static_cast<uint8_t>(value[6]) << 16) |
-                       (static_cast<uint8_t>(value[7]) << 24);
-
-        QString addrName = DE1::MMR::addressName(address);
-        logRx(QString("MMR_WRITE: %1 = %2 (0x%3)")
-            .arg(addrName)
-            .arg(val)
-            .arg(val, 8, 16, QChar('0')));
-    }
+    void onLinkConnectedChanged(bool connected) {
+        m_linkConnected = connected;
+        if (connected) m_awaitingFirstLink = false;
+        m_connectBtn->setText(connected ? "Disconnect" : "Connect");
+        m_connectBtn->setEnabled(true);
 
-    void handleHeaderWrite(const QByteArray &value) {
-        if (value.size() < 5) {
-            logRx(QString("HEADER_WRITE: invalid size %1").arg(value.size()));
-            return;
+        for (auto *btn : {m_powerBtn, m_espressoBtn, m_steamBtn, m_hotWaterBtn, m_flushBtn, m_stopBtn}) {
+            btn->setEnabled(connected);
         }
 
-        const uint8_t* d = reinterpret_cast<const uint8_t*>(value.constData());
-        m_profileHeader.headerV = d[0];
-        m_profileHeader.numFrames = d[1];
-        m_profileHeader.numPreinfuseFrames = d[2];
-        m_profileHeader.minPressure = BinaryCodec::decodeU8P4(d[3]);
-        m_profileHeader.maxFlow = BinaryCodec::decodeU8P4(d[4]);
-
-        m_profileFrames.clear();
-        m_profileFrames.resize(m_profileHeader.numFrames);
-
-        logRx(QString("HEADER_WRITE: %1").arg(m_profileHeader.toString()));
-        updateProfileDisplay();
+        if (!connected) m_rateLabel->setText("-");
+        m_latencyView->reset();
     }
 
-    void handleFrameWrite(const QByteArray &value) {
-        if (value.size() < 8) {
-            logRx(QString("FRAME_WRITE: invalid size %1").arg(value.size()));
-            return;
-        }
-
-        const uint8_t* d = reinterpret_cast<const uint8_t*>(value.constData());
-        uint8_t frameIdx = d[0];
-
-        if (frameIdx >= 32) {
-            int actualIdx = frameIdx - 32;
-            if (actualIdx < m_profileFrames.size()) {
-                m_profileFrames[actualIdx].hasExtension = true;
-                m_profileFrames[actualIdx].limiterValue = BinaryCodec::decodeU8P4(d[1]);
-                m_profileFrames[actualIdx].limiterRange = BinaryCodec::decodeU8P4(d[2]);
-                logRx(QString("FRAME_EXT[%1]: limiter=%2, range=%3")
-                    .arg(actualIdx)
-                    .arg(m_profileFrames[actualIdx].limiterValue, 0, 'f', 1)
-                    .arg(m_profileFrames[actualIdx].limiterRange, 0, 'f', 1));
-            }
-        } else if (frameIdx == m_profileHeader.numFrames) {
-            logRx(QString("FRAME_WRITE: Tail frame received (profile complete)"));
-        } else if (frameIdx < m_profileFrames.size()) {
-            ProfileFrame& frame = m_profileFrames[frameIdx];
-            frame.frameIndex = frameIdx;
-            frame.flags = d[1];
-            frame.setVal = BinaryCodec::decodeU8P4(d[2]);
-            frame.temp = BinaryCodec::decodeU8P1(d[3]);
-            frame.duration = BinaryCodec::decodeF8_1_7(d[4]);
-            frame.triggerVal = BinaryCodec::decodeU8P4(d[5]);
-            frame.maxVol = BinaryCodec::decodeU10P0(d + 6);
-
-            logRx(QString("FRAME_WRITE[%1]: %2").arg(frameIdx).arg(frame.toString()));
+    void onBleClientChanged(const QString &client) {
+        m_bleConnected = !client.isEmpty();
+        if (client.isEmpty()) {
+            m_bleClientLabel->setText("None");
+            m_bleClientLabel->setStyleSheet("font-weight: bold; color: #666;");
         } else {
-            logRx(QString("FRAME_WRITE: index %1 out of range").arg(frameIdx));
-        }
-
-        updateProfileDisplay();
-    }
-
-    void handleShotSettings(const QByteArray &value) {
-        if (value.size() < 9) {
-            logRx(QString("SHOT_SETTINGS: invalid size %1").arg(value.size()));
-            return;
+            m_bleClientLabel->setText(client);
+            m_bleClientLabel->setStyleSheet("font-weight: bold; color: #4CAF50;");
         }
-
-        const uint8_t* d = reinterpret_cast<const uint8_t*>(value.constData());
-        uint8_t steamTemp = d[1];
-        uint8_t steamDuration = d[2];
-        uint8_t hotWaterTemp = d[3];
-        uint8_t hotWaterVol = d[4];
-        uint8_t espressoVol = d[6];
-        double groupTemp = BinaryCodec::decodeShortBE(d + 7) / 256.0;
-
-        logRx(QString("SHOT_SETTINGS: steam=%1C/%2s, hotWater=%3C/%4mL, espresso=%5mL, groupTemp=%6C")
-            .arg(steamTemp).arg(steamDuration)
-            .arg(hotWaterTemp).arg(hotWaterVol)
-            .arg(espressoVol)
-            .arg(groupTemp, 0, 'f', 1));
-    }
-
-    // === Send to Pi ===
-
-    void sendCommand(const QJsonObject &cmd) {
-        if (m_socket->state() != QAbstractSocket::ConnectedState) return;
-
-        QByteArray json = QJsonDocument(cmd).toJson(QJsonDocument::Compact) + "\n";
-        m_socket->write(json);
-        m_socket->flush();
-    }
-
-    void sendNotification(const QString &charId, const QByteArray &data) {
-        QJsonObject cmd;
-        cmd["cmd"] = "notify";
-        cmd["char"] = charId;
-        cmd["data"] = QString(data.toHex());
-        sendCommand(cmd);
-    }
-
-    void sendStateNotification() {
-        QByteArray data(2, 0);
-        data[0] = static_cast<char>(m_currentState);
-        data[1] = static_cast<char>(m_currentSubState);
-
-        sendNotification(DE1::CHAR_STATE_INFO, data);
-        logTx(QString("STATE_INFO: %1/%2")
-            .arg(DE1::stateName(m_currentState))
-            .arg(DE1::subStateName(m_currentSubState)));
-    }
-
-    void sendWaterLevel() {
-        if (m_socket->state() != QAbstractSocket::ConnectedState) return;
-
-        double waterMm = (m_waterLevel / 100.0) * 40.0 - 5.0;
-        uint16_t encoded = BinaryCodec::encodeU16P8(waterMm);
-
-        QByteArray data(2, 0);
-        BinaryCodec::encodeShortBE(encoded, reinterpret_cast<uint8_t*>(data.data()));
-
-        sendNotification(DE1::CHAR_WATER_LEVELS, data);
-    }
-
-    void sendShotSample() {
-        if (m_socket->state() != QAbstractSocket::ConnectedState) return;
-
-        QByteArray data(19, 0);
-        uint8_t* d = reinterpret_cast<uint8_t*>(data.data());
-
-        uint16_t timerEncoded = static_cast<uint16_t>(m_shotTimer_s * 100);
-        BinaryCodec::encodeShortBE(timerEncoded, d);
-
-        uint16_t pressureEncoded = BinaryCodec::encodeU16P12(m_pressure);
-        BinaryCodec::encodeShortBE(pressureEncoded, d + 2);
-
-        uint16_t flowEncoded = BinaryCodec::encodeU16P12(m_flow);
-        BinaryCodec::encodeShortBE(flowEncoded, d + 4);
-
-        uint16_t mixTempEncoded = BinaryCodec::encodeU16P8(m_temperature);
-        BinaryCodec::encodeShortBE(mixTempEncoded, d + 6);
-
-        BinaryCodec::encodeU24P16(m_temperature, d + 8);
-
-        BinaryCodec::encodeShortBE(BinaryCodec::encodeU16P8(m_setTemp), d + 11);
-        BinaryCodec::encodeShortBE(BinaryCodec::encodeU16P8(m_setTemp), d + 13);
-
-        d[15] = BinaryCodec::encodeU8P4(m_setPressure);
-        d[16] = BinaryCodec::encodeU8P4(m_setFlow);
-        d[17] = static_cast<uint8_t>(m_frameNumber);
-        d[18] = static_cast<uint8_t>(m_steamTemp);
-
-        sendNotification(DE1::CHAR_SHOT_SAMPLE, data);
     }
 
-    // === Simulation ===
-
-    void onShotTimerTick() {
-        m_shotTimer_s += 0.2;
-        updateSimulationValues();
-        sendShotSample();
+    void onSnapshot(const EngineSnapshot &snapshot) {
+        m_snapshot = snapshot;
+        updateStateDisplay();
         updateValuesDisplay();
     }
 
-    void updateSimulationValues() {
-        if (m_currentState == DE1::State::Espresso) {
-            if (m_currentSubState == DE1::SubState::Preinfusion) {
-                m_pressure = qMin(4.0, m_shotTimer_s * 0.8);
-                m_flow = 2.0;
-                m_setPressure = 4.0;
-                m_setFlow = 2.0;
-            } else if (m_currentSubState == DE1::SubState::Pouring) {
-                double pouringTime = m_shotTimer_s - 7.0;
-                m_pressure = 8.0 + qSin(pouringTime * 0.5) * 1.0;
-                m_flow = 2.0 + qSin(pouringTime * 0.3) * 0.5;
-                m_setPressure = 9.0;
-                m_setFlow = 2.0;
-                m_frameNumber = qMin(5, static_cast<int>(pouringTime / 5.0) + 1);
-            } else if (m_currentSubState == DE1::SubState::Ending) {
-                m_pressure = qMax(0.0, m_pressure - 0.5);
-                m_flow = qMax(0.0, m_flow - 0.3);
-            }
-        } else if (m_currentState == DE1::State::Steam) {
-            m_pressure = 1.5;
-            m_flow = 0.0;
-            m_steamTemp = qMin(150.0, 100.0 + m_shotTimer_s * 2.0);
-        } else if (m_currentState == DE1::State::HotWater) {
-            m_pressure = 0.5;
-            m_flow = 6.0;
-        } else if (m_currentState == DE1::State::HotWaterRinse) {
-            m_pressure = 1.0;
-            m_flow = 8.0;
-        }
-    }
-
-    void onPhaseTimeout() {
-        if (m_currentState == DE1::State::Espresso) {
-            if (m_currentSubState == DE1::SubState::Heating) {
-                transitionToState(DE1::State::Espresso, DE1::SubState::Preinfusion);
-                m_phaseTimer->start(5000);
-            } else if (m_currentSubState == DE1::SubState::Preinfusion) {
-                transitionToState(DE1::State::Espresso, DE1::SubState::Pouring);
-                m_phaseTimer->start(25000);
-            } else if (m_currentSubState == DE1::SubState::Pouring) {
-                transitionToState(DE1::State::Espresso, DE1::SubState::Ending);
-                m_phaseTimer->start(2000);
-            } else if (m_currentSubState == DE1::SubState::Ending) {
-                stopOperation();
-            }
-        } else if (m_currentState == DE1::State::Steam) {
-            stopOperation();
-        } else if (m_currentState == DE1::State::HotWater) {
-            stopOperation();
-        } else if (m_currentState == DE1::State::HotWaterRinse) {
-            stopOperation();
-        }
-    }
-
-    void transitionToState(DE1::State state, DE1::SubState subState) {
-        m_currentState = state;
-        m_currentSubState = subState;
-        updateStateDisplay();
-        sendStateNotification();
+    void onLoadReported(const LoadReport &r) {
+        if (!m_linkConnected) return;
+
+        m_rateLabel->setText(QString("%1 Hz requested / %2 sent / %3 delivered (%4 queued) / "
+                                     "%5 BLE (%6 coalesced) / %7 ms latency (%8 max)")
+            .arg(r.requestedHz)
+            .arg(r.sentHz, 0, 'f', 1)
+            .arg(r.deliveredHz, 0, 'f', 1)
+            .arg(r.queued)
+            .arg(r.bleHz, 0, 'f', 1)
+            .arg(r.bleCoalescedHz, 0, 'f', 1)
+            .arg(r.latencyAvgMs, 0, 'f', 2)
+            .arg(r.latencyMaxMs, 0, 'f', 2)
+            + (r.bleIntervalMs > 0 ? QString(" / %1 ms interval").arg(r.bleIntervalMs) : QString())
+            + (r.rttMs >= 0 ? QString(" / %1 ms RTT").arg(r.rttMs, 0, 'f', 1) : QString()));
     }
 
     void updateStateDisplay() {
-        m_stateLabel->setText(DE1::stateName(m_currentState));
-        m_subStateLabel->setText(DE1::subStateName(m_currentSubState));
-
-        m_powerBtn->setChecked(m_currentState == DE1::State::Sleep);
-        m_espressoBtn->setChecked(m_currentState == DE1::State::Espresso);
-        m_steamBtn->setChecked(m_currentState == DE1::State::Steam);
-        m_hotWaterBtn->setChecked(m_currentState == DE1::State::HotWater);
-        m_flushBtn->setChecked(m_currentState == DE1::State::HotWaterRinse);
+        DE1::State state = m_snapshot.state;
+        m_stateLabel->setText(DE1::stateName(state));
+        m_subStateLabel->setText(DE1::subStateName(m_snapshot.subState));
+
+        m_powerBtn->setChecked(state == DE1::State::Sleep);
+        m_espressoBtn->setChecked(state == DE1::State::Espresso);
+        m_steamBtn->setChecked(state == DE1::State::Steam);
+        m_hotWaterBtn->setChecked(state == DE1::State::HotWater);
+        m_flushBtn->setChecked(state == DE1::State::HotWaterRinse);
     }
 
     void updateValuesDisplay() {
-        m_pressureLabel->setText(QString("%1 bar").arg(m_pressure, 0, 'f', 1));
-        m_flowLabel->setText(QString("%1 mL/s").arg(m_flow, 0, 'f', 1));
-        m_tempLabel->setText(QString("%1 C").arg(m_temperature, 0, 'f', 1));
-        m_timerLabel->setText(QString("%1 s").arg(m_shotTimer_s, 0, 'f', 1));
-        m_waterLabel->setText(QString("%1 %").arg(static_cast<int>(m_waterLevel)));
-        m_frameLabel->setText(QString::number(m_frameNumber));
-    }
-
-    void updateProfileDisplay() {
-        QString text;
-        text += "=== CURRENT PROFILE ===\n\n";
-
-        if (m_profileHeader.numFrames == 0) {
-            text += "(No profile uploaded yet)\n";
-        } else {
-            text += m_profileHeader.toString() + "\n\n";
-
-            for (int i = 0; i < m_profileFrames.size(); i++) {
-                const auto& frame = m_profileFrames[i];
-                if (i < m_profileHeader.numPreinfuseFrames) {
-                    text += "[Preinfuse] ";
-                } else {
-                    text += "[Pour]      ";
-                }
-                text += frame.toString() + "\n";
-            }
-        }
-
-        m_profileView->setPlainText(text);
-    }
-
-    void startOperation(DE1::State state) {
-        if (m_currentState != DE1::State::Idle && m_currentState != DE1::State::Sleep) {
-            return;
-        }
-
-        m_shotTimer_s = 0.0;
-        m_pressure = 0.0;
-        m_flow = 0.0;
-        m_frameNumber = 0;
-
-        if (state == DE1::State::Espresso) {
-            transitionToState(DE1::State::Espresso, DE1::SubState::Heating);
-            m_phaseTimer->start(2000);
-        } else if (state == DE1::State::Steam) {
-            transitionToState(DE1::State::Steam, DE1::SubState::Steaming);
-            m_phaseTimer->start(45000);
-        } else if (state == DE1::State::HotWater) {
-            transitionToState(DE1::State::HotWater, DE1::SubState::Pouring);
-            m_phaseTimer->start(30000);
-        } else if (state == DE1::State::HotWaterRinse) {
-            transitionToState(DE1::State::HotWaterRinse, DE1::SubState::Pouring);
-            m_phaseTimer->start(10000);
-        }
-
-        m_shotTimer->start();
-        updateValuesDisplay();
+        m_pressureLabel->setText(QString("%1 bar").arg(m_snapshot.pressure, 0, 'f', 1));
+        m_flowLabel->setText(QString("%1 mL/s").arg(m_snapshot.flow, 0, 'f', 1));
+        m_tempLabel->setText(QString("%1 C").arg(m_snapshot.temperature, 0, 'f', 1));
+        m_timerLabel->setText(QString("%1 s").arg(m_snapshot.shotTime, 0, 'f', 1));
+        m_waterLabel->setText(QString("%1 %").arg(static_cast<int>(m_snapshot.waterLevel)));
+        m_frameLabel->setText(QString::number(m_snapshot.frameNumber));
     }
 
-    void stopOperation() {
-        m_shotTimer->stop();
-        m_phaseTimer->stop();
-
-        m_pressure = 0.0;
-        m_flow = 0.0;
-        m_steamTemp = 0.0;
-        m_frameNumber = 0;
-
-        transitionToState(DE1::State::Idle, DE1::SubState::Ready);
-        updateValuesDisplay();
-    }
+    // === GHC buttons ===
 
     void onPowerClicked() {
-        if (m_currentState == DE1::State::Sleep) {
-            transitionToState(DE1::State::Idle, DE1::SubState::Ready);
-        } else {
-            stopOperation();
-            transitionToState(DE1::State::Sleep, DE1::SubState::Ready);
-        }
+        QMetaObject::invokeMethod(m_engine, &SimulationEngine::togglePower);
     }
 
-    void onEspressoClicked() {
-        if (m_currentState == DE1::State::Espresso) {
-            stopOperation();
-        } else {
-            startOperation(DE1::State::Espresso);
-        }
-    }
+    void onEspressoClicked() { toggleOperation(DE1::State::Espresso); }
+    void onSteamClicked() { toggleOperation(DE1::State::Steam); }
+    void onHotWaterClicked() { toggleOperation(DE1::State::HotWater); }
+    void onFlushClicked() { toggleOperation(DE1::State::HotWaterRinse); }
 
-    void onSteamClicked() {
-        if (m_currentState == DE1::State::Steam) {
-            stopOperation();
-        } else {
-            startOperation(DE1::State::Steam);
-        }
+    void onStopClicked() {
+        QMetaObject::invokeMethod(m_engine, &SimulationEngine::stopOperation);
     }
 
-    void onHotWaterClicked() {
-        if (m_currentState == DE1::State::HotWater) {
-            stopOperation();
-        } else {
-            startOperation(DE1::State::HotWater);
-        }
+private:
+    void toggleOperation(DE1::State state) {
+        QMetaObject::invokeMethod(m_engine, [engine = m_engine, state]() {
+            engine->toggleOperation(state);
+        });
     }
 
-    void onFlushClicked() {
-        if (m_currentState == DE1::State::HotWaterRinse) {
-            stopOperation();
-        } else {
-            startOperation(DE1::State::HotWaterRinse);
-        }
-    }
+    // Simulation (lives on m_engineThread)
+    SimulationEngine *m_engine = nullptr;
+    QThread *m_engineThread = nullptr;
+    EngineSnapshot m_snapshot;
+    bool m_linkConnected = false;
 
-    void onStopClicked() {
-        stopOperation();
-    }
+    bool m_awaitingFirstLink = false;     // Startup check: offer setup if the first attempt fails
 
-private:
-    // TCP
-    QTcpSocket *m_socket = nullptr;
-    QTcpSocket *m_checkSocket = nullptr;  // For startup check
-    QByteArray m_tcpBuffer;
-
-    // State
-    DE1::State m_currentState = DE1::State::Idle;
-    DE1::SubState m_currentSubState = DE1::SubState::Ready;
-
-    // Profile data
-    ProfileHeader m_profileHeader;
-    QVector<ProfileFrame> m_profileFrames;
-
-    // Simulated values
-    double m_pressure = 0.0;
-    double m_flow = 0.0;
-    double m_temperature = 93.0;
-    double m_setTemp = 93.0;
-    double m_setPressure = 9.0;
-    double m_setFlow = 2.0;
-    double m_shotTimer_s = 0.0;
-    double m_waterLevel = 75.0;
-    double m_steamTemp = 0.0;
-    int m_frameNumber = 0;
-
-    // Timers
-    QTimer *m_shotTimer = nullptr;
-    QTimer *m_phaseTimer = nullptr;
-    QTimer *m_waterTimer = nullptr;
-    QTimer *m_reconnectTimer = nullptr;
+    // GUI - Traces
+    QAction *m_recordAction = nullptr;
+    QAction *m_replayAction = nullptr;
+    QActionGroup *m_replaySpeedGroup = nullptr;
+    bool m_replaying = false;
+
+    // GUI - Scenarios
+    QAction *m_scenarioAction = nullptr;
+    ScenarioRunner *m_scenario = nullptr;  // Lives on the engine thread while it runs
+    bool m_bleConnected = false;
 
     // GUI - Connection
     QLineEdit *m_hostEdit = nullptr;
     QSpinBox *m_portSpin = nullptr;
     QPushButton *m_connectBtn = nullptr;
+    QCheckBox *m_binaryCheck = nullptr;
 
     // GUI - Status
     QLabel *m_statusLabel = nullptr;
@@ -1779,6 +1674,9 @@ private:
     QLabel *m_timerLabel = nullptr;
     QLabel *m_waterLabel = nullptr;
     QLabel *m_frameLabel = nullptr;
+    QComboBox *m_sampleRateCombo = nullptr;
+    QLabel *m_rateLabel = nullptr;
+    QComboBox *m_simSpeedCombo = nullptr;
 
     // GUI - Buttons
     QPushButton *m_powerBtn = nullptr;
@@ -1792,9 +1690,11 @@ private:
 
     // GUI - Tabs
     QTabWidget *m_tabWidget = nullptr;
-    QPlainTextEdit *m_logView = nullptr;
+    LogView *m_logView = nullptr;
     QPlainTextEdit *m_profileView = nullptr;
-    QPushButton *m_clearLogBtn = nullptr;
+    LatencyView *m_latencyView = nullptr;
+    ShotsView *m_shotsView = nullptr;
+    LivePlot *m_livePlot = nullptr;
 };
 
 // ============================================================================
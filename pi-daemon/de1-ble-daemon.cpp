@@ -1,16 +1,31 @@
 /*
  * DE1 BLE Daemon for Raspberry Pi
  *
- * Minimal BLE peripheral that forwards traffic to/from a Windows GUI app.
- * Runs headless on Pi, controlled via TCP from the Windows simulator.
+ * BLE peripheral that forwards traffic to/from a Windows GUI app; all
+ * simulation logic stays in the GUI. Runs headless on Pi, controlled via TCP
+ * from the Windows simulator.
  *
  * Build:
  *   qmake6 && make
  *
  * Run:
- *   sudo ./de1-ble-daemon [port]
+ *   sudo ./de1-ble-daemon [--notify-interval ms] [--conn-interval ms[-ms]]
+ *                         [--slave-latency n] [--supervision-timeout ms]
+ *                         [--state-dir dir] [--metrics-port port] [--advertising qt|hci]
+ *                         [--verbose] [port]
+ *   sudo ./de1-ble-daemon --config /etc/de1-ble-daemon.json
  *
  * Default port: 12345
+ *
+ * A config file can run several simulated machines from one host, each on
+ * its own adapter. Machines on different ports get their own TCP link;
+ * machines sharing a port are multiplexed over one connection and told
+ * apart by machine ID (see de1-wire.h).
+ *
+ * With --metrics-port, GET /metrics on that port returns Prometheus text:
+ * notifications and bytes per machine and characteristic, TCP bytes and
+ * parse time per port, event loop lag, CPU time and RSS. The GUI gets the
+ * same numbers in its "stats" events, or at once with {"cmd": "stats"}.
  */
 
 #include <QCoreApplication>
@@ -22,13 +37,38 @@
 #include <QLowEnergyDescriptorData>
 #include <QLowEnergyAdvertisingData>
 #include <QLowEnergyAdvertisingParameters>
+#include <QLowEnergyConnectionParameters>
+#include <QBluetoothLocalDevice>
+#include <QBluetoothAddress>
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QDir>
+#include <QSaveFile>
+#include <QSocketNotifier>
+#include <QSet>
 #include <QDebug>
+#include <QLoggingCategory>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+#include "de1-wire.h"
 
 // DE1 Service UUID
 static const QString SERVICE_UUID = "0000A000-0000-1000-8000-00805F9B34FB";
@@ -50,389 +90,2212 @@ static const QMap<QString, QString> CHAR_UUIDS = {
 // CCCD UUID for notifications
 static const QString CCCD_UUID = "00002902-0000-1000-8000-00805f9b34fb";
 
-class DE1BleDaemon : public QObject
+// Characteristics whose notifications only matter as their latest value
+static bool isCoalescable(quint16 charId)
 {
-    Q_OBJECT
+    return charId == 0xA00D     // SHOT_SAMPLE
+        || charId == 0xA011;    // WATER_LEVELS
+}
 
-public:
-    explicit DE1BleDaemon(quint16 port, QObject *parent = nullptr)
-        : QObject(parent), m_port(port)
-    {
-        // Setup TCP server
-        m_tcpServer = new QTcpServer(this);
-        connect(m_tcpServer, &QTcpServer::newConnection, this, &DE1BleDaemon::onTcpConnection);
+static const char *DAEMON_VERSION = "1.10.0";
 
-        // Setup BLE
-        setupBluetooth();
-    }
+static constexpr quint16 READ_FROM_MMR_ID = 0xA005;
+static constexpr quint16 WRITE_TO_MMR_ID = 0xA006;
 
-    bool start()
-    {
-        if (!m_tcpServer->listen(QHostAddress::Any, m_port)) {
-            qCritical() << "Failed to start TCP server on port" << m_port;
-            return false;
-        }
-        qInfo() << "TCP server listening on port" << m_port;
-        qInfo() << "Waiting for Windows GUI connection...";
-        return true;
-    }
+// Half a sample period at the GUI's fastest SHOT_SAMPLE rate (50 Hz), so
+// every sample still gets its own burst, while a backlog arriving at once
+// (a TCP stall catching up) collapses to the newest value. At 0 each event
+// loop pass drains the queue, and coalescing only catches samples that
+// arrive in the same read.
+static constexpr int DEFAULT_NOTIFY_INTERVAL_MS = 10;
 
-private:
-    void setupBluetooth()
-    {
-        m_bleController = QLowEnergyController::createPeripheral(this);
+// One simulated machine
+struct InstanceConfig {
+    int id = 0;                 // Machine ID on a multiplexed link (0-255)
+    QString adapter;            // Empty (default adapter), "hciN" or adapter address
+    QString name = "DE1-SIM";   // Advertised name, keep it short (~10 chars)
+    quint16 port = 12345;
+    int notifyIntervalMs = DEFAULT_NOTIFY_INTERVAL_MS;
+    QString stateFile;          // Characteristic cache, empty = not persisted
+    bool hciAdvertising = false;    // Advertise over a raw HCI socket, not through Qt
+
+    // Connection parameters requested once a central connects. Without an
+    // interval the central's choice stands.
+    double connIntervalMinMs = 0;
+    double connIntervalMaxMs = 0;
+    int slaveLatency = 0;
+    int supervisionTimeoutMs = 0;   // 0 = DEFAULT_SUPERVISION_TIMEOUT_MS
+
+    bool requestsConnectionUpdate() const { return connIntervalMaxMs > 0; }
+};
 
-        connect(m_bleController, &QLowEnergyController::connected, this, [this]() {
-            qInfo() << "BLE client connected";
-            sendToWindows("connected", {{"client", m_bleController->remoteAddress().toString()}});
-        });
+// BLE limits for the connection parameters
+static constexpr double MIN_CONN_INTERVAL_MS = 7.5;
+static constexpr double MAX_CONN_INTERVAL_MS = 4000.0;
+static constexpr int MAX_SLAVE_LATENCY = 499;
+static constexpr int MIN_SUPERVISION_TIMEOUT_MS = 100;
+static constexpr int MAX_SUPERVISION_TIMEOUT_MS = 32000;
+static constexpr int DEFAULT_SUPERVISION_TIMEOUT_MS = 4000;
 
-        connect(m_bleController, &QLowEnergyController::disconnected, this, [this]() {
-            qInfo() << "BLE client disconnected";
-            sendToWindows("disconnected", {});
-            // Restart advertising
-            startAdvertising();
-        });
+// The supervision timeout has to outlast (1 + latency) * max interval twice
+static bool checkConnectionParameters(const InstanceConfig &config, QString &error)
+{
+    if (!config.requestsConnectionUpdate()) return true;
 
-        connect(m_bleController, QOverload<QLowEnergyController::Error>::of(&QLowEnergyController::errorOccurred),
-                this, [this](QLowEnergyController::Error error) {
-            qWarning() << "BLE error:" << error;
-            sendToWindows("error", {{"code", static_cast<int>(error)}});
-        });
+    if (config.connIntervalMinMs < MIN_CONN_INTERVAL_MS || config.connIntervalMaxMs > MAX_CONN_INTERVAL_MS
+        || config.connIntervalMinMs > config.connIntervalMaxMs) {
+        error = QString("connection interval must be %1-%2 ms").arg(MIN_CONN_INTERVAL_MS).arg(MAX_CONN_INTERVAL_MS);
+        return false;
+    }
+    if (config.slaveLatency < 0 || config.slaveLatency > MAX_SLAVE_LATENCY) {
+        error = QString("slave latency must be 0-%1").arg(MAX_SLAVE_LATENCY);
+        return false;
+    }
+    int timeout = config.supervisionTimeoutMs;
+    if (timeout < MIN_SUPERVISION_TIMEOUT_MS || timeout > MAX_SUPERVISION_TIMEOUT_MS) {
+        error = QString("supervision timeout must be %1-%2 ms")
+            .arg(MIN_SUPERVISION_TIMEOUT_MS).arg(MAX_SUPERVISION_TIMEOUT_MS);
+        return false;
+    }
+    if (timeout <= 2 * (1 + config.slaveLatency) * config.connIntervalMaxMs) {
+        error = QString("supervision timeout %1 ms is too short for latency %2 at %3 ms")
+            .arg(timeout).arg(config.slaveLatency).arg(config.connIntervalMaxMs);
+        return false;
+    }
+    return true;
+}
 
-        // Create service and start advertising immediately
-        createDE1Service();
+// "15" or "15-30"; false if it isn't a number or range
+static bool parseConnInterval(const QString &text, double &minMs, double &maxMs)
+{
+    const QStringList parts = text.split('-');
+    bool okMin = false, okMax = false;
+    minMs = parts.first().toDouble(&okMin);
+    maxMs = parts.size() == 2 ? parts.last().toDouble(&okMax) : minMs;
+    return okMin && (parts.size() == 1 || (parts.size() == 2 && okMax));
+}
 
-        // Start advertising on startup (don't wait for Windows connection)
-        QTimer::singleShot(100, this, &DE1BleDaemon::startAdvertising);
-    }
+// Every write, read, notification and command. Off unless --verbose (or
+// QT_LOGGING_RULES="de1.traffic.debug=true"): a line per SHOT_SAMPLE costs
+// a Pi 3 more CPU than forwarding the sample does.
+Q_LOGGING_CATEGORY(lcTraffic, "de1.traffic", QtInfoMsg)
 
-    void createDE1Service()
-    {
-        QLowEnergyServiceData serviceData;
-        serviceData.setType(QLowEnergyServiceData::ServiceTypePrimary);
-        serviceData.setUuid(QBluetoothUuid(SERVICE_UUID));
+// Monotonic microseconds, for the timing points reported in "timing" events
+static qint64 monotonicUs()
+{
+    static QElapsedTimer clock = []() { QElapsedTimer t; t.start(); return t; }();
+    return clock.nsecsElapsed() / 1000;
+}
 
-        // VERSION - Read only
-        {
-            QLowEnergyCharacteristicData charData;
-            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["VERSION"]));
-            charData.setProperties(QLowEnergyCharacteristic::Read);
-            charData.setValue(QByteArray::fromHex("02010000")); // Version 2.1.0.0
-            serviceData.addCharacteristic(charData);
-        }
+// CPU time (user + system) and resident set of this process, from /proc;
+// -1 where there is no /proc
+struct ProcessUsage {
+    double cpuSeconds = -1.0;
+    qint64 rssBytes = -1;
 
-        // REQUESTED_STATE - Write
-        {
-            QLowEnergyCharacteristicData charData;
-            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["REQUESTED_STATE"]));
-            charData.setProperties(QLowEnergyCharacteristic::Write);
-            charData.setValue(QByteArray(1, 0x00));
-            serviceData.addCharacteristic(charData);
+    static ProcessUsage read()
+    {
+        ProcessUsage usage;
+#ifdef Q_OS_LINUX
+        QFile stat("/proc/self/stat");
+        if (stat.open(QIODevice::ReadOnly)) {
+            // Fields after the command name, which can contain spaces; utime
+            // and stime are fields 14 and 15 of the whole line
+            QByteArray line = stat.readAll();
+            const QList<QByteArray> fields = line.mid(line.lastIndexOf(')') + 2).split(' ');
+            if (fields.size() > 12) {
+                usage.cpuSeconds = double(fields[11].toLongLong() + fields[12].toLongLong())
+                                   / sysconf(_SC_CLK_TCK);
+            }
         }
 
-        // READ_FROM_MMR - Read, Notify
-        {
-            QLowEnergyCharacteristicData charData;
-            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["READ_FROM_MMR"]));
-            charData.setProperties(QLowEnergyCharacteristic::Read | QLowEnergyCharacteristic::Notify);
-            charData.setValue(QByteArray(8, 0x00));
-            QLowEnergyDescriptorData cccd(QBluetoothUuid(CCCD_UUID), QByteArray(2, 0));
-            charData.addDescriptor(cccd);
-            serviceData.addCharacteristic(charData);
+        QFile statm("/proc/self/statm");
+        if (statm.open(QIODevice::ReadOnly)) {
+            const QList<QByteArray> fields = statm.readAll().split(' ');
+            if (fields.size() > 1) usage.rssBytes = fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
         }
+#endif
+        return usage;
+    }
+};
 
-        // WRITE_TO_MMR - Write
-        {
-            QLowEnergyCharacteristicData charData;
-            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["WRITE_TO_MMR"]));
-            charData.setProperties(QLowEnergyCharacteristic::Write);
-            charData.setValue(QByteArray(8, 0x00));
-            serviceData.addCharacteristic(charData);
-        }
+// A timed notification on its way through the daemon (see de1-wire.h)
+struct NotifyTiming {
+    quint16 seq = 0;
+    quint32 sentUs = 0;         // GUI clock, echoed back as is
+    qint64 receivedUs = 0;      // TCP data read
+    qint64 parsedUs = 0;        // Frame or command parsed and queued
+};
 
-        // SHOT_SETTINGS - Read, Write
-        {
-            QLowEnergyCharacteristicData charData;
-            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["SHOT_SETTINGS"]));
-            charData.setProperties(QLowEnergyCharacteristic::Read | QLowEnergyCharacteristic::Write);
-            charData.setValue(QByteArray(8, 0x00));
-            serviceData.addCharacteristic(charData);
-        }
+// ============================================================================
+// HCI advertising - LE advertising commands on a raw HCI socket
+// ============================================================================
+//
+// Qt's startAdvertising() reports success on a Pi 3 without BlueZ ever
+// advertising, and a central connecting ends the advertising ExecStartPost
+// set up, so nothing could find the machine again after the first app
+// disconnected. With --advertising hci the daemon sends the commands
+// hcitool would (disable, parameters, data, scan response, enable) itself,
+// on startup and on every disconnect.
+//
+// Commands go out one at a time; the next is sent when the Command Complete
+// for the last one arrives on the socket notifier, so the event loop never
+// waits on the controller. A command unanswered for REPLY_TIMEOUT_MS ends
+// the sequence with failed(). Only advertising moves: the GATT service
+// stays with QLowEnergyController. Needs root or CAP_NET_RAW, like hcitool.
+
+class HciAdvertiser : public QObject
+{
+    Q_OBJECT
 
-        // SHOT_SAMPLE - Notify
-        {
-            QLowEnergyCharacteristicData charData;
-            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["SHOT_SAMPLE"]));
-            charData.setProperties(QLowEnergyCharacteristic::Notify);
-            charData.setValue(QByteArray(19, 0x00));
-            QLowEnergyDescriptorData cccd(QBluetoothUuid(CCCD_UUID), QByteArray(2, 0));
-            charData.addDescriptor(cccd);
-            serviceData.addCharacteristic(charData);
-        }
+public:
+    explicit HciAdvertiser(QObject *parent = nullptr) : QObject(parent)
+    {
+        m_replyTimer = new QTimer(this);
+        m_replyTimer->setSingleShot(true);
+        m_replyTimer->setInterval(REPLY_TIMEOUT_MS);
+        connect(m_replyTimer, &QTimer::timeout, this, [this]() {
+            fail(QString("HCI command 0x%1: no reply within %2 ms")
+                 .arg(m_inFlight.ocf, 4, 16, QChar('0')).arg(REPLY_TIMEOUT_MS));
+        });
+    }
 
-        // STATE_INFO - Read, Notify
-        {
-            QLowEnergyCharacteristicData charData;
-            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["STATE_INFO"]));
-            charData.setProperties(QLowEnergyCharacteristic::Read | QLowEnergyCharacteristic::Notify);
-            charData.setValue(QByteArray::fromHex("0200")); // Idle, Ready
-            QLowEnergyDescriptorData cccd(QBluetoothUuid(CCCD_UUID), QByteArray(2, 0));
-            charData.addDescriptor(cccd);
-            serviceData.addCharacteristic(charData);
-        }
+    ~HciAdvertiser() { close(); }
 
-        // HEADER_WRITE - Write
-        {
-            QLowEnergyCharacteristicData charData;
-            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["HEADER_WRITE"]));
-            charData.setProperties(QLowEnergyCharacteristic::Write);
-            charData.setValue(QByteArray(5, 0x00));
-            serviceData.addCharacteristic(charData);
-        }
+    bool isOpen() const { return m_fd >= 0; }
 
-        // FRAME_WRITE - Write
-        {
-            QLowEnergyCharacteristicData charData;
-            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["FRAME_WRITE"]));
-            charData.setProperties(QLowEnergyCharacteristic::Write);
-            charData.setValue(QByteArray(8, 0x00));
-            serviceData.addCharacteristic(charData);
+    // device: N of hciN
+    bool open(int device, QString &error)
+    {
+#ifdef Q_OS_LINUX
+        close();
+        m_fd = ::socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, BTPROTO_HCI);
+        if (m_fd < 0) {
+            error = QString("HCI socket: %1").arg(strerror(errno));
+            return false;
         }
 
-        // WATER_LEVELS - Read, Notify
-        {
-            QLowEnergyCharacteristicData charData;
-            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["WATER_LEVELS"]));
-            charData.setProperties(QLowEnergyCharacteristic::Read | QLowEnergyCharacteristic::Notify);
-            charData.setValue(QByteArray::fromHex("4B00")); // 75%
-            QLowEnergyDescriptorData cccd(QBluetoothUuid(CCCD_UUID), QByteArray(2, 0));
-            charData.addDescriptor(cccd);
-            serviceData.addCharacteristic(charData);
+        // Only command results come back to us
+        HciFilter filter;
+        filter.typeMask = 1u << HCI_EVENT_PKT;
+        filter.eventMask[0] = (1u << EVT_CMD_COMPLETE) | (1u << EVT_CMD_STATUS);
+        SockaddrHci addr;
+        addr.device = static_cast<quint16>(device);
+        if (::setsockopt(m_fd, SOL_HCI, HCI_FILTER, &filter, sizeof(filter)) < 0
+            || ::bind(m_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+            error = QString("hci%1: %2").arg(device).arg(strerror(errno));
+            close();
+            return false;
         }
 
-        m_de1Service = m_bleController->addService(serviceData);
-
-        if (m_de1Service) {
-            connect(m_de1Service, &QLowEnergyService::characteristicChanged,
-                    this, &DE1BleDaemon::onCharacteristicChanged);
-            connect(m_de1Service, &QLowEnergyService::characteristicRead,
-                    this, &DE1BleDaemon::onCharacteristicRead);
-            qInfo() << "DE1 service created successfully";
-        } else {
-            qCritical() << "Failed to create DE1 service";
-        }
+        m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &HciAdvertiser::onReadable);
+        return true;
+#else
+        Q_UNUSED(device);
+        error = "HCI advertising needs Linux";
+        return false;
+#endif
     }
 
-    void startAdvertising()
+    void close()
     {
-        if (!m_de1Service) {
-            qWarning() << "Cannot advertise - service not created";
-            return;
-        }
-
-        QLowEnergyAdvertisingData advertisingData;
-        advertisingData.setDiscoverability(QLowEnergyAdvertisingData::DiscoverabilityGeneral);
-        advertisingData.setLocalName("DE1-SIM");
-        // Include service UUID in advertising data so scanners can filter by it
-        advertisingData.setServices(QList<QBluetoothUuid>() << QBluetoothUuid(SERVICE_UUID));
-
-        QLowEnergyAdvertisingData scanResponse;
-        scanResponse.setLocalName("DE1-SIM");
-        // Also include in scan response
-        scanResponse.setServices(QList<QBluetoothUuid>() << QBluetoothUuid(SERVICE_UUID));
-
-        m_bleController->startAdvertising(QLowEnergyAdvertisingParameters(),
-                                          advertisingData, scanResponse);
-        qInfo() << "Started BLE advertising as 'DE1-SIM'";
-        sendToWindows("advertising", {});
+        delete m_notifier;
+        m_notifier = nullptr;
+#ifdef Q_OS_LINUX
+        if (m_fd >= 0) ::close(m_fd);
+#endif
+        m_fd = -1;
+        m_queue.clear();
+        m_busy = false;
+        m_replyTimer->stop();
     }
 
-    void stopAdvertising()
+    // Connectable undirected advertising every ADV_INTERVAL_MS, flags and
+    // the DE1 service UUID in the advertising data, name in both. Replaces
+    // whatever sequence hasn't been sent yet; started() once it's on.
+    void start(const QString &name)
     {
-        m_bleController->stopAdvertising();
-        qInfo() << "Stopped BLE advertising";
+        const quint16 interval = static_cast<quint16>(ADV_INTERVAL_MS / 0.625);
+        QByteArray params;
+        params.append(char(interval & 0xFF)).append(char(interval >> 8));   // Min
+        params.append(char(interval & 0xFF)).append(char(interval >> 8));   // Max
+        params.append(char(0x00));                  // ADV_IND
+        params.append(char(0x00));                  // Own address public
+        params.append(7, char(0x00));               // Peer address type and address
+        params.append(char(0x07));                  // All three channels
+        params.append(char(0x00));                  // No whitelist
+
+        QByteArray name8 = name.toUtf8();
+        QByteArray adv;
+        adv.append("\x02\x01\x06", 3);         // LE General Discoverable, no BR/EDR
+        adv.append("\x03\x03\x00\xA0", 4);     // Complete 16-bit UUIDs: A000
+        adv.append(nameField(name8, MAX_ADV_DATA - adv.size()));
+
+        // Stopping first: parameters can't change while advertising
+        run({{OCF_SET_ADV_ENABLE, QByteArray(1, char(0x00)), true},
+             {OCF_SET_ADV_PARAMETERS, params},
+             {OCF_SET_ADV_DATA, padded(adv)},
+             {OCF_SET_SCAN_RESPONSE, padded(nameField(name8, MAX_ADV_DATA))},
+             {OCF_SET_ADV_ENABLE, QByteArray(1, char(0x01)), false, true}});
     }
 
-private slots:
-    void onTcpConnection()
+    void stop()
     {
-        QTcpSocket *socket = m_tcpServer->nextPendingConnection();
-        if (m_tcpClient) {
-            qWarning() << "Rejecting new connection - already have a client";
-            socket->close();
-            socket->deleteLater();
-            return;
-        }
+        run({{OCF_SET_ADV_ENABLE, QByteArray(1, char(0x00)), true}});
+    }
 
-        m_tcpClient = socket;
-        qInfo() << "Windows GUI connected from" << socket->peerAddress().toString();
+    static constexpr int ADV_INTERVAL_MS = 100;
+    static constexpr int REPLY_TIMEOUT_MS = 1000;
 
-        connect(socket, &QTcpSocket::readyRead, this, &DE1BleDaemon::onTcpData);
-        connect(socket, &QTcpSocket::disconnected, this, [this]() {
-            qInfo() << "Windows GUI disconnected";
-            m_tcpClient = nullptr;
-            // Keep advertising - don't stop when Windows disconnects
-        });
+signals:
+    void started();
+    void failed(const QString &error);
 
-        // Send ready message (advertising already started on daemon startup)
-        sendToWindows("ready", {{"version", "1.0.0"}});
+private:
+    static constexpr int MAX_ADV_DATA = 31;
+
+    // From BlueZ's hci.h, which comes with libbluetooth-dev we don't link
+    static constexpr int BTPROTO_HCI = 1;
+    static constexpr int SOL_HCI = 0;
+    static constexpr int HCI_FILTER = 2;
+    static constexpr quint8 HCI_COMMAND_PKT = 0x01;
+    static constexpr quint8 HCI_EVENT_PKT = 0x04;
+    static constexpr quint8 EVT_CMD_COMPLETE = 0x0E;
+    static constexpr quint8 EVT_CMD_STATUS = 0x0F;
+    static constexpr quint16 OGF_LE = 0x08;
+    static constexpr quint16 OCF_SET_ADV_PARAMETERS = 0x0006;
+    static constexpr quint16 OCF_SET_ADV_DATA = 0x0008;
+    static constexpr quint16 OCF_SET_SCAN_RESPONSE = 0x0009;
+    static constexpr quint16 OCF_SET_ADV_ENABLE = 0x000A;
+    static constexpr quint8 STATUS_COMMAND_DISALLOWED = 0x0C;
+
+#ifdef Q_OS_LINUX
+    struct SockaddrHci {
+        quint16 family = AF_BLUETOOTH;
+        quint16 device = 0;
+        quint16 channel = 0;    // HCI_CHANNEL_RAW: BlueZ keeps running alongside
+    };
+
+    struct HciFilter {
+        quint32 typeMask = 0;
+        quint32 eventMask[2] = {0, 0};
+        quint16 opcode = 0;
+    };
+#endif
+
+    struct Command {
+        quint16 ocf = 0;
+        QByteArray params;
+        bool allowDisallowed = false;   // Disabling advertising that is already off is fine
+        bool announce = false;          // Last of a start(): emit started()
+        int sequence = 0;
+    };
+
+    // Complete local name, or as much as fits as a shortened one
+    static QByteArray nameField(const QByteArray &name, int room)
+    {
+        QByteArray field;
+        int length = qMin<int>(name.size(), room - 2);
+        if (length <= 0) return field;
+        field.append(char(length + 1));
+        field.append(char(length == name.size() ? 0x09 : 0x08));
+        field.append(name.left(length));
+        return field;
     }
 
-    void onTcpData()
+    // Length byte, then the data padded to 31 bytes
+    static QByteArray padded(const QByteArray &data)
     {
-        if (!m_tcpClient) return;
+        QByteArray out(1, char(data.size()));
+        out.append(data);
+        out.append(MAX_ADV_DATA - data.size(), char(0x00));
+        return out;
+    }
 
-        m_tcpBuffer += m_tcpClient->readAll();
+    static quint16 opcode(quint16 ocf) { return static_cast<quint16>((OGF_LE << 10) | ocf); }
 
-        // Process complete JSON messages (newline-delimited)
-        while (true) {
-            int idx = m_tcpBuffer.indexOf('\n');
-            if (idx < 0) break;
+    // A command already on its way is still answered; a reply from an
+    // older sequence is then just the cue to send the new one
+    void run(QList<Command> commands)
+    {
+        if (m_fd < 0) {
+            emit failed("HCI socket not open");
+            return;
+        }
+        m_sequence++;
+        for (Command &command : commands) command.sequence = m_sequence;
+        m_queue = commands;
+        if (!m_busy) sendNext();
+    }
 
-            QByteArray line = m_tcpBuffer.left(idx);
-            m_tcpBuffer = m_tcpBuffer.mid(idx + 1);
+    void sendNext()
+    {
+#ifdef Q_OS_LINUX
+        if (m_queue.isEmpty()) {
+            m_busy = false;
+            return;
+        }
 
-            if (line.isEmpty()) continue;
+        m_inFlight = m_queue.takeFirst();
+        const quint16 op = opcode(m_inFlight.ocf);
+        QByteArray packet;
+        packet.append(char(HCI_COMMAND_PKT));
+        packet.append(char(op & 0xFF)).append(char(op >> 8));
+        packet.append(char(m_inFlight.params.size()));
+        packet.append(m_inFlight.params);
+        if (::write(m_fd, packet.constData(), packet.size()) != packet.size()) {
+            m_busy = true;      // fail() clears it
+            fail(QString("HCI command 0x%1: %2").arg(m_inFlight.ocf, 4, 16, QChar('0')).arg(strerror(errno)));
+            return;
+        }
+        m_busy = true;
+        m_replyTimer->start();
+#endif
+    }
 
-            QJsonParseError err;
-            QJsonDocument doc = QJsonDocument::fromJson(line, &err);
-            if (err.error != QJsonParseError::NoError) {
-                qWarning() << "JSON parse error:" << err.errorString();
+    void onReadable()
+    {
+#ifdef Q_OS_LINUX
+        unsigned char buf[260];
+        ssize_t n;
+        while ((n = ::read(m_fd, buf, sizeof(buf))) > 0) {
+            if (!m_busy || n < 7 || buf[0] != HCI_EVENT_PKT) continue;
+
+            // Command Complete: ncmd, opcode, status; Command Status: status, ncmd, opcode
+            quint8 status = 0;
+            quint16 replyOpcode = 0;
+            if (buf[1] == EVT_CMD_COMPLETE) {
+                replyOpcode = quint16(buf[4] | (buf[5] << 8));
+                status = buf[6];
+            } else if (buf[1] == EVT_CMD_STATUS) {
+                replyOpcode = quint16(buf[5] | (buf[6] << 8));
+                status = buf[3];
+            } else {
                 continue;
             }
+            if (replyOpcode != opcode(m_inFlight.ocf)) continue;
 
-            handleCommand(doc.object());
+            m_replyTimer->stop();
+            bool ok = status == 0 || (m_inFlight.allowDisallowed && status == STATUS_COMMAND_DISALLOWED);
+            if (!ok && m_inFlight.sequence == m_sequence) {
+                fail(QString("HCI command 0x%1 failed with status 0x%2")
+                     .arg(m_inFlight.ocf, 4, 16, QChar('0')).arg(int(status), 2, 16, QChar('0')));
+                continue;
+            }
+            if (ok && m_inFlight.announce && m_inFlight.sequence == m_sequence) emit started();
+            sendNext();
         }
+#endif
     }
 
-    void onCharacteristicChanged(const QLowEnergyCharacteristic &c, const QByteArray &value)
+    void fail(const QString &error)
     {
-        // BLE client wrote to a characteristic
-        QString shortUuid = c.uuid().toString().mid(5, 4).toUpper();
-        qDebug() << "Characteristic written:" << shortUuid << "->" << value.toHex();
-
-        sendToWindows("write", {
-            {"char", shortUuid},
-            {"data", QString(value.toHex())}
-        });
+        m_replyTimer->stop();
+        bool current = m_inFlight.sequence == m_sequence;
+        m_busy = false;
+        if (current) {
+            m_queue.clear();
+            emit failed(error);
+        } else {
+            sendNext();     // A newer sequence is waiting
+        }
     }
 
-    void onCharacteristicRead(const QLowEnergyCharacteristic &c, const QByteArray &value)
-    {
-        // BLE client read a characteristic
-        QString shortUuid = c.uuid().toString().mid(5, 4).toUpper();
-        qDebug() << "Characteristic read:" << shortUuid;
+    int m_fd = -1;
+    QSocketNotifier *m_notifier = nullptr;
+    QTimer *m_replyTimer = nullptr;
+    QList<Command> m_queue;
+    Command m_inFlight;
+    bool m_busy = false;        // m_inFlight sent, no reply yet
+    int m_sequence = 0;
+};
 
-        sendToWindows("read", {
-            {"char", shortUuid}
+class De1Instance;
+
+// ============================================================================
+// TCP link - one port, one GUI connection, one or more machines
+// ============================================================================
+//
+// The first client on a port is the controller and drives the machines.
+// Up to MAX_OBSERVERS more can watch, e.g. a monitoring or recording tool.
+// They get every event and frame the controller gets, from one buffer per
+// message, plus their own "ready" and pongs. Apart from ping, nothing they
+// send is acted on. An observer that falls OBSERVER_QUEUE_LIMIT bytes
+// behind is dropped, so a slow one can't hold memory or time the controller
+// and BLE need.
+
+class TcpLink : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TcpLink(quint16 port, QObject *parent = nullptr)
+        : QObject(parent), m_port(port)
+    {
+        m_tcpServer = new QTcpServer(this);
+        connect(m_tcpServer, &QTcpServer::newConnection, this, &TcpLink::onTcpConnection);
+
+        // Outgoing TCP messages are sent once per event-loop pass
+        m_tcpBatcher = new Wire::WriteBatcher(this);
+
+        m_ackTimer = new QTimer(this);
+        m_ackTimer->setSingleShot(true);
+        m_ackTimer->setInterval(ACK_INTERVAL_MS);
+        connect(m_ackTimer, &QTimer::timeout, this, &TcpLink::flushAcks);
+
+        // A GUI that pings and then goes quiet is on a half-open link;
+        // dropping it frees the port for its reconnect
+        m_watchdogTimer = new QTimer(this);
+        m_watchdogTimer->setInterval(WATCHDOG_INTERVAL_MS);
+        connect(m_watchdogTimer, &QTimer::timeout, this, [this]() {
+            if (!m_tcpClient || !m_heartbeat || m_lastHeard.elapsed() <= GUI_TIMEOUT_MS) return;
+            qWarning() << "Port" << m_port << ": nothing from the GUI for" << m_lastHeard.elapsed()
+                       << "ms, dropping it";
+            m_tcpClient->abort();
         });
     }
 
-private:
-    void handleCommand(const QJsonObject &cmd)
-    {
-        QString action = cmd["cmd"].toString();
-        qDebug() << "Received command:" << action;
+    // Timing acks are collected and sent as one "timing" event
+    static constexpr int ACK_INTERVAL_MS = 100;
+    static constexpr int ACK_BATCH_MAX = 64;
 
-        if (action == "notify") {
-            // Send notification to BLE client
-            QString charId = cmd["char"].toString();
-            QByteArray data = QByteArray::fromHex(cmd["data"].toString().toLatin1());
-            sendNotification(charId, data);
-        }
-        else if (action == "update") {
-            // Update characteristic value (for reads)
-            QString charId = cmd["char"].toString();
-            QByteArray data = QByteArray::fromHex(cmd["data"].toString().toLatin1());
-            updateCharacteristic(charId, data);
-        }
-        else if (action == "start") {
-            startAdvertising();
-        }
-        else if (action == "stop") {
-            stopAdvertising();
-        }
-        else {
-            qWarning() << "Unknown command:" << action;
+    // GUIs that ping do so every 250 ms
+    static constexpr int WATCHDOG_INTERVAL_MS = 250;
+    static constexpr int GUI_TIMEOUT_MS = 1500;
+
+    static constexpr int MAX_OBSERVERS = 4;
+    static constexpr qint64 OBSERVER_QUEUE_LIMIT = 256 * 1024;     // Unsent bytes
+
+    bool listen()
+    {
+        if (!m_tcpServer->listen(QHostAddress::Any, m_port)) {
+            qCritical() << "Failed to start TCP server on port" << m_port;
+            return false;
         }
+        qInfo() << "TCP server listening on port" << m_port << "for" << m_instances.size() << "machine(s)";
+        return true;
     }
 
-    void sendNotification(const QString &charShortId, const QByteArray &data)
+    void addInstance(De1Instance *instance, int id)
     {
-        if (!m_de1Service) return;
+        m_instances.append(instance);
+        m_byId.insert(id, instance);
+    }
 
-        // Find the characteristic by short UUID
-        QString fullUuid = QString("0000%1-0000-1000-8000-00805F9B34FB").arg(charShortId);
-        QLowEnergyCharacteristic c = m_de1Service->characteristic(QBluetoothUuid(fullUuid));
+    quint16 port() const { return m_port; }
+    bool isMultiplexed() const { return m_instances.size() > 1; }
+    int protocol() const { return m_protocol; }
 
-        if (!c.isValid()) {
-            qWarning() << "Characteristic not found:" << charShortId;
-            return;
-        }
+    // Since the daemon started, for metrics
+    qint64 bytesIn() const { return m_bytesIn; }
+    qint64 bytesOut() const { return m_bytesOut; }
+    qint64 parseUs() const { return m_parseUs; }    // Reading and handling what arrived
+    qint64 parses() const { return m_parses; }      // readyRead passes
+
+    // writtenUs is when writeCharacteristic() returned, or -1 if the
+    // notification was coalesced away or dropped
+    void ackNotification(int machine, const NotifyTiming &timing, qint64 writtenUs)
+    {
+        if (!m_timing || !addressable(machine)) return;
 
-        m_de1Service->writeCharacteristic(c, data);
-        qDebug() << "Sent notification on" << charShortId << ":" << data.toHex();
+        m_acks.append({machine, timing, writtenUs});
+        if (m_acks.size() >= ACK_BATCH_MAX) {
+            flushAcks();
+        } else if (!m_ackTimer->isActive()) {
+            m_ackTimer->start();
+        }
     }
 
-    void updateCharacteristic(const QString &charShortId, const QByteArray &data)
+    // The controlling GUI
+    bool isConnected() const
     {
-        if (!m_de1Service) return;
-
-        QString fullUuid = QString("0000%1-0000-1000-8000-00805F9B34FB").arg(charShortId);
-        QLowEnergyCharacteristic c = m_de1Service->characteristic(QBluetoothUuid(fullUuid));
+        return m_tcpClient && m_tcpClient->state() == QAbstractSocket::ConnectedState;
+    }
 
-        if (!c.isValid()) {
-            qWarning() << "Characteristic not found:" << charShortId;
-            return;
-        }
+    int observerCount() const { return m_observers.size(); }
 
-        // For read characteristics, we update the value
-        m_de1Service->writeCharacteristic(c, data);
+    // A GUI that didn't opt in to machine IDs only sees the first machine;
+    // events from the others are dropped instead of being mixed in
+    void sendEvent(int machine, const QString &event, const QVariantMap &data)
+    {
+        if (!hasClients() || !addressable(machine)) return;
+        fanOut(encodeEvent(machine, event, data));
     }
 
-    void sendToWindows(const QString &event, const QVariantMap &data)
+    // Returns false if the payload doesn't fit a frame (caller falls back to JSON)
+    bool sendFrame(int machine, quint8 type, quint16 charId, const QByteArray &data)
     {
-        if (!m_tcpClient || m_tcpClient->state() != QAbstractSocket::ConnectedState) {
-            return;
-        }
+        if (!hasClients() || !addressable(machine)) return true;
 
-        QJsonObject obj;
+        QByteArray frame = Wire::encodeFrame(type, charId, data, m_machineIds ? machine : -1);
+        if (frame.isEmpty()) return false;
+
+        fanOut(frame);
+        return true;
+    }
+
+signals:
+    void statsRequested(int machine);   // {"cmd": "stats"}
+
+private slots:
+    void onTcpConnection();
+    void onTcpData();
+
+private:
+    bool hasClients() const { return isConnected() || !m_observers.isEmpty(); }
+
+    QByteArray encodeEvent(int machine, const QString &event, const QVariantMap &data) const
+    {
+        QJsonObject obj;
         obj["event"] = event;
+        if (m_machineIds) obj["machine"] = machine;
         for (auto it = data.begin(); it != data.end(); ++it) {
             obj[it.key()] = QJsonValue::fromVariant(it.value());
         }
+        return QJsonDocument(obj).toJson(QJsonDocument::Compact) + "\n";
+    }
+
+    // One client only: its "ready" and its pongs
+    void sendTo(QTcpSocket *socket, const QString &event, const QVariantMap &data)
+    {
+        Wire::WriteBatcher *batcher = m_tcpBatcher;
+        if (socket != m_tcpClient) {
+            auto it = m_observers.constFind(socket);
+            if (it == m_observers.constEnd()) return;
+            batcher = it->batcher;
+        }
+
+        QByteArray json = encodeEvent(m_instances.first()->id(), event, data);
+        batcher->enqueue(json);
+        m_bytesOut += json.size();
+    }
+
+    // Everything for the controller, to every client
+    void fanOut(const QByteArray &bytes)
+    {
+        if (isConnected()) {
+            m_tcpBatcher->enqueue(bytes);
+            m_bytesOut += bytes.size();
+        }
+
+        QList<QTcpSocket*> behind;
+        for (auto it = m_observers.constBegin(); it != m_observers.constEnd(); ++it) {
+            if (it.key()->bytesToWrite() + it->batcher->pending() + bytes.size() > OBSERVER_QUEUE_LIMIT) {
+                behind.append(it.key());
+                continue;
+            }
+            it->batcher->enqueue(bytes);
+            m_bytesOut += bytes.size();
+        }
+
+        for (QTcpSocket *socket : std::as_const(behind)) {
+            qWarning() << "Port" << m_port << ": observer" << socket->peerAddress().toString()
+                       << "fell" << OBSERVER_QUEUE_LIMIT / 1024 << "KB behind, dropping it";
+            removeObserver(socket);
+            socket->abort();
+        }
+    }
+
+    // The controller's hello decides how the stream is encoded
+    void sendStreamInfo()
+    {
+        for (auto it = m_observers.constBegin(); it != m_observers.constEnd(); ++it) {
+            sendTo(it.key(), "stream", {{"protocol", m_protocol}, {"machine_ids", m_machineIds}});
+        }
+    }
+
+    QVariantMap readyEvent() const;
+    void addObserver(QTcpSocket *socket);
+    void removeObserver(QTcpSocket *socket);
+    void onObserverData(QTcpSocket *socket);
+
+    bool addressable(int machine) const
+    {
+        return m_machineIds || (!m_instances.isEmpty() && m_byId.value(machine) == m_instances.first());
+    }
+
+    // Untagged messages go to the first machine on the link
+    De1Instance *route(int machine) const
+    {
+        if (machine < 0 || !m_machineIds) return m_instances.first();
+
+        De1Instance *instance = m_byId.value(machine);
+        if (!instance) qWarning() << "Port" << m_port << "has no machine" << machine;
+        return instance;
+    }
+
+    void handleFrame(const Wire::Message &msg);
+    void handleCommand(const QJsonObject &cmd);
+
+    // {"event": "timing", "acks": [[seq, sent_us, parse_us, ble_us, hold_us], ...]}
+    // parse_us: TCP read -> parsed, ble_us: parsed -> writeCharacteristic()
+    // returned (-1: never written), hold_us: written -> this event
+    void flushAcks()
+    {
+        m_ackTimer->stop();
+        if (m_acks.isEmpty()) return;
+
+        qint64 now = monotonicUs();
+        QMap<int, QVariantList> byMachine;
+        for (const PendingAck &ack : std::as_const(m_acks)) {
+            const NotifyTiming &t = ack.timing;
+            bool written = ack.writtenUs >= 0;
+            byMachine[ack.machine].append(QVariant(QVariantList{
+                t.seq, t.sentUs, t.parsedUs - t.receivedUs,
+                written ? ack.writtenUs - t.parsedUs : -1,
+                written ? now - ack.writtenUs : -1}));
+        }
+        m_acks.clear();
+
+        for (auto it = byMachine.constBegin(); it != byMachine.constEnd(); ++it) {
+            sendEvent(it.key(), "timing", {{"acks", *it}});
+        }
+    }
+
+    struct PendingAck {
+        int machine;
+        NotifyTiming timing;
+        qint64 writtenUs;
+    };
+
+    quint16 m_port;
+    QTcpServer *m_tcpServer = nullptr;
+    QTcpSocket *m_tcpClient = nullptr;
+    Wire::StreamBuffer m_tcpBuffer;
+    Wire::WriteBatcher *m_tcpBatcher = nullptr;
+    int m_protocol = Wire::PROTOCOL_JSON;
+    bool m_machineIds = false;      // GUI asked for machine IDs in "hello"
+    bool m_timing = false;          // GUI asked for timing acks in "hello"
+    qint64 m_receivedUs = 0;        // When the data being parsed was read
+    QList<PendingAck> m_acks;
+    QTimer *m_ackTimer = nullptr;
+    bool m_heartbeat = false;       // GUI pings, so silence means a dead link
+    QElapsedTimer m_lastHeard;      // Last data from the GUI
+    QTimer *m_watchdogTimer = nullptr;
+
+    qint64 m_bytesIn = 0;
+    qint64 m_bytesOut = 0;          // Queued to the socket
+    qint64 m_parseUs = 0;
+    qint64 m_parses = 0;
+
+    struct Observer {
+        Wire::WriteBatcher *batcher = nullptr;  // Child of the socket
+        Wire::StreamBuffer buffer;
+    };
+    QHash<QTcpSocket*, Observer> m_observers;
+
+    QList<De1Instance*> m_instances;
+    QHash<int, De1Instance*> m_byId;
+};
+
+// ============================================================================
+// DE1 instance - BLE peripheral, GATT service and notification queue
+// ============================================================================
+
+class De1Instance : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int HCI_AFTER_QT_MS = 500;     // Qt's advertising commands settle first
+
+    De1Instance(const InstanceConfig &config, const QString &logTag, TcpLink *link, QObject *parent = nullptr)
+        : QObject(parent), m_config(config), m_tag(logTag), m_link(link),
+          m_minNotifyIntervalMs(config.notifyIntervalMs)
+    {
+        // Notification queue drain, at most once per m_minNotifyIntervalMs
+        m_drainTimer = new QTimer(this);
+        m_drainTimer->setSingleShot(true);
+        connect(m_drainTimer, &QTimer::timeout, this, &De1Instance::drainNotifications);
+        m_lastDrain.start();
+
+        m_saveTimer = new QTimer(this);
+        m_saveTimer->setSingleShot(true);
+        m_saveTimer->setInterval(SAVE_DELAY_MS);
+        connect(m_saveTimer, &QTimer::timeout, this, &De1Instance::saveCache);
+
+        m_hciAdvertiser = new HciAdvertiser(this);
+        connect(m_hciAdvertiser, &HciAdvertiser::started, this, [this]() {
+            qInfo().noquote() << m_tag + "Started HCI advertising as" << m_config.name;
+            sendToWindows("advertising", {});
+        });
+        connect(m_hciAdvertiser, &HciAdvertiser::failed, this, [this](const QString &error) {
+            qWarning().noquote() << m_tag + "HCI advertising failed:" << error;
+        });
+
+        // The HCI sequence goes out once Qt's own advertising commands are through
+        m_hciStartTimer = new QTimer(this);
+        m_hciStartTimer->setSingleShot(true);
+        m_hciStartTimer->setInterval(HCI_AFTER_QT_MS);
+        connect(m_hciStartTimer, &QTimer::timeout, this, [this]() {
+            m_hciAdvertiser->start(m_config.name);
+        });
+    }
+
+    bool setup()
+    {
+        QBluetoothAddress adapter;
+        if (!resolveAdapter(m_config.adapter, adapter)) {
+            qCritical().noquote() << m_tag + "Bluetooth adapter not found:" << m_config.adapter;
+            return false;
+        }
+
+        if (m_config.hciAdvertising) {
+            QString error;
+            int device = adapterIndex(m_config.adapter, adapter);
+            if (device < 0 || !m_hciAdvertiser->open(device, error)) {
+                qCritical().noquote() << m_tag + "HCI advertising:"
+                                      << (device < 0 ? "no hciN for " + m_config.adapter : error);
+                return false;
+            }
+        }
+
+        setupBluetooth(adapter);
+        if (m_de1Service) loadCache();
+        return m_de1Service != nullptr;
+    }
+
+    // Last value of every readable characteristic, for "ready": the GUI need
+    // not resend what the app would read anyway
+    QVariantMap cachedValues() const
+    {
+        QVariantMap values;
+        for (auto it = m_cache.constBegin(); it != m_cache.constEnd(); ++it) {
+            values[Wire::charIdToString(it.key())] = QString(it.value().toHex());
+        }
+        return values;
+    }
+
+    int id() const { return m_config.id; }
+    const InstanceConfig &config() const { return m_config; }
+
+    struct NotifyCounters {
+        qint64 sent = 0;
+        qint64 coalesced = 0;   // Replaced by a newer value before being sent
+        qint64 dropped = 0;     // Unknown characteristic
+        qint64 bytes = 0;       // Payload bytes sent
+    };
+
+    // For metrics: counters since the daemon started, unlike the "stats" ones
+    const QHash<quint16, NotifyCounters> &notifyTotals() const { return m_notifyTotals; }
+    int queueDepth() const { return m_notifyQueue.size(); }
+    bool bleConnected() const
+    {
+        return m_bleController && m_bleController->state() == QLowEnergyController::ConnectedState;
+    }
+
+    // The GUI (re)connected: counters start from zero for it, and answers
+    // from an earlier session are dropped until it pushes its own
+    void linkConnected()
+    {
+        m_notifyStats.clear();
+        m_statsDirty = false;
+        m_mmr.clear();
+        m_answerMmr = false;
+    }
+
+    // Static answers from the GUI: MMR registers ({"0x80000C": "0x00000002",
+    // ...}) and characteristic values ({"A001": "<hex>"}). With registers,
+    // READ_FROM_MMR is answered here instead of on a round trip through
+    // Windows; the GUI pushes a new set whenever its registers change.
+    void setAnswers(const QJsonObject &mmr, const QJsonObject &chars)
+    {
+        m_mmr.clear();
+        for (auto it = mmr.begin(); it != mmr.end(); ++it) {
+            quint32 address = 0, value = 0;
+            if (!parseWord(QJsonValue(it.key()), address) || !parseWord(it.value(), value)) {
+                qWarning().noquote() << m_tag + "Ignoring bad MMR answer" << it.key();
+                continue;
+            }
+            m_mmr.insert(address & ~3u, value);
+        }
+        m_answerMmr = !m_mmr.isEmpty();
+        scheduleSave();
+
+        for (auto it = chars.begin(); it != chars.end(); ++it) {
+            updateCharacteristic(Wire::charIdFromString(it.key()),
+                                 QByteArray::fromHex(it.value().toString().toLatin1()));
+        }
+        qInfo().noquote() << m_tag + "Answering" << m_mmr.size() << "MMR register(s) locally,"
+                          << chars.size() << "static characteristic(s)";
+    }
+
+    // Notifications are queued and sent on the next drain. STATE_INFO, MMR
+    // responses etc. keep their order and are never dropped; SHOT_SAMPLE and
+    // WATER_LEVELS collapse to the newest value while an older one is still
+    // waiting, so a slow link never works through a backlog of stale samples.
+    void queueNotification(quint16 charId, const QByteArray &data, const NotifyTiming *timing = nullptr)
+    {
+        m_statsDirty = true;
+
+        if (isCoalescable(charId)) {
+            auto slot = m_pendingSlots.constFind(charId);
+            if (slot != m_pendingSlots.constEnd()) {
+                PendingNotification &pending = m_notifyQueue[*slot];
+                if (pending.timed) m_link->ackNotification(m_config.id, pending.timing, -1);
+                pending.data = data;
+                pending.timed = timing != nullptr;
+                if (timing) pending.timing = *timing;
+                m_notifyStats[charId].coalesced++;
+                m_notifyTotals[charId].coalesced++;
+                return;
+            }
+            m_pendingSlots.insert(charId, m_notifyQueue.size());
+        }
+
+        m_notifyQueue.append({charId, data, timing != nullptr, timing ? *timing : NotifyTiming()});
+
+        if (!m_drainTimer->isActive()) {
+            m_drainTimer->start(static_cast<int>(qMax<qint64>(0, m_minNotifyIntervalMs - m_lastDrain.elapsed())));
+        }
+    }
+
+    void updateCharacteristic(quint16 charId, const QByteArray &data)
+    {
+        if (!m_de1Service) return;
+
+        auto it = m_characteristics.constFind(charId);
+        if (it == m_characteristics.constEnd()) {
+            qWarning().noquote() << m_tag + "Characteristic not found:" << Wire::charIdToString(charId);
+            return;
+        }
+
+        // For read characteristics, we update the value
+        m_de1Service->writeCharacteristic(*it, data);
+        rememberValue(charId, data);
+    }
+
+    void startAdvertising()
+    {
+        if (!m_de1Service) {
+            qWarning().noquote() << m_tag + "Cannot advertise - service not created";
+            return;
+        }
+
+        QLowEnergyAdvertisingData advertisingData;
+        advertisingData.setDiscoverability(QLowEnergyAdvertisingData::DiscoverabilityGeneral);
+        advertisingData.setLocalName(m_config.name);
+        // Include service UUID in advertising data so scanners can filter by it
+        advertisingData.setServices(QList<QBluetoothUuid>() << QBluetoothUuid(SERVICE_UUID));
+
+        QLowEnergyAdvertisingData scanResponse;
+        scanResponse.setLocalName(m_config.name);
+        // Also include in scan response
+        scanResponse.setServices(QList<QBluetoothUuid>() << QBluetoothUuid(SERVICE_UUID));
+
+        // Always through Qt first: on BlueZ this also opens the ATT listening
+        // socket, without which no central can connect to the GATT server.
+        // With --advertising hci the advertising set is then replaced by
+        // ours, logged and reported to the GUI from the advertiser's signals.
+        m_bleController->startAdvertising(QLowEnergyAdvertisingParameters(),
+                                          advertisingData, scanResponse);
+        if (m_hciAdvertiser->isOpen()) {
+            m_hciStartTimer->start();
+            return;
+        }
+        qInfo().noquote() << m_tag + "Started BLE advertising as" << m_config.name;
+        sendToWindows("advertising", {});
+    }
+
+    void stopAdvertising()
+    {
+        if (m_hciAdvertiser->isOpen()) {
+            m_hciStartTimer->stop();
+            m_hciAdvertiser->stop();
+        }
+        m_bleController->stopAdvertising();
+        qInfo().noquote() << m_tag + "Stopped BLE advertising";
+    }
+
+    // process: what DE1BleDaemon measured for the whole daemon. Without
+    // force only sent when a counter changed.
+    void sendStats(int loopLagMs, const QVariantMap &process, bool force = false)
+    {
+        if (!m_statsDirty && !force) return;
+        m_statsDirty = false;
+
+        QVariantMap perChar;
+        for (auto it = m_notifyStats.constBegin(); it != m_notifyStats.constEnd(); ++it) {
+            perChar[Wire::charIdToString(it.key())] = QVariantMap{
+                {"sent", it->sent},
+                {"coalesced", it->coalesced},
+                {"dropped", it->dropped}
+            };
+        }
+
+        sendToWindows("stats", {
+            {"interval_ms", STATS_INTERVAL_MS},
+            {"queued", m_notifyQueue.size()},
+            {"loop_lag_ms", loopLagMs},
+            {"notify", perChar},
+            {"tcp", QVariantMap{
+                {"bytes_in", m_link->bytesIn()},
+                {"bytes_out", m_link->bytesOut()},
+                {"parse_us_avg", m_link->parses() ? double(m_link->parseUs()) / m_link->parses() : 0.0}
+            }},
+            {"process", process}
+        });
+    }
+
+    static constexpr int STATS_INTERVAL_MS = 1000;
+
+private:
+    // "hciN" is the Nth adapter BlueZ reports; use the address if in doubt
+    static bool resolveAdapter(const QString &adapter, QBluetoothAddress &address)
+    {
+        if (adapter.isEmpty()) return true;
+
+        if (adapter.startsWith("hci")) {
+            bool ok = false;
+            int index = adapter.mid(3).toInt(&ok);
+            const QList<QBluetoothHostInfo> devices = QBluetoothLocalDevice::allDevices();
+            if (!ok || index < 0 || index >= devices.size()) return false;
+            address = devices[index].address();
+            return true;
+        }
+
+        address = QBluetoothAddress(adapter);
+        return !address.isNull();
+    }
+
+    // N of hciN for HCI advertising, in the same order as resolveAdapter();
+    // -1 if the adapter isn't there
+    static int adapterIndex(const QString &adapter, const QBluetoothAddress &address)
+    {
+        if (adapter.isEmpty()) return 0;
+        if (adapter.startsWith("hci")) return adapter.mid(3).toInt();
+
+        const QList<QBluetoothHostInfo> devices = QBluetoothLocalDevice::allDevices();
+        for (int i = 0; i < devices.size(); i++) {
+            if (devices[i].address() == address) return i;
+        }
+        return -1;
+    }
+
+    void setupBluetooth(const QBluetoothAddress &adapter)
+    {
+        m_bleController = adapter.isNull()
+            ? QLowEnergyController::createPeripheral(this)
+            : QLowEnergyController::createPeripheral(adapter, this);
+
+        connect(m_bleController, &QLowEnergyController::connected, this, [this]() {
+            qInfo().noquote() << m_tag + "BLE client connected";
+
+            QVariantMap event{{"client", m_bleController->remoteAddress().toString()},
+                              {"mtu", m_bleController->mtu()}};
+            if (m_config.requestsConnectionUpdate()) {
+                const QLowEnergyConnectionParameters params = connectionParameters();
+                m_bleController->requestConnectionUpdate(params);
+                event["requested"] = QVariantMap{
+                    {"interval_min_ms", params.minimumInterval()},
+                    {"interval_max_ms", params.maximumInterval()},
+                    {"latency", params.latency()},
+                    {"supervision_timeout_ms", params.supervisionTimeout()}
+                };
+                qInfo().noquote() << m_tag + QString("Requested connection interval %1-%2 ms, latency %3, "
+                                                     "supervision timeout %4 ms")
+                    .arg(params.minimumInterval()).arg(params.maximumInterval())
+                    .arg(params.latency()).arg(params.supervisionTimeout());
+            }
+            sendToWindows("connected", event);
+        });
+
+        // What was actually negotiated, whoever asked for it; the central
+        // can also change it later on its own
+        connect(m_bleController, &QLowEnergyController::connectionUpdated, this,
+                [this](const QLowEnergyConnectionParameters &params) {
+            qInfo().noquote() << m_tag + QString("Connection updated: interval %1 ms, latency %2, "
+                                                 "supervision timeout %3 ms")
+                .arg(params.minimumInterval()).arg(params.latency()).arg(params.supervisionTimeout());
+            sendToWindows("connection", {
+                {"interval_ms", params.minimumInterval()},
+                {"latency", params.latency()},
+                {"supervision_timeout_ms", params.supervisionTimeout()},
+                {"mtu", m_bleController->mtu()}
+            });
+        });
+
+        connect(m_bleController, &QLowEnergyController::mtuChanged, this, [this](int mtu) {
+            qInfo().noquote() << m_tag + "MTU" << mtu;
+            sendToWindows("connection", {{"mtu", mtu}});
+        });
+
+        connect(m_bleController, &QLowEnergyController::disconnected, this, [this]() {
+            qInfo().noquote() << m_tag + "BLE client disconnected";
+            sendToWindows("disconnected", {});
+            // Restart advertising; the controller stopped it when the app connected
+            startAdvertising();
+        });
+
+        connect(m_bleController, QOverload<QLowEnergyController::Error>::of(&QLowEnergyController::errorOccurred),
+                this, [this](QLowEnergyController::Error error) {
+            qWarning().noquote() << m_tag + "BLE error:" << error;
+            sendToWindows("error", {{"code", static_cast<int>(error)}});
+        });
+
+        // Create service and start advertising immediately
+        createDE1Service();
+
+        // Start advertising on startup (don't wait for Windows connection)
+        QTimer::singleShot(100, this, &De1Instance::startAdvertising);
+    }
+
+    static bool parseWord(const QJsonValue &value, quint32 &out)
+    {
+        if (value.isDouble()) {
+            out = static_cast<quint32>(value.toInteger());
+            return true;
+        }
+        QString s = value.toString().trimmed();
+        if (s.startsWith("0x", Qt::CaseInsensitive)) s = s.mid(2);
+        bool ok = false;
+        out = s.toUInt(&ok, 16);
+        return ok;
+    }
+
+    // Same layout as the machine: [len][address u24 BE][len + 1 words LE],
+    // at most MMR_WORDS_PER_NOTIFICATION words per notification
+    void answerMmrRead(const QByteArray &request)
+    {
+        const uchar *d = reinterpret_cast<const uchar*>(request.constData());
+        int words = d[0] + 1;
+        quint32 address = ((quint32(d[1]) << 16) | (quint32(d[2]) << 8) | d[3]) & ~3u;
+
+        for (int done = 0; done < words; done += MMR_WORDS_PER_NOTIFICATION) {
+            int n = qMin(MMR_WORDS_PER_NOTIFICATION, words - done);
+            quint32 chunk = address + done * 4;
+
+            QByteArray response(4 + n * 4, 0);
+            response[0] = static_cast<char>(n - 1);
+            response[1] = static_cast<char>((chunk >> 16) & 0xFF);
+            response[2] = static_cast<char>((chunk >> 8) & 0xFF);
+            response[3] = static_cast<char>(chunk & 0xFF);
+            for (int w = 0; w < n; w++) {
+                quint32 value = m_mmr.value(chunk + w * 4, 0);
+                for (int b = 0; b < 4; b++) response[4 + w * 4 + b] = static_cast<char>((value >> (8 * b)) & 0xFF);
+            }
+            queueNotification(READ_FROM_MMR_ID, response);
+        }
+    }
+
+    // Keeps the local registers in step with what the app writes; the write
+    // still goes to the GUI, which does the same
+    void storeMmrWrite(const QByteArray &request)
+    {
+        if (request.size() < 8) return;
+        const uchar *d = reinterpret_cast<const uchar*>(request.constData());
+        int words = qMin<int>(d[0] + 1, (request.size() - 4) / 4);
+        quint32 address = ((quint32(d[1]) << 16) | (quint32(d[2]) << 8) | d[3]) & ~3u;
+
+        for (int w = 0; w < words; w++) {
+            const uchar *v = d + 4 + w * 4;
+            m_mmr.insert(address + w * 4, quint32(v[0]) | (quint32(v[1]) << 8) | (quint32(v[2]) << 16) | (quint32(v[3]) << 24));
+        }
+        scheduleSave();
+    }
+
+    // === State cache ===
+    //
+    // Readable characteristic values and the MMR answers survive a GUI
+    // disconnect in memory and a daemon restart on disk (config.stateFile,
+    // written SAVE_DELAY_MS after the first change, atomically). Loaded
+    // values go straight into the GATT database, so an app reading before
+    // the GUI is back gets the last state rather than the defaults. Changes
+    // in the last SAVE_DELAY_MS before the daemon is killed are lost.
+
+    void rememberValue(quint16 charId, const QByteArray &data)
+    {
+        if (!m_readable.contains(charId)) return;
+        auto it = m_cache.find(charId);
+        if (it != m_cache.end() && *it == data) return;
+        m_cache.insert(charId, data);
+        scheduleSave();
+    }
+
+    void scheduleSave()
+    {
+        if (!m_config.stateFile.isEmpty() && !m_saveTimer->isActive()) m_saveTimer->start();
+    }
+
+    void saveCache()
+    {
+        QJsonObject mmr;
+        for (auto it = m_mmr.constBegin(); it != m_mmr.constEnd(); ++it) {
+            mmr[QString("0x%1").arg(it.key(), 6, 16, QChar('0')).toUpper()] =
+                QString("0x%1").arg(it.value(), 8, 16, QChar('0')).toUpper();
+        }
+
+        QJsonObject root;
+        root["values"] = QJsonObject::fromVariantMap(cachedValues());
+        root["mmr"] = mmr;
+
+        QSaveFile file(m_config.stateFile);
+        if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(root).toJson()) < 0 || !file.commit()) {
+            qWarning().noquote() << m_tag + "Cannot save state to" << m_config.stateFile << ":" << file.errorString();
+        }
+    }
+
+    void loadCache()
+    {
+        if (m_config.stateFile.isEmpty()) return;
+
+        QFile file(m_config.stateFile);
+        if (!file.open(QIODevice::ReadOnly)) return;    // First start
+
+        QJsonParseError err;
+        QJsonObject root = QJsonDocument::fromJson(file.readAll(), &err).object();
+        if (err.error != QJsonParseError::NoError) {
+            qWarning().noquote() << m_tag + "Ignoring state file" << m_config.stateFile << ":" << err.errorString();
+            return;
+        }
+
+        const QJsonObject values = root["values"].toObject();
+        for (auto it = values.begin(); it != values.end(); ++it) {
+            quint16 charId = Wire::charIdFromString(it.key());
+            auto c = m_characteristics.constFind(charId);
+            if (c == m_characteristics.constEnd() || !m_readable.contains(charId)) continue;
+
+            QByteArray data = QByteArray::fromHex(it.value().toString().toLatin1());
+            m_de1Service->writeCharacteristic(*c, data);
+            m_cache.insert(charId, data);
+        }
+
+        const QJsonObject mmr = root["mmr"].toObject();
+        for (auto it = mmr.begin(); it != mmr.end(); ++it) {
+            quint32 address = 0, value = 0;
+            if (parseWord(QJsonValue(it.key()), address) && parseWord(it.value(), value)) {
+                m_mmr.insert(address & ~3u, value);
+            }
+        }
+        m_answerMmr = !m_mmr.isEmpty();
+
+        qInfo().noquote() << m_tag + "Restored" << m_cache.size() << "characteristic value(s) and"
+                          << m_mmr.size() << "MMR register(s) from" << m_config.stateFile;
+    }
+
+    QLowEnergyConnectionParameters connectionParameters() const
+    {
+        QLowEnergyConnectionParameters params;
+        params.setIntervalRange(m_config.connIntervalMinMs, m_config.connIntervalMaxMs);
+        params.setLatency(m_config.slaveLatency);
+        params.setSupervisionTimeout(m_config.supervisionTimeoutMs);
+        return params;
+    }
+
+    void createDE1Service()
+    {
+        QLowEnergyServiceData serviceData;
+        serviceData.setType(QLowEnergyServiceData::ServiceTypePrimary);
+        serviceData.setUuid(QBluetoothUuid(SERVICE_UUID));
+
+        // VERSION - Read only
+        {
+            QLowEnergyCharacteristicData charData;
+            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["VERSION"]));
+            charData.setProperties(QLowEnergyCharacteristic::Read);
+            charData.setValue(QByteArray::fromHex("02010000")); // Version 2.1.0.0
+            serviceData.addCharacteristic(charData);
+        }
+
+        // REQUESTED_STATE - Write
+        {
+            QLowEnergyCharacteristicData charData;
+            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["REQUESTED_STATE"]));
+            charData.setProperties(QLowEnergyCharacteristic::Write);
+            charData.setValue(QByteArray(1, 0x00));
+            serviceData.addCharacteristic(charData);
+        }
+
+        // READ_FROM_MMR - Read, Notify
+        {
+            QLowEnergyCharacteristicData charData;
+            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["READ_FROM_MMR"]));
+            charData.setProperties(QLowEnergyCharacteristic::Read | QLowEnergyCharacteristic::Notify);
+            charData.setValue(QByteArray(8, 0x00));
+            QLowEnergyDescriptorData cccd(QBluetoothUuid(CCCD_UUID), QByteArray(2, 0));
+            charData.addDescriptor(cccd);
+            serviceData.addCharacteristic(charData);
+        }
+
+        // WRITE_TO_MMR - Write
+        {
+            QLowEnergyCharacteristicData charData;
+            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["WRITE_TO_MMR"]));
+            charData.setProperties(QLowEnergyCharacteristic::Write);
+            charData.setValue(QByteArray(8, 0x00));
+            serviceData.addCharacteristic(charData);
+        }
+
+        // SHOT_SETTINGS - Read, Write
+        {
+            QLowEnergyCharacteristicData charData;
+            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["SHOT_SETTINGS"]));
+            charData.setProperties(QLowEnergyCharacteristic::Read | QLowEnergyCharacteristic::Write);
+            charData.setValue(QByteArray(8, 0x00));
+            serviceData.addCharacteristic(charData);
+        }
+
+        // SHOT_SAMPLE - Notify
+        {
+            QLowEnergyCharacteristicData charData;
+            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["SHOT_SAMPLE"]));
+            charData.setProperties(QLowEnergyCharacteristic::Notify);
+            charData.setValue(QByteArray(19, 0x00));
+            QLowEnergyDescriptorData cccd(QBluetoothUuid(CCCD_UUID), QByteArray(2, 0));
+            charData.addDescriptor(cccd);
+            serviceData.addCharacteristic(charData);
+        }
+
+        // STATE_INFO - Read, Notify
+        {
+            QLowEnergyCharacteristicData charData;
+            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["STATE_INFO"]));
+            charData.setProperties(QLowEnergyCharacteristic::Read | QLowEnergyCharacteristic::Notify);
+            charData.setValue(QByteArray::fromHex("0200")); // Idle, Ready
+            QLowEnergyDescriptorData cccd(QBluetoothUuid(CCCD_UUID), QByteArray(2, 0));
+            charData.addDescriptor(cccd);
+            serviceData.addCharacteristic(charData);
+        }
+
+        // HEADER_WRITE - Write
+        {
+            QLowEnergyCharacteristicData charData;
+            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["HEADER_WRITE"]));
+            charData.setProperties(QLowEnergyCharacteristic::Write);
+            charData.setValue(QByteArray(5, 0x00));
+            serviceData.addCharacteristic(charData);
+        }
+
+        // FRAME_WRITE - Write
+        {
+            QLowEnergyCharacteristicData charData;
+            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["FRAME_WRITE"]));
+            charData.setProperties(QLowEnergyCharacteristic::Write);
+            charData.setValue(QByteArray(8, 0x00));
+            serviceData.addCharacteristic(charData);
+        }
+
+        // WATER_LEVELS - Read, Notify
+        {
+            QLowEnergyCharacteristicData charData;
+            charData.setUuid(QBluetoothUuid(CHAR_UUIDS["WATER_LEVELS"]));
+            charData.setProperties(QLowEnergyCharacteristic::Read | QLowEnergyCharacteristic::Notify);
+            charData.setValue(QByteArray::fromHex("4B00")); // 75%
+            QLowEnergyDescriptorData cccd(QBluetoothUuid(CCCD_UUID), QByteArray(2, 0));
+            charData.addDescriptor(cccd);
+            serviceData.addCharacteristic(charData);
+        }
+
+
+        m_de1Service = m_bleController->addService(serviceData);
+
+        if (m_de1Service) {
+            connect(m_de1Service, &QLowEnergyService::characteristicChanged,
+                    this, &De1Instance::onCharacteristicChanged);
+            connect(m_de1Service, &QLowEnergyService::characteristicRead,
+                    this, &De1Instance::onCharacteristicRead);
+
+            // Resolve characteristics once; notifications look them up by short ID
+            m_characteristics.clear();
+            for (const QLowEnergyCharacteristic &c : m_de1Service->characteristics()) {
+                m_characteristics.insert(c.uuid().toUInt16(), c);
+                if (c.properties() & QLowEnergyCharacteristic::Read) m_readable.insert(c.uuid().toUInt16());
+            }
+            qInfo().noquote() << m_tag + "DE1 service created successfully with"
+                              << m_characteristics.size() << "characteristics";
+        } else {
+            qCritical().noquote() << m_tag + "Failed to create DE1 service";
+        }
+    }
+
+private slots:
+    void onCharacteristicChanged(const QLowEnergyCharacteristic &c, const QByteArray &value)
+    {
+        // BLE client wrote to a characteristic
+        QString shortUuid = c.uuid().toString().mid(5, 4).toUpper();
+        qCDebug(lcTraffic).noquote() << m_tag + "Characteristic written:" << shortUuid << "->" << value.toHex();
+
+        quint16 charId = c.uuid().toUInt16();
+        rememberValue(charId, value);
+        bool answered = false;
+        if (m_answerMmr && charId == READ_FROM_MMR_ID && value.size() >= 4) {
+            answerMmrRead(value);
+            answered = true;
+        } else if (m_answerMmr && charId == WRITE_TO_MMR_ID) {
+            storeMmrWrite(value);
+        }
+
+        if (m_link->protocol() >= Wire::PROTOCOL_BINARY
+            && m_link->sendFrame(m_config.id, answered ? Wire::FrameAnswered : Wire::FrameWrite, charId, value)) {
+            return;
+        }
+
+        sendToWindows(answered ? "answered" : "write", {
+            {"char", shortUuid},
+            {"data", QString(value.toHex())}
+        });
+    }
+
+    void onCharacteristicRead(const QLowEnergyCharacteristic &c, const QByteArray &value)
+    {
+        Q_UNUSED(value);
+
+        // BLE client read a characteristic
+        QString shortUuid = c.uuid().toString().mid(5, 4).toUpper();
+        qCDebug(lcTraffic).noquote() << m_tag + "Characteristic read:" << shortUuid;
+
+        if (m_link->protocol() >= Wire::PROTOCOL_BINARY
+            && m_link->sendFrame(m_config.id, Wire::FrameRead, c.uuid().toUInt16(), QByteArray())) {
+            return;
+        }
 
-        QByteArray json = QJsonDocument(obj).toJson(QJsonDocument::Compact) + "\n";
-        m_tcpClient->write(json);
-        m_tcpClient->flush();
+        sendToWindows("read", {
+            {"char", shortUuid}
+        });
     }
 
 private:
-    quint16 m_port;
-    QTcpServer *m_tcpServer = nullptr;
-    QTcpSocket *m_tcpClient = nullptr;
-    QByteArray m_tcpBuffer;
+    void drainNotifications()
+    {
+        // Swap out first: sending may re-enter the event loop
+        QList<PendingNotification> batch;
+        batch.swap(m_notifyQueue);
+        m_pendingSlots.clear();
+
+        for (const PendingNotification &n : std::as_const(batch)) {
+            bool sent = sendNotification(n.charId, n.data);
+            if (n.timed) m_link->ackNotification(m_config.id, n.timing, sent ? monotonicUs() : -1);
+        }
+        m_lastDrain.start();
+    }
+
+    bool sendNotification(quint16 charId, const QByteArray &data)
+    {
+        if (!m_de1Service) return false;
+
+        auto it = m_characteristics.constFind(charId);
+        if (it == m_characteristics.constEnd()) {
+            qWarning().noquote() << m_tag + "Characteristic not found:" << Wire::charIdToString(charId);
+            m_notifyStats[charId].dropped++;
+            m_notifyTotals[charId].dropped++;
+            return false;
+        }
+
+        m_de1Service->writeCharacteristic(*it, data);
+        m_notifyStats[charId].sent++;
+        NotifyCounters &total = m_notifyTotals[charId];
+        total.sent++;
+        total.bytes += data.size();
+        rememberValue(charId, data);
+        qCDebug(lcTraffic).noquote() << m_tag + "Sent notification on" << Wire::charIdToString(charId) << ":" << data.toHex();
+        return true;
+    }
+
+    void sendToWindows(const QString &event, const QVariantMap &data)
+    {
+        m_link->sendEvent(m_config.id, event, data);
+    }
+
+    struct PendingNotification {
+        quint16 charId;
+        QByteArray data;
+        bool timed;
+        NotifyTiming timing;
+    };
+
+    InstanceConfig m_config;
+    QString m_tag;              // Log prefix, empty with a single machine
+    TcpLink *m_link = nullptr;
 
     QLowEnergyController *m_bleController = nullptr;
     QLowEnergyService *m_de1Service = nullptr;
+    HciAdvertiser *m_hciAdvertiser = nullptr;   // Open with --advertising hci
+    QTimer *m_hciStartTimer = nullptr;          // Qt's advertising, then ours
+    QHash<quint16, QLowEnergyCharacteristic> m_characteristics;   // By short UUID, e.g. 0xA00D
+
+    // Notification queue
+    QList<PendingNotification> m_notifyQueue;
+    QHash<quint16, int> m_pendingSlots;         // Queue index of pending coalescable values
+    QTimer *m_drainTimer = nullptr;
+    QElapsedTimer m_lastDrain;
+    int m_minNotifyIntervalMs = 0;
+
+    // Counters since the GUI connected, reported in the "stats" event
+    QHash<quint16, NotifyCounters> m_notifyStats;
+    bool m_statsDirty = false;
+    QHash<quint16, NotifyCounters> m_notifyTotals;  // Since the daemon started
+
+
+    // MMR registers pushed by the GUI, by word address
+    static constexpr int MMR_WORDS_PER_NOTIFICATION = 4;
+    QHash<quint32, quint32> m_mmr;
+    bool m_answerMmr = false;
+
+    // State cache
+    static constexpr int SAVE_DELAY_MS = 5000;
+    QSet<quint16> m_readable;                   // Characteristics an app can read
+    QHash<quint16, QByteArray> m_cache;         // Their last values
+    QTimer *m_saveTimer = nullptr;
+};
+
+// ============================================================================
+// TCP link - connection handling and routing to machines
+// ============================================================================
+
+void TcpLink::onTcpConnection()
+{
+    QTcpSocket *socket = m_tcpServer->nextPendingConnection();
+    if (m_tcpClient) {
+        if (m_observers.size() < MAX_OBSERVERS) {
+            addObserver(socket);
+            return;
+        }
+        qWarning() << "Port" << m_port << ": rejecting new connection - already have a client and"
+                   << MAX_OBSERVERS << "observers";
+        socket->close();
+        socket->deleteLater();
+        return;
+    }
+
+    m_tcpClient = socket;
+    qInfo() << "Windows GUI connected on port" << m_port << "from" << socket->peerAddress().toString();
+
+    // Writes are already batched per event-loop pass; don't let Nagle
+    // hold back a lone STATE_INFO or MMR response
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    m_tcpBatcher->setDevice(socket);
+
+    for (De1Instance *instance : std::as_const(m_instances)) {
+        instance->linkConnected();
+    }
+
+    connect(socket, &QTcpSocket::readyRead, this, &TcpLink::onTcpData);
+    connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+        qInfo() << "Windows GUI disconnected from port" << m_port;
+        m_tcpClient = nullptr;
+        m_tcpBatcher->setDevice(nullptr);
+        m_tcpBuffer.clear();
+        m_protocol = Wire::PROTOCOL_JSON;
+        m_machineIds = false;
+        m_timing = false;
+        m_acks.clear();
+        m_ackTimer->stop();
+        m_heartbeat = false;
+        m_watchdogTimer->stop();
+        sendStreamInfo();
+        socket->deleteLater();
+        // Keep advertising - don't stop when Windows disconnects
+        // Observers stay; the next connection becomes the controller
+    });
+
+    // Send ready message (advertising already started on daemon startup).
+    // The GUI answers with "hello" if it wants the binary protocol, with
+    // "machine_ids" if it wants to drive every machine on the link, and
+    // with "timing" if it wants timing acks for its timed notifications.
+    m_protocol = Wire::PROTOCOL_JSON;
+    m_machineIds = false;
+    m_timing = false;
+
+    m_heartbeat = false;
+    m_lastHeard.start();
+
+    QVariantMap ready = readyEvent();
+    ready["role"] = "controller";
+    sendTo(socket, "ready", ready);
+}
+
+QVariantMap TcpLink::readyEvent() const
+{
+    QVariantMap ready{{"version", DAEMON_VERSION}, {"protocol", Wire::PROTOCOL_BINARY}, {"timing", true},
+                      {"answers", true}, {"heartbeat", true}, {"observers", MAX_OBSERVERS}};
+    if (isMultiplexed()) {
+        QVariantList machines;
+        for (De1Instance *instance : std::as_const(m_instances)) {
+            machines.append(QVariantMap{{"id", instance->id()}, {"name", instance->config().name},
+                                        {"cache", instance->cachedValues()}});
+        }
+        ready["machines"] = machines;
+    }
+    ready["cache"] = m_instances.first()->cachedValues();   // For a GUI driving just the first
+    return ready;
+}
+
+// Observers are told how the controller's stream is encoded in "ready",
+// and again in a "stream" event whenever that changes
+void TcpLink::addObserver(QTcpSocket *socket)
+{
+    qInfo().noquote() << QString("Observer connected on port %1 from %2 (%3 of %4)")
+        .arg(m_port).arg(socket->peerAddress().toString()).arg(m_observers.size() + 1).arg(MAX_OBSERVERS);
+
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    Observer &observer = m_observers[socket];
+    observer.batcher = new Wire::WriteBatcher(socket);
+    observer.batcher->setDevice(socket);
+
+    connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { onObserverData(socket); });
+    connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+        if (m_observers.contains(socket)) qInfo() << "Observer disconnected from port" << m_port;
+        removeObserver(socket);
+    });
+
+    QVariantMap ready = readyEvent();
+    ready["role"] = "observer";
+    ready["stream"] = QVariantMap{{"protocol", m_protocol}, {"machine_ids", m_machineIds}};
+    sendTo(socket, "ready", ready);
+}
+
+void TcpLink::removeObserver(QTcpSocket *socket)
+{
+    if (m_observers.remove(socket)) socket->deleteLater();
+}
+
+void TcpLink::onObserverData(QTcpSocket *socket)
+{
+    auto it = m_observers.find(socket);
+    if (it == m_observers.end()) return;
+
+    m_bytesIn += qMax<qint64>(0, it->buffer.readFrom(socket));
+
+    Wire::Message msg;
+    while (it->buffer.next(msg)) {
+        QJsonObject cmd = msg.binary ? QJsonObject()
+            : QJsonDocument::fromJson(QByteArray::fromRawData(msg.payload.data(), msg.payload.size())).object();
+        if (cmd["cmd"].toString() == "ping") {
+            sendTo(socket, "pong", {{"seq", cmd["seq"].toVariant()}, {"t", cmd["t"].toVariant()}});
+        } else {
+            qWarning() << "Port" << m_port << ": ignoring" << (msg.binary ? "frame" : cmd["cmd"].toString())
+                       << "from an observer, observers are read-only";
+        }
+    }
+    it->buffer.compact();
+}
+
+void TcpLink::onTcpData()
+{
+    if (!m_tcpClient) return;
+
+    m_bytesIn += qMax<qint64>(0, m_tcpBuffer.readFrom(m_tcpClient));
+    m_receivedUs = monotonicUs();
+    m_lastHeard.start();
+
+    // Process complete messages (binary frames or newline-delimited JSON)
+    Wire::Message msg;
+    while (m_tcpBuffer.next(msg)) {
+        if (msg.binary) {
+            handleFrame(msg);
+            continue;
+        }
+
+        QJsonParseError err;
+        QJsonDocument doc = QJsonDocument::fromJson(
+            QByteArray::fromRawData(msg.payload.data(), msg.payload.size()), &err);
+        if (err.error != QJsonParseError::NoError) {
+            qWarning() << "JSON parse error:" << err.errorString();
+            continue;
+        }
+
+        handleCommand(doc.object());
+    }
+    m_tcpBuffer.compact();
+
+    m_parseUs += monotonicUs() - m_receivedUs;
+    m_parses++;
+}
+
+void TcpLink::handleFrame(const Wire::Message &msg)
+{
+    De1Instance *instance = route(msg.machine);
+    if (!instance) return;
+
+    if (msg.type == Wire::FrameNotify) {
+        if (msg.timed && m_timing) {
+            NotifyTiming timing{msg.timing.seq, msg.timing.sentUs, m_receivedUs, monotonicUs()};
+            instance->queueNotification(msg.charId, msg.payload.toByteArray(), &timing);
+        } else {
+            instance->queueNotification(msg.charId, msg.payload.toByteArray());
+        }
+    } else if (msg.type == Wire::FrameUpdate) {
+        instance->updateCharacteristic(msg.charId, msg.payload.toByteArray());
+    } else {
+        qWarning() << "Unknown frame type:" << Qt::hex << static_cast<int>(msg.type);
+    }
+}
+
+void TcpLink::handleCommand(const QJsonObject &cmd)
+{
+    QString action = cmd["cmd"].toString();
+    qCDebug(lcTraffic) << "Received command:" << action;
+
+    if (action == "hello") {
+        // GUI picks the protocol; never go above what we support
+        m_protocol = qBound(Wire::PROTOCOL_JSON, cmd["protocol"].toInt(Wire::PROTOCOL_JSON),
+                            Wire::PROTOCOL_BINARY);
+        m_machineIds = isMultiplexed() && cmd["machine_ids"].toBool();
+        m_timing = cmd["timing"].toBool();
+        qInfo() << "Port" << m_port << "using protocol" << m_protocol
+                << (m_machineIds ? "with machine IDs" : "") << (m_timing ? "with timing acks" : "");
+        sendStreamInfo();
+        return;
+    }
+    if (action == "ping") {
+        // Echoed as is: the GUI measures the round trip on its own clock
+        if (!m_heartbeat) {
+            m_heartbeat = true;
+            m_watchdogTimer->start();
+        }
+        sendTo(m_tcpClient, "pong", {{"seq", cmd["seq"].toVariant()}, {"t", cmd["t"].toVariant()}});
+        return;
+    }
+
+    De1Instance *instance = route(cmd.contains("machine") ? cmd["machine"].toInt() : -1);
+    if (!instance) return;
+
+    if (action == "notify") {
+        // Send notification to BLE client
+        quint16 charId = Wire::charIdFromString(cmd["char"].toString());
+        QByteArray data = QByteArray::fromHex(cmd["data"].toString().toLatin1());
+        if (m_timing && cmd.contains("seq")) {
+            NotifyTiming timing{static_cast<quint16>(cmd["seq"].toInt()),
+                                static_cast<quint32>(cmd["t"].toInteger()), m_receivedUs, monotonicUs()};
+            instance->queueNotification(charId, data, &timing);
+        } else {
+            instance->queueNotification(charId, data);
+        }
+    }
+    else if (action == "update") {
+        // Update characteristic value (for reads)
+        quint16 charId = Wire::charIdFromString(cmd["char"].toString());
+        QByteArray data = QByteArray::fromHex(cmd["data"].toString().toLatin1());
+        instance->updateCharacteristic(charId, data);
+    }
+    else if (action == "answers") {
+        instance->setAnswers(cmd["mmr"].toObject(), cmd["chars"].toObject());
+    }
+    else if (action == "stats") {
+        emit statsRequested(instance->id());
+    }
+    else if (action == "start") {
+        instance->startAdvertising();
+    }
+    else if (action == "stop") {
+        instance->stopAdvertising();
+    }
+    else {
+        qWarning() << "Unknown command:" << action;
+    }
+}
+
+// ============================================================================
+// Metrics - Prometheus text over just enough HTTP for a scraper or curl
+// ============================================================================
+//
+// One GET per connection, answered and closed. Nothing is measured or
+// formatted until a scrape asks for it.
+
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Render = std::function<QByteArray()>;
+
+    MetricsServer(quint16 port, Render render, QObject *parent = nullptr)
+        : QObject(parent), m_port(port), m_render(std::move(render))
+    {
+        m_server = new QTcpServer(this);
+        connect(m_server, &QTcpServer::newConnection, this, &MetricsServer::onConnection);
+    }
+
+    bool listen()
+    {
+        if (!m_server->listen(QHostAddress::Any, m_port)) {
+            qCritical() << "Failed to start metrics server on port" << m_port;
+            return false;
+        }
+        qInfo() << "Metrics on port" << m_port << "(GET /metrics)";
+        return true;
+    }
+
+private:
+    static constexpr int MAX_REQUEST_BYTES = 4096;
+    static constexpr int REQUEST_TIMEOUT_MS = 5000;
+
+    void onConnection()
+    {
+        while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+            connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { respond(socket); });
+            QTimer::singleShot(REQUEST_TIMEOUT_MS, socket, [socket]() { socket->abort(); });
+        }
+    }
+
+    void respond(QTcpSocket *socket)
+    {
+        // The whole header first: closing with it half read would reset
+        // the connection before the client has the answer
+        QByteArray request = socket->peek(MAX_REQUEST_BYTES);
+        if (!request.contains("\r\n\r\n")) {
+            if (request.size() >= MAX_REQUEST_BYTES) socket->abort();
+            return;
+        }
+        socket->readAll();
+
+        const QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+        bool found = requestLine.size() >= 2 && requestLine[0] == "GET"
+                  && (requestLine[1] == "/metrics" || requestLine[1] == "/");
+
+        QByteArray body = found ? m_render() : QByteArray("Not found\n");
+        QByteArray response = found ? "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                    : "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n";
+        response += "Content-Length: " + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n";
+        socket->write(response + body);
+        socket->disconnectFromHost();
+    }
+
+    quint16 m_port;
+    Render m_render;
+    QTcpServer *m_server = nullptr;
+};
+
+// Label value in the exposition format: backslash, quote and newline escaped
+static QByteArray metricLabel(const QString &value)
+{
+    QByteArray escaped = value.toUtf8();
+    escaped.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+    return escaped;
+}
+
+// SHOT_SAMPLE for 0xA00D; the short UUID for anything not in CHAR_UUIDS
+static QString charLabel(quint16 charId)
+{
+    QString shortId = Wire::charIdToString(charId);
+    for (auto it = CHAR_UUIDS.constBegin(); it != CHAR_UUIDS.constEnd(); ++it) {
+        if (it.value().mid(4, 4) == shortId) return it.key();
+    }
+    return shortId;
+}
+
+// ============================================================================
+// Daemon - owns the machines and their links
+// ============================================================================
+//
+// Everything runs on one event loop. Per-notification work is a hash lookup
+// plus a queue append, and BLE writes are batched per drain, so the loop
+// itself is rarely the bottleneck; the adapters' radio time runs out first.
+// The loop lag monitor makes it visible when it isn't: it is reported in
+// every "stats" event and logged when it passes LOOP_LAG_WARN_MS.
+
+class DE1BleDaemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int LOOP_LAG_PROBE_MS = 50;
+    static constexpr int LOOP_LAG_WARN_MS = 20;
+
+    // metricsPort 0: no metrics server
+    DE1BleDaemon(const QList<InstanceConfig> &configs, quint16 metricsPort, QObject *parent = nullptr)
+        : QObject(parent), m_configs(configs), m_metricsPort(metricsPort)
+    {
+        // Queue counters for the GUI (only sent when something changed)
+        m_statsTimer = new QTimer(this);
+        m_statsTimer->setInterval(De1Instance::STATS_INTERVAL_MS);
+        connect(m_statsTimer, &QTimer::timeout, this, &DE1BleDaemon::sendStats);
+
+        // Event loop lag: how late a periodic timer fires
+        m_lagTimer = new QTimer(this);
+        m_lagTimer->setTimerType(Qt::PreciseTimer);
+        m_lagTimer->setInterval(LOOP_LAG_PROBE_MS);
+        connect(m_lagTimer, &QTimer::timeout, this, [this]() {
+            int lag = static_cast<int>(m_lagClock.restart()) - LOOP_LAG_PROBE_MS;
+            m_maxLoopLagMs = qMax(m_maxLoopLagMs, lag);
+        });
+
+        m_cpuClock.start();
+        m_lastCpuSeconds = ProcessUsage::read().cpuSeconds;
+    }
+
+    bool start()
+    {
+        bool multi = m_configs.size() > 1;
+
+        for (const InstanceConfig &config : std::as_const(m_configs)) {
+            TcpLink *&link = m_links[config.port];
+            if (!link) {
+                link = new TcpLink(config.port, this);
+                connect(link, &TcpLink::statsRequested, this, &DE1BleDaemon::sendStatsNow);
+            }
+
+            QString tag = multi ? QString("[%1] ").arg(config.name) : QString();
+            auto *instance = new De1Instance(config, tag, link, this);
+            if (!instance->setup()) return false;
+
+            link->addInstance(instance, config.id);
+            m_instances.append(instance);
+        }
+
+        for (TcpLink *link : std::as_const(m_links)) {
+            if (!link->listen()) return false;
+        }
+        if (m_metricsPort) {
+            auto *metrics = new MetricsServer(m_metricsPort, [this]() { return metricsText(); }, this);
+            if (!metrics->listen()) return false;
+        }
+        qInfo() << "Waiting for Windows GUI connection...";
+
+        m_statsTimer->start();
+        m_lagClock.start();
+        m_lagTimer->start();
+        return true;
+    }
+
+private:
+    void sendStats()
+    {
+        m_loopLagMs = qMax(0, m_maxLoopLagMs);
+        m_maxLoopLagMs = 0;
+
+        if (m_loopLagMs > LOOP_LAG_WARN_MS) {
+            qWarning() << "Event loop lagged" << m_loopLagMs << "ms with" << m_instances.size() << "machine(s)";
+        }
+
+        // CPU share over the last interval
+        ProcessUsage usage = ProcessUsage::read();
+        double wallSeconds = m_cpuClock.restart() / 1000.0;
+        if (usage.cpuSeconds >= 0 && m_lastCpuSeconds >= 0 && wallSeconds > 0) {
+            m_cpuPercent = (usage.cpuSeconds - m_lastCpuSeconds) / wallSeconds * 100.0;
+        }
+        m_lastCpuSeconds = usage.cpuSeconds;
+
+        QVariantMap process = processStats(usage);
+        for (De1Instance *instance : std::as_const(m_instances)) {
+            instance->sendStats(m_loopLagMs, process);
+        }
+    }
+
+    // {"cmd": "stats"}: the GUI wants the numbers now, changed or not
+    void sendStatsNow(int machine)
+    {
+        QVariantMap process = processStats(ProcessUsage::read());
+        for (De1Instance *instance : std::as_const(m_instances)) {
+            if (instance->id() == machine) instance->sendStats(m_loopLagMs, process, true);
+        }
+    }
+
+    QVariantMap processStats(const ProcessUsage &usage) const
+    {
+        return {{"cpu_percent", m_cpuPercent}, {"cpu_seconds", usage.cpuSeconds},
+                {"rss_kb", usage.rssBytes >= 0 ? usage.rssBytes / 1024 : -1}};
+    }
+
+    // Prometheus text format. Counters run from daemon start, so rate()
+    // gives notifications and bytes per second.
+    QByteArray metricsText() const
+    {
+        QByteArray out;
+        auto family = [&out](const char *name, const char *type, const char *help) {
+            out += QByteArray("# HELP ") + name + ' ' + help + "\n# TYPE " + name + ' ' + type + '\n';
+        };
+        auto sample = [&out](const QByteArray &series, const QByteArray &value) {
+            out += series + ' ' + value + '\n';
+        };
+        auto machine = [](const De1Instance *instance) {
+            return "machine=\"" + metricLabel(instance->config().name) + '"';
+        };
+
+        family("de1_daemon_info", "gauge", "Daemon version");
+        sample(QByteArray("de1_daemon_info{version=\"") + DAEMON_VERSION + "\"}", "1");
+
+        family("de1_notifications_total", "counter", "BLE notifications by outcome");
+        for (const De1Instance *instance : m_instances) {
+            const auto &totals = instance->notifyTotals();
+            for (auto it = totals.constBegin(); it != totals.constEnd(); ++it) {
+                QByteArray labels = machine(instance) + ",char=\"" + metricLabel(charLabel(it.key())) + '"';
+                sample("de1_notifications_total{" + labels + ",result=\"sent\"}", QByteArray::number(it->sent));
+                sample("de1_notifications_total{" + labels + ",result=\"coalesced\"}", QByteArray::number(it->coalesced));
+                sample("de1_notifications_total{" + labels + ",result=\"dropped\"}", QByteArray::number(it->dropped));
+            }
+        }
+
+        family("de1_notification_bytes_total", "counter", "Payload bytes sent as BLE notifications");
+        for (const De1Instance *instance : m_instances) {
+            const auto &totals = instance->notifyTotals();
+            for (auto it = totals.constBegin(); it != totals.constEnd(); ++it) {
+                sample("de1_notification_bytes_total{" + machine(instance) + ",char=\""
+                       + metricLabel(charLabel(it.key())) + "\"}", QByteArray::number(it->bytes));
+            }
+        }
+
+        family("de1_notify_queue_depth", "gauge", "Notifications waiting for the next drain");
+        for (const De1Instance *instance : m_instances) {
+            sample("de1_notify_queue_depth{" + machine(instance) + '}', QByteArray::number(instance->queueDepth()));
+        }
+
+        family("de1_ble_connected", "gauge", "1 while an app is connected over BLE");
+        for (const De1Instance *instance : m_instances) {
+            sample("de1_ble_connected{" + machine(instance) + '}', instance->bleConnected() ? "1" : "0");
+        }
+
+        family("de1_gui_connected", "gauge", "1 while the simulator GUI is connected");
+        for (const TcpLink *link : m_links) {
+            sample("de1_gui_connected{port=\"" + QByteArray::number(link->port()) + "\"}",
+                   link->isConnected() ? "1" : "0");
+        }
+
+        family("de1_observers", "gauge", "Read-only clients watching the GUI's stream");
+        for (const TcpLink *link : m_links) {
+            sample("de1_observers{port=\"" + QByteArray::number(link->port()) + "\"}",
+                   QByteArray::number(link->observerCount()));
+        }
+
+        family("de1_tcp_received_bytes_total", "counter", "Bytes read from the GUI");
+        for (const TcpLink *link : m_links) {
+            sample("de1_tcp_received_bytes_total{port=\"" + QByteArray::number(link->port()) + "\"}",
+                   QByteArray::number(link->bytesIn()));
+        }
+
+        family("de1_tcp_sent_bytes_total", "counter", "Bytes queued to the GUI and observers");
+        for (const TcpLink *link : m_links) {
+            sample("de1_tcp_sent_bytes_total{port=\"" + QByteArray::number(link->port()) + "\"}",
+                   QByteArray::number(link->bytesOut()));
+        }
+
+        family("de1_tcp_parse_seconds", "summary", "Time spent reading and handling GUI data, per read");
+        for (const TcpLink *link : m_links) {
+            QByteArray port = "{port=\"" + QByteArray::number(link->port()) + "\"}";
+            sample("de1_tcp_parse_seconds_sum" + port, QByteArray::number(link->parseUs() / 1e6, 'f', 6));
+            sample("de1_tcp_parse_seconds_count" + port, QByteArray::number(link->parses()));
+        }
+
+        family("de1_event_loop_lag_seconds", "gauge", "Worst event loop lag over the last stats interval");
+        sample("de1_event_loop_lag_seconds", QByteArray::number(m_loopLagMs / 1000.0, 'f', 3));
+
+        ProcessUsage usage = ProcessUsage::read();
+        if (usage.cpuSeconds >= 0) {
+            family("process_cpu_seconds_total", "counter", "User and system CPU time");
+            sample("process_cpu_seconds_total", QByteArray::number(usage.cpuSeconds, 'f', 2));
+        }
+        if (usage.rssBytes >= 0) {
+            family("process_resident_memory_bytes", "gauge", "Resident set size");
+            sample("process_resident_memory_bytes", QByteArray::number(usage.rssBytes));
+        }
+        return out;
+    }
+
+    QList<InstanceConfig> m_configs;
+    quint16 m_metricsPort = 0;
+    QMap<quint16, TcpLink*> m_links;     // By port
+    QList<De1Instance*> m_instances;
+
+    QTimer *m_statsTimer = nullptr;
+    QTimer *m_lagTimer = nullptr;
+    QElapsedTimer m_lagClock;
+    int m_maxLoopLagMs = 0;             // Since the last stats event
+    int m_loopLagMs = 0;                // Over the last stats interval
+
+    QElapsedTimer m_cpuClock;           // Since the last stats event
+    double m_lastCpuSeconds = -1.0;
+    double m_cpuPercent = 0.0;          // Of one core, over the last stats interval
 };
 
+// Config file: {"notify_interval_ms": 0, "conn_interval_ms": [15, 30], "slave_latency": 0,
+// "supervision_timeout_ms": 4000, "advertising": "hci", "instances": [{"id": 0, "adapter": "hci0", "name": "DE1-SIM",
+// "port": 12345, "notify_interval_ms": 0, "conn_interval_ms": 15, ...}, ...]}
+// Top-level values apply to every instance that doesn't set its own.
+static void readConnectionParameters(const QJsonObject &obj, InstanceConfig &config)
+{
+    QJsonValue interval = obj["conn_interval_ms"];
+    if (interval.isArray()) {
+        config.connIntervalMinMs = interval.toArray().at(0).toDouble();
+        config.connIntervalMaxMs = interval.toArray().at(1).toDouble();
+    } else if (interval.isDouble()) {
+        config.connIntervalMinMs = config.connIntervalMaxMs = interval.toDouble();
+    }
+    config.slaveLatency = obj["slave_latency"].toInt(config.slaveLatency);
+    config.supervisionTimeoutMs = obj["supervision_timeout_ms"].toInt(config.supervisionTimeoutMs);
+}
+
+static bool loadConfig(const QString &path, const InstanceConfig &defaults, QList<InstanceConfig> &configs)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical() << "Cannot open config" << path << ":" << file.errorString();
+        return false;
+    }
+
+    QJsonParseError err;
+    QJsonObject root = QJsonDocument::fromJson(file.readAll(), &err).object();
+    if (err.error != QJsonParseError::NoError) {
+        qCritical() << "Config parse error:" << err.errorString();
+        return false;
+    }
+
+    InstanceConfig shared = defaults;
+    shared.notifyIntervalMs = root["notify_interval_ms"].toInt(defaults.notifyIntervalMs);
+    shared.hciAdvertising = root["advertising"].toString(defaults.hciAdvertising ? "hci" : "qt") == "hci";
+    readConnectionParameters(root, shared);
+    QSet<int> ids;
+    QSet<QString> adapters;
+
+    const QJsonArray instances = root["instances"].toArray();
+    for (const QJsonValue &value : instances) {
+        QJsonObject obj = value.toObject();
+
+        InstanceConfig config = shared;
+        config.id = obj["id"].toInt(configs.size());
+        config.adapter = obj["adapter"].toString();
+        config.name = obj["name"].toString(configs.isEmpty() ? "DE1-SIM" : QString("DE1-SIM%1").arg(config.id));
+        config.port = static_cast<quint16>(obj["port"].toInt(12345));
+        config.notifyIntervalMs = obj["notify_interval_ms"].toInt(shared.notifyIntervalMs);
+        config.hciAdvertising = obj["advertising"].toString(shared.hciAdvertising ? "hci" : "qt") == "hci";
+        readConnectionParameters(obj, config);
+        if (config.requestsConnectionUpdate() && config.supervisionTimeoutMs == 0) {
+            config.supervisionTimeoutMs = DEFAULT_SUPERVISION_TIMEOUT_MS;
+        }
+
+        QString error;
+        if (!checkConnectionParameters(config, error)) {
+            qCritical().noquote() << "Config: machine" << config.id << ":" << error;
+            return false;
+        }
+
+        if (config.id < 0 || config.id > 255 || ids.contains(config.id)) {
+            qCritical() << "Config: machine id" << config.id << "is out of range or used twice";
+            return false;
+        }
+        if (adapters.contains(config.adapter)) {
+            // BlueZ has one GATT database per adapter; two DE1 services on it would clash
+            qCritical() << "Config: adapter" << config.adapter << "is used by more than one machine";
+            return false;
+        }
+
+        ids.insert(config.id);
+        adapters.insert(config.adapter);
+        configs.append(config);
+    }
+
+    if (configs.isEmpty()) {
+        qCritical() << "Config" << path << "lists no instances";
+        return false;
+    }
+    return true;
+}
+
 int main(int argc, char *argv[])
 {
     QCoreApplication app(argc, argv);
     app.setApplicationName("DE1 BLE Daemon");
-    app.setApplicationVersion("1.0.0");
+    app.setApplicationVersion(DAEMON_VERSION);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("BLE peripheral for the DE1 simulator");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("port", "TCP port for the Windows GUI (default 12345)", "[port]");
+    QCommandLineOption notifyIntervalOption("notify-interval",
+        QString("Minimum time between notification bursts in ms (default %1). "
+                "Samples arriving in between are coalesced to the newest; "
+                "0 sends every event loop pass, which coalesces almost nothing.")
+            .arg(DEFAULT_NOTIFY_INTERVAL_MS), "ms", QString::number(DEFAULT_NOTIFY_INTERVAL_MS));
+    parser.addOption(notifyIntervalOption);
+    QCommandLineOption configOption("config",
+        "JSON file listing the simulated machines (adapter, name, port). "
+        "Without it one machine runs on the default adapter.", "file");
+    parser.addOption(configOption);
+    QCommandLineOption connIntervalOption("conn-interval",
+        "Connection interval to request once an app connects, in ms (7.5-4000), or a min-max "
+        "range. Without it the app's choice stands.", "ms");
+    parser.addOption(connIntervalOption);
+    QCommandLineOption slaveLatencyOption("slave-latency",
+        "Connection events the peripheral may skip, with --conn-interval (default 0)", "n", "0");
+    parser.addOption(slaveLatencyOption);
+    QCommandLineOption supervisionTimeoutOption("supervision-timeout",
+        "Supervision timeout in ms, with --conn-interval (default 4000)", "ms",
+        QString::number(DEFAULT_SUPERVISION_TIMEOUT_MS));
+    parser.addOption(supervisionTimeoutOption);
+    QCommandLineOption stateDirOption("state-dir",
+        "Directory to keep each machine's last characteristic values in across restarts", "dir");
+    parser.addOption(stateDirOption);
+    QCommandLineOption metricsPortOption("metrics-port",
+        "Serve Prometheus metrics on this TCP port (GET /metrics)", "port");
+    parser.addOption(metricsPortOption);
+    QCommandLineOption advertisingOption("advertising",
+        "How to advertise: qt (QLowEnergyController) or hci (LE commands on a raw HCI socket, "
+        "restarted on every disconnect)", "qt|hci", "qt");
+    parser.addOption(advertisingOption);
+    QCommandLineOption verboseOption({"v", "verbose"},
+        "Log every notification, write, read and command (costs CPU at high sample rates)");
+    parser.addOption(verboseOption);
+    parser.process(app);
+
+    if (parser.isSet(verboseOption)) {
+        QLoggingCategory::setFilterRules("de1.traffic.debug=true");
+    }
 
-    quint16 port = 12345;
-    if (argc > 1) {
-        port = QString(argv[1]).toUShort();
+    // Command line values are the defaults for every machine in a config file
+    InstanceConfig defaults;
+    defaults.notifyIntervalMs = parser.value(notifyIntervalOption).toInt();
+    if (parser.isSet(connIntervalOption)
+        && !parseConnInterval(parser.value(connIntervalOption), defaults.connIntervalMinMs,
+                              defaults.connIntervalMaxMs)) {
+        qCritical() << "--conn-interval takes ms or min-max";
+        return 1;
+    }
+    defaults.slaveLatency = parser.value(slaveLatencyOption).toInt();
+    defaults.supervisionTimeoutMs = parser.value(supervisionTimeoutOption).toInt();
+    const QString advertising = parser.value(advertisingOption);
+    if (advertising != "qt" && advertising != "hci") {
+        qCritical() << "--advertising takes qt or hci";
+        return 1;
+    }
+    defaults.hciAdvertising = advertising == "hci";
+
+    QList<InstanceConfig> configs;
+    if (parser.isSet(configOption)) {
+        if (!parser.positionalArguments().isEmpty()) {
+            qWarning() << "Ignoring port argument, ports come from the config file";
+        }
+        if (!loadConfig(parser.value(configOption), defaults, configs)) {
+            return 1;
+        }
+    } else {
+        InstanceConfig config = defaults;
+        if (!parser.positionalArguments().isEmpty()) {
+            config.port = parser.positionalArguments().first().toUShort();
+        }
+        QString error;
+        if (!checkConnectionParameters(config, error)) {
+            qCritical().noquote() << "Connection parameters:" << error;
+            return 1;
+        }
+        configs.append(config);
+    }
+
+    if (parser.isSet(stateDirOption)) {
+        QDir dir(parser.value(stateDirOption));
+        if (!dir.mkpath(".")) {
+            qCritical() << "Cannot create state directory" << dir.path();
+            return 1;
+        }
+        for (InstanceConfig &config : configs) {
+            config.stateFile = dir.filePath(QString("machine-%1.json").arg(config.id));
+        }
     }
 
-    qInfo() << "DE1 BLE Daemon v1.0.0";
+    qInfo().noquote() << "DE1 BLE Daemon v" + QString(DAEMON_VERSION);
     qInfo() << "---";
 
-    DE1BleDaemon daemon(port);
+    quint16 metricsPort = 0;
+    if (parser.isSet(metricsPortOption)) {
+        metricsPort = parser.value(metricsPortOption).toUShort();
+        if (!metricsPort) {
+            qCritical() << "--metrics-port takes a port number";
+            return 1;
+        }
+    }
+
+    DE1BleDaemon daemon(configs, metricsPort);
     if (!daemon.start()) {
         return 1;
     }
@@ -4,6 +4,7 @@ CONFIG -= app_bundle
 
 TARGET = de1-ble-daemon
 SOURCES += de1-ble-daemon.cpp
+HEADERS += de1-wire.h
 
 # For BlueZ peripheral support on Linux
 linux {
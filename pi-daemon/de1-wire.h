@@ -0,0 +1,276 @@
+/*
+ * DE1 Wire Protocol - shared by the Windows GUI and the Pi daemon
+ *
+ * Protocol 1 is the original newline-delimited JSON protocol.
+ * Protocol 2 adds binary frames for characteristic traffic:
+ *
+ *   [type u8][charId u16 BE][len u8][payload...]
+ *
+ * Binary frame types always have bit 7 set and JSON lines always start
+ * with '{', so both can be mixed on one stream. Control messages (ready,
+ * connected, ...) stay JSON, and JSON can still be used for everything
+ * when debugging with netcat.
+ *
+ * When several simulated machines share one connection, frames set
+ * FrameMachineFlag in the type and carry the machine ID in one extra byte
+ * after the length:
+ *
+ *   [type|0x40 u8][charId u16 BE][len u8][machine u8][payload...]
+ *
+ * JSON messages carry it as a "machine" field.
+ *
+ * With timing negotiated in hello, notify frames set FrameTimedFlag and
+ * carry a sequence number and the sender's send time after that:
+ *
+ *   [type|0x20 u8][charId u16 BE][len u8][machine u8]?[seq u16 BE][sent_us u32 BE][payload...]
+ *
+ * (JSON: "seq" and "t"). The daemon echoes both back in a "timing" event
+ * together with how long it spent parsing and writing the notification.
+ *
+ * A daemon that advertises "answers" in ready accepts an "answers" command
+ * with the GUI's MMR registers and static characteristic values, and then
+ * answers READ_FROM_MMR writes itself. The GUI still sees those writes, as
+ * FrameAnswered (JSON: "answered" event), but only to log them.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QIODevice>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+#include <cstring>
+
+namespace Wire {
+
+constexpr int PROTOCOL_JSON   = 1;
+constexpr int PROTOCOL_BINARY = 2;
+
+constexpr quint8 FrameMachineFlag = 0x40;
+constexpr quint8 FrameTimedFlag   = 0x20;
+
+enum FrameType : quint8 {
+    FrameNotify = 0x80,     // GUI -> Pi: send BLE notification
+    FrameUpdate = 0x81,     // GUI -> Pi: update characteristic value
+    FrameWrite  = 0x90,     // Pi -> GUI: characteristic written by app
+    FrameRead   = 0x91,     // Pi -> GUI: characteristic read by app
+    FrameAnswered = 0x92    // Pi -> GUI: write by app the Pi already answered
+};
+
+constexpr int FRAME_HEADER_SIZE = 4;
+constexpr int FRAME_TIMING_SIZE = 6;
+constexpr int MAX_FRAME_PAYLOAD = 255;
+
+// Sequence number and send time in microseconds of the sender's monotonic
+// clock; both wrap, only differences are meaningful
+struct FrameTiming {
+    quint16 seq = 0;
+    quint32 sentUs = 0;
+};
+
+inline bool isBinaryFrame(char first) {
+    return static_cast<quint8>(first) & 0x80;
+}
+
+inline quint16 charIdFromString(const QString &shortId) {
+    return shortId.toUShort(nullptr, 16);
+}
+
+inline QString charIdToString(quint16 charId) {
+    return QString("%1").arg(charId, 4, 16, QChar('0')).toUpper();
+}
+
+// Appends one frame to out, for callers that batch many frames into one
+// buffer. Returns false (appending nothing) if the payload doesn't fit.
+// A machine ID >= 0 adds the machine byte, timing adds the timing fields.
+inline bool appendFrame(QByteArray &out, quint8 type, quint16 charId, const char *payload, int len,
+                        int machine = -1, const FrameTiming *timing = nullptr) {
+    if (len > MAX_FRAME_PAYLOAD) return false;
+
+    bool tagged = machine >= 0;
+    char header[FRAME_HEADER_SIZE + 1 + FRAME_TIMING_SIZE];
+    int n = 0;
+    header[n++] = static_cast<char>(type | (tagged ? FrameMachineFlag : 0) | (timing ? FrameTimedFlag : 0));
+    header[n++] = static_cast<char>((charId >> 8) & 0xFF);
+    header[n++] = static_cast<char>(charId & 0xFF);
+    header[n++] = static_cast<char>(len);
+    if (tagged) header[n++] = static_cast<char>(machine);
+    if (timing) {
+        header[n++] = static_cast<char>((timing->seq >> 8) & 0xFF);
+        header[n++] = static_cast<char>(timing->seq & 0xFF);
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            header[n++] = static_cast<char>((timing->sentUs >> shift) & 0xFF);
+        }
+    }
+    out.append(header, n);
+    out.append(payload, len);
+    return true;
+}
+
+// Returns an empty array if the payload doesn't fit in a frame; callers
+// fall back to JSON in that case
+inline QByteArray encodeFrame(quint8 type, quint16 charId, const QByteArray &payload, int machine = -1,
+                              const FrameTiming *timing = nullptr) {
+    QByteArray frame;
+    frame.reserve(FRAME_HEADER_SIZE + 1 + FRAME_TIMING_SIZE + payload.size());
+    appendFrame(frame, type, charId, payload.constData(), payload.size(), machine, timing);
+    return frame;
+}
+
+// A parsed message. payload points into the StreamBuffer and is only
+// valid until the next readFrom()/compact(); copy it if it must outlive that.
+struct Message {
+    bool binary = false;
+    quint8 type = 0;            // Without FrameMachineFlag/FrameTimedFlag
+    quint16 charId = 0;
+    int machine = -1;           // -1 if the frame wasn't tagged
+    bool timed = false;
+    FrameTiming timing;
+    QByteArrayView payload;     // Frame payload, or the JSON line
+};
+
+// Receive buffer with a read cursor. Messages are parsed in place and the
+// consumed prefix is dropped once per readyRead in compact(), instead of
+// copying the rest of the buffer after every message.
+class StreamBuffer {
+public:
+    // Appends everything the device has available
+    qint64 readFrom(QIODevice *dev) {
+        qint64 avail = dev->bytesAvailable();
+        if (avail <= 0) return 0;
+
+        qsizetype oldSize = m_data.size();
+        m_data.resize(oldSize + avail);
+        qint64 n = dev->read(m_data.data() + oldSize, avail);
+        m_data.resize(oldSize + qMax<qint64>(0, n));
+        return n;
+    }
+
+    void append(QByteArrayView data) { m_data.append(data); }
+
+    // Parses the next complete message. Returns false if none is complete yet.
+    bool next(Message &msg) {
+        const char *base = m_data.constData();
+        qsizetype size = m_data.size();
+
+        while (m_pos < size) {
+            const char *p = base + m_pos;
+            qsizetype avail = size - m_pos;
+
+            if (isBinaryFrame(*p)) {
+                if (avail < FRAME_HEADER_SIZE) return false;
+                const uchar *h = reinterpret_cast<const uchar*>(p);
+                bool tagged = h[0] & FrameMachineFlag;
+                bool timed = h[0] & FrameTimedFlag;
+                int extra = (tagged ? 1 : 0) + (timed ? FRAME_TIMING_SIZE : 0);
+                int len = h[3];
+                if (avail < FRAME_HEADER_SIZE + extra + len) return false;
+
+                msg.binary = true;
+                msg.type = static_cast<quint8>(h[0] & ~(FrameMachineFlag | FrameTimedFlag));
+                msg.charId = static_cast<quint16>((h[1] << 8) | h[2]);
+                msg.machine = tagged ? h[FRAME_HEADER_SIZE] : -1;
+                msg.timed = timed;
+                if (timed) {
+                    const uchar *t = h + FRAME_HEADER_SIZE + (tagged ? 1 : 0);
+                    msg.timing.seq = static_cast<quint16>((t[0] << 8) | t[1]);
+                    msg.timing.sentUs = (quint32(t[2]) << 24) | (quint32(t[3]) << 16)
+                                      | (quint32(t[4]) << 8) | quint32(t[5]);
+                }
+                msg.payload = QByteArrayView(p + FRAME_HEADER_SIZE + extra, len);
+                m_pos += FRAME_HEADER_SIZE + extra + len;
+                return true;
+            }
+
+            const char *nl = static_cast<const char*>(memchr(p, '\n', avail));
+            if (!nl) return false;
+
+            qsizetype len = nl - p;
+            m_pos += len + 1;
+            if (len == 0) continue;
+
+            msg.binary = false;
+            msg.type = 0;
+            msg.charId = 0;
+            msg.machine = -1;
+            msg.timed = false;
+            msg.payload = QByteArrayView(p, len);
+            return true;
+        }
+        return false;
+    }
+
+    // Drops everything already parsed; call once after draining next()
+    void compact() {
+        if (m_pos == 0) return;
+        if (m_pos >= m_data.size()) {
+            m_data.resize(0);   // Keeps the allocation for the next read
+        } else {
+            m_data.remove(0, m_pos);
+        }
+        m_pos = 0;
+    }
+
+    void clear() {
+        m_data.clear();
+        m_pos = 0;
+    }
+
+    qsizetype pending() const { return m_data.size() - m_pos; }
+
+private:
+    QByteArray m_data;
+    qsizetype m_pos = 0;    // Read cursor
+};
+
+// Collects everything written during one event-loop pass (e.g. STATE_INFO +
+// SHOT_SAMPLE + an MMR response from the same tick) and hands it to the
+// socket in a single write, instead of a write + flush() per message. Pair
+// with QAbstractSocket::LowDelayOption so a lone message isn't held back by
+// Nagle. Give it the socket's owner as parent so it follows moveToThread().
+class WriteBatcher : public QObject {
+public:
+    explicit WriteBatcher(QObject *parent = nullptr) : QObject(parent) {}
+
+    // Switching devices discards anything still pending for the old one
+    void setDevice(QIODevice *dev) {
+        m_device = dev;
+        m_pending.clear();
+        m_flushScheduled = false;
+    }
+
+    QIODevice *device() const { return m_device; }
+
+    void enqueue(QByteArrayView bytes) {
+        if (!m_device) return;
+
+        m_pending.append(bytes);
+        if (!m_flushScheduled) {
+            m_flushScheduled = true;
+            QTimer::singleShot(0, this, [this, dev = m_device]() {
+                if (dev == m_device) flush();
+            });
+        }
+    }
+
+    // Writes everything pending now; normally called from the event loop
+    void flush() {
+        m_flushScheduled = false;
+        if (!m_device || m_pending.isEmpty()) return;
+
+        m_device->write(m_pending);
+        m_pending.resize(0);    // Keeps the allocation for the next batch
+    }
+
+    qsizetype pending() const { return m_pending.size(); }
+
+private:
+    QIODevice *m_device = nullptr;
+    QByteArray m_pending;
+    bool m_flushScheduled = false;
+};
+
+} // namespace Wire
@@ -91,7 +91,7 @@ elif [ -f "/tmp/de1-daemon/de1-ble-daemon.cpp" ]; then
     SRC_DIR="/tmp/de1-daemon"
 else
     echo "ERROR: Source files not found!"
-    echo "Please copy de1-ble-daemon.cpp and de1-ble-daemon.pro to this directory"
+    echo "Please copy de1-ble-daemon.cpp, de1-wire.h and de1-ble-daemon.pro to this directory"
     exit 1
 fi
 
@@ -129,7 +129,8 @@ Type=simple
 TimeoutStartSec=30
 ExecStartPre=/bin/sleep 2
 ExecStartPre=/bin/bash -c "timeout 5 btmgmt power on || true; timeout 5 btmgmt le on || true; timeout 5 btmgmt advertising on || true; timeout 3 btmgmt name DE1-SIM || true; hciconfig hci0 piscan || true"
-ExecStart=/usr/local/bin/de1-ble-daemon
+ExecStart=/usr/local/bin/de1-ble-daemon --state-dir /var/lib/de1-ble-daemon --metrics-port 9120
+StateDirectory=de1-ble-daemon
 Restart=on-failure
 RestartSec=5
 